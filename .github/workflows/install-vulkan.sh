@@ -29,4 +29,5 @@
 
 sudo apt install vulkan-tools
 sudo apt install libvulkan-dev
-sudo apt install vulkan-validationlayers-dev spirv-tools
\ No newline at end of file
+sudo apt install vulkan-validationlayers-dev spirv-tools
+sudo apt install glslang-tools
\ No newline at end of file
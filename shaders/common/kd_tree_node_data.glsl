@@ -5,18 +5,24 @@
 #include "triangle.glsl"
 #include "ray.glsl"
 
+/** Traversal stack size (must be greater than maximal tree depth) */
+#define KD_TREE_STACK_SIZE 64
+
 /**
  * \brief Packed tree node data
  */
 struct KD_TREE_NODE_DATA
 {
-  /** Node bounding box */
-  AABB BB;
+  /** Node bounding box minimal coordinate */
+  vec3 Min;
+
+  /** Triangles offset for leaf, second (right) child index for not leaf (left child is next node) */
+  UINT Offset;
 
-  /** Node triangles offset */
-  UINT TrianglesOffset;
+  /** Node bounding box maximal coordinate */
+  vec3 Max;
 
-  /** Number of triangles (-1 - if not leaf) */
+  /** Number of triangles for leaf, -1 - split axis for not leaf (-1 - X, -2 - Y, -3 - Z) */
   INT NumOfTriangles;
 };
 
@@ -3,6 +3,36 @@
 
 #include "random.glsl"
 
+/**
+ * \brief Shaded surface point description for BSDF evaluation
+ */
+struct SURFACE
+{
+  /** Normal (faced to viewer) */
+  vec3 N;
+
+  /** Direction to viewer */
+  vec3 V;
+
+  /** Cosine between normal and direction to viewer */
+  FLT NV;
+
+  /** Albedo */
+  vec3 Color;
+
+  /** Fresnel coefficient at normal incidence */
+  vec3 F0;
+
+  /** Metal ratio */
+  FLT Metal;
+
+  /** Square of alpha coefficient (Roughness ^ 4) */
+  FLT Alpha2;
+
+  /** Probability of specular lobe sampling */
+  FLT SpecularProbability;
+};
+
 /**
  * \brief Get random micro normal function
  * \param[in] Alpha2 Square of alpha coefficient (Roughness ^ 4)
@@ -27,7 +57,7 @@ vec3 GetMicroNormal( FLT Alpha2, vec3 MacroNormal, inout RANDOM_STATE State )
   vec3 N = vec3(SinThetha * Co, CosThetha, SinThetha * Si);
   
   vec3 Up1 = (abs(MacroNormal.y) < 0.9f ? vec3(0, 1, 0) : vec3(1, 0, 0));
-  vec3 Tan = cross(Up1, MacroNormal);
+  vec3 Tan = normalize(cross(Up1, MacroNormal));
   vec3 Bitan = cross(MacroNormal, Tan);
   mat3 Trans = mat3(Tan.x, Tan.y, Tan.z,
                     MacroNormal.x, MacroNormal.y, MacroNormal.z,
@@ -37,7 +67,7 @@ vec3 GetMicroNormal( FLT Alpha2, vec3 MacroNormal, inout RANDOM_STATE State )
 }
 
 /**
- * \brief Get vector in hemisphere function
+ * \brief Get cosine distributed vector in hemisphere function
  * \param[in] Normal Surface normal vector (Hemisphere direction)
  * \param[in, out] State Random numbers generator state
  * \return Vector in hemisphere
@@ -46,16 +76,15 @@ vec3 GetDiffDir( vec3 Normal, inout RANDOM_STATE State )
 {
   const FLT PI = 3.14159265359;
 
-  FLT Y = GetNextUniform(State) * 2 - 1;
+  FLT R2 = GetNextUniform(State);
   FLT Phi = GetNextUniform(State) * 2 * PI;
-  FLT R = sqrt(1 - pow(Y, 2));
+  FLT R = sqrt(R2);
 
-  FLT Si = sin(Phi);
-  FLT Co = cos(Phi);
-
-  vec3 Res = vec3(R * Si, Y, R * Co);
+  vec3 Up1 = (abs(Normal.y) < 0.9f ? vec3(0, 1, 0) : vec3(1, 0, 0));
+  vec3 Tan = normalize(cross(Up1, Normal));
+  vec3 Bitan = cross(Normal, Tan);
 
-  return faceforward(-Res, Res, Normal);
+  return Tan * (R * sin(Phi)) + Normal * sqrt(1 - R2) + Bitan * (R * cos(Phi));
 }
 
 /**
@@ -85,4 +114,49 @@ vec3 FresnelSchlick( vec3 F0, FLT CosTheta )
     pow(1 - clamp(CosTheta, 0, 1), 5);
 }
 
+/**
+ * \brief Evaluate BSDF (GGX specular and Lambert diffuse lobes) function
+ * \param[in] S Surface point
+ * \param[in] L Direction to light
+ * \param[out] Pdf Probability density of sampling L (0 if L is under surface)
+ * \return BSDF value multiplied by cosine between normal and L
+ */
+vec3 EvalBsdf( SURFACE S, vec3 L, out FLT Pdf )
+{
+  const FLT PI = 3.14159265359;
+  FLT NL = dot(S.N, L);
+
+  if (NL <= 0)
+  {
+    Pdf = 0;
+    return vec3(0, 0, 0);
+  }
+
+  vec3 H = normalize(S.V + L);
+  FLT NH = max(dot(S.N, H), 0);
+  FLT HV = max(dot(H, S.V), 1e-37);
+
+  FLT DDenum = NH * NH * (S.Alpha2 - 1) + 1;
+  FLT D = S.Alpha2 / (PI * DDenum * DDenum);
+  FLT G = GeometryEval(S.NV, S.Alpha2) * GeometryEval(NL, S.Alpha2);
+  vec3 F = FresnelSchlick(S.F0, HV);
+
+  vec3 Spec = F * (D * G / (4 * S.NV));
+  vec3 Diff = S.Color * (vec3(1, 1, 1) - F) * (NL * (1 - S.Metal) / PI);
+
+  Pdf = S.SpecularProbability * D * NH / (4 * HV) + (1 - S.SpecularProbability) * NL / PI;
+  return Spec + Diff;
+}
+
+/**
+ * \brief Power heuristic weight of multiple importance sampling
+ * \param[in] Pdf Probability density of used sampling strategy
+ * \param[in] OtherPdf Probability density of other sampling strategy
+ * \return Weight
+ */
+FLT PowerHeuristic( FLT Pdf, FLT OtherPdf )
+{
+  return Pdf * Pdf / (Pdf * Pdf + OtherPdf * OtherPdf);
+}
+
 #endif /* _light_glsl_ */
@@ -0,0 +1,47 @@
+#ifndef _light_list_glsl_
+#define _light_list_glsl_
+
+#include "../glsl_def.glsl"
+
+/**
+ * \brief Emissive triangle structure
+ */
+struct LIGHT
+{
+  /** First triangle vertex position */
+  vec4 P0;
+
+  /** First triangle edge (from first vertex to second) */
+  vec4 Edge1;
+
+  /** Second triangle edge (from first vertex to third) */
+  vec4 Edge2;
+
+  /** Triangle geometric normal */
+  vec4 N;
+
+  /** Sum of areas of lights up to this one (including it) */
+  FLT CumulativeArea;
+
+  /** Triangle area */
+  FLT Area;
+
+  /** Material index */
+  INT MatId;
+};
+
+/**
+ * \brief Get uniformly distributed point on light triangle function
+ * \param[in] Light Light triangle
+ * \param[in] U First uniform random number in [0, 1)
+ * \param[in] V Second uniform random number in [0, 1)
+ * \return Point
+ */
+vec3 GetLightPoint( LIGHT Light, FLT U, FLT V )
+{
+  FLT SqrtU = sqrt(U);
+
+  return Light.P0.xyz + Light.Edge1.xyz * (SqrtU * (1 - V)) + Light.Edge2.xyz * (SqrtU * V);
+}
+
+#endif /* _light_list_glsl_ */
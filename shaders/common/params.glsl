@@ -16,6 +16,15 @@ struct RENDER_PARAMS
 
   /** Maximal depth render */
   INT MaxDepthRender;
+
+  /** Seed of random numbers for frame */
+  UINT Seed;
+
+  /** Number of bounces after which paths are terminated by Russian roulette */
+  INT RouletteDepth;
+
+  /** Minimal probability of path continuation by Russian roulette */
+  FLT RouletteMinProbability;
 };
 
 #endif /* _params_h_ */
\ No newline at end of file
@@ -98,5 +98,25 @@ BOOL IntersectTriangle( TRIANGLE Triangle, UINT TriangleNumber, RAY Ray, RENDER_
   return FALSE;
 }
 
+/**
+ * \brief Check triangle intersection with ray closer than distance function (intersection structure is not filled)
+ * \param[in] TRIANGLE Triangle for intersection
+ * \param[in] Ray Ray for intersection
+ * \param[in] Par Render parameters
+ * \param[in] MaxDist Distance along ray
+ * \return TRUE-if intersection, FALSE-if otheerwise
+ */
+BOOL IsTriangleIntersected( TRIANGLE Triangle, RAY Ray, RENDER_PARAMS Par, FLT MaxDist )
+{
+  FLT NormDir = dot(Triangle.N.xyz, Ray.Dir.xyz);
+  FLT T = -(dot(Triangle.N.xyz, Ray.Org) - Triangle.D) / NormDir;
+  vec3 P = Ray.Dir * T + Ray.Org;
+  FLT
+    U = dot(P, Triangle.U1.xyz) - Triangle.U0,
+    V = dot(P, Triangle.V1.xyz) - Triangle.V0;
+
+  return abs(NormDir) > Par.Threshold &&
+         T > 0 && T < MaxDist && U >= 0 && V >= 0 && U + V <= 1;
+}
 
 #endif /* _triangle_h_ */
\ No newline at end of file
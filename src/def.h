@@ -25,5 +25,6 @@ typedef uint64_t UINT64;
 
 #define ENABLE_VULKAN_FUNCTION_RESULT_VALIDATION 1
 #define ENABLE_VULKAN_VALIDATION_LAYER 1
+#define ENABLE_TREE_TRAVERSAL_STATISTICS 0
 
 #endif /* __def_h_ */
@@ -3,13 +3,13 @@
 #include "render/render.h"
 #include "scene/material.h"
 #include "utils/error.h"
+#include "utils/parallel_for.h"
 #include "scene_loader/scene_loader.h"
 
 /* Hardcode shapes */
 /*shape Cow;
 shape Box;
-shape Emit;
-shape Dragons; */
+shape Emit; */
 
 /**
  * \brief Generate scene function (Hardcode)
@@ -37,23 +37,24 @@ shape Dragons; */
   Box.MakeBox(vec(0.5f, 0, -13.5), vec(5, 2, -11.5), RedMtl, DefEnvi);
   Emit.MakeBox(vec(-3, 6.4, -3), vec(3, 6.51, 3), EmitMtl, DefEnvi);
 
-  Dragons.LoadOBJ("bin/models/dragon.obj", GreenMtl, DefEnvi,
+  std::shared_ptr<mesh> Dragon = mesh::LoadOBJ("bin/models/dragon.obj");
+
+  Scn.Instances.emplace_back(Dragon, GreenMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(35) * matr::Translate(vec(-4, 0, 1.5)));
-  Dragons.LoadOBJ("bin/models/dragon.obj", PinkMetalMtl, DefEnvi,
+  Scn.Instances.emplace_back(Dragon, PinkMetalMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(125) * matr::Translate(vec(4, 0, 1.5)));
-  Dragons.LoadOBJ("bin/models/dragon.obj", BlueMtl, DefEnvi,
+  Scn.Instances.emplace_back(Dragon, BlueMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(-145) * matr::Translate(vec(3, 0, -3)));
-  Dragons.LoadOBJ("bin/models/dragon.obj", RedMtl, DefEnvi,
+  Scn.Instances.emplace_back(Dragon, RedMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(-55) * matr::Translate(vec(-3, 0, -3)));
 
   Scn.Objects.push_back(&Cow);
   Scn.Objects.push_back(&Box);
   Scn.Objects.push_back(&Emit);
-  Scn.Objects.push_back(&Dragons);
 
   Scn.IsChanged = TRUE;
 }   */
@@ -109,16 +110,23 @@ INT main( INT ArgC, CHAR **ArgV )
 
     Loader.LoadXML(ArgV[1]);
 
+    parallel_for::SetNumberOfThreads(Loader.NumberOfThreads);
+
     render Rnd;
 
     Rnd.SetRenderMode(Loader.RenderMode, Loader.DeviceId);
+    Rnd.SetProgressiveParams(Loader.Progressive);
+    Rnd.SetTimeBudget(Loader.TimeBudget);
+    Rnd.SetAdaptiveParams(Loader.Adaptive);
+    Rnd.SetLinearOutput(image::IsLinearFormat(Loader.OutputFormat));
+    Rnd.SetDevicePostProcessing(!image::IsLinearFormat(Loader.OutputFormat));
 
     image Img;
 
     Rnd.MakeFrame(&Img, Loader.Camera, Loader.Scene,
                   Loader.Width, Loader.Height, Loader.NumberOfSamples);
 
-    Img.Save(Loader.OutputPath, Loader.OutputFormat);
+    Rnd.SaveFrame(Img, Loader.OutputPath, Loader.OutputFormat);
   }
   catch ( const error &Err )
   {
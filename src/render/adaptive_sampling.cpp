@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "adaptive_sampling.h"
+#include "utils/image_kernels.h"
+#include "utils/parallel_for.h"
+
+/**
+ * \brief Adaptive sampling constructor
+ * \param[in] NewPar Adaptive sampling parameters
+ * \param[in] NewW Frame width
+ * \param[in] NewH Frame height
+ * \param[in] NewTileSize Size of square tile (in pixels)
+ * \param[in] NumberOfSamples Number of already accumulated samples of every pixel
+ */
+adaptive_sampling::adaptive_sampling( const ADAPTIVE_PARAMS &NewPar, const INT NewW, const INT NewH,
+                                      const INT NewTileSize, const INT NumberOfSamples ) :
+  Par(NewPar), W(NewW), H(NewH), TileSize(NewTileSize),
+  TilesW((NewW + NewTileSize - 1) / NewTileSize), TilesH((NewH + NewTileSize - 1) / NewTileSize),
+  FirstSamples(NumberOfSamples)
+{
+  TileSamples.assign(TilesW * TilesH, NumberOfSamples);
+  Mask.assign(TilesW * TilesH, 1);
+
+  // Resumed samples have no statistics, so their pixels are estimated again
+  if (IsEnabled())
+  {
+    Stats.assign(W * H, PIXEL_STATS {0, 0});
+    if (Par.MaxSamples > 0 && NumberOfSamples >= Par.MaxSamples)
+      std::fill(Mask.begin(), Mask.end(), 0);
+  }
+}
+
+/**
+ * \brief Check if adaptive sampling is used function
+ * \return TRUE-if converged tiles are stopped, FALSE-otherwise (all pixels get same number of samples)
+ */
+BOOL adaptive_sampling::IsEnabled( VOID ) const
+{
+  return Par.Threshold > 0;
+}
+
+/**
+ * \brief Get tile index function
+ * \param[in] X Pixel column
+ * \param[in] Y Pixel row
+ * \return Index of tile containing pixel
+ */
+INT adaptive_sampling::GetTileIndex( const INT X, const INT Y ) const
+{
+  return (Y / TileSize) * TilesW + X / TileSize;
+}
+
+/**
+ * \brief Get number of pixels of tile function
+ * \param[in] Tile Tile index
+ * \return Number of pixels
+ */
+INT adaptive_sampling::GetNumberOfTilePixels( const INT Tile ) const
+{
+  const INT X0 = (Tile % TilesW) * TileSize;
+  const INT Y0 = (Tile / TilesW) * TileSize;
+
+  return (std::min(X0 + TileSize, W) - X0) * (std::min(Y0 + TileSize, H) - Y0);
+}
+
+/**
+ * \brief Check if tile gets samples function
+ * \param[in] Tile Tile index
+ * \return TRUE-if tile is active, FALSE-otherwise
+ */
+BOOL adaptive_sampling::IsTileActive( const INT Tile ) const
+{
+  return Mask[Tile] != 0;
+}
+
+/**
+ * \brief Get number of samples of tile function
+ * \param[in] Tile Tile index
+ * \return Number of samples
+ */
+INT adaptive_sampling::GetNumberOfTileSamples( const INT Tile ) const
+{
+  return TileSamples[Tile];
+}
+
+/**
+ * \brief Get number of samples of tile in pixels statistics function
+ * \param[in] Tile Tile index
+ * \return Number of samples (resumed samples are not counted)
+ */
+INT adaptive_sampling::GetNumberOfStatsSamples( const INT Tile ) const
+{
+  return TileSamples[Tile] - FirstSamples;
+}
+
+/**
+ * \brief Check if all tiles are converged function
+ * \return TRUE-if no tile gets samples, FALSE-otherwise
+ */
+BOOL adaptive_sampling::IsConverged( VOID ) const
+{
+  return std::find(Mask.cbegin(), Mask.cend(), 1) == Mask.cend();
+}
+
+/**
+ * \brief Get number of samples of frame function
+ * \return Average number of samples of pixel (rounded down)
+ */
+INT adaptive_sampling::GetNumberOfSamples( VOID ) const
+{
+  INT64 NumberOfPixelSamples = 0;
+
+  for (INT i = 0; i < (INT)TileSamples.size(); i++)
+    NumberOfPixelSamples += static_cast<INT64>(TileSamples[i]) * GetNumberOfTilePixels(i);
+
+  return static_cast<INT>(NumberOfPixelSamples / std::max<INT64>(static_cast<INT64>(W) * H, 1));
+}
+
+/**
+ * \brief Get number of samples of every active tile for pass function
+ * \param[in] NumberOfSamples Number of samples of frame which may be spent by pass
+ * \return Number of samples (samples of converged tiles are given to active ones)
+ */
+INT adaptive_sampling::GetNumberOfPassSamples( const INT NumberOfSamples ) const
+{
+  if (!IsEnabled())
+    return NumberOfSamples;
+
+  INT64 ActivePixels = 0;
+  INT MaxTileSamples = 0;
+
+  for (INT i = 0; i < (INT)TileSamples.size(); i++)
+    if (Mask[i] != 0)
+    {
+      ActivePixels += GetNumberOfTilePixels(i);
+      MaxTileSamples = std::max(MaxTileSamples, TileSamples[i]);
+    }
+
+  if (ActivePixels == 0)
+    return 0;
+
+  // Error is estimated after every MinSamples samples, so converged tiles are stopped in time
+  INT64 Samples = std::max<INT64>(1, static_cast<INT64>(NumberOfSamples) * W * H / ActivePixels);
+
+  Samples = std::min<INT64>(Samples, std::max(Par.MinSamples, 1));
+  if (Par.MaxSamples > 0)
+    Samples = std::min<INT64>(Samples, std::max(Par.MaxSamples - MaxTileSamples, 1));
+
+  return static_cast<INT>(Samples);
+}
+
+/**
+ * \brief Get statistics of pixel function
+ * \param[in] X Pixel column
+ * \param[in] Y Pixel row
+ * \return Statistics reference
+ */
+adaptive_sampling::PIXEL_STATS & adaptive_sampling::GetPixelStats( const INT X, const INT Y )
+{
+  return Stats[Y * W + X];
+}
+
+/**
+ * \brief Get statistics of all pixels function (rows are stored one after another)
+ * \return Statistics array
+ */
+adaptive_sampling::PIXEL_STATS * adaptive_sampling::GetStats( VOID )
+{
+  return Stats.data();
+}
+
+/**
+ * \brief Get active tiles mask function (tiles rows are stored one after another)
+ * \return Mask (1 - tile gets samples, 0 - converged)
+ */
+const std::vector<UINT32> & adaptive_sampling::GetMask( VOID ) const
+{
+  return Mask;
+}
+
+/**
+ * \brief Add sample luminance to pixel statistics function
+ * \param[in, out] PixelStats Pixel statistics
+ * \param[in] NumberOfSamples Number of samples in statistics including new one
+ * \param[in] Color Sample color
+ */
+VOID adaptive_sampling::AddSample( PIXEL_STATS *PixelStats, const INT NumberOfSamples, const vec &Color )
+{
+  const FLT Luminance = 0.2126f * Color.X + 0.7152f * Color.Y + 0.0722f * Color.Z;
+  const FLT Delta = Luminance - PixelStats->Mean;
+
+  PixelStats->Mean += Delta / NumberOfSamples;
+  PixelStats->M2 += Delta * (Luminance - PixelStats->Mean);
+}
+
+/**
+ * \brief Check if pixels of tile reached target error function
+ * \param[in] Tile Tile index
+ * \return TRUE-if tile is converged, FALSE-otherwise
+ */
+BOOL adaptive_sampling::IsTileConverged( const INT Tile ) const
+{
+  const INT N = GetNumberOfStatsSamples(Tile);
+
+  if (N < std::max(Par.MinSamples, 2))
+    return FALSE;
+
+  const INT X0 = (Tile % TilesW) * TileSize;
+  const INT Y0 = (Tile / TilesW) * TileSize;
+  const INT X1 = std::min(X0 + TileSize, W);
+  const INT Y1 = std::min(Y0 + TileSize, H);
+
+  // Relative errors of pixel means are averaged over tile, single pixel estimates are too noisy for stopping
+  DBL SumError2 = 0;
+
+  for (INT y = Y0; y < Y1; y++)
+    for (INT x = X0; x < X1; x++)
+    {
+      const PIXEL_STATS &PixelStats = Stats[y * W + x];
+      const DBL Variance = std::max(PixelStats.M2, 0.0f) / ((N - 1) * static_cast<DBL>(N));
+      const DBL Mean = PixelStats.Mean + DarkLuminance;
+
+      SumError2 += Variance / (Mean * Mean);
+    }
+
+  return SumError2 <= Par.Threshold * Par.Threshold * GetNumberOfTilePixels(Tile);
+}
+
+/**
+ * \brief End pass function (samples are added to active tiles and converged tiles are stopped)
+ * \param[in] NumberOfSamples Number of samples of every active tile in pass
+ */
+VOID adaptive_sampling::EndPass( const INT NumberOfSamples )
+{
+  for (INT i = 0; i < (INT)TileSamples.size(); i++)
+    if (Mask[i] != 0)
+    {
+      TileSamples[i] += NumberOfSamples;
+      if (IsEnabled() && ((Par.MaxSamples > 0 && TileSamples[i] >= Par.MaxSamples) || IsTileConverged(i)))
+        Mask[i] = 0;
+    }
+}
+
+/**
+ * \brief Divide sums by number of samples of their tiles function
+ * \param[in] Sum Accumulation buffer
+ * \param[out] Dst Destination image of accumulation buffer size (may be accumulation buffer itself)
+ * \param[in] Scale Result scale
+ */
+VOID adaptive_sampling::Normalize( const image &Sum, image *Dst, const DBL Scale ) const
+{
+  parallel_for::Run(H, [&]( INT y )
+    {
+      for (INT Tile = GetTileIndex(0, y), x = 0; x < W; Tile++, x += TileSize)
+      {
+        const INT NumberOfPixels = std::min(TileSize, W - x);
+        const DBL N = std::max(TileSamples[Tile], 1);
+
+        image_kernels::Divide(Sum.GetRow(y) + x * 3, Dst->GetRow(y) + x * 3, NumberOfPixels * 3, N, Scale);
+      }
+    });
+}
+
+/**
+ * \brief Get sums scaled to same number of samples function (they may be saved in accumulation buffer)
+ * \param[in] Sum Accumulation buffer
+ * \return Sums of frame number of samples
+ */
+const image & adaptive_sampling::GetUniformSum( const image &Sum )
+{
+  if (std::adjacent_find(TileSamples.cbegin(), TileSamples.cend(), std::not_equal_to<INT>()) == TileSamples.cend())
+    return Sum;
+
+  UniformSum.Resize(W, H);
+  Normalize(Sum, &UniformSum, GetNumberOfSamples());
+
+  return UniformSum;
+}
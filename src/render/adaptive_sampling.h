@@ -0,0 +1,208 @@
+#ifndef __adaptive_sampling_h_
+#define __adaptive_sampling_h_
+
+#include <vector>
+
+#include "utils/image.h"
+
+/**
+ * \brief Adaptive sampling parameters (converged tiles stop getting samples)
+ */
+struct ADAPTIVE_PARAMS
+{
+  /** Target relative error of pixels mean (0 - adaptive sampling is not used) */
+  FLT Threshold = 0;
+
+  /** Number of samples of pixel before its error is estimated (error is estimated after every such number) */
+  INT MinSamples = 16;
+
+  /** Maximal number of samples of pixel (0 - not limited) */
+  INT MaxSamples = 0;
+};
+
+/**
+ * \brief Adaptive sampling state (frame is split into tiles, samples of tile are stopped when its pixels converge)
+ */
+class adaptive_sampling
+{
+public:
+  /**
+   * \brief Running statistics of pixel luminance (Welford's algorithm)
+   */
+  struct PIXEL_STATS
+  {
+    /** Mean luminance */
+    FLT Mean;
+
+    /** Sum of squared deviations from mean */
+    FLT M2;
+  };
+
+private:
+  /** Luminance added to pixel mean for relative error, so error of black pixels stays finite */
+  static constexpr FLT DarkLuminance = 0.01f;
+
+  /** Adaptive sampling parameters */
+  ADAPTIVE_PARAMS Par;
+
+  /** Frame width */
+  INT W;
+
+  /** Frame height */
+  INT H;
+
+  /** Size of square tile (in pixels) */
+  INT TileSize;
+
+  /** Number of tiles in row */
+  INT TilesW;
+
+  /** Number of tiles in column */
+  INT TilesH;
+
+  /** Number of samples of frame before statistics were started (resumed samples) */
+  INT FirstSamples;
+
+  /** Number of samples of every tile */
+  std::vector<INT> TileSamples;
+
+  /** Active tiles mask (1 - tile gets samples, 0 - converged) */
+  std::vector<UINT32> Mask;
+
+  /** Luminance statistics of every pixel */
+  std::vector<PIXEL_STATS> Stats;
+
+  /** Sums scaled to same number of samples (for checkpoints) */
+  image UniformSum;
+
+  /**
+   * \brief Get number of pixels of tile function
+   * \param[in] Tile Tile index
+   * \return Number of pixels
+   */
+  INT GetNumberOfTilePixels( const INT Tile ) const;
+
+  /**
+   * \brief Check if pixels of tile reached target error function
+   * \param[in] Tile Tile index
+   * \return TRUE-if tile is converged, FALSE-otherwise
+   */
+  BOOL IsTileConverged( const INT Tile ) const;
+
+public:
+  /**
+   * \brief Adaptive sampling constructor
+   * \param[in] NewPar Adaptive sampling parameters
+   * \param[in] NewW Frame width
+   * \param[in] NewH Frame height
+   * \param[in] NewTileSize Size of square tile (in pixels)
+   * \param[in] NumberOfSamples Number of already accumulated samples of every pixel
+   */
+  adaptive_sampling( const ADAPTIVE_PARAMS &NewPar, const INT NewW, const INT NewH, const INT NewTileSize,
+                     const INT NumberOfSamples );
+
+  /**
+   * \brief Check if adaptive sampling is used function
+   * \return TRUE-if converged tiles are stopped, FALSE-otherwise (all pixels get same number of samples)
+   */
+  BOOL IsEnabled( VOID ) const;
+
+  /**
+   * \brief Get tile index function
+   * \param[in] X Pixel column
+   * \param[in] Y Pixel row
+   * \return Index of tile containing pixel
+   */
+  INT GetTileIndex( const INT X, const INT Y ) const;
+
+  /**
+   * \brief Check if tile gets samples function
+   * \param[in] Tile Tile index
+   * \return TRUE-if tile is active, FALSE-otherwise
+   */
+  BOOL IsTileActive( const INT Tile ) const;
+
+  /**
+   * \brief Get number of samples of tile function
+   * \param[in] Tile Tile index
+   * \return Number of samples
+   */
+  INT GetNumberOfTileSamples( const INT Tile ) const;
+
+  /**
+   * \brief Get number of samples of tile in pixels statistics function
+   * \param[in] Tile Tile index
+   * \return Number of samples (resumed samples are not counted)
+   */
+  INT GetNumberOfStatsSamples( const INT Tile ) const;
+
+  /**
+   * \brief Check if all tiles are converged function
+   * \return TRUE-if no tile gets samples, FALSE-otherwise
+   */
+  BOOL IsConverged( VOID ) const;
+
+  /**
+   * \brief Get number of samples of frame function
+   * \return Average number of samples of pixel (rounded down)
+   */
+  INT GetNumberOfSamples( VOID ) const;
+
+  /**
+   * \brief Get number of samples of every active tile for pass function
+   * \param[in] NumberOfSamples Number of samples of frame which may be spent by pass
+   * \return Number of samples (samples of converged tiles are given to active ones)
+   */
+  INT GetNumberOfPassSamples( const INT NumberOfSamples ) const;
+
+  /**
+   * \brief Get statistics of pixel function
+   * \param[in] X Pixel column
+   * \param[in] Y Pixel row
+   * \return Statistics reference
+   */
+  PIXEL_STATS & GetPixelStats( const INT X, const INT Y );
+
+  /**
+   * \brief Get statistics of all pixels function (rows are stored one after another)
+   * \return Statistics array
+   */
+  PIXEL_STATS * GetStats( VOID );
+
+  /**
+   * \brief Get active tiles mask function (tiles rows are stored one after another)
+   * \return Mask (1 - tile gets samples, 0 - converged)
+   */
+  const std::vector<UINT32> & GetMask( VOID ) const;
+
+  /**
+   * \brief Add sample luminance to pixel statistics function
+   * \param[in, out] PixelStats Pixel statistics
+   * \param[in] NumberOfSamples Number of samples in statistics including new one
+   * \param[in] Color Sample color
+   */
+  static VOID AddSample( PIXEL_STATS *PixelStats, const INT NumberOfSamples, const vec &Color );
+
+  /**
+   * \brief End pass function (samples are added to active tiles and converged tiles are stopped)
+   * \param[in] NumberOfSamples Number of samples of every active tile in pass
+   */
+  VOID EndPass( const INT NumberOfSamples );
+
+  /**
+   * \brief Divide sums by number of samples of their tiles function
+   * \param[in] Sum Accumulation buffer
+   * \param[out] Dst Destination image of accumulation buffer size (may be accumulation buffer itself)
+   * \param[in] Scale Result scale
+   */
+  VOID Normalize( const image &Sum, image *Dst, const DBL Scale ) const;
+
+  /**
+   * \brief Get sums scaled to same number of samples function (they may be saved in accumulation buffer)
+   * \param[in] Sum Accumulation buffer
+   * \return Sums of frame number of samples
+   */
+  const image & GetUniformSum( const image &Sum );
+};
+
+#endif /* __adaptive_sampling_h_ */
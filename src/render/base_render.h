@@ -3,9 +3,31 @@
 
 #include "utils/image.h"
 #include "scene/scene.h"
+#include "adaptive_sampling.h"
+#include "checkpoint.h"
+#include "time_budget.h"
 
 class base_render
 {
+protected:
+  /** Progressive rendering parameters */
+  PROGRESSIVE_PARAMS ProgressivePar;
+
+  /** Frame time budget in seconds (0 - number of samples is fixed) */
+  FLT TimeBudget = 0;
+
+  /** Adaptive sampling parameters */
+  ADAPTIVE_PARAMS AdaptivePar;
+
+  /** Time of HDR correction of last frame in seconds (it is reserved in time budget of next frame) */
+  DBL FinalizeTime = 0;
+
+  /** Linear output flag (frame keeps averaged samples without HDR correction) */
+  BOOL LinearOutput = FALSE;
+
+  /** 8 bits per component colors of last frame (0xAABBGGRR, empty if frame is kept in image) */
+  std::vector<DWORD> Colors;
+
 public:
   /**
    * \brief Render initialization function
@@ -50,12 +72,58 @@ public:
    */
   //virtual VOID ProcessHDR( image *Im ) = 0;
 
+  /**
+   * \brief Setup progressive rendering parameters function
+   * \param[in] NewPar Progressive rendering parameters
+   */
+  VOID SetProgressiveParams( const PROGRESSIVE_PARAMS &NewPar )
+  {
+    ProgressivePar = NewPar;
+  }
+
+  /**
+   * \brief Setup frame time budget function
+   * \param[in] Seconds Frame time budget in seconds (0 - number of samples is fixed)
+   */
+  VOID SetTimeBudget( const FLT Seconds )
+  {
+    TimeBudget = Seconds;
+  }
+
+  /**
+   * \brief Setup adaptive sampling parameters function
+   * \param[in] NewPar Adaptive sampling parameters
+   */
+  VOID SetAdaptiveParams( const ADAPTIVE_PARAMS &NewPar )
+  {
+    AdaptivePar = NewPar;
+  }
+
+  /**
+   * \brief Setup linear output function
+   * \param[in] Enable Linear output flag (frame keeps averaged samples without HDR correction)
+   */
+  VOID SetLinearOutput( const BOOL Enable )
+  {
+    LinearOutput = Enable;
+  }
+
+  /**
+   * \brief Get 8 bits per component colors of last frame function
+   * \return Colors (0xAABBGGRR, empty if frame is kept in image)
+   */
+  const std::vector<DWORD> & GetColors( VOID ) const
+  {
+    return Colors;
+  }
+
   /**
    * \brief Render frame function
    * \param[in, out] Im Image for render
    * \param[in] Camera Camera for render
    * \param[in, out] Scene Scene for render
-   * \param[in] NumberOfSamples Number of samples
+   * \param[in] NumberOfSamples Number of samples (average number of samples of pixel for adaptive sampling,
+   *                            ignored if time budget is set)
    */
   virtual VOID RenderFrame( image *Im, const cam &Camera, scene &Scene, INT NumberOfSamples ) = 0;
 
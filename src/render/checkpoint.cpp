@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "checkpoint.h"
+#include "utils/error.h"
+
+/**
+ * \brief Checkpoints constructor
+ * \param[in] NewPar Progressive rendering parameters
+ */
+checkpoint::checkpoint( const PROGRESSIVE_PARAMS &NewPar ) : Par(NewPar)
+{
+}
+
+/**
+ * \brief Load accumulation buffer function
+ * \param[in, out] Sum Accumulation buffer (image must have frame size)
+ * \param[in] Seed Seed of random numbers of frame
+ * \return Number of accumulated samples (0 - if file is missing)
+ */
+INT checkpoint::LoadAccumulation( image *Sum, const UINT32 Seed ) const
+{
+  std::ifstream File(Par.AccumulationPath, std::ios::binary);
+
+  if (!File)
+    return 0;
+
+  ACCUMULATION_HEADER Header;
+
+  // Samples of other frame would spoil image, so render is not silently restarted
+  if (!File.read(reinterpret_cast<CHAR *>(&Header), sizeof(ACCUMULATION_HEADER)) ||
+      memcmp(Header.Signature, Signature, sizeof(Signature)) != 0 ||
+      Header.Version != Version)
+    error("'" + Par.AccumulationPath + "' is not accumulation buffer");
+  if (Header.W != Sum->FrameW || Header.H != Sum->FrameH || Header.Seed != Seed || Header.NumberOfSamples < 0)
+    error("Accumulation buffer '" + Par.AccumulationPath + "' is saved for other frame");
+
+  std::vector<image_vec> Row(Sum->FrameW);
+
+  for (INT y = 0; y < Sum->FrameH; y++)
+  {
+    if (!File.read(reinterpret_cast<CHAR *>(Row.data()), Row.size() * sizeof(image_vec)))
+      error("Accumulation buffer '" + Par.AccumulationPath + "' is truncated");
+    for (INT x = 0; x < Sum->FrameW; x++)
+      Sum->SetPixel(x, y, Row[x]);
+  }
+
+  return Header.NumberOfSamples;
+}
+
+/**
+ * \brief Save accumulation buffer function
+ * \param[in] Sum Accumulation buffer
+ * \param[in] NumberOfSamples Number of accumulated samples
+ * \param[in] Seed Seed of random numbers of frame
+ * \return TRUE-if buffer saved, FALSE-otherwise
+ */
+BOOL checkpoint::SaveAccumulation( const image &Sum, const INT NumberOfSamples, const UINT32 Seed ) const
+{
+  ACCUMULATION_HEADER Header = {};
+
+  memcpy(Header.Signature, Signature, sizeof(Signature));
+  Header.Version = Version;
+  Header.W = Sum.FrameW;
+  Header.H = Sum.FrameH;
+  Header.NumberOfSamples = NumberOfSamples;
+  Header.Seed = Seed;
+
+  std::error_code Error;
+
+  std::filesystem::create_directories(std::filesystem::path(Par.AccumulationPath).parent_path(), Error);
+  Error.clear();
+
+  // Write to temporary file and rename it, so killed render never leaves partially written buffer
+  const std::string TmpFileName = Par.AccumulationPath + "." + std::to_string(std::random_device()()) + ".tmp";
+  std::ofstream File(TmpFileName, std::ios::binary);
+  std::vector<image_vec> Row(Sum.FrameW);
+
+  File.write(reinterpret_cast<const CHAR *>(&Header), sizeof(ACCUMULATION_HEADER));
+  for (INT y = 0; y < Sum.FrameH; y++)
+  {
+    for (INT x = 0; x < Sum.FrameW; x++)
+      Row[x] = Sum.GetPixel(x, y);
+    File.write(reinterpret_cast<const CHAR *>(Row.data()), Row.size() * sizeof(image_vec));
+  }
+  File.close();
+
+  if (File)
+    std::filesystem::rename(TmpFileName, Par.AccumulationPath, Error);
+
+  if (!File || Error)
+  {
+    std::filesystem::remove(TmpFileName, Error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * \brief Start frame function (accumulation buffer is loaded if render is resumed)
+ * \param[in, out] Sum Cleared accumulation buffer (image must have frame size)
+ * \param[in] Seed Seed of random numbers of frame
+ * \return Number of already accumulated samples
+ */
+INT checkpoint::Start( image *Sum, const UINT32 Seed )
+{
+  LastSamples = 0;
+  if (Par.Resume && !Par.AccumulationPath.empty())
+  {
+    LastSamples = LoadAccumulation(Sum, Seed);
+    if (LastSamples > 0)
+      std::cout << "Resumed from " + std::to_string(LastSamples) + " samples\n";
+  }
+  LastTime = std::chrono::steady_clock::now();
+  StartTime = LastTime;
+  StartSamples = LastSamples;
+
+  return LastSamples;
+}
+
+/**
+ * \brief Get number of samples for rendering before next check function
+ * \param[in] NumberOfSamples Number of accumulated samples
+ * \param[in] TotalNumberOfSamples Number of samples of frame
+ * \return Number of samples
+ */
+INT checkpoint::GetNumberOfPassSamples( const INT NumberOfSamples, const INT TotalNumberOfSamples ) const
+{
+  const INT Rest = TotalNumberOfSamples - NumberOfSamples;
+
+  if (Par.ImagePath.empty() && Par.AccumulationPath.empty())
+    return Rest;
+  // Pass lasts till next checkpoint by measured time of sample (time is checked after every sample until it is measured)
+  if (Par.Seconds > 0)
+  {
+    const INT Measured = NumberOfSamples - StartSamples;
+
+    if (Measured == 0)
+      return std::min(Rest, 1);
+
+    const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+    const DBL SampleTime = std::chrono::duration<DBL>(Now - StartTime).count() / Measured;
+    const DBL RestTime = Par.Seconds - std::chrono::duration<DBL>(Now - LastTime).count();
+    const INT Fit = (INT)std::min<DBL>(std::floor(RestTime / SampleTime), Measured);
+
+    return std::min(Rest, std::max(1, Fit));
+  }
+  if (Par.Samples > 0)
+    return std::min(Rest, std::max(1, LastSamples + Par.Samples - NumberOfSamples));
+  return Rest;
+}
+
+/**
+ * \brief Check if checkpoint should be saved function (last pass of frame is always saved)
+ * \param[in] NumberOfSamples Number of accumulated samples
+ * \param[in] TotalNumberOfSamples Number of samples of frame
+ * \return TRUE-if checkpoint is needed, FALSE-otherwise
+ */
+BOOL checkpoint::IsNeeded( const INT NumberOfSamples, const INT TotalNumberOfSamples ) const
+{
+  if (Par.ImagePath.empty() && Par.AccumulationPath.empty())
+    return FALSE;
+
+  return NumberOfSamples >= TotalNumberOfSamples ||
+         (Par.Samples > 0 && NumberOfSamples - LastSamples >= Par.Samples) ||
+         (Par.Seconds > 0 &&
+          std::chrono::duration<FLT>(std::chrono::steady_clock::now() - LastTime).count() >= Par.Seconds);
+}
+
+/**
+ * \brief Save checkpoint function
+ * \param[in] Sum Accumulation buffer
+ * \param[in] NumberOfSamples Number of accumulated samples
+ * \param[in] Seed Seed of random numbers of frame
+ * \param[in] ProcessHDR Tone mapping function of render
+ */
+VOID checkpoint::Save( const image &Sum, const INT NumberOfSamples, const UINT32 Seed,
+                       const std::function<VOID (image *)> &ProcessHDR )
+{
+  if (!Par.AccumulationPath.empty() && !SaveAccumulation(Sum, NumberOfSamples, Seed))
+    std::cout << "Accumulation buffer '" + Par.AccumulationPath + "' is not saved\n";
+
+  if (!Par.ImagePath.empty())
+  {
+    image Img;
+
+    Img.SetDivided(Sum, NumberOfSamples);
+    if (!image::IsLinearFormat(Par.ImageFormat))
+      ProcessHDR(&Img);
+    Img.Save(Par.ImagePath, Par.ImageFormat);
+  }
+
+  std::cout << "Checkpoint: " + std::to_string(NumberOfSamples) + " samples\n";
+
+  LastSamples = NumberOfSamples;
+  LastTime = std::chrono::steady_clock::now();
+}
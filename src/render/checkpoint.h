@@ -0,0 +1,144 @@
+#ifndef __checkpoint_h_
+#define __checkpoint_h_
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include "utils/image.h"
+
+/**
+ * \brief Progressive rendering parameters (intermediate results are saved while frame is rendered)
+ */
+struct PROGRESSIVE_PARAMS
+{
+  /** Number of samples between checkpoints (0 - checkpoints are not made by number of samples) */
+  INT Samples = 0;
+
+  /** Time between checkpoints in seconds (0 - checkpoints are not made by time) */
+  FLT Seconds = 0;
+
+  /** Path to tone mapped image saved at checkpoint (empty - image is not saved) */
+  std::string ImagePath;
+
+  /** Image format (image of linear format is not tone mapped) */
+  image::FORMAT ImageFormat = image::FORMAT::PNG;
+
+  /** Path to accumulation buffer saved at checkpoint (empty - buffer is not saved) */
+  std::string AccumulationPath;
+
+  /** Continue render from saved accumulation buffer flag */
+  BOOL Resume = FALSE;
+};
+
+/**
+ * \brief Progressive rendering checkpoints (accumulation buffer keeps sum of samples of every pixel)
+ */
+class checkpoint
+{
+private:
+  /**
+   * \brief Accumulation buffer file header
+   */
+  struct ACCUMULATION_HEADER
+  {
+    /** File signature */
+    CHAR Signature[8];
+
+    /** File format version */
+    UINT32 Version;
+
+    /** Frame width */
+    INT W;
+
+    /** Frame height */
+    INT H;
+
+    /** Number of accumulated samples */
+    INT NumberOfSamples;
+
+    /** Seed of random numbers of frame */
+    UINT32 Seed;
+  };
+
+  /** Accumulation buffer file signature */
+  static constexpr CHAR Signature[8] = "IGACCUM";
+
+  /** Accumulation buffer file format version */
+  static constexpr UINT32 Version = 1;
+
+  /** Progressive rendering parameters */
+  PROGRESSIVE_PARAMS Par;
+
+  /** Time of last checkpoint (or of render start) */
+  std::chrono::steady_clock::time_point LastTime;
+
+  /** Number of samples at last checkpoint (or at render start) */
+  INT LastSamples = 0;
+
+  /** Render start time */
+  std::chrono::steady_clock::time_point StartTime;
+
+  /** Number of samples at render start */
+  INT StartSamples = 0;
+
+  /**
+   * \brief Load accumulation buffer function
+   * \param[in, out] Sum Accumulation buffer (image must have frame size)
+   * \param[in] Seed Seed of random numbers of frame
+   * \return Number of accumulated samples (0 - if file is missing)
+   */
+  INT LoadAccumulation( image *Sum, const UINT32 Seed ) const;
+
+  /**
+   * \brief Save accumulation buffer function
+   * \param[in] Sum Accumulation buffer
+   * \param[in] NumberOfSamples Number of accumulated samples
+   * \param[in] Seed Seed of random numbers of frame
+   * \return TRUE-if buffer saved, FALSE-otherwise
+   */
+  BOOL SaveAccumulation( const image &Sum, const INT NumberOfSamples, const UINT32 Seed ) const;
+
+public:
+  /**
+   * \brief Checkpoints constructor
+   * \param[in] NewPar Progressive rendering parameters
+   */
+  checkpoint( const PROGRESSIVE_PARAMS &NewPar );
+
+  /**
+   * \brief Start frame function (accumulation buffer is loaded if render is resumed)
+   * \param[in, out] Sum Cleared accumulation buffer (image must have frame size)
+   * \param[in] Seed Seed of random numbers of frame
+   * \return Number of already accumulated samples
+   */
+  INT Start( image *Sum, const UINT32 Seed );
+
+  /**
+   * \brief Get number of samples for rendering before next check function
+   * \param[in] NumberOfSamples Number of accumulated samples
+   * \param[in] TotalNumberOfSamples Number of samples of frame
+   * \return Number of samples
+   */
+  INT GetNumberOfPassSamples( const INT NumberOfSamples, const INT TotalNumberOfSamples ) const;
+
+  /**
+   * \brief Check if checkpoint should be saved function (last pass of frame is always saved)
+   * \param[in] NumberOfSamples Number of accumulated samples
+   * \param[in] TotalNumberOfSamples Number of samples of frame
+   * \return TRUE-if checkpoint is needed, FALSE-otherwise
+   */
+  BOOL IsNeeded( const INT NumberOfSamples, const INT TotalNumberOfSamples ) const;
+
+  /**
+   * \brief Save checkpoint function
+   * \param[in] Sum Accumulation buffer
+   * \param[in] NumberOfSamples Number of accumulated samples
+   * \param[in] Seed Seed of random numbers of frame
+   * \param[in] ProcessHDR Tone mapping function of render
+   */
+  VOID Save( const image &Sum, const INT NumberOfSamples, const UINT32 Seed,
+             const std::function<VOID (image *)> &ProcessHDR );
+};
+
+#endif /* __checkpoint_h_ */
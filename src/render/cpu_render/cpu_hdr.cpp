@@ -1,50 +1,66 @@
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 #include "cpu_hdr.h"
+#include "utils/image_kernels.h"
 #include "utils/parallel_for.h"
 
-/**
-  * \brief Tone mapping function
-  * \param[in] Src Vector before tone compression
-  * \return Compressed color
-  */
-image_vec cpu_hdr::ToneCompression( const image_vec &Src ) const
-{
-  return image_vec(1.0 - exp(-Src.R * Exposure),
-                   1.0 - exp(-Src.G * Exposure),
-                   1.0 - exp(-Src.B * Exposure));
-}
-
 /**
   * \brief Bloom function
   * \param[in, out] Img Image
   */
 VOID cpu_hdr::Bloom( image * Img )
 {
-  //#pragma omp parallel for
-  //for (INT y = 0; y < Img->FrameH; y++)
-  parallel_for::Run(Img->FrameH, [&]( INT y )
+  const BLOOM_SCHEDULE Schedule = GetBloomSchedule();
+
+  if (Schedule.LastLevel == 0)
+    return;
+
+  // Bright pixels are downsampled to level 1 at once
+  parallel_for::Run(Levels[1].FrameH, [&]( INT y )
   {
-    for (INT x = 0; x < Img->FrameW; x++)
+    // Last row and column are repeated for odd sizes
+    std::vector<DBL> Bright(Img->FrameW * 6);
+    const DBL *BrightRows[2] = {Bright.data(), Bright.data() + Img->FrameW * 3};
+
+    for (INT i = 0; i < 2; i++)
+      image_kernels::Threshold(Img->GetRow(std::min(2 * y + i, Img->FrameH - 1)), Bright.data() + Img->FrameW * 3 * i,
+                               Img->FrameW, BrighnessLimit);
+
+    for (INT x = 0; x < Levels[1].FrameW; x++)
     {
-      image_vec SrcColor(Img->GetPixel(x, y));
       image_vec Color(0, 0, 0);
 
-      if (SrcColor.R * 0.3 + SrcColor.G * 0.59 + SrcColor.B * 0.11 > BrighnessLimit)
+      for (INT i = 0; i < 4; i++)
       {
-        Color = SrcColor;
+        const DBL *SrcColor = BrightRows[i >> 1] + std::min(2 * x + (i & 1), Img->FrameW - 1) * 3;
+
+        Color.R += 0.25 * SrcColor[0];
+        Color.G += 0.25 * SrcColor[1];
+        Color.B += 0.25 * SrcColor[2];
       }
 
-      PingPongBuffers[1].SetPixel(x, y, Color);
+      Levels[1].SetPixel(x, y, Color);
     }
   });
 
-  for (INT i = 0; i < NumberOfBlumIterations; i++)
+  for (INT Level = 1; Level < Schedule.LastLevel; Level++)
+  {
+    BlurHorisontalIteration(Levels[Level], &TmpLevels[Level]);
+    BlurVerticalIteration(TmpLevels[Level], &Levels[Level]);
+    Downsample(Levels[Level], &Levels[Level + 1]);
+  }
+
+  for (INT i = 0; i < Schedule.NumberOfLastLevelIterations; i++)
   {
-    BlurHorisontalIteration(PingPongBuffers[1], &PingPongBuffers[0]);
-    BlurVerticalIteration(PingPongBuffers[0], &PingPongBuffers[1]);
+    BlurHorisontalIteration(Levels[Schedule.LastLevel], &TmpLevels[Schedule.LastLevel]);
+    BlurVerticalIteration(TmpLevels[Schedule.LastLevel], &Levels[Schedule.LastLevel]);
   }
 
+  for (INT Level = Schedule.LastLevel; Level > 1; Level--)
+    Upsample(Levels[Level], &Levels[Level - 1]);
+
   //#pragma omp parallel for
   //for (INT y = 0; y < Img->FrameH; y++)
   parallel_for::Run(Img->FrameH, [&]( INT y )
@@ -52,7 +68,7 @@ VOID cpu_hdr::Bloom( image * Img )
     for (INT x = 0; x < Img->FrameW; x++)
     {
       image_vec Color(Img->GetPixel(x, y));
-      image_vec BloomResult(PingPongBuffers[1].GetPixel(x, y));
+      const image_vec BloomResult(GetUpsampledPixel(Levels[1], x, y));
 
       Color.R += BloomResult.R;
       Color.G += BloomResult.G;
@@ -74,22 +90,12 @@ VOID cpu_hdr::BlurVerticalIteration( const image & Src, image * Dest )
   //for (INT y = 0; y < Dest->FrameH; y++)
   parallel_for::Run(Dest->FrameH, [&]( INT y )
   {
-    for (INT x = 0; x < Dest->FrameW; x++)
-    {
-      image_vec Color(0, 0, 0);
+    const DBL *Rows[9];
 
-      for (INT i = -4; i < 5; i++)
-      {
-        const image_vec SrcColor = Src.GetPixelSave(x, y + i);
-        const FLT Coef = BlurCoefs[std::abs(i)];
-
-        Color.R += Coef * SrcColor.R;
-        Color.G += Coef * SrcColor.G;
-        Color.B += Coef * SrcColor.B;
-      }
+    for (INT i = -4; i < 5; i++)
+      Rows[i + 4] = Src.GetRow(std::clamp(y + i, 0, Src.FrameH - 1));
 
-      Dest->SetPixel(x, y, Color);
-    }
+    image_kernels::BlurColumn(Rows, Dest->GetRow(y), Dest->FrameW * 3, BlurCoefs);
   });
 }
 
@@ -102,20 +108,32 @@ VOID cpu_hdr::BlurHorisontalIteration( const image & Src, image * Dest )
 {
   //#pragma omp parallel for
   //for (INT y = 0; y < Dest->FrameH; y++)
+  parallel_for::Run(Dest->FrameH, [&]( INT y )
+  {
+    image_kernels::BlurRow(Src.GetRow(y), Dest->GetRow(y), Dest->FrameW, BlurCoefs);
+  });
+}
+
+/**
+  * \brief Downsample image 2 times function (pixel is average of 2x2 block)
+  * \param[in] Src Source image
+  * \param[in, out] Dest Destination image (of half source size rounded up)
+  */
+VOID cpu_hdr::Downsample( const image &Src, image *Dest )
+{
   parallel_for::Run(Dest->FrameH, [&]( INT y )
   {
     for (INT x = 0; x < Dest->FrameW; x++)
     {
       image_vec Color(0, 0, 0);
 
-      for (INT i = -4; i < 5; i++)
+      for (INT i = 0; i < 4; i++)
       {
-        const image_vec SrcColor = Src.GetPixelSave(x + i, y);
-        const FLT Coef = BlurCoefs[std::abs(i)];
+        const image_vec &SrcColor = Src.GetPixelSave(2 * x + (i & 1), 2 * y + (i >> 1));
 
-        Color.R += Coef * SrcColor.R;
-        Color.G += Coef * SrcColor.G;
-        Color.B += Coef * SrcColor.B;
+        Color.R += 0.25 * SrcColor.R;
+        Color.G += 0.25 * SrcColor.G;
+        Color.B += 0.25 * SrcColor.B;
       }
 
       Dest->SetPixel(x, y, Color);
@@ -123,6 +141,54 @@ VOID cpu_hdr::BlurHorisontalIteration( const image & Src, image * Dest )
   });
 }
 
+/**
+  * \brief Upsample image 2 times function (bilinear filtering)
+  * \param[in] Src Source image
+  * \param[in, out] Dest Destination image (of double source size or less by 1)
+  */
+VOID cpu_hdr::Upsample( const image &Src, image *Dest )
+{
+  parallel_for::Run(Dest->FrameH, [&]( INT y )
+  {
+    for (INT x = 0; x < Dest->FrameW; x++)
+      Dest->SetPixel(x, y, GetUpsampledPixel(Src, x, y));
+  });
+}
+
+/**
+  * \brief Get bilinear filtered pixel of image downsampled 2 times function
+  * \param[in] Src Downsampled image
+  * \param[in] X Column of pixel of image of double size
+  * \param[in] Y Row of pixel of image of double size
+  * \return Pixel color
+  */
+image_vec cpu_hdr::GetUpsampledPixel( const image &Src, const INT X, const INT Y )
+{
+  // Pixel center lies at 1/4 or 3/4 between centers of neighbour downsampled pixels
+  const INT
+    X0 = std::max((X - 1) >> 1, 0),
+    Y0 = std::max((Y - 1) >> 1, 0),
+    X1 = std::min(((X - 1) >> 1) + 1, Src.FrameW - 1),
+    Y1 = std::min(((Y - 1) >> 1) + 1, Src.FrameH - 1);
+  const DBL
+    Fx = (X & 1) ? 0.25 : 0.75,
+    Fy = (Y & 1) ? 0.25 : 0.75;
+  const image_vec
+    &C00 = Src.GetPixel(X0, Y0),
+    &C10 = Src.GetPixel(X1, Y0),
+    &C01 = Src.GetPixel(X0, Y1),
+    &C11 = Src.GetPixel(X1, Y1);
+  const DBL
+    W00 = (1 - Fx) * (1 - Fy),
+    W10 = Fx * (1 - Fy),
+    W01 = (1 - Fx) * Fy,
+    W11 = Fx * Fy;
+
+  return image_vec(W00 * C00.R + W10 * C10.R + W01 * C01.R + W11 * C11.R,
+                   W00 * C00.G + W10 * C10.G + W01 * C01.G + W11 * C11.G,
+                   W00 * C00.B + W10 * C10.B + W01 * C01.B + W11 * C11.B);
+}
+
 /**
   * \brief Setup exposure for tone mapping function
   * \param[in] NewExposure Exposure
@@ -139,8 +205,17 @@ VOID cpu_hdr::SetExposure( FLT NewExposure )
   */
 VOID cpu_hdr::SetSize(const INT W, const INT H)
 {
-  PingPongBuffers[0].Resize(W, H);
-  PingPongBuffers[1].Resize(W, H);
+  INT LevelW = W, LevelH = H;
+
+  NumberOfLevels = 1;
+  while (NumberOfLevels < MaxBloomLevels && (LevelW > 1 || LevelH > 1))
+  {
+    LevelW = (LevelW + 1) / 2;
+    LevelH = (LevelH + 1) / 2;
+    Levels[NumberOfLevels].Resize(LevelW, LevelH);
+    TmpLevels[NumberOfLevels].Resize(LevelW, LevelH);
+    NumberOfLevels++;
+  }
 }
 
 /**
@@ -161,6 +236,61 @@ VOID cpu_hdr::SetBrighnesLimit( const FLT BrL )
   BrighnessLimit = BrL;
 }
 
+/**
+  * \brief Get exposure for tone mapping function
+  * \return Exposure
+  */
+FLT cpu_hdr::GetExposure( VOID ) const
+{
+  return Exposure;
+}
+
+/**
+  * \brief Get brighness limit for bloom function
+  * \return Brighness limit (minimum color in grayscale)
+  */
+FLT cpu_hdr::GetBrighnesLimit( VOID ) const
+{
+  return BrighnessLimit;
+}
+
+/**
+  * \brief Get bloom passes schedule of image size function
+  * \return Bloom schedule
+  */
+cpu_hdr::BLOOM_SCHEDULE cpu_hdr::GetBloomSchedule( VOID ) const
+{
+  if (NumberOfLevels < 2)
+    return {0, 0};
+
+  // Variance of blur iteration in pixels of its level
+  DBL BlurVariance = 0;
+
+  for (INT i = 1; i < 5; i++)
+    BlurVariance += 2.0 * i * i * BlurCoefs[i];
+
+  const DBL TargetVariance = NumberOfBlumIterations * BlurVariance;
+
+  // Variances of blur iterations and 2x2 averages grow 4 times with every level, so few levels give whole radius
+  DBL Variance = 0.25;
+  INT Level = 1;
+
+  for (; Level + 1 < NumberOfLevels; Level++)
+  {
+    const DBL PixelArea = static_cast<DBL>(1 << (2 * Level));
+
+    if (Variance + (5 * BlurVariance + 0.25) * PixelArea > TargetVariance)
+      break;
+
+    Variance += (BlurVariance + 0.25) * PixelArea;
+  }
+
+  // Rest of radius is blurred on last level
+  const DBL PixelArea = static_cast<DBL>(1 << (2 * Level));
+
+  return {Level, std::max(1, static_cast<INT>(std::lround((TargetVariance - Variance) / (BlurVariance * PixelArea))))};
+}
+
 /**
   * \brief Apply HDR correction to image function
   * \param[in, out] Img Image for processing
@@ -175,7 +305,6 @@ VOID cpu_hdr::Process( image *Img )
   //for (INT y = 0; y < Img->FrameH; y++)
   parallel_for::Run(Img->FrameH, [&]( INT y )
   {
-    for (INT x = 0; x < Img->FrameW; x++)
-      Img->SetPixel(x, y, ToneCompression(Img->GetPixel(x, y)));
+    image_kernels::ToneMap(Img->GetRow(y), Img->GetRow(y), Img->FrameW * 3, Exposure);
   });
 }
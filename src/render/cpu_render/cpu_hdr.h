@@ -8,29 +8,44 @@
  */
 class cpu_hdr
 {
+public:
+  /**
+   * \brief Bloom passes schedule (same for CPU and device post-processing)
+   */
+  struct BLOOM_SCHEDULE
+  {
+    /** Last (coarsest) blurred level of bloom pyramid (0 - image is too small for bloom) */
+    INT LastLevel;
+
+    /** Number of blur iterations of last level (every finer level is blurred once) */
+    INT NumberOfLastLevelIterations;
+  };
+
 private:
   /** Exposure coefficient */
   FLT Exposure = 1.5f;
 
-  /** Number of bluum iterations */
+  /** Maximal number of bloom pyramid levels */
+  static constexpr INT MaxBloomLevels = 12;
+
+  /** Number of bluum iterations (bloom radius is same as of such number of full resolution blur iterations) */
   INT NumberOfBlumIterations = 5;
 
-  /** Buffers for bloom  */
-  image PingPongBuffers[2];
+  /** Bloom pyramid levels (level 0 is not used, level i is image downsampled 2^i times) */
+  image Levels[MaxBloomLevels];
+
+  /** Temporary buffers for blur of bloom pyramid levels */
+  image TmpLevels[MaxBloomLevels];
+
+  /** Number of allocated bloom pyramid levels */
+  INT NumberOfLevels = 0;
 
   /** Brighnes limit for bloom */
   FLT BrighnessLimit = 1;
 
-  /** Blur coefficients for bloom */
-  const FLT BlurCoefs[5] = {0.227027f, 0.1945946f, 0.1216216f, 0.054054f, 0.016216f};
+  /** Blur coefficients for bloom (device post-processing shader has same ones) */
+  const DBL BlurCoefs[5] = {0.227027f, 0.1945946f, 0.1216216f, 0.054054f, 0.016216f};
 
-  /**
-   * \brief Tone mapping function
-   * \param[in] Src Vector before tone compression
-   * \return Compressed color
-   */
-  image_vec ToneCompression( const image_vec &Src ) const;
-  
   /**
    * \brief Bloom function
    * \param[in, out] Img Image
@@ -51,6 +66,29 @@ private:
    */
   VOID BlurHorisontalIteration( const image &Src, image *Dest );
 
+  /**
+   * \brief Downsample image 2 times function (pixel is average of 2x2 block)
+   * \param[in] Src Source image
+   * \param[in, out] Dest Destination image (of half source size rounded up)
+   */
+  VOID Downsample( const image &Src, image *Dest );
+
+  /**
+   * \brief Upsample image 2 times function (bilinear filtering)
+   * \param[in] Src Source image
+   * \param[in, out] Dest Destination image (of double source size or less by 1)
+   */
+  VOID Upsample( const image &Src, image *Dest );
+
+  /**
+   * \brief Get bilinear filtered pixel of image downsampled 2 times function
+   * \param[in] Src Downsampled image
+   * \param[in] X Column of pixel of image of double size
+   * \param[in] Y Row of pixel of image of double size
+   * \return Pixel color
+   */
+  static image_vec GetUpsampledPixel( const image &Src, const INT X, const INT Y );
+
 public:
   /**
    * \brief Setup exposure for tone mapping function
@@ -67,7 +105,7 @@ public:
 
   /**
    * \brief Setup number of bloom iterations function
-   * \param[in] N Number of bloom iterations
+   * \param[in] N Number of bloom iterations (bloom radius is same as of such number of full resolution blur iterations)
    */
   VOID SetNumberOfBloomIterations( const INT N );
 
@@ -77,6 +115,24 @@ public:
    */
   VOID SetBrighnesLimit( const FLT BrL );
 
+  /**
+   * \brief Get exposure for tone mapping function
+   * \return Exposure
+   */
+  FLT GetExposure( VOID ) const;
+
+  /**
+   * \brief Get brighness limit for bloom function
+   * \return Brighness limit (minimum color in grayscale)
+   */
+  FLT GetBrighnesLimit( VOID ) const;
+
+  /**
+   * \brief Get bloom passes schedule of image size function
+   * \return Bloom schedule
+   */
+  BLOOM_SCHEDULE GetBloomSchedule( VOID ) const;
+
   /**
    * \brief Apply HDR correction to image function
    * \param[in, out] Img Image for processing
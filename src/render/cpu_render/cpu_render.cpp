@@ -1,5 +1,5 @@
+#include <algorithm>
 #include <ctime>
-#include <random>
 #include <iostream>
 #include <iomanip>
 
@@ -66,30 +66,98 @@ VOID cpu_render::ProcessHDR( image * Im )
 }
 
 /**
-  * \brief Generate sample image function
-  * \param[in, out] Im Image
-  */
-VOID cpu_render::MakeSample( image *Im )
+ * \brief Get Morton code (interleaved bits) of tile coordinates function
+ * \param[in] X Tile column
+ * \param[in] Y Tile row
+ * \return Morton code
+ */
+UINT64 cpu_render::GetMortonCode( const UINT32 X, const UINT32 Y )
+{
+  UINT64 Code = 0;
+
+  for (INT Bit = 0; Bit < 32; Bit++)
+    Code |= ((UINT64)((X >> Bit) & 1) << (2 * Bit)) | ((UINT64)((Y >> Bit) & 1) << (2 * Bit + 1));
+
+  return Code;
+}
+
+/**
+ * \brief Get tiles in Morton order function (neighbouring tiles are rendered close in time)
+ * \param[in] W Frame width
+ * \param[in] H Frame height
+ * \return Tiles top-left corners
+ */
+std::vector<std::pair<INT, INT>> cpu_render::GetTilesOrder( const INT W, const INT H )
+{
+  std::vector<std::pair<INT, INT>> Tiles;
+
+  for (INT y = 0; y < H; y += TileSize)
+    for (INT x = 0; x < W; x += TileSize)
+      Tiles.emplace_back(x, y);
+
+  std::sort(Tiles.begin(), Tiles.end(),
+            []( const std::pair<INT, INT> &A, const std::pair<INT, INT> &B )
+            {
+              return GetMortonCode(A.first / TileSize, A.second / TileSize) <
+                     GetMortonCode(B.first / TileSize, B.second / TileSize);
+            });
+
+  return Tiles;
+}
+
+/**
+ * \brief Render samples range of tile function
+ * \param[in, out] Im Accumulation buffer (samples are added to tile pixels)
+ * \param[in] Tree Acceleration structure of scene
+ * \param[in, out] Adaptive Adaptive sampling state (statistics of tile pixels are updated if it is used)
+ * \param[in] X0 Tile left column
+ * \param[in] Y0 Tile top row
+ * \param[in] NumberOfSamples Number of samples (tile continues from its number of samples)
+ */
+VOID cpu_render::RenderTile( image *Im, const acceleration_structure &Tree, adaptive_sampling &Adaptive,
+                             const INT X0, const INT Y0, const INT NumberOfSamples )
 {
-  static std::uniform_real_distribution<FLT> Distr(-0.5f, 0.5f);
-  static std::mt19937_64 Gen;
   const environment AirEnvi = environment::Make();
-  const kd_tree &Tree = Scene->GetTree();
+  const light_list &Lights = Scene->GetLights();
+  const INT X1 = std::min(X0 + TileSize, Im->FrameW);
+  const INT Y1 = std::min(Y0 + TileSize, Im->FrameH);
+  const INT Tile = Adaptive.GetTileIndex(X0, Y0);
+  const INT FirstSample = Adaptive.GetNumberOfTileSamples(Tile);
+  const INT FirstStatsSample = Adaptive.GetNumberOfStatsSamples(Tile);
+  image_vec Sum[TileSize][TileSize];
 
- // #pragma omp parallel for
-  //for (INT y = 0; y < Im->FrameH; y++)
-  parallel_for::Run(Im->FrameH, [&]( INT y )
-    {
-      tracer RayTraceStructure(Tree, AirEnvi, Gen, Scene->RenderPar);
+  for (INT y = Y0; y < Y1; y++)
+    for (INT x = X0; x < X1; x++)
+      Sum[y - Y0][x - X0] = Im->GetPixel(x, y);
 
-      for (INT x = 0; x < Im->FrameW; x++)
+  for (INT SampleIndex = FirstSample; SampleIndex < FirstSample + NumberOfSamples; SampleIndex++)
+  {
+    const UINT64 SampleSeed = (static_cast<UINT64>(Scene->RenderPar.Seed) << 32) | static_cast<UINT32>(SampleIndex);
+
+    for (INT y = Y0; y < Y1; y++)
+      for (INT x = X0; x < X1; x++)
       {
-        vec TraceResult = RayTraceStructure.Trace(Camera->ToRay(x + Distr(Gen), y + Distr(Gen)),
-                                                  Scene->AirEnvi, vec(1, 1, 1));
+        // Every pixel has own random numbers stream, so result doesn't depend on threads scheduling
+        random_generator Gen(SampleSeed, static_cast<UINT64>(y) * Im->FrameW + x);
+        tracer RayTraceStructure(Tree, Lights, AirEnvi, Gen, Scene->RenderPar);
+        const FLT DX = Gen.GetNextUniform(-0.5f, 0.5f);
+        const FLT DY = Gen.GetNextUniform(-0.5f, 0.5f);
+        const vec TraceResult = RayTraceStructure.Trace(Camera->ToRay(x + DX, y + DY), Scene->AirEnvi);
+        image_vec &Pixel = Sum[y - Y0][x - X0];
+
+        Pixel.R += TraceResult.X;
+        Pixel.G += TraceResult.Y;
+        Pixel.B += TraceResult.Z;
 
-        Im->SetPixel(x, y, image_vec(TraceResult.X, TraceResult.Y, TraceResult.Z));
+        if (Adaptive.IsEnabled())
+          adaptive_sampling::AddSample(&Adaptive.GetPixelStats(x, y), FirstStatsSample + SampleIndex - FirstSample + 1,
+                                       TraceResult);
       }
-    });
+  }
+
+  for (INT y = Y0; y < Y1; y++)
+    for (INT x = X0; x < X1; x++)
+      Im->SetPixel(x, y, Sum[y - Y0][x - X0]);
 }
 
 /**
@@ -101,47 +169,86 @@ VOID cpu_render::MakeSample( image *Im )
  */
 VOID cpu_render::RenderFrame( image *Im, const cam &Camera, scene &Scene, INT NumberOfSamples )
 {
-  StartFrame(Im->FrameW, Im->FrameH);
+  time_budget Budget(TimeBudget, FinalizeTime);
 
-  image SampleImg;
+  StartFrame(Im->FrameW, Im->FrameH);
 
-  SampleImg.Resize(Im->FrameW, Im->FrameH);
-  SampleImg.Clear();
   Im->Clear();
 
   std::cout << "Generating/Getting tree\n";
 
   INT64 Time = clock();
 
-  Scene.GetTree();
+  const acceleration_structure &Tree = Scene.GetAccelerationStructure();
   std::cout << "Success. Elapsed time: " + std::to_string((clock() - Time) /
                                                           (DBL)CLOCKS_PER_SEC) << "\n\n";
 
   SetCamera(Camera);
   SetScene(Scene);
 
-  INT SampleCounter;
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+  acceleration_structure::NumOfVisitedNodes = 0;
+  acceleration_structure::NumOfIntersectionRequests = 0;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+  // Tiles differ in cost, so they are handed out to threads dynamically
+  const std::vector<std::pair<INT, INT>> Tiles = GetTilesOrder(Im->FrameW, Im->FrameH);
+
+  checkpoint Checkpoint(ProgressivePar);
+  INT SamplesDone = Checkpoint.Start(Im, Scene.RenderPar.Seed);
+  adaptive_sampling Adaptive(AdaptivePar, Im->FrameW, Im->FrameH, TileSize, SamplesDone);
+  std::vector<std::pair<INT, INT>> ActiveTiles;
 
-  for (SampleCounter = 0; SampleCounter < NumberOfSamples; SampleCounter++)
+  if (Budget.IsEnabled())
+    std::cout << "Generating samples for " + std::to_string(TimeBudget) + " seconds\n";
+  else
+    std::cout << "Generating " + std::to_string(NumberOfSamples) + " samples\n";
+  Time = clock();
+  Budget.StartSampling(SamplesDone);
+
+  INT TotalSamples;
+
+  // Samples are rendered by passes between checkpoints (sample index defines random numbers, so result is the same)
+  while (!Adaptive.IsConverged() &&
+         SamplesDone < (TotalSamples = Budget.GetNumberOfSamples(SamplesDone, NumberOfSamples)))
   {
-    SampleImg.Clear();
-
-    std::cout << "Generating sample #" + std::to_string(SampleCounter + 1) + "\n";
-    Time = clock();
-    MakeSample(&SampleImg);
-    std::cout << "Success. Elapsed time: " + std::to_string((clock() - Time) /
-                                                            (DBL)CLOCKS_PER_SEC) << "\n";
-
-    std::cout << "Applying sample #" + std::to_string(SampleCounter + 1) + "\n";
-    Time = clock();
-    //  Img->ApplySample(SampleImg, i);
-    *Im += SampleImg;
-    std::cout << "Success. Elapsed time: " + std::to_string((clock() - Time) /
-                                                            (DBL)CLOCKS_PER_SEC) << "\n" << std::endl;
+    const INT PassSamples =
+      Adaptive.GetNumberOfPassSamples(Checkpoint.GetNumberOfPassSamples(SamplesDone, TotalSamples));
+
+    ActiveTiles.clear();
+    for (const std::pair<INT, INT> &Tile : Tiles)
+      if (Adaptive.IsTileActive(Adaptive.GetTileIndex(Tile.first, Tile.second)))
+        ActiveTiles.push_back(Tile);
+
+    parallel_for::Run(ActiveTiles.size(), [&]( INT i )
+      {
+        RenderTile(Im, Tree, Adaptive, ActiveTiles[i].first, ActiveTiles[i].second, PassSamples);
+      });
+    Adaptive.EndPass(PassSamples);
+    SamplesDone = Adaptive.GetNumberOfSamples();
+
+    // Converged frame ends before its number of samples, so its last pass is saved too
+    if (Checkpoint.IsNeeded(SamplesDone, Adaptive.IsConverged() ? SamplesDone : TotalSamples))
+      Checkpoint.Save(Adaptive.GetUniformSum(*Im), SamplesDone, Scene.RenderPar.Seed, [&]( image *Img )
+        {
+          ProcessHDR(Img);
+        });
   }
+  std::cout << "Success. Samples: " + std::to_string(SamplesDone) + ", elapsed time: " +
+               std::to_string((clock() - Time) / (DBL)CLOCKS_PER_SEC) << "\n" << std::endl;
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+  std::cout << "Average number of visited tree nodes per ray: " +
+    std::to_string(acceleration_structure::NumOfVisitedNodes /
+                   std::max<DBL>(1, acceleration_structure::NumOfIntersectionRequests)) << "\n\n";
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+  const std::chrono::steady_clock::time_point FinalizeStart = std::chrono::steady_clock::now();
 
-  *Im /= SampleCounter;
-  ProcessHDR(Im);
+  Adaptive.Normalize(*Im, Im, 1);
+  if (!LinearOutput)
+    ProcessHDR(Im);
+  FinalizeTime = std::chrono::duration<DBL>(std::chrono::steady_clock::now() - FinalizeStart).count();
 
   EndFrame();
 }
@@ -1,6 +1,8 @@
 #ifndef __cpu_render_h_
 #define __cpu_render_h_
 
+#include <vector>
+
 #include "utils/image.h"
 #include "scene/scene.h"
 #include "render/base_render.h"
@@ -39,11 +41,36 @@ private:
    */
   VOID ProcessHDR( image *Im );
 
+  /** Size of square tile rendered by one thread at once (in pixels) */
+  static const INT TileSize = 16;
+
   /**
-   * \brief Generate sample image function
-   * \param[in, out] Im Image
+   * \brief Get Morton code (interleaved bits) of tile coordinates function
+   * \param[in] X Tile column
+   * \param[in] Y Tile row
+   * \return Morton code
+   */
+  static UINT64 GetMortonCode( const UINT32 X, const UINT32 Y );
+
+  /**
+   * \brief Get tiles in Morton order function (neighbouring tiles are rendered close in time)
+   * \param[in] W Frame width
+   * \param[in] H Frame height
+   * \return Tiles top-left corners
+   */
+  static std::vector<std::pair<INT, INT>> GetTilesOrder( const INT W, const INT H );
+
+  /**
+   * \brief Render samples range of tile function
+   * \param[in, out] Im Accumulation buffer (samples are added to tile pixels)
+   * \param[in] Tree Acceleration structure of scene
+   * \param[in, out] Adaptive Adaptive sampling state (statistics of tile pixels are updated if it is used)
+   * \param[in] X0 Tile left column
+   * \param[in] Y0 Tile top row
+   * \param[in] NumberOfSamples Number of samples (tile continues from its number of samples)
    */
-  VOID MakeSample( image *Im );
+  VOID RenderTile( image *Im, const acceleration_structure &Tree, adaptive_sampling &Adaptive,
+                   const INT X0, const INT Y0, const INT NumberOfSamples );
 
   /**
    * \brief Begin frame function
@@ -1,65 +1,129 @@
 #include <cmath>
-#include <random>
 #include <ctime>
 #include <algorithm>
 #include <cfloat>
 
 #include "math/matr.h"
+#include "scene/instance.h"
 #include "trace.h"
 
 /**
   * \brief Constructor with initial value
   * \param[in] Tree Tree acceleratiron structure
+  * \param[in] Lights Emissive triangles
   * \param[in] AirEnvi Air environment
+  * \param[in, out] Gen Random numbers generator
+  * \param[in] Par Render parameters
   */
-tracer::tracer( const kd_tree& Tree, const environment &AirEnvi,
-                std::mt19937_64 &Gen, const RENDER_PARAMS &Par ) :
-  Tree(Tree), AirEnvi(AirEnvi), Gen(Gen), Par(Par)
+tracer::tracer( const acceleration_structure &Tree, const light_list &Lights, const environment &AirEnvi,
+                random_generator &Gen, const RENDER_PARAMS &Par ) :
+  Tree(Tree), Lights(Lights), AirEnvi(AirEnvi), Gen(Gen), Par(Par)
 {
 }
 
+/**
+ * \brief Power heuristic weight of multiple importance sampling
+ * \param[in] Pdf Probability density of used sampling strategy
+ * \param[in] OtherPdf Probability density of other sampling strategy
+ * \return Weight
+ */
+FLT tracer::PowerHeuristic( const FLT Pdf, const FLT OtherPdf )
+{
+  return Pdf * Pdf / (Pdf * Pdf + OtherPdf * OtherPdf);
+}
+
 /**
  * \brief Trace ray function
  * \param[in] R Ray
  * \param[in] Envi Ray environment
- * \param[in] Weight Ray weight
  * \return Color
  */
-vec tracer::Trace( const ray &R, const environment &Envi, const vec &Weight )
+vec tracer::Trace( const ray &R, const environment &Envi )
 {
   vec Color = vec::Make();
+  vec Weight(1, 1, 1);
+  ray CurRay = R;
   INTR Intr;
-  FLT Near = INFINITY;
-  FLT Fog = 0;
-  FLT Decay = 0;
+  FLT Pdf = 0;
 
-  if (Weight.X < Par.ColorThreshold &&
-      Weight.Y < Par.ColorThreshold &&
-      Weight.Z < Par.ColorThreshold)
+  // Every iteration is one bounce, path contribution is accumulated with running throughput
+  for (INT Depth = 0; Depth < Par.MaxDepthRender && !IsWeightNegligible(Weight); Depth++)
   {
-    return Color;
-  }
+    FLT Near = INFINITY;
 
-  if (++CurrentLevel <= Par.MaxDepthRender)
-  {
-    if (Tree.Intersect(R, &Intr, &Near, Par))
+    if (!Tree.Intersect(CurRay, &Intr, &Near, Par))
     {
-      Intr.Vert = Intr.Tr->GetInterp(Intr);
-      Fog = expf(-Envi.FogCoef * Intr.T);
-      Decay = expf(-Envi.AbsCoef * Intr.T);
-      Color = Shade(R.Dir, Intr, Envi, Weight * (Fog * Decay));
+      const FLT Fog = Envi.FogCoef == 0 ? 1 : 0;
+      const FLT Decay = Envi.AbsCoef == 0 ? 1 : 0;
+
+      Color += Weight * Envi.FogColor * ((1 - Fog) * Decay);
+      break;
     }
-    else
+
+    Intr.Vert = Intr.Tr->GetInterp(Intr);
+    if (Intr.Instance != nullptr)
+      Intr.Instance->TransformVertex(&Intr.Vert);
+
+    const FLT Fog = expf(-Envi.FogCoef * Intr.T);
+    const FLT Decay = expf(-Envi.AbsCoef * Intr.T);
+
+    Color += Weight * Envi.FogColor * ((1 - Fog) * Decay);
+    Weight *= Fog * Decay;
+
+    const material &Mtl =
+      material::Table[Intr.Instance != nullptr ? Intr.Instance->MtlId : Intr.Tr->GetMaterialId()];
+
+    // Light hit by camera ray is not sampled explicitly, light hit by BSDF sampled ray is weighted with light sampling
+    if (Mtl.Emit.X > 0 || Mtl.Emit.Y > 0 || Mtl.Emit.Z > 0)
+      Color += Mtl.Emit * Weight * (Pdf == 0 ? 1 : PowerHeuristic(Pdf, GetLightPdf(CurRay, Intr)));
+
+    if (IsWeightNegligible(Weight) || !Shade(&CurRay, Intr, Mtl, Envi, &Color, &Weight, &Pdf))
+      break;
+
+    // Russian roulette: path continues with probability of its throughput, survived path weight is compensated
+    if (Depth + 1 >= Par.RouletteDepth)
     {
-      if (Envi.AbsCoef == 0)
-        Decay = 1;
-      if (Envi.FogCoef == 0)
-        Fog = 1;
+      const FLT Probability =
+        std::clamp(std::max({Weight.X, Weight.Y, Weight.Z}), Par.RouletteMinProbability, 1.0f);
+
+      if (Gen.GetNextUniform() >= Probability)
+        break;
+      Weight /= Probability;
     }
   }
-  CurrentLevel--;
 
-  return (Color * Fog + Envi.FogColor * (1 - Fog)) * Decay;
+  return Color;
+}
+
+/**
+ * \brief Check if ray weight is too small for tracing function
+ * \param[in] Weight Ray weight
+ * \return TRUE-if all weight components are less than color threshold, FALSE-otherwise
+ */
+BOOL tracer::IsWeightNegligible( const vec &Weight ) const
+{
+  return Weight.X < Par.ColorThreshold &&
+         Weight.Y < Par.ColorThreshold &&
+         Weight.Z < Par.ColorThreshold;
+}
+
+/**
+ * \brief Transform direction from local basis of normal (normal is Y axis) function
+ * \param[in] Dir Direction in local basis
+ * \param[in] Normal Normal vector
+ * \return World space direction
+ */
+vec tracer::TransformFromNormalBasis( const vec &Dir, const vec &Normal )
+{
+  const vec Up1(abs(Normal.Y) < 0.9f ? vec(0, 1, 0) : vec(1, 0, 0));
+  const vec Tan((Up1 % Normal).GetNormalized());
+  const vec Bitan(Normal % Tan);
+  const matr Trans(Tan.X,    Tan.Y,    Tan.Z,    0,
+                   Normal.X, Normal.Y, Normal.Z, 0,
+                   Bitan.X,  Bitan.Y,  Bitan.Z,  0,
+                   0,        0,        0,        1);
+
+  return Trans.VectorTransform(Dir);
 }
 
 /**
@@ -71,11 +135,9 @@ vec tracer::Trace( const ray &R, const environment &Envi, const vec &Weight )
 vec tracer::GetMicroNormal( const FLT Alpha2, const vec &MacroNormal )
 {
   const FLT PI(3.14159265359f);
-  static std::uniform_real_distribution<FLT> DistrPhi(0, 2 * PI);
-  static std::uniform_real_distribution<FLT> DistrStd(0, 1);
 
-  const FLT Phi = DistrPhi(Gen);
-  const FLT Std = DistrStd(Gen);
+  const FLT Phi = Gen.GetNextUniform(0, 2 * PI);
+  const FLT Std = Gen.GetNextUniform();
 
   const FLT CosTheta2 = fminf((1.f - Std) / (1.f + Alpha2 * Std - Std), 1.f);
   FLT CosTheta;
@@ -93,54 +155,23 @@ vec tracer::GetMicroNormal( const FLT Alpha2, const vec &MacroNormal )
   else
     SinThetha = sqrt(SinThetaArg);
 
-  const vec N = vec(SinThetha * cos(Phi), CosTheta, SinThetha * sin(Phi));
-  
-  const vec Up1(abs(MacroNormal.Y) < 0.9f ? vec(0, 1, 0) : vec(1, 0, 0));
-  const vec Tan(Up1 % MacroNormal);
-  const vec Bitan(MacroNormal % Tan);
-  const matr Trans(Tan.X,         Tan.Y,         Tan.Z,         0,
-                   MacroNormal.X, MacroNormal.Y, MacroNormal.Z, 0,
-                   Bitan.X,       Bitan.Y,       Bitan.Z,       0,
-                   0,             0,             0,             1);
-  
-  return Trans.VectorTransform(N);
+  return TransformFromNormalBasis(vec(SinThetha * cos(Phi), CosTheta, SinThetha * sin(Phi)), MacroNormal);
 }
 
 /**
-  * \brief Get vector in hemisphere function
+  * \brief Get cosine distributed vector in hemisphere function
   * \param[in] Normal Surface normal vector (Hemisphere direction)
   * \return Vector in hemisphere
   */
 vec tracer::GetDiffDir( const vec& Normal )
 {
   const FLT PI(3.14159265359f);
-  static std::uniform_real_distribution<FLT> DistrPhi(0, 2 * PI);
-  static std::uniform_real_distribution<FLT> DistrH(-1, 1);
-
-  const FLT Y = DistrH(Gen);
-  const FLT Phi = DistrPhi(Gen);
-  FLT PowY2;
 
-  if (fabs(Y) < FLT_MIN)
-    PowY2 = 0;
-  else if (Y < -FLT_MIN)
-    PowY2 = -powf(-Y, 2);
-  else
-    PowY2 = powf(Y, 2);
-
-  FLT RArg = 1 - PowY2;
-  FLT R;
-
-  if (RArg < FLT_MIN)
-    R = 0;
-  else
-    R = sqrt(RArg);
-
-  const vec Res = vec(R * sin(Phi), Y, R * cos(Phi));
+  const FLT R2 = Gen.GetNextUniform();
+  const FLT Phi = Gen.GetNextUniform(0, 2 * PI);
+  const FLT R = sqrt(R2);
 
-  if ((Res & Normal) > 0)
-    return Res;
-  return Res * (-1);
+  return TransformFromNormalBasis(vec(R * sin(Phi), sqrt(1 - R2), R * cos(Phi)), Normal);
 }
 
 /**
@@ -186,89 +217,174 @@ vec tracer::FresnelSchlick( const vec &F0, const FLT CosTheta )
 }
 
 /**
-  * \brief Shade intersection point function
-  * \param[in] Dir Ray direction
-  * \param[in] Intr Intersection structure
-  * \param[in] Envi Environment structure
-  * \param[in] Weight Ray weight
-  * \return Intersectiron point color
-  */
-vec tracer::Shade( const vec &Dir, const INTR &Intr, const environment &Envi, const vec &Weight )
+ * \brief Evaluate BSDF (GGX specular and Lambert diffuse lobes) function
+ * \param[in] S Surface point
+ * \param[in] L Direction to light
+ * \param[out] Pdf Probability density of sampling L by Shade (0 if L is under surface)
+ * \return BSDF value multiplied by cosine between normal and L
+ */
+vec tracer::EvalBsdf( const SURFACE &S, const vec &L, FLT *Pdf )
 {
   const FLT PI(3.14159265359f);
-  static std::uniform_real_distribution<FLT> DistrStd(0, 1);
-  
-  if (Weight.X < Par.ColorThreshold &&
-      Weight.Y < Par.ColorThreshold &&
-      Weight.Z < Par.ColorThreshold)
+  const FLT NL = S.N & L;
+
+  if (NL <= 0)
   {
+    *Pdf = 0;
     return vec::Make();
   }
-  
-  const vec V = Dir * (-1);
-  
-  vec Normal = Intr.Vert.N;
-  FLT NV = Normal & V;
+
+  const vec H = (S.V + L).GetNormalized();
+  const FLT NH = fmaxf(S.N & H, 0.f);
+  const FLT HV = fmaxf(H & S.V, FLT_MIN);
+
+  const FLT DDenum = NH * NH * (S.Alpha2 - 1) + 1;
+  const FLT D = S.Alpha2 / (PI * DDenum * DDenum);
+  const FLT G = GeometryEval(S.NV, S.Alpha2) * GeometryEval(NL, S.Alpha2);
+  const vec F = FresnelSchlick(S.F0, HV);
+
+  const vec Spec = F * (D * G / (4 * S.NV));
+  const vec Diff = S.Color * (vec(1, 1, 1) - F) * (NL * (1 - S.Metal) / PI);
+
+  *Pdf = S.SpecularProbability * D * NH / (4 * HV) + (1 - S.SpecularProbability) * NL / PI;
+  return Spec + Diff;
+}
+
+/**
+ * \brief Get probability density of sampling point on light by light sampling function
+ * \param[in] R Ray hit light
+ * \param[in] Intr Light intersection structure (vertex is evaluated)
+ * \return Probability density by solid angle
+ */
+FLT tracer::GetLightPdf( const ray &R, const INTR &Intr ) const
+{
+  vertex V[3];
+
+  // Light list has world space geometric normals, so normal is evaluated in the same way
+  for (INT i = 0; i < 3; i++)
+  {
+    V[i] = Intr.Tr->GetVertex(i);
+    if (Intr.Instance != nullptr)
+      Intr.Instance->TransformVertex(&V[i]);
+  }
+
+  const vec Cross = (V[1].P - V[0].P) % (V[2].P - V[0].P);
+  const FLT CosL = fabsf(Cross & R.Dir) / (!Cross * !R.Dir);
+
+  if (CosL < FLT_MIN || Lights.IsEmpty())
+    return 0;
+
+  return (Intr.Vert.P - R.Org).Length2() / (CosL * Lights.GetArea());
+}
+
+/**
+ * \brief Sample light and trace shadow ray function (next-event estimation)
+ * \param[in] S Surface point
+ * \param[in] Envi Environment between surface and light
+ * \return Light contribution (multiplied by BSDF and multiple importance sampling weight)
+ */
+vec tracer::SampleLights( const SURFACE &S, const environment &Envi )
+{
+  vec LightP;
+  const FLT Select = Gen.GetNextUniform();
+  const FLT U = Gen.GetNextUniform();
+  const FLT V = Gen.GetNextUniform();
+  const LIGHT &Light = Lights.Sample(Select, U, V, &LightP);
+
+  const vec Dir = LightP - S.P;
+  const FLT Dist2 = Dir.Length2();
+
+  if (Dist2 < Par.Threshold * Par.Threshold)
+    return vec::Make();
+
+  const FLT Dist = sqrt(Dist2);
+  const vec L = Dir / Dist;
+  const FLT CosL = fabsf(Light.N & L);
+  FLT BsdfPdf;
+  const vec Bsdf = EvalBsdf(S, L, &BsdfPdf);
+
+  if (CosL < FLT_MIN || BsdfPdf == 0 || IsWeightNegligible(Bsdf))
+    return vec::Make();
+
+  // Light is visible if there are no intersections before it (light triangle itself is not counted)
+  if (Tree.Occluded(ray(S.P + L * Par.Threshold, L), Dist * (1 - 1e-3f), Par))
+    return vec::Make();
+
+  const FLT LightPdf = Dist2 / (CosL * Lights.GetArea());
+  const FLT Transmittance = expf(-(Envi.FogCoef + Envi.AbsCoef) * Dist);
+
+  return material::Table[Light.MatId].Emit * Bsdf *
+         (Transmittance * PowerHeuristic(LightPdf, BsdfPdf) / LightPdf);
+}
+
+/**
+  * \brief Shade intersection point and sample next ray function
+  * \param[in, out] R Ray (replaced by next ray of path)
+  * \param[in] Intr Intersection structure
+  * \param[in] Mtl Intersection material
+  * \param[in] Envi Ray environment
+  * \param[in, out] Color Accumulated path color
+  * \param[in, out] Weight Path throughput (multiplied by next ray weight)
+  * \param[out] Pdf Probability density of next ray direction
+  * \return TRUE-if path continues, FALSE-if path is terminated
+  */
+BOOL tracer::Shade( ray *R, const INTR &Intr, const material &Mtl, const environment &Envi,
+                    vec *Color, vec *Weight, FLT *Pdf )
+{
+  SURFACE S;
+
+  S.P = Intr.Vert.P;
+  S.N = Intr.Vert.N;
+  S.V = R->Dir * (-1);
+  S.NV = S.N & S.V;
 
   // Correction normal and IsEnter flag
-  if (NV < 0)
+  if (S.NV < 0)
   {
-    NV = -NV;
-    Normal = Normal * (-1);
+    S.NV = -S.NV;
+    S.N = S.N * (-1);
   }
-  
-  const material &Mtl = material::Table[Intr.Tr->GetMaterialId()];
-  FLT Alpha2;
+  if (S.NV < FLT_MIN)
+    return FALSE;
 
-  if (Mtl.Roughness < FLT_MIN)
-    Alpha2 = 0;
-  else
-    Alpha2 = powf(Mtl.Roughness, 4);
-  
-  const vec MicroN = GetMicroNormal(Alpha2, Normal);
-  const vec Refl = Dir - MicroN * (2 * (MicroN & Dir));
-  const vec Diff = GetDiffDir(Normal);
-
-  const vec H = (V + Refl).GetNormalized();
-  
-  const FLT NH = Normal & H;
-  const FLT NL = Normal & Refl;
-  if (NL < 0 || NV < 0)
-    return Mtl.Emit;
-  
-  const vec F0 = Mtl.Color * Mtl.Metal + vec(0.04f, 0.04f, 0.04f) * (1 - Mtl.Metal);
-  const FLT HV = H & V;
-
-  const FLT G = GeometryEval(NV, Alpha2) * GeometryEval(NL, Alpha2);
-  const vec F = FresnelSchlick(F0, HV);
-  
-  const vec ReflColor = F * (G * HV / (NV * NH));
-  const vec DiffColor = Mtl.Color * (vec(1, 1, 1) - F) *
-                        (NL * (1 - Mtl.Metal) * (Normal & Diff) / PI);
-  
-  vec Color = vec::Make();
-  
+  // Perfect mirror has delta distribution, so roughness is limited for BSDF evaluation
+  S.Color = Mtl.Color;
+  S.Metal = Mtl.Metal;
+  S.Alpha2 = fmaxf(powf(Mtl.Roughness, 4), 1e-6f);
+  S.F0 = Mtl.Color * Mtl.Metal + vec(0.04f, 0.04f, 0.04f) * (1 - Mtl.Metal);
+
+  // Lobe is selected by its approximate reflectance
+  const vec FV = FresnelSchlick(S.F0, S.NV);
+  const FLT SpecLen = FV.X + FV.Y + FV.Z;
+  const vec DiffColor = S.Color * (vec(1, 1, 1) - FV) * (1 - S.Metal);
+  const FLT DiffLen = fmaxf(DiffColor.X + DiffColor.Y + DiffColor.Z, 0.f);
+
+  if (SpecLen + DiffLen < FLT_MIN)
+    return FALSE;
+  S.SpecularProbability = SpecLen / (SpecLen + DiffLen);
+
+  if (!Lights.IsEmpty())
+    *Color += *Weight * SampleLights(S, Envi);
+
+  vec L;
+
+  if (Gen.GetNextUniform() < S.SpecularProbability)
   {
-    FLT ReflLen = !ReflColor;
-    FLT DiffLen = !DiffColor;
-  
-    const FLT AllLen = ReflLen + DiffLen;
-    
-    ReflLen /= AllLen;
-    DiffLen /= AllLen;
-    if (DistrStd(Gen) < ReflLen)
-    {
-      Color = ReflColor *
-                 Trace(ray(Intr.Vert.P + Refl * Par.Threshold, Refl),
-                       Envi, ReflColor * Weight) / ReflLen;
-    }
-    else
-    {
-      Color = DiffColor *
-                Trace(ray(Intr.Vert.P + Diff * Par.Threshold, Diff),
-                      Envi, DiffColor * Weight) / DiffLen;
-    }
+    const vec MicroN = GetMicroNormal(S.Alpha2, S.N);
+
+    L = R->Dir - MicroN * (2 * (MicroN & R->Dir));
   }
+  else
+    L = GetDiffDir(S.N);
+
+  const vec Bsdf = EvalBsdf(S, L, Pdf);
+
+  if (*Pdf < FLT_MIN)
+    return FALSE;
+
+  // Albedo above 1 gives negative diffuse lobe, which cuts the channel
+  *R = ray(S.P + L * Par.Threshold, L);
+  *Weight = vec::Max(*Weight * Bsdf / *Pdf, vec::Make());
 
-  return vec::Max(Color, vec::Make()) + Mtl.Emit;
+  return TRUE;
 }
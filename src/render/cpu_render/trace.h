@@ -1,9 +1,44 @@
 #ifndef __trace_h_
 #define __trace_h_
 
-#include "scene/kd_tree.h"
+#include "scene/acceleration_structure.h"
 #include "scene/environment.h"
 #include "scene/material.h"
+#include "scene/light_list.h"
+#include "utils/random.h"
+
+/**
+ * \brief Shaded surface point description for BSDF evaluation
+ */
+struct SURFACE
+{
+  /** Position */
+  vec P;
+
+  /** Normal (faced to viewer) */
+  vec N;
+
+  /** Direction to viewer */
+  vec V;
+
+  /** Cosine between normal and direction to viewer */
+  FLT NV;
+
+  /** Albedo */
+  vec Color;
+
+  /** Fresnel coefficient at normal incidence */
+  vec F0;
+
+  /** Metal ratio */
+  FLT Metal;
+
+  /** Square of alpha coefficient (Roughness ^ 4) */
+  FLT Alpha2;
+
+  /** Probability of specular lobe sampling */
+  FLT SpecularProbability;
+};
 
 /**
  * \brief Ray tracer for cpu_render
@@ -11,17 +46,17 @@
 class tracer
 {
 private:
-  /** Reference to kdtree */
-  const kd_tree &Tree;
+  /** Reference to acceleration structure */
+  const acceleration_structure &Tree;
+
+  /** Reference to emissive triangles */
+  const light_list &Lights;
 
   /** Reference to air environment */
   const environment &AirEnvi;
 
-  /** Refernece to random numbers generator */
-  std::mt19937_64 &Gen;
-
-  /** Current recursive level */
-  FLT CurrentLevel = 0;
+  /** Reference to random numbers generator (own for every pixel) */
+  random_generator &Gen;
 
   /* Reference to render parameters */
   const RENDER_PARAMS &Par;
@@ -35,12 +70,28 @@ private:
   vec GetMicroNormal( const FLT Alpha2, const vec &MacroNormal );
  
   /**
-   * \brief Get vector in hemisphere function
+   * \brief Get cosine distributed vector in hemisphere function
    * \param[in] Normal Surface normal vector (Hemisphere direction)
    * \return Vector in hemisphere
    */
   vec GetDiffDir( const vec &Normal );
 
+  /**
+   * \brief Transform direction from local basis of normal (normal is Y axis) function
+   * \param[in] Dir Direction in local basis
+   * \param[in] Normal Normal vector
+   * \return World space direction
+   */
+  static vec TransformFromNormalBasis( const vec &Dir, const vec &Normal );
+
+  /**
+   * \brief Power heuristic weight of multiple importance sampling
+   * \param[in] Pdf Probability density of used sampling strategy
+   * \param[in] OtherPdf Probability density of other sampling strategy
+   * \return Weight
+   */
+  static FLT PowerHeuristic( const FLT Pdf, const FLT OtherPdf );
+
   /**
    * \brief Calculate selfshadowing coefficient
    * \param[in] CosThetaN Angle between outgoing/incoming direction and normal cosine
@@ -58,32 +109,70 @@ private:
   vec FresnelSchlick( const vec &F0, const FLT CosTheta );
 
   /**
-   * \brief Shade intersection point function
-   * \param[in] Dir Ray direction
-   * \param[in] Intr Intersection structure
-   * \param[in] Envi Environment structure
+   * \brief Check if ray weight is too small for tracing function
    * \param[in] Weight Ray weight
-   * \return Intersectiron point color
+   * \return TRUE-if all weight components are less than color threshold, FALSE-otherwise
+   */
+  BOOL IsWeightNegligible( const vec &Weight ) const;
+
+  /**
+   * \brief Evaluate BSDF (GGX specular and Lambert diffuse lobes) function
+   * \param[in] S Surface point
+   * \param[in] L Direction to light
+   * \param[out] Pdf Probability density of sampling L by Shade (0 if L is under surface)
+   * \return BSDF value multiplied by cosine between normal and L
+   */
+  vec EvalBsdf( const SURFACE &S, const vec &L, FLT *Pdf );
+
+  /**
+   * \brief Get probability density of sampling point on light by light sampling function
+   * \param[in] R Ray hit light
+   * \param[in] Intr Light intersection structure (vertex is evaluated)
+   * \return Probability density by solid angle
    */
-  vec Shade( const vec &Dir, const INTR &Intr, const environment &Envi, const vec &Weight );
+  FLT GetLightPdf( const ray &R, const INTR &Intr ) const;
+
+  /**
+   * \brief Sample light and trace shadow ray function (next-event estimation)
+   * \param[in] S Surface point
+   * \param[in] Envi Environment between surface and light
+   * \return Light contribution (multiplied by BSDF and multiple importance sampling weight)
+   */
+  vec SampleLights( const SURFACE &S, const environment &Envi );
+
+  /**
+   * \brief Shade intersection point and sample next ray function
+   * \param[in, out] R Ray (replaced by next ray of path)
+   * \param[in] Intr Intersection structure
+   * \param[in] Mtl Intersection material
+   * \param[in] Envi Ray environment
+   * \param[in, out] Color Accumulated path color
+   * \param[in, out] Weight Path throughput (multiplied by next ray weight)
+   * \param[out] Pdf Probability density of next ray direction
+   * \return TRUE-if path continues, FALSE-if path is terminated
+   */
+  BOOL Shade( ray *R, const INTR &Intr, const material &Mtl, const environment &Envi,
+              vec *Color, vec *Weight, FLT *Pdf );
 public:
 
   /**
    * \brief Constructor with initial value
    * \param[in] Tree Tree acceleratiron structure
+   * \param[in] Lights Emissive triangles
    * \param[in] AirEnvi Air environment
+   * \param[in, out] Gen Random numbers generator
+   * \param[in] Par Render parameters
    */
-  tracer( const kd_tree& Tree, const environment &AirEnvi,
-          std::mt19937_64 &Gen, const RENDER_PARAMS &Par );
+  tracer( const acceleration_structure &Tree, const light_list &Lights, const environment &AirEnvi,
+          random_generator &Gen, const RENDER_PARAMS &Par );
 
   /**
    * \brief Trace ray function
    * \param[in] R Ray
    * \param[in] Envi Ray environment
-   * \param[in] Weight Ray weight
    * \return Color
    */
-  vec Trace( const ray &R, const environment &Envi, const vec &Weight );
+  vec Trace( const ray &R, const environment &Envi );
 };
 
 #endif /* __trace_h_ */
@@ -35,6 +35,56 @@ VOID render::SetRenderMode( MODE RndMode, UINT DeviceId )
   RndPtr->InitRender(DeviceId, RndMode == MODE::VULKAN_ONE_SEED);
 }
 
+/**
+  * \brief Setup progressive rendering parameters function (both renders use them)
+  * \param[in] Par Progressive rendering parameters
+  */
+VOID render::SetProgressiveParams( const PROGRESSIVE_PARAMS &Par )
+{
+  RndCPU.SetProgressiveParams(Par);
+  RndVulkan.SetProgressiveParams(Par);
+}
+
+/**
+  * \brief Setup frame time budget function (both renders use it)
+  * \param[in] Seconds Frame time budget in seconds (0 - number of samples is fixed)
+  */
+VOID render::SetTimeBudget( const FLT Seconds )
+{
+  RndCPU.SetTimeBudget(Seconds);
+  RndVulkan.SetTimeBudget(Seconds);
+}
+
+/**
+  * \brief Setup adaptive sampling parameters function (both renders use them)
+  * \param[in] Par Adaptive sampling parameters
+  */
+VOID render::SetAdaptiveParams( const ADAPTIVE_PARAMS &Par )
+{
+  RndCPU.SetAdaptiveParams(Par);
+  RndVulkan.SetAdaptiveParams(Par);
+}
+
+/**
+  * \brief Setup linear output function (both renders use it)
+  * \param[in] Enable Linear output flag (frame keeps averaged samples without HDR correction)
+  */
+VOID render::SetLinearOutput( const BOOL Enable )
+{
+  RndCPU.SetLinearOutput(Enable);
+  RndVulkan.SetLinearOutput(Enable);
+}
+
+/**
+  * \brief Setup post-processing on device function (Vulkan render only)
+  * \param[in] Enable Post-processing on device flag (TRUE - frame is kept as 8-bit colors of render,
+  *                   FALSE - float image is read back and processed by CPU)
+  */
+VOID render::SetDevicePostProcessing( const BOOL Enable )
+{
+  RndVulkan.SetDevicePostProcessing(Enable);
+}
+
 /**
   * \brief Make one frame function
   * \param[in, out] Img Image for render
@@ -42,7 +92,7 @@ VOID render::SetRenderMode( MODE RndMode, UINT DeviceId )
   * \param[in] Scene Scene for render
   * \param[in] W Image width
   * \param[in] H Image heigth
-  * \param[in] NumOfSamples Number of samples
+  * \param[in] NumOfSamples Number of samples (ignored if time budget is set)
   */
 VOID render::MakeFrame( image *Img, const cam &Camera, scene &Scn, const INT W, const INT H,
                         const INT NumOfSamples ) const
@@ -58,3 +108,19 @@ VOID render::MakeFrame( image *Img, const cam &Camera, scene &Scn, const INT W,
   std::cout << "Total elapsed time: " << std::to_string((clock() - TotalTimeStart) /
     (DBL)CLOCKS_PER_SEC) << "\n\n";
 }
+
+/**
+  * \brief Save last frame function (8-bit colors of render are saved if frame was post-processed on device)
+  * \param[in] Img Image of frame
+  * \param[in] FileName Name of file
+  * \param[in] Format File format
+  */
+VOID render::SaveFrame( const image &Img, const std::string &FileName, image::FORMAT Format ) const
+{
+  const std::vector<DWORD> &Colors = RndPtr->GetColors();
+
+  if (Colors.empty())
+    Img.Save(FileName, Format);
+  else
+    image::SaveQuantized(FileName, Format, Colors.data(), Img.FrameW, Img.FrameH);
+}
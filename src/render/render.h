@@ -48,6 +48,37 @@ public:
    */
   VOID SetRenderMode( MODE RndMode, UINT DeviceId = 0 );
   
+  /**
+   * \brief Setup progressive rendering parameters function (both renders use them)
+   * \param[in] Par Progressive rendering parameters
+   */
+  VOID SetProgressiveParams( const PROGRESSIVE_PARAMS &Par );
+
+  /**
+   * \brief Setup frame time budget function (both renders use it)
+   * \param[in] Seconds Frame time budget in seconds (0 - number of samples is fixed)
+   */
+  VOID SetTimeBudget( const FLT Seconds );
+
+  /**
+   * \brief Setup adaptive sampling parameters function (both renders use them)
+   * \param[in] Par Adaptive sampling parameters
+   */
+  VOID SetAdaptiveParams( const ADAPTIVE_PARAMS &Par );
+
+  /**
+   * \brief Setup linear output function (both renders use it)
+   * \param[in] Enable Linear output flag (frame keeps averaged samples without HDR correction)
+   */
+  VOID SetLinearOutput( const BOOL Enable );
+
+  /**
+   * \brief Setup post-processing on device function (Vulkan render only)
+   * \param[in] Enable Post-processing on device flag (TRUE - frame is kept as 8-bit colors of render,
+   *                   FALSE - float image is read back and processed by CPU)
+   */
+  VOID SetDevicePostProcessing( const BOOL Enable );
+
   /**
    * \brief Make one frame function
    * \param[in, out] Img Image for render
@@ -55,10 +86,18 @@ public:
    * \param[in] Scene Scene for render
    * \param[in] W Image width
    * \param[in] H Image heigth
-   * \param[in] NumOfSamples Number of samples
+   * \param[in] NumOfSamples Number of samples (ignored if time budget is set)
    */
   VOID MakeFrame( image *Img, const cam &Camera, scene &Scn, const INT W, const INT H,
                   const INT NumOfSamples = 100 ) const;
+
+  /**
+   * \brief Save last frame function (8-bit colors of render are saved if frame was post-processed on device)
+   * \param[in] Img Image of frame
+   * \param[in] FileName Name of file
+   * \param[in] Format File format
+   */
+  VOID SaveFrame( const image &Img, const std::string &FileName, image::FORMAT Format ) const;
 };
 
 #endif /* __render_h_ */
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cmath>
+
+#include "time_budget.h"
+
+/**
+ * \brief Time budget constructor (frame time is counted from construction)
+ * \param[in] Seconds Frame time budget in seconds (0 - budget is not used)
+ * \param[in] PrevFinalizeTime Time of finalization of previous frame in seconds (0 - unknown)
+ */
+time_budget::time_budget( const FLT Seconds, const DBL PrevFinalizeTime ) :
+  Budget(Seconds), FinalizeTime(std::max<DBL>(PrevFinalizeTime, Seconds * FinalizeReserve)),
+  FrameStart(std::chrono::steady_clock::now())
+{
+  SamplingStart = FrameStart;
+}
+
+/**
+ * \brief Check if budget is used function
+ * \return TRUE-if number of samples is defined by budget, FALSE-otherwise
+ */
+BOOL time_budget::IsEnabled( VOID ) const
+{
+  return Budget > 0;
+}
+
+/**
+ * \brief Start sampling function (time before is spent on frame setup and isn't used for prediction)
+ * \param[in] SamplesDone Number of already accumulated samples
+ */
+VOID time_budget::StartSampling( const INT SamplesDone )
+{
+  SamplingStart = std::chrono::steady_clock::now();
+  FirstSample = SamplesDone;
+}
+
+/**
+ * \brief Get number of samples of frame function
+ * \param[in] SamplesDone Number of accumulated samples
+ * \param[in] NumberOfSamples Number of samples requested for frame (used if budget is not used)
+ * \return Number of samples of frame (equals SamplesDone if next sample doesn't fit in budget)
+ */
+INT time_budget::GetNumberOfSamples( const INT SamplesDone, const INT NumberOfSamples ) const
+{
+  if (Budget <= 0)
+    return NumberOfSamples;
+
+  const INT Measured = SamplesDone - FirstSample;
+
+  // Cost of sample is unknown until first one is rendered (and frame always has at least one sample)
+  if (Measured == 0)
+    return SamplesDone + 1;
+
+  const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+  const DBL SampleTime = std::chrono::duration<DBL>(Now - SamplingStart).count() / Measured;
+  const DBL RestTime = Budget - FinalizeTime - std::chrono::duration<DBL>(Now - FrameStart).count();
+
+  if (RestTime < SampleTime)
+    return SamplesDone;
+
+  // Prediction is trusted for at most as many samples as were measured, so it is refined while time goes
+  const DBL Fit = std::floor(RestTime / SampleTime);
+
+  return SamplesDone + (INT)std::min<DBL>(Fit, Measured);
+}
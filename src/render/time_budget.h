@@ -0,0 +1,61 @@
+#ifndef __time_budget_h_
+#define __time_budget_h_
+
+#include <chrono>
+
+#include "def.h"
+
+/**
+ * \brief Frame time budget (number of samples is predicted from measured time of rendered samples)
+ */
+class time_budget
+{
+private:
+  /** Minimal part of budget kept for HDR correction and image saving */
+  static constexpr FLT FinalizeReserve = 0.05f;
+
+  /** Frame time budget in seconds (0 - budget is not used) */
+  FLT Budget;
+
+  /** Predicted time of frame finalization in seconds */
+  DBL FinalizeTime;
+
+  /** Frame start time */
+  std::chrono::steady_clock::time_point FrameStart;
+
+  /** Sampling start time */
+  std::chrono::steady_clock::time_point SamplingStart;
+
+  /** Number of samples at sampling start (resumed samples are not measured) */
+  INT FirstSample = 0;
+
+public:
+  /**
+   * \brief Time budget constructor (frame time is counted from construction)
+   * \param[in] Seconds Frame time budget in seconds (0 - budget is not used)
+   * \param[in] PrevFinalizeTime Time of finalization of previous frame in seconds (0 - unknown)
+   */
+  time_budget( const FLT Seconds, const DBL PrevFinalizeTime );
+
+  /**
+   * \brief Check if budget is used function
+   * \return TRUE-if number of samples is defined by budget, FALSE-otherwise
+   */
+  BOOL IsEnabled( VOID ) const;
+
+  /**
+   * \brief Start sampling function (time before is spent on frame setup and isn't used for prediction)
+   * \param[in] SamplesDone Number of already accumulated samples
+   */
+  VOID StartSampling( const INT SamplesDone );
+
+  /**
+   * \brief Get number of samples of frame function
+   * \param[in] SamplesDone Number of accumulated samples
+   * \param[in] NumberOfSamples Number of samples requested for frame (used if budget is not used)
+   * \return Number of samples of frame (equals SamplesDone if next sample doesn't fit in budget)
+   */
+  INT GetNumberOfSamples( const INT SamplesDone, const INT NumberOfSamples ) const;
+};
+
+#endif /* __time_budget_h_ */
@@ -2,6 +2,7 @@
 #include <cstdio>
 #include <ctime>
 #include <cstring>
+#include <algorithm>
 
 #include "vulkan_render.h"
 #include "utils/error.h"
@@ -17,6 +18,19 @@
  */
 vulkan_render::vulkan_render( UINT DeviceId )
 {
+  HDR.SetBrighnesLimit(1.5);
+  HDR.SetExposure(2);
+  HDR.SetNumberOfBloomIterations(100);
+}
+
+/**
+ * \brief Setup post-processing on device function
+ * \param[in] Enable Post-processing on device flag (TRUE - only 8-bit colors are read back to render colors,
+ *                   FALSE - float image is read back and processed by CPU)
+ */
+VOID vulkan_render::SetDevicePostProcessing( BOOL Enable )
+{
+  DevicePostProcessing = Enable;
 }
 
 /**
@@ -24,7 +38,7 @@ vulkan_render::vulkan_render( UINT DeviceId )
  */
 VOID vulkan_render::CreatePipelineLayout( VOID )
 {
-  VkDescriptorSetLayoutBinding SceneDescriptionLayoutBindings[6] = {};
+  VkDescriptorSetLayoutBinding SceneDescriptionLayoutBindings[7] = {};
 
   SceneDescriptionLayoutBindings[0].binding = 0;
   SceneDescriptionLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -62,10 +76,16 @@ VOID vulkan_render::CreatePipelineLayout( VOID )
   SceneDescriptionLayoutBindings[5].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
   SceneDescriptionLayoutBindings[5].pImmutableSamplers = nullptr;
 
+  SceneDescriptionLayoutBindings[6].binding = 6;
+  SceneDescriptionLayoutBindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  SceneDescriptionLayoutBindings[6].descriptorCount = 1;
+  SceneDescriptionLayoutBindings[6].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  SceneDescriptionLayoutBindings[6].pImmutableSamplers = nullptr;
+
   RenderSceneDescriptionSetLayout =
-    descriptor_set_layout(VkApp.GetDeviceId(), 6, SceneDescriptionLayoutBindings );
+    descriptor_set_layout(VkApp.GetDeviceId(), 7, SceneDescriptionLayoutBindings );
 
-  VkDescriptorSetLayoutBinding ImageLayoutBindings[1] = {};
+  VkDescriptorSetLayoutBinding ImageLayoutBindings[3] = {};
 
   ImageLayoutBindings[0].binding = 0;
   ImageLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
@@ -73,8 +93,20 @@ VOID vulkan_render::CreatePipelineLayout( VOID )
   ImageLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
   ImageLayoutBindings[0].pImmutableSamplers = nullptr;
 
+  ImageLayoutBindings[1].binding = 1;
+  ImageLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  ImageLayoutBindings[1].descriptorCount = 1;
+  ImageLayoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  ImageLayoutBindings[1].pImmutableSamplers = nullptr;
+
+  ImageLayoutBindings[2].binding = 2;
+  ImageLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  ImageLayoutBindings[2].descriptorCount = 1;
+  ImageLayoutBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  ImageLayoutBindings[2].pImmutableSamplers = nullptr;
+
   ImageSetLayout =
-    descriptor_set_layout(VkApp.GetDeviceId(), 1, ImageLayoutBindings);
+    descriptor_set_layout(VkApp.GetDeviceId(), 3, ImageLayoutBindings);
 
   VkDescriptorSetLayout VulkanDescriptorSetLayoutsId[2] =
   {
@@ -105,6 +137,95 @@ VOID vulkan_render::CreateRenderPipeline( VOID )
                      RenderShader, "main", EmptyCache);
 }
 
+/**
+ * \brief Check that shader blocks layouts match host structures function (outdated shader binaries are rejected)
+ * \param[in] Shader Shader module
+ * \param[in] Name Shader name for error message
+ * \param[in] Expected Expected blocks layouts
+ */
+VOID vulkan_render::CheckShaderLayout( const shader_module &Shader, const std::string &Name,
+                                       const std::vector<shader_module::BLOCK_LAYOUT> &Expected )
+{
+  const std::vector<shader_module::BLOCK_LAYOUT> &Blocks = Shader.GetBlocks();
+
+  for (const shader_module::BLOCK_LAYOUT &Layout : Expected)
+  {
+    std::vector<shader_module::BLOCK_LAYOUT>::const_iterator Block =
+      std::find_if(Blocks.cbegin(), Blocks.cend(), [&]( const shader_module::BLOCK_LAYOUT &B )
+        {
+          return B.Set == Layout.Set && B.Binding == Layout.Binding;
+        });
+
+    if (Block == Blocks.cend() || Block->MemberOffsets != Layout.MemberOffsets ||
+        Block->ArrayStride != Layout.ArrayStride)
+      error("Shader " + Name + " doesn't match render structures (shader binary is outdated, rebuild shaders)");
+  }
+}
+
+/**
+ * \brief Get bloom pyramid level size function (image size is halved with rounding up for every level)
+ * \param[in] Size Image width or height
+ * \param[in] Level Level (level 0 is temporary buffer of level 1 size)
+ * \return Level width or height
+ */
+UINT32 vulkan_render::GetBloomLevelSize( INT Size, INT Level )
+{
+  return ((Size - 1) >> std::max(Level, 1)) + 1;
+}
+
+/**
+ * \brief Create post-processing pipeline and allocate its descriptor set function (if they are not created yet)
+ */
+VOID vulkan_render::CreateHDRPipeline( VOID )
+{
+  if (HDRSet != VK_NULL_HANDLE)
+    return;
+
+  HDRShader = shader_module(VkApp.GetDeviceId(), "shaders-build/hdr.comp.spv");
+
+  VkDescriptorSetLayoutBinding HDRLayoutBindings[3] = {};
+
+  HDRLayoutBindings[0].binding = 0;
+  HDRLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  HDRLayoutBindings[0].descriptorCount = 1;
+  HDRLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  HDRLayoutBindings[0].pImmutableSamplers = nullptr;
+
+  HDRLayoutBindings[1].binding = 1;
+  HDRLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  HDRLayoutBindings[1].descriptorCount = 1;
+  HDRLayoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  HDRLayoutBindings[1].pImmutableSamplers = nullptr;
+
+  HDRLayoutBindings[2].binding = 2;
+  HDRLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  HDRLayoutBindings[2].descriptorCount = 1;
+  HDRLayoutBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  HDRLayoutBindings[2].pImmutableSamplers = nullptr;
+
+  HDRSetLayout =
+    descriptor_set_layout(VkApp.GetDeviceId(), 3, HDRLayoutBindings);
+
+  VkDescriptorSetLayout VulkanDescriptorSetLayoutId = HDRSetLayout.GetSetLayoutId();
+  VkPushConstantRange PushConstantRange = {};
+
+  PushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  PushConstantRange.offset = 0;
+  PushConstantRange.size = sizeof(HDR_PUSH_CONSTANTS);
+
+  HDRPipelineLayout =
+    pipeline_layout(VkApp.GetDeviceId(), 1, &VulkanDescriptorSetLayoutId,
+                    1, &PushConstantRange);
+
+  pipeline_cache EmptyCache(VkApp.GetDeviceId());
+
+  HDRPipeline =
+    compute_pipeline(VkApp.GetDeviceId(), HDRPipelineLayout.GetPipelineLayoutId(),
+                     HDRShader, "main", EmptyCache);
+
+  DescriptorPool.AllocateSets(&HDRSet, 1, &VulkanDescriptorSetLayoutId);
+}
+
 /**
  * \brief Create descriptor pool and allocate descriptor sets function.
  */
@@ -113,13 +234,16 @@ VOID vulkan_render::CreateDescriptorPoolAndAllocateSets( VOID )
   VkDescriptorPoolSize DescriptorPoolSizes[2];
 
   DescriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-  DescriptorPoolSizes[0].descriptorCount = 6;
+  DescriptorPoolSizes[0].descriptorCount = 12;
 
   DescriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
   DescriptorPoolSizes[1].descriptorCount = 1;
 
   DescriptorPool =
-    descriptor_pool(VkApp.GetDeviceId(), 0, 2, 2, DescriptorPoolSizes);
+    descriptor_pool(VkApp.GetDeviceId(), 0, 3, 2, DescriptorPoolSizes);
+
+  // Post-processing set is allocated when its pipeline is created (old one is freed with old pool)
+  HDRSet = VK_NULL_HANDLE;
 
   VkDescriptorSetLayout DescriptorSetsLayout[2] =
   {
@@ -140,8 +264,8 @@ VOID vulkan_render::CreateDescriptorPoolAndAllocateSets( VOID )
  */
 VOID vulkan_render::WriteDescriptorSets( VOID )
 {
-  VkWriteDescriptorSet WriteDescriptorSetStructures[7] = {};
-  VkDescriptorBufferInfo BufferInfoArray[7] = {};
+  VkWriteDescriptorSet WriteDescriptorSetStructures[13] = {};
+  VkDescriptorBufferInfo BufferInfoArray[13] = {};
 
   BufferInfoArray[0].buffer = DeviceUniformBuffer.GetBufferId();
   BufferInfoArray[0].offset = ShaderArgumentsOffset;
@@ -248,7 +372,99 @@ VOID vulkan_render::WriteDescriptorSets( VOID )
   WriteDescriptorSetStructures[6].pBufferInfo = &BufferInfoArray[6];
   WriteDescriptorSetStructures[6].pTexelBufferView = nullptr;
 
-  vkUpdateDescriptorSets(VkApp.GetDeviceId(), 7, WriteDescriptorSetStructures, 0, nullptr);
+  BufferInfoArray[7].buffer = DeviceStorageBuffer.GetBufferId();
+  BufferInfoArray[7].offset = LightsOffset;
+  BufferInfoArray[7].range = LightsSize;
+
+  WriteDescriptorSetStructures[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  WriteDescriptorSetStructures[7].pNext = nullptr;
+  WriteDescriptorSetStructures[7].dstSet = RenderSceneDescriptionSet;
+  WriteDescriptorSetStructures[7].dstBinding = 6;
+  WriteDescriptorSetStructures[7].dstArrayElement = 0;
+  WriteDescriptorSetStructures[7].descriptorCount = 1;
+  WriteDescriptorSetStructures[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  WriteDescriptorSetStructures[7].pImageInfo = nullptr;
+  WriteDescriptorSetStructures[7].pBufferInfo = &BufferInfoArray[7];
+  WriteDescriptorSetStructures[7].pTexelBufferView = nullptr;
+
+  BufferInfoArray[8].buffer = DeviceStorageBuffer.GetBufferId();
+  BufferInfoArray[8].offset = PixelStatsOffset;
+  BufferInfoArray[8].range = PixelStatsSize;
+
+  WriteDescriptorSetStructures[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  WriteDescriptorSetStructures[8].pNext = nullptr;
+  WriteDescriptorSetStructures[8].dstSet = ImageSet;
+  WriteDescriptorSetStructures[8].dstBinding = 1;
+  WriteDescriptorSetStructures[8].dstArrayElement = 0;
+  WriteDescriptorSetStructures[8].descriptorCount = 1;
+  WriteDescriptorSetStructures[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  WriteDescriptorSetStructures[8].pImageInfo = nullptr;
+  WriteDescriptorSetStructures[8].pBufferInfo = &BufferInfoArray[8];
+  WriteDescriptorSetStructures[8].pTexelBufferView = nullptr;
+
+  BufferInfoArray[9].buffer = DeviceStorageBuffer.GetBufferId();
+  BufferInfoArray[9].offset = TilesMaskOffset;
+  BufferInfoArray[9].range = TilesMaskSize;
+
+  WriteDescriptorSetStructures[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  WriteDescriptorSetStructures[9].pNext = nullptr;
+  WriteDescriptorSetStructures[9].dstSet = ImageSet;
+  WriteDescriptorSetStructures[9].dstBinding = 2;
+  WriteDescriptorSetStructures[9].dstArrayElement = 0;
+  WriteDescriptorSetStructures[9].descriptorCount = 1;
+  WriteDescriptorSetStructures[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  WriteDescriptorSetStructures[9].pImageInfo = nullptr;
+  WriteDescriptorSetStructures[9].pBufferInfo = &BufferInfoArray[9];
+  WriteDescriptorSetStructures[9].pTexelBufferView = nullptr;
+
+  BufferInfoArray[10].buffer = DeviceStorageBuffer.GetBufferId();
+  BufferInfoArray[10].offset = ImageOffset;
+  BufferInfoArray[10].range = ImageSize;
+
+  WriteDescriptorSetStructures[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  WriteDescriptorSetStructures[10].pNext = nullptr;
+  WriteDescriptorSetStructures[10].dstSet = HDRSet;
+  WriteDescriptorSetStructures[10].dstBinding = 0;
+  WriteDescriptorSetStructures[10].dstArrayElement = 0;
+  WriteDescriptorSetStructures[10].descriptorCount = 1;
+  WriteDescriptorSetStructures[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  WriteDescriptorSetStructures[10].pImageInfo = nullptr;
+  WriteDescriptorSetStructures[10].pBufferInfo = &BufferInfoArray[10];
+  WriteDescriptorSetStructures[10].pTexelBufferView = nullptr;
+
+  BufferInfoArray[11].buffer = DeviceStorageBuffer.GetBufferId();
+  BufferInfoArray[11].offset = BloomLevelsOffset;
+  BufferInfoArray[11].range = BloomLevelsSize;
+
+  WriteDescriptorSetStructures[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  WriteDescriptorSetStructures[11].pNext = nullptr;
+  WriteDescriptorSetStructures[11].dstSet = HDRSet;
+  WriteDescriptorSetStructures[11].dstBinding = 1;
+  WriteDescriptorSetStructures[11].dstArrayElement = 0;
+  WriteDescriptorSetStructures[11].descriptorCount = 1;
+  WriteDescriptorSetStructures[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  WriteDescriptorSetStructures[11].pImageInfo = nullptr;
+  WriteDescriptorSetStructures[11].pBufferInfo = &BufferInfoArray[11];
+  WriteDescriptorSetStructures[11].pTexelBufferView = nullptr;
+
+  BufferInfoArray[12].buffer = DeviceStorageBuffer.GetBufferId();
+  BufferInfoArray[12].offset = ColorsOffset;
+  BufferInfoArray[12].range = ColorsSize;
+
+  WriteDescriptorSetStructures[12].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  WriteDescriptorSetStructures[12].pNext = nullptr;
+  WriteDescriptorSetStructures[12].dstSet = HDRSet;
+  WriteDescriptorSetStructures[12].dstBinding = 2;
+  WriteDescriptorSetStructures[12].dstArrayElement = 0;
+  WriteDescriptorSetStructures[12].descriptorCount = 1;
+  WriteDescriptorSetStructures[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  WriteDescriptorSetStructures[12].pImageInfo = nullptr;
+  WriteDescriptorSetStructures[12].pBufferInfo = &BufferInfoArray[12];
+  WriteDescriptorSetStructures[12].pTexelBufferView = nullptr;
+
+  // Post-processing set is written last, it exists only if post-processing is done on device
+  vkUpdateDescriptorSets(VkApp.GetDeviceId(), HDRSet != VK_NULL_HANDLE ? 13 : 10, WriteDescriptorSetStructures, 0,
+                         nullptr);
 }
 
 /**
@@ -432,11 +648,49 @@ VOID vulkan_render::EvaluateOffsetsAndSizes( INT W, INT H, const cam &Camera, co
 
   Offset += Sizes.NodesSizeAlignment;
 
+  // Descriptor range can't be empty, so there is at least one light in buffer
+  LightsOffset = Offset;
+  LightsSize = std::max<UINT64>(Scene.GetLights().GetLights().size(), 1) * sizeof(LIGHT);
+
+  Offset += DataAlignment * ((LightsSize + DataAlignment - 1) / DataAlignment);
+
   ImageOffset = Offset;
   ImageSize = W * H * sizeof(vec);
 
   Offset += DataAlignment * ((ImageSize + DataAlignment - 1) / DataAlignment);
 
+  // Statistics follow image, so one barrier covers all data written by render shader
+  PixelStatsOffset = Offset;
+  PixelStatsSize = W * H * sizeof(adaptive_sampling::PIXEL_STATS);
+
+  Offset += DataAlignment * ((PixelStatsSize + DataAlignment - 1) / DataAlignment);
+
+  TilesMaskOffset = Offset;
+  TilesMaskSize = ((W + WorkGroupSize - 1) / WorkGroupSize) * ((H + WorkGroupSize - 1) / WorkGroupSize) * sizeof(UINT32);
+
+  Offset += DataAlignment * ((TilesMaskSize + DataAlignment - 1) / DataAlignment);
+
+  // Levels are halved with rounding up as in cpu_hdr, temporary buffer of blur has level 1 size
+  const cpu_hdr::BLOOM_SCHEDULE Schedule = HDR.GetBloomSchedule();
+  UINT32 NumberOfLevelsPixels = 0;
+
+  BloomLevelOffsets.resize(Schedule.LastLevel + 1);
+  for (INT Level = 0; Level <= Schedule.LastLevel; Level++)
+  {
+    BloomLevelOffsets[Level] = NumberOfLevelsPixels;
+    NumberOfLevelsPixels += GetBloomLevelSize(W, Level) * GetBloomLevelSize(H, Level);
+  }
+
+  BloomLevelsOffset = Offset;
+  BloomLevelsSize = NumberOfLevelsPixels * sizeof(vec);
+
+  Offset += DataAlignment * ((BloomLevelsSize + DataAlignment - 1) / DataAlignment);
+
+  ColorsOffset = Offset;
+  ColorsSize = W * H * sizeof(UINT32);
+
+  Offset += DataAlignment * ((ColorsSize + DataAlignment - 1) / DataAlignment);
+
   StorageBufferSize = Offset;
 }
 
@@ -537,8 +791,10 @@ VOID vulkan_render::CreateBuffersAndAllocateMemory( INT W, INT H, const cam &Cam
  * \param[in] Camera Camera for render
  * \param[in] Scene Scene for render
  * \param[in] Tree Scene Kd-tree
+ * \param[in] Sum Initial accumulation buffer (sum of already rendered samples)
  */
-VOID vulkan_render::CopyParametersToGPUMemory( INT W, INT H, const cam &Camera, const scene &Scene, const kd_tree &Tree )
+VOID vulkan_render::CopyParametersToGPUMemory( INT W, INT H, const cam &Camera, const scene &Scene, const kd_tree &Tree,
+                                               const image &Sum )
 {
   BYTE *Data;
   memory *CurMemory = &DeviceUniformMemory;
@@ -553,6 +809,8 @@ VOID vulkan_render::CopyParametersToGPUMemory( INT W, INT H, const cam &Camera,
   reinterpret_cast<SCENE_DATA *>(Data)->Par = Scene.RenderPar;
   reinterpret_cast<SCENE_DATA *>(Data)->Height = H;
   reinterpret_cast<SCENE_DATA *>(Data)->Width = W;
+  reinterpret_cast<SCENE_DATA *>(Data)->NumOfLights = Scene.GetLights().GetLights().size();
+  reinterpret_cast<SCENE_DATA *>(Data)->LightsArea = Scene.GetLights().GetArea();
 
   if ((VkApp.DeviceMemoryProperties.memoryTypes[CurMemory->MemoryType].propertyFlags &
        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
@@ -615,9 +873,23 @@ VOID vulkan_render::CopyParametersToGPUMemory( INT W, INT H, const cam &Camera,
   for (INT i = 0; i < W * H; i++)
     reinterpret_cast<UINT *>(Data + RandomNumbersOffset)[i] = rand();
 
-  memset(Data + ImageOffset, 0, ImageSize);
-    
+  // Fourth component of pixel counts samples in its statistics, resumed samples have no statistics
+  for (INT y = 0; y < H; y++)
+    for (INT x = 0; x < W; x++)
+    {
+      const image_vec &Pixel = Sum.GetPixel(x, y);
+      vec &Dst = reinterpret_cast<vec *>(Data + ImageOffset)[W * y + x];
+
+      Dst = vec(Pixel.R, Pixel.G, Pixel.B);
+      Dst._Padding[0] = 0;
+    }
+  memset(Data + PixelStatsOffset, 0, PixelStatsSize);
+  std::fill_n(reinterpret_cast<UINT32 *>(Data + TilesMaskOffset), TilesMaskSize / sizeof(UINT32), 1);
+
   Tree.FillSceneData(Data + MaterialsOffset, DataAlignment);
+  memset(Data + LightsOffset, 0, LightsSize);
+  memcpy(Data + LightsOffset, Scene.GetLights().GetLights().data(),
+         Scene.GetLights().GetLights().size() * sizeof(LIGHT));
 
   if ((VkApp.DeviceMemoryProperties.memoryTypes[CurMemory->MemoryType].propertyFlags &
        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
@@ -695,9 +967,6 @@ VOID vulkan_render::CopyParametersToGPUMemory( INT W, INT H, const cam &Camera,
  */
 VOID vulkan_render::ProcessHDR( image * Im )
 {
-  HDR.SetBrighnesLimit(1.5);
-  HDR.SetExposure(2);
-  HDR.SetNumberOfBloomIterations(100);
   HDR.Process(Im);
 }
 
@@ -706,8 +975,10 @@ VOID vulkan_render::ProcessHDR( image * Im )
  * \param[in] W Image width
  * \param[in] H Image height
  * \param[in] NumberOfSamples Number of samples
+ * \param[in] WaitParameters Wait for copy of parameters to GPU memory flag (only first run after copy waits)
+ * \param[in] PostProcess Post-process image after samples in same command buffer flag
  */
-VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
+VOID vulkan_render::RunRenderShader( INT W, INT H, INT NumberOfSamples, BOOL WaitParameters, BOOL PostProcess )
 {
   std::uniform_int_distribution<UINT32> Distr;
   INT64 t = clock();
@@ -719,7 +990,7 @@ VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
 
   FirstCommandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-  if (NeedCopyStorage || NeedCopyUniform)
+  if (WaitParameters && (NeedCopyStorage || NeedCopyUniform))
   {
     std::vector<VkBufferMemoryBarrier> BarriersArray;
 
@@ -781,7 +1052,7 @@ VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
                          BarriersArray.size(), BarriersArray.data(),
                          0, nullptr);
   }
-  if (!NeedCopyStorage || !NeedCopyUniform)
+  if (WaitParameters && (!NeedCopyStorage || !NeedCopyUniform))
   {
     std::vector<VkBufferMemoryBarrier> BarriersArray;
 
@@ -825,6 +1096,45 @@ VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
                          0, nullptr);
   }
 
+  VkBufferMemoryBarrier MiddleBufferBarrier = {};
+
+  MiddleBufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  MiddleBufferBarrier.pNext = nullptr;
+  MiddleBufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  MiddleBufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  MiddleBufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  MiddleBufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  MiddleBufferBarrier.buffer = DeviceStorageBuffer.GetBufferId();
+  MiddleBufferBarrier.offset = ImageOffset;
+  MiddleBufferBarrier.size = PixelStatsOffset + PixelStatsSize - ImageOffset;
+
+  // Previous pass wrote accumulation buffer in other submission, active tiles mask is updated between passes
+  if (!WaitParameters)
+  {
+    vkCmdPipelineBarrier(VulkanCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr,
+                         1, &MiddleBufferBarrier,
+                         0, nullptr);
+
+    VkBufferMemoryBarrier MaskBufferBarrier = {};
+
+    MaskBufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    MaskBufferBarrier.pNext = nullptr;
+    MaskBufferBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    MaskBufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    MaskBufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    MaskBufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    MaskBufferBarrier.buffer = DeviceStorageBuffer.GetBufferId();
+    MaskBufferBarrier.offset = TilesMaskOffset;
+    MaskBufferBarrier.size = TilesMaskSize;
+
+    vkCmdPipelineBarrier(VulkanCommandBuffer, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr,
+                         1, &MaskBufferBarrier,
+                         0, nullptr);
+  }
+
   FirstCommandBuffer.CmdBindComputePipeline(RenderPipeline);
 
   VkDescriptorSet VulkanDescriptorSets[2] =
@@ -847,22 +1157,11 @@ VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
                        sizeof(UINT32) * 2, Seeds);
   }
 
-  vkCmdDispatch(VulkanCommandBuffer, (W + 8 - 1) / 8, (H + 8 - 1) / 8, 1);
+  vkCmdDispatch(VulkanCommandBuffer, (W + WorkGroupSize - 1) / WorkGroupSize, (H + WorkGroupSize - 1) / WorkGroupSize,
+                1);
 
   std::cout << (clock() - t) / (DBL)CLOCKS_PER_SEC << " before cycle\n";
 
-  VkBufferMemoryBarrier MiddleBufferBarrier = {};
-
-  MiddleBufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-  MiddleBufferBarrier.pNext = nullptr;
-  MiddleBufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-  MiddleBufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  MiddleBufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  MiddleBufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  MiddleBufferBarrier.buffer = DeviceStorageBuffer.GetBufferId();
-  MiddleBufferBarrier.offset = ImageOffset;
-  MiddleBufferBarrier.size = ImageSize;
-
   for (INT i = 0; i < NumberOfSamples - 1; i++)
   {
 
@@ -885,9 +1184,13 @@ VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
     vkCmdPushConstants(VulkanCommandBuffer, RenderPipelineLayout.GetPipelineLayoutId(),
                        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UINT32) * 2, Seeds);
 
-    vkCmdDispatch(VulkanCommandBuffer, (W + 8 - 1) / 8, (H + 8 - 1) / 8, 1);
+    vkCmdDispatch(VulkanCommandBuffer, (W + WorkGroupSize - 1) / WorkGroupSize, (H + WorkGroupSize - 1) / WorkGroupSize,
+                  1);
   }
 
+  if (PostProcess)
+    RecordHDRShader(VulkanCommandBuffer, W, H);
+
   std::cout << (clock() - t) / (DBL)CLOCKS_PER_SEC << " before end\n";
 
   FirstCommandBuffer.End();
@@ -905,7 +1208,7 @@ VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
   SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   SubmitInfo.pNext = nullptr;
 
-  if (NeedCopyUniform || NeedCopyStorage)
+  if (WaitParameters && (NeedCopyUniform || NeedCopyStorage))
   {
     SubmitInfo.waitSemaphoreCount = 1;
     SubmitInfo.pWaitSemaphores = &VulkanSemaphore;
@@ -936,10 +1239,207 @@ VOID vulkan_render::RunRenderShader(  INT W, INT H, INT NumberOfSamples )
 }
 
 /**
- * \brief Copy image back  to CPU
- * \param Im Destination image
+ * \brief Record post-processing passes function (accumulation buffer is turned to tone mapped colors)
+ * \param[in] VulkanCommandBuffer Command buffer
+ * \param[in] W Image width
+ * \param[in] H Image height
  */
-VOID vulkan_render::CopyImageToCPU( image *Im ) const
+VOID vulkan_render::RecordHDRShader( VkCommandBuffer VulkanCommandBuffer, INT W, INT H ) const
+{
+  VkBufferMemoryBarrier ImageBarrier = {};
+
+  ImageBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  ImageBarrier.pNext = nullptr;
+  ImageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  ImageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  ImageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  ImageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  ImageBarrier.buffer = DeviceStorageBuffer.GetBufferId();
+  ImageBarrier.offset = ImageOffset;
+  ImageBarrier.size = ImageSize;
+
+  vkCmdPipelineBarrier(VulkanCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 0, nullptr,
+                       1, &ImageBarrier,
+                       0, nullptr);
+
+  command_buffer(VulkanCommandBuffer).CmdBindComputePipeline(HDRPipeline);
+
+  vkCmdBindDescriptorSets(VulkanCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          HDRPipelineLayout.GetPipelineLayoutId(), 0, 1, &HDRSet, 0, nullptr);
+
+  // Passes are same as cpu_hdr ones, level 0 stands for temporary buffer of blur
+  const cpu_hdr::BLOOM_SCHEDULE Schedule = HDR.GetBloomSchedule();
+  HDR_PUSH_CONSTANTS Constants = {};
+
+  Constants.ResumedSamples = static_cast<FLT>(ResumedSamples);
+  Constants.BrighnessLimit = HDR.GetBrighnesLimit();
+  Constants.Exposure = HDR.GetExposure();
+
+  auto SetSource = [&]( const INT Level )
+    {
+      Constants.SrcOffset = BloomLevelOffsets[Level];
+      Constants.SrcWidth = GetBloomLevelSize(W, Level);
+      Constants.SrcHeight = GetBloomLevelSize(H, Level);
+    };
+  auto SetDestination = [&]( const INT Level )
+    {
+      Constants.DstOffset = BloomLevelOffsets[Level];
+      Constants.DstWidth = GetBloomLevelSize(W, Level);
+      Constants.DstHeight = GetBloomLevelSize(H, Level);
+    };
+  auto Blur = [&]( const INT Level )
+    {
+      Constants.Pass = HDR_PASS::BLUR_HORIZONTAL;
+      SetSource(Level);
+      SetDestination(0);
+      RecordHDRPass(VulkanCommandBuffer, Constants);
+      Constants.Pass = HDR_PASS::BLUR_VERTICAL;
+      SetSource(0);
+      SetDestination(Level);
+      RecordHDRPass(VulkanCommandBuffer, Constants);
+    };
+
+  if (Schedule.LastLevel > 0)
+  {
+    Constants.Pass = HDR_PASS::THRESHOLD;
+    Constants.SrcOffset = 0;
+    Constants.SrcWidth = W;
+    Constants.SrcHeight = H;
+    SetDestination(1);
+    RecordHDRPass(VulkanCommandBuffer, Constants);
+
+    for (INT Level = 1; Level < Schedule.LastLevel; Level++)
+    {
+      Blur(Level);
+      Constants.Pass = HDR_PASS::DOWNSAMPLE;
+      SetSource(Level);
+      SetDestination(Level + 1);
+      RecordHDRPass(VulkanCommandBuffer, Constants);
+    }
+
+    for (INT i = 0; i < Schedule.NumberOfLastLevelIterations; i++)
+      Blur(Schedule.LastLevel);
+
+    for (INT Level = Schedule.LastLevel; Level > 1; Level--)
+    {
+      Constants.Pass = HDR_PASS::UPSAMPLE;
+      SetSource(Level);
+      SetDestination(Level - 1);
+      RecordHDRPass(VulkanCommandBuffer, Constants);
+    }
+
+    SetSource(1);
+  }
+  else
+  {
+    Constants.SrcOffset = 0;
+    Constants.SrcWidth = 0;
+    Constants.SrcHeight = 0;
+  }
+
+  Constants.Pass = HDR_PASS::COMPOSE;
+  Constants.DstOffset = 0;
+  Constants.DstWidth = W;
+  Constants.DstHeight = H;
+  RecordHDRPass(VulkanCommandBuffer, Constants);
+
+  VkBufferMemoryBarrier ColorsBarrier = {};
+
+  ColorsBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  ColorsBarrier.pNext = nullptr;
+  ColorsBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  ColorsBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+  ColorsBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  ColorsBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  ColorsBarrier.buffer = DeviceStorageBuffer.GetBufferId();
+  ColorsBarrier.offset = ColorsOffset;
+  ColorsBarrier.size = ColorsSize;
+
+  vkCmdPipelineBarrier(VulkanCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0, 0, nullptr,
+                       1, &ColorsBarrier,
+                       0, nullptr);
+}
+
+/**
+ * \brief Record post-processing pass function
+ * \param[in] VulkanCommandBuffer Command buffer
+ * \param[in] Constants Pass parameters
+ */
+VOID vulkan_render::RecordHDRPass( VkCommandBuffer VulkanCommandBuffer, const HDR_PUSH_CONSTANTS &Constants ) const
+{
+  vkCmdPushConstants(VulkanCommandBuffer, HDRPipelineLayout.GetPipelineLayoutId(), VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(HDR_PUSH_CONSTANTS), &Constants);
+
+  vkCmdDispatch(VulkanCommandBuffer, (Constants.DstWidth + HDRWorkGroupSize - 1) / HDRWorkGroupSize,
+                (Constants.DstHeight + HDRWorkGroupSize - 1) / HDRWorkGroupSize, 1);
+
+  // Every pass reads levels written by previous one and may overwrite levels read by it
+  VkBufferMemoryBarrier LevelsBarrier = {};
+
+  LevelsBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  LevelsBarrier.pNext = nullptr;
+  LevelsBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  LevelsBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  LevelsBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  LevelsBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  LevelsBarrier.buffer = DeviceStorageBuffer.GetBufferId();
+  LevelsBarrier.offset = BloomLevelsOffset;
+  LevelsBarrier.size = BloomLevelsSize;
+
+  vkCmdPipelineBarrier(VulkanCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 0, nullptr,
+                       1, &LevelsBarrier,
+                       0, nullptr);
+}
+
+/**
+ * \brief Run post-processing shader in separate submission function
+ * \param[in] W Image width
+ * \param[in] H Image height
+ */
+VOID vulkan_render::RunHDRShader( INT W, INT H )
+{
+  VkCommandBuffer VulkanCommandBuffer;
+
+  ComputeCommandPool.AllocateCommandBuffers(&VulkanCommandBuffer, 1);
+
+  command_buffer CommandBuffer(VulkanCommandBuffer);
+
+  CommandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  RecordHDRShader(VulkanCommandBuffer, W, H);
+  CommandBuffer.End();
+
+  fence Fence(VkApp.GetDeviceId());
+
+  VkSubmitInfo SubmitInfo = {};
+
+  SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  SubmitInfo.pNext = nullptr;
+  SubmitInfo.waitSemaphoreCount = 0;
+  SubmitInfo.pWaitSemaphores = nullptr;
+  SubmitInfo.pWaitDstStageMask = nullptr;
+  SubmitInfo.commandBufferCount = 1;
+  SubmitInfo.pCommandBuffers = &VulkanCommandBuffer;
+  SubmitInfo.signalSemaphoreCount = 0;
+  SubmitInfo.pSignalSemaphores = nullptr;
+
+  ComputeQueue.Submit(&SubmitInfo, 1, Fence.GetFenceId());
+
+  vulkan_validation::Check(
+    Fence.Wait(),
+    "Wait fence error");
+}
+
+/**
+ * \brief Read range of storage buffer function (range is copied to host memory if it is needed)
+ * \param[in] Offset Range offset
+ * \param[in] Size Range size
+ * \param[out] Dst Destination memory
+ */
+VOID vulkan_render::ReadStorage( UINT64 Offset, UINT64 Size, VOID *Dst ) const
 {
   const memory *CurMemory = &DeviceStorageMemory;
 
@@ -974,8 +1474,8 @@ VOID vulkan_render::CopyImageToCPU( image *Im ) const
     }
     
     BufferBarrier.buffer = DeviceStorageBuffer.GetBufferId();
-    BufferBarrier.offset = ImageOffset;
-    BufferBarrier.size = ImageSize;
+    BufferBarrier.offset = Offset;
+    BufferBarrier.size = Size;
 
     vkCmdPipelineBarrier(VulkanCopyCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
                          0, 0, nullptr,
@@ -984,9 +1484,9 @@ VOID vulkan_render::CopyImageToCPU( image *Im ) const
 
     VkBufferCopy CopyRegion = {};
 
-    CopyRegion.srcOffset = ImageOffset;
-    CopyRegion.dstOffset = ImageOffset;
-    CopyRegion.size = ImageSize;
+    CopyRegion.srcOffset = Offset;
+    CopyRegion.dstOffset = Offset;
+    CopyRegion.size = Size;
 
     vkCmdCopyBuffer(VulkanCopyCommandBuffer, DeviceStorageBuffer.GetBufferId(), HostStorageBuffer.GetBufferId(),
                     1, &CopyRegion);
@@ -1001,8 +1501,8 @@ VOID vulkan_render::CopyImageToCPU( image *Im ) const
       BufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
       BufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
       BufferBarrier.buffer = HostStorageBuffer.GetBufferId();
-      BufferBarrier.offset = ImageOffset;
-      BufferBarrier.size = ImageSize;
+      BufferBarrier.offset = Offset;
+      BufferBarrier.size = Size;
 
       vkCmdPipelineBarrier(VulkanCopyCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
                            VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &BufferBarrier, 0, nullptr);
@@ -1033,26 +1533,134 @@ VOID vulkan_render::CopyImageToCPU( image *Im ) const
       "Wait fence error");
   }
 
-  vec *Data;
+  BYTE *Data;
+
+  CurMemory->MapMemory(Offset, Size, reinterpret_cast<VOID **>(&Data));
+
+  if ((VkApp.DeviceMemoryProperties.memoryTypes[CurMemory->MemoryType].propertyFlags &
+       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+  {
+    CurMemory->InvalidateAllRange(Offset);
+  }
+
+  memcpy(Dst, Data, Size);
 
-  CurMemory->MapMemory(ImageOffset, ImageSize, reinterpret_cast<VOID **>(&Data));
+  CurMemory->UnmapMemory();
+}
+
+/**
+ * \brief Write range of storage buffer function (range is copied to device memory if it is needed)
+ * \param[in] Offset Range offset
+ * \param[in] Size Range size
+ * \param[in] Src Source memory
+ */
+VOID vulkan_render::WriteStorage( UINT64 Offset, UINT64 Size, const VOID *Src ) const
+{
+  const memory *CurMemory = &DeviceStorageMemory;
+  BYTE *Data;
+
+  if (NeedCopyStorage)
+    CurMemory = &HostStorageMemory;
+
+  CurMemory->MapMemory(Offset, Size, reinterpret_cast<VOID **>(&Data));
+
+  memcpy(Data, Src, Size);
 
   if ((VkApp.DeviceMemoryProperties.memoryTypes[CurMemory->MemoryType].propertyFlags &
        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
   {
-    CurMemory->InvalidateAllRange(ImageOffset);
+    CurMemory->FlushAllRange(Offset);
   }
 
+  CurMemory->UnmapMemory();
+
+  if (NeedCopyStorage)
+  {
+    VkCommandBuffer VulkanCopyCommandBuffer;
+
+    TransferCommandPool.AllocateCommandBuffers(&VulkanCopyCommandBuffer);
+
+    command_buffer CommandBuffer(VulkanCopyCommandBuffer);
+
+    CommandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    VkBufferMemoryBarrier BufferBarrier = {};
+
+    BufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    BufferBarrier.pNext = nullptr;
+    BufferBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+    BufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    BufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    BufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    BufferBarrier.buffer = HostStorageBuffer.GetBufferId();
+    BufferBarrier.offset = Offset;
+    BufferBarrier.size = Size;
+
+    vkCmdPipelineBarrier(VulkanCopyCommandBuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr,
+                         1, &BufferBarrier,
+                         0, nullptr);
+
+    VkBufferCopy CopyRegion = {};
+
+    CopyRegion.srcOffset = Offset;
+    CopyRegion.dstOffset = Offset;
+    CopyRegion.size = Size;
+
+    vkCmdCopyBuffer(VulkanCopyCommandBuffer, HostStorageBuffer.GetBufferId(), DeviceStorageBuffer.GetBufferId(),
+                    1, &CopyRegion);
+
+    CommandBuffer.End();
+
+    fence Fence(VkApp.GetDeviceId());
+
+    VkSubmitInfo SubmitInfo = {};
+
+    SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    SubmitInfo.pNext = nullptr;
+    SubmitInfo.waitSemaphoreCount = 0;
+    SubmitInfo.pWaitSemaphores = nullptr;
+    SubmitInfo.pWaitDstStageMask = nullptr;
+    SubmitInfo.commandBufferCount = 1;
+    SubmitInfo.pCommandBuffers = &VulkanCopyCommandBuffer;
+    SubmitInfo.signalSemaphoreCount = 0;
+    SubmitInfo.pSignalSemaphores = nullptr;
+
+    TransferQueue.Submit(&SubmitInfo, 1, Fence.GetFenceId());
+
+    vulkan_validation::Check(
+      Fence.Wait(),
+      "Wait fence error");
+  }
+}
+
+/**
+ * \brief Copy image back  to CPU
+ * \param Im Destination image
+ */
+VOID vulkan_render::CopyImageToCPU( image *Im ) const
+{
+  std::vector<vec> Pixels(Im->FrameW * Im->FrameH);
+
+  ReadStorage(ImageOffset, ImageSize, Pixels.data());
+
   std::cout << "Read memory\n";
 
   for (INT y = 0; y < Im->FrameH; y++)
     for (INT x = 0; x < Im->FrameW; x++)
     {
-      const vec &Pixel = Data[Im->FrameW * y + x];
+      const vec &Pixel = Pixels[Im->FrameW * y + x];
       Im->SetPixel(x, y, image_vec(Pixel.X, Pixel.Y, Pixel.Z));
     }
+}
 
-  CurMemory->UnmapMemory();
+/**
+ * \brief Copy tone mapped colors back to CPU function (they are kept in render colors)
+ */
+VOID vulkan_render::CopyColorsToCPU( VOID )
+{
+  Colors.resize(ColorsSize / sizeof(DWORD));
+  ReadStorage(ColorsOffset, ColorsSize, Colors.data());
 }
 
 /**
@@ -1064,21 +1672,99 @@ VOID vulkan_render::CopyImageToCPU( image *Im ) const
  */
 VOID vulkan_render::RenderFrame( image *Im, const cam &Camera, scene &Scene, INT NumberOfSamples )
 {
+  time_budget Budget(TimeBudget, FinalizeTime);
   const kd_tree &Tree = Scene.GetTree();
 
   Sizes = Tree.GetSizesOfPackedSceneElements(DataAlignment);
 
-  CreateBuffersAndAllocateMemory(Im->FrameW, Im->FrameH, Camera, Scene);
-  CopyParametersToGPUMemory(Im->FrameW, Im->FrameH, Camera, Scene, Tree);
-  WriteDescriptorSets();
+  checkpoint Checkpoint(ProgressivePar);
 
-  RunRenderShader(Im->FrameW, Im->FrameH, NumberOfSamples);
+  HDR.SetSize(Im->FrameW, Im->FrameH);
+  Im->Clear();
+  Colors.clear();
 
-  CopyImageToCPU(Im);
-  *Im /= NumberOfSamples;
+  INT SamplesDone = Checkpoint.Start(Im, Scene.RenderPar.Seed);
+  adaptive_sampling Adaptive(AdaptivePar, Im->FrameW, Im->FrameH, WorkGroupSize, SamplesDone);
+  BOOL IsRendered = FALSE, IsPostProcessed = FALSE;
 
-  HDR.SetSize(Im->FrameW, Im->FrameH);
-  ProcessHDR(Im);
+  // Linear output needs float image, so it is read back as for post-processing on CPU
+  const BOOL IsDevicePostProcessing = DevicePostProcessing && !LinearOutput;
+
+  ResumedSamples = SamplesDone;
+  if (!Adaptive.IsConverged() && SamplesDone < Budget.GetNumberOfSamples(SamplesDone, NumberOfSamples))
+  {
+    if (IsDevicePostProcessing)
+      CreateHDRPipeline();
+    CreateBuffersAndAllocateMemory(Im->FrameW, Im->FrameH, Camera, Scene);
+    CopyParametersToGPUMemory(Im->FrameW, Im->FrameH, Camera, Scene, Tree, *Im);
+    WriteDescriptorSets();
+
+    // Samples seeds sequence depends only on frame seed, so seeds of resumed samples are skipped
+    std::uniform_int_distribution<UINT32> Distr;
+
+    Gen.seed(Scene.RenderPar.Seed);
+    for (INT i = 0; i < 2 * SamplesDone; i++)
+      Distr(Gen);
+
+    // Accumulation buffer stays in GPU memory between passes and is copied back only at checkpoints
+    BOOL IsCopied = FALSE;
+    INT TotalSamples;
+
+    Budget.StartSampling(SamplesDone);
+    for (BOOL IsFirstPass = TRUE;
+         !Adaptive.IsConverged() &&
+         SamplesDone < (TotalSamples = Budget.GetNumberOfSamples(SamplesDone, NumberOfSamples));
+         IsFirstPass = FALSE)
+    {
+      const INT PassSamples =
+        Adaptive.GetNumberOfPassSamples(Checkpoint.GetNumberOfPassSamples(SamplesDone, TotalSamples));
+
+      // Pass expected to be last one post-processes image in its command buffer (otherwise it is done after loop)
+      IsPostProcessed = IsDevicePostProcessing && SamplesDone + PassSamples >= TotalSamples;
+      RunRenderShader(Im->FrameW, Im->FrameH, PassSamples, IsFirstPass, IsPostProcessed);
+
+      // Work groups of converged tiles are masked out of dispatches, only statistics and mask cross the bus
+      if (Adaptive.IsEnabled())
+        ReadStorage(PixelStatsOffset, PixelStatsSize, Adaptive.GetStats());
+      Adaptive.EndPass(PassSamples);
+      if (Adaptive.IsEnabled())
+        WriteStorage(TilesMaskOffset, TilesMaskSize, Adaptive.GetMask().data());
+
+      SamplesDone = Adaptive.GetNumberOfSamples();
+      IsCopied = FALSE;
+
+      if (Checkpoint.IsNeeded(SamplesDone, Adaptive.IsConverged() ? SamplesDone : TotalSamples))
+      {
+        CopyImageToCPU(Im);
+        IsCopied = TRUE;
+        Checkpoint.Save(Adaptive.GetUniformSum(*Im), SamplesDone, Scene.RenderPar.Seed, [&]( image *Img )
+          {
+            ProcessHDR(Img);
+          });
+      }
+    }
+
+    IsRendered = TRUE;
+    if (!IsDevicePostProcessing && !IsCopied)
+      CopyImageToCPU(Im);
+  }
+
+  const std::chrono::steady_clock::time_point FinalizeStart = std::chrono::steady_clock::now();
+
+  // Bloom and tone mapping are done on device, so only 8-bit colors are read back (image keeps no frame)
+  if (IsRendered && IsDevicePostProcessing)
+  {
+    if (!IsPostProcessed)
+      RunHDRShader(Im->FrameW, Im->FrameH);
+    CopyColorsToCPU();
+  }
+  else
+  {
+    Adaptive.Normalize(*Im, Im, 1);
+    if (!LinearOutput)
+      ProcessHDR(Im);
+  }
+  FinalizeTime = std::chrono::duration<DBL>(std::chrono::steady_clock::now() - FinalizeStart).count();
 }
 
 /**
@@ -1089,11 +1775,32 @@ VOID vulkan_render::RenderFrame( image *Im, const cam &Camera, scene &Scene, INT
 VOID vulkan_render::InitRender( UINT SelectedDeviceId, BOOL OneSeed )
 {
   VkApp.InitApplication(SelectedDeviceId);
-  if (OneSeed)
-    RenderShader = shader_module(VkApp.GetDeviceId(), "shaders-build/trace_one_seed.comp.spv");
-  else
-    RenderShader = shader_module(VkApp.GetDeviceId(), "shaders-build/trace.comp.spv");
+  const std::string RenderShaderName =
+    OneSeed ? "shaders-build/trace_one_seed.comp.spv" : "shaders-build/trace.comp.spv";
 
+  RenderShader = shader_module(VkApp.GetDeviceId(), RenderShaderName);
+  CheckShaderLayout(RenderShader, RenderShaderName,
+    {
+      {
+        0, 0,
+        {
+          offsetof(SCENE_DATA, Cam), offsetof(SCENE_DATA, Par), offsetof(SCENE_DATA, AirEnvi),
+          offsetof(SCENE_DATA, Width), offsetof(SCENE_DATA, Height),
+          offsetof(SCENE_DATA, NumOfLights), offsetof(SCENE_DATA, LightsArea)
+        },
+        0
+      },
+      {0, 1, {0}, sizeof(UINT32)},
+      {0, 2, {0}, sizeof(material)},
+      {0, 3, {0}, sizeof(environment)},
+      {0, 4, {0}, sizeof(triangle)},
+      {0, 5, {0}, sizeof(kd_tree_node_data)},
+      {0, 6, {0}, sizeof(LIGHT)},
+      {1, 0, {0}, sizeof(vec)},
+      {1, 1, {0}, sizeof(adaptive_sampling::PIXEL_STATS)},
+      {1, 2, {0}, sizeof(UINT32)},
+      {shader_module::PushConstantsBinding, shader_module::PushConstantsBinding, {0, sizeof(UINT32)}, 0}
+    });
   if (!VkApp.ComputeQueueFamilyIndex)
     error("Compute queue family dont found");
 
@@ -1106,4 +1813,6 @@ VOID vulkan_render::InitRender( UINT SelectedDeviceId, BOOL OneSeed )
   CreatePipelineLayout();
   CreateRenderPipeline();
   CreateDescriptorPoolAndAllocateSets();
+  if (DevicePostProcessing)
+    CreateHDRPipeline();
 }
@@ -25,6 +25,72 @@ class vulkan_render : public base_render
 private:
   static constexpr UINT64 DataAlignment = 256;
 
+  /** Size of square work group of render shader (in pixels), it is tile of adaptive sampling */
+  static constexpr INT WorkGroupSize = 8;
+
+  /** Size of square work group of post-processing shader (in pixels) */
+  static constexpr INT HDRWorkGroupSize = 8;
+
+  /**
+   * \brief Post-processing shader passes (same as in shader)
+   */
+  enum class HDR_PASS : UINT32
+  {
+    /** Bright pass of averaged accumulation buffer with downsampling to bloom level 1 */
+    THRESHOLD,
+
+    /** Horizontal blur of level to temporary buffer */
+    BLUR_HORIZONTAL,
+
+    /** Vertical blur of temporary buffer to level */
+    BLUR_VERTICAL,
+
+    /** Downsampling of level to next one */
+    DOWNSAMPLE,
+
+    /** Upsampling of level to previous one */
+    UPSAMPLE,
+
+    /** Addition of bloom, tone mapping and quantization to 8-bit colors */
+    COMPOSE
+  };
+
+  /**
+   * \brief Post-processing shader pass parameters (same as push constants of shader)
+   */
+  struct HDR_PUSH_CONSTANTS
+  {
+    /** Pass */
+    HDR_PASS Pass;
+
+    /** Source level offset in bloom levels (in pixels) */
+    UINT32 SrcOffset;
+
+    /** Source width (0 - there is no bloom) */
+    UINT32 SrcWidth;
+
+    /** Source height */
+    UINT32 SrcHeight;
+
+    /** Destination level offset in bloom levels (in pixels) */
+    UINT32 DstOffset;
+
+    /** Destination width */
+    UINT32 DstWidth;
+
+    /** Destination height */
+    UINT32 DstHeight;
+
+    /** Number of samples of accumulation buffer not counted by pixels (they were resumed) */
+    FLT ResumedSamples;
+
+    /** Brighness limit for bloom */
+    FLT BrighnessLimit;
+
+    /** Exposure for tone mapping */
+    FLT Exposure;
+  };
+
   /** Vulkan application class */
   vulkan_application VkApp;
 
@@ -43,6 +109,18 @@ private:
   /** Render pipeline */
   compute_pipeline RenderPipeline;
 
+  /** Post-processing shader module */
+  shader_module HDRShader;
+
+  /** Post-processing data descriptor set layout */
+  descriptor_set_layout HDRSetLayout;
+
+  /** Post-processing pipeline layout */
+  pipeline_layout HDRPipelineLayout;
+
+  /** Post-processing pipeline */
+  compute_pipeline HDRPipeline;
+
   /** Descriptor pool */
   descriptor_pool DescriptorPool;
 
@@ -52,6 +130,9 @@ private:
   /** Image descriptor set */
   VkDescriptorSet ImageSet = VK_NULL_HANDLE;
 
+  /** Post-processing data descriptor set */
+  VkDescriptorSet HDRSet = VK_NULL_HANDLE;
+
   /** Device storage memory */
   memory DeviceStorageMemory;
 
@@ -124,15 +205,54 @@ private:
   /** Nodes offset */
   UINT64 NodesOffset;
 
+  /** Lights offset */
+  UINT64 LightsOffset;
+
+  /** Lights size */
+  UINT64 LightsSize;
+
   /** Image offset */
   UINT64 ImageOffset;
 
   /** Image size */
   UINT64 ImageSize;
 
+  /** Pixels statistics offset */
+  UINT64 PixelStatsOffset;
+
+  /** Pixels statistics size */
+  UINT64 PixelStatsSize;
+
+  /** Active tiles mask offset */
+  UINT64 TilesMaskOffset;
+
+  /** Active tiles mask size */
+  UINT64 TilesMaskSize;
+
+  /** Bloom levels offset */
+  UINT64 BloomLevelsOffset;
+
+  /** Bloom levels size */
+  UINT64 BloomLevelsSize;
+
+  /** Offsets of bloom pyramid levels from bloom levels start in pixels (level 0 is temporary buffer for blur) */
+  std::vector<UINT32> BloomLevelOffsets;
+
+  /** Tone mapped colors offset */
+  UINT64 ColorsOffset;
+
+  /** Tone mapped colors size */
+  UINT64 ColorsSize;
+
   /** Storage buffer size */
   UINT64 StorageBufferSize;
 
+  /** Number of samples in accumulation buffer before render (pixels count only samples of render) */
+  INT ResumedSamples = 0;
+
+  /** Post-processing on device flag (FALSE - float image is read back and processed by CPU) */
+  BOOL DevicePostProcessing = FALSE;
+
   /** Kd-tree elements sizes */
   kd_tree::PACKED_SCENE_ELEMENTS_SIZES Sizes;
 
@@ -152,6 +272,28 @@ private:
    */
   VOID CreateRenderPipeline( VOID );
 
+  /**
+   * \brief Check that shader blocks layouts match host structures function (outdated shader binaries are rejected)
+   * \param[in] Shader Shader module
+   * \param[in] Name Shader name for error message
+   * \param[in] Expected Expected blocks layouts
+   */
+  static VOID CheckShaderLayout( const shader_module &Shader, const std::string &Name,
+                                 const std::vector<shader_module::BLOCK_LAYOUT> &Expected );
+
+  /**
+   * \brief Get bloom pyramid level size function (image size is halved with rounding up for every level)
+   * \param[in] Size Image width or height
+   * \param[in] Level Level (level 0 is temporary buffer of level 1 size)
+   * \return Level width or height
+   */
+  static UINT32 GetBloomLevelSize( INT Size, INT Level );
+
+  /**
+   * \brief Create post-processing pipeline and allocate its descriptor set function (if they are not created yet)
+   */
+  VOID CreateHDRPipeline( VOID );
+
   /**
    * \brief Create descriptor pool and allocate descriptor sets function.
    */
@@ -205,16 +347,58 @@ private:
    * \param[in] Camera Camera for render
    * \param[in] Scene Scene for render
    * \param[in] Tree Scene Kd-tree
+   * \param[in] Sum Initial accumulation buffer (sum of already rendered samples)
    */
-  VOID CopyParametersToGPUMemory( INT W, INT H, const cam &Camera, const scene &Scene, const kd_tree &Tree );
+  VOID CopyParametersToGPUMemory( INT W, INT H, const cam &Camera, const scene &Scene, const kd_tree &Tree,
+                                  const image &Sum );
 
   /**
    * \brief Run shader function
    * \param[in] W Image width
    * \param[in] H Image height
    * \param[in] NumberOfSamples Number of samples
+   * \param[in] WaitParameters Wait for copy of parameters to GPU memory flag (only first run after copy waits)
+   * \param[in] PostProcess Post-process image after samples in same command buffer flag
    */
-  VOID RunRenderShader( INT W, INT H, INT NumberOfSamples );
+  VOID RunRenderShader( INT W, INT H, INT NumberOfSamples, BOOL WaitParameters, BOOL PostProcess );
+
+  /**
+   * \brief Record post-processing passes function (accumulation buffer is turned to tone mapped colors)
+   * \param[in] VulkanCommandBuffer Command buffer
+   * \param[in] W Image width
+   * \param[in] H Image height
+   */
+  VOID RecordHDRShader( VkCommandBuffer VulkanCommandBuffer, INT W, INT H ) const;
+
+  /**
+   * \brief Record post-processing pass function
+   * \param[in] VulkanCommandBuffer Command buffer
+   * \param[in] Constants Pass parameters
+   */
+  VOID RecordHDRPass( VkCommandBuffer VulkanCommandBuffer, const HDR_PUSH_CONSTANTS &Constants ) const;
+
+  /**
+   * \brief Run post-processing shader in separate submission function
+   * \param[in] W Image width
+   * \param[in] H Image height
+   */
+  VOID RunHDRShader( INT W, INT H );
+
+  /**
+   * \brief Read range of storage buffer function (range is copied to host memory if it is needed)
+   * \param[in] Offset Range offset
+   * \param[in] Size Range size
+   * \param[out] Dst Destination memory
+   */
+  VOID ReadStorage( UINT64 Offset, UINT64 Size, VOID *Dst ) const;
+
+  /**
+   * \brief Write range of storage buffer function (range is copied to device memory if it is needed)
+   * \param[in] Offset Range offset
+   * \param[in] Size Range size
+   * \param[in] Src Source memory
+   */
+  VOID WriteStorage( UINT64 Offset, UINT64 Size, const VOID *Src ) const;
 
   /**
    * \brief Copy image back  to CPU
@@ -222,6 +406,11 @@ private:
    */
   VOID CopyImageToCPU( image *Im ) const;
 
+  /**
+   * \brief Copy tone mapped colors back to CPU function (they are kept in render colors)
+   */
+  VOID CopyColorsToCPU( VOID );
+
   /**
    * \brief Apply HDR correction to image function
    * \param[in, out] Im Image
@@ -235,6 +424,13 @@ public:
    */
   vulkan_render( UINT DeviceId );
 
+  /**
+   * \brief Setup post-processing on device function
+   * \param[in] Enable Post-processing on device flag (TRUE - only 8-bit colors are read back to render colors,
+   *                   FALSE - float image is read back and processed by CPU)
+   */
+  VOID SetDevicePostProcessing( BOOL Enable );
+
   /**
    * \brief Render frame function
    * \param[in, out] Im Image for render
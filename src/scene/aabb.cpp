@@ -52,6 +52,17 @@ FLT vec::* aabb::MaxAxis( VOID ) const
       return &vec::Z;
 }
 
+/**
+ * \brief Get surface area function
+ * \return Surface area of box
+ */
+FLT aabb::GetSurfaceArea( VOID ) const
+{
+  vec D = Max - Min;
+
+  return 2 * (D.X * D.Y + D.Y * D.Z + D.Z * D.X);
+}
+
 /**
  * \brief Intersection with ray function
  * \param[in] R Ray
@@ -55,6 +55,12 @@ public:
    */
   FLT vec::* MaxAxis( VOID ) const;
 
+  /**
+   * \brief Get surface area function
+   * \return Surface area of box
+   */
+  FLT GetSurfaceArea( VOID ) const;
+
   /**
    * \brief Intersection with ray function
    * \param[in] R Ray
@@ -0,0 +1,48 @@
+#ifndef __acceleration_structure_h_
+#define __acceleration_structure_h_
+
+#include <atomic>
+
+#include "triangle.h"
+#include "params.h"
+
+/**
+ * \brief Acceleration structure for fast ray-scene intersection
+ */
+class acceleration_structure
+{
+public:
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+  /** Number of nodes visited by all intersection requests */
+  inline static std::atomic<UINT64> NumOfVisitedNodes = 0;
+
+  /** Number of intersection requests */
+  inline static std::atomic<UINT64> NumOfIntersectionRequests = 0;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+  /**
+   * \brief Intersection with ray function
+   * \param[in] R Ray
+   * \param[in, out] Intr Intersection structure
+   * \param[in, out] Near Distance to nearest intersection
+   * \param[in] Par Render parameters
+   * \return TRUE-if intersect, FALSE-if otherwise
+   */
+  virtual BOOL Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const = 0;
+
+  /**
+   * \brief Check if any intersection with ray is closer than distance function (traversal stops at first found one)
+   * \param[in] R Ray
+   * \param[in] MaxDist Distance along ray
+   * \param[in] Par Render parameters
+   * \return TRUE-if ray is occluded, FALSE-if otherwise
+   */
+  virtual BOOL Occluded( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const = 0;
+
+  /**
+   * \brief Acceleration structure destructor
+   */
+  virtual ~acceleration_structure( VOID ) = default;
+};
+
+#endif /* __acceleration_structure_h_ */
@@ -0,0 +1,73 @@
+#include "instance.h"
+
+/**
+ * \brief Instance constructor
+ * \param[in] Mesh Instanced mesh
+ * \param[in] MtlId Material identificator
+ * \param[in] EnviId Environment identificator
+ * \param[in] Transform Object to world transformation
+ */
+instance::instance( const std::shared_ptr<mesh> &Mesh, const INT MtlId, const INT EnviId, const matr &Transform ) :
+  Mesh(Mesh), Transform(Transform), InvTransform(Transform.GetInverse()),
+  NormalTransform(InvTransform.GetTranspose()), MtlId(MtlId), EnviId(EnviId)
+{
+}
+
+/**
+ * \brief Set object to world transformation function (scene IsTransformChanged flag must be set)
+ * \param[in] NewTransform Object to world transformation
+ */
+VOID instance::SetTransform( const matr &NewTransform )
+{
+  Transform = NewTransform;
+  InvTransform = Transform.GetInverse();
+  NormalTransform = InvTransform.GetTranspose();
+}
+
+/**
+ * \brief Get world space bounding box function (mesh must be built)
+ * \return Bounding box
+ */
+aabb instance::GetBB( VOID ) const
+{
+  const aabb MeshBB = Mesh->GetBB();
+  aabb BB;
+
+  BB.Min = BB.Max = Transform.PointTransform(MeshBB.Min);
+  for (INT i = 1; i < 8; i++)
+    BB.Expand(Transform.PointTransform(vec(i & 1 ? MeshBB.Max.X : MeshBB.Min.X,
+                                           i & 2 ? MeshBB.Max.Y : MeshBB.Min.Y,
+                                           i & 4 ? MeshBB.Max.Z : MeshBB.Min.Z)));
+
+  return BB;
+}
+
+/**
+ * \brief Transform interpolated intersection vertex to world space function
+ * \param[in, out] V Vertex
+ */
+VOID instance::TransformVertex( vertex *V ) const
+{
+  V->P = Transform.PointTransform(V->P);
+  V->N = NormalTransform.VectorTransform(V->N).GetNormalized();
+}
+
+/**
+ * \brief Add world space triangles of instance function (mesh must be built)
+ * \param[in, out] Tr Triangles array
+ */
+VOID instance::AddTriangles( std::vector<triangle> *Tr ) const
+{
+  for (const triangle &T : Mesh->GetTriangles())
+  {
+    vertex V[3];
+
+    for (INT i = 0; i < 3; i++)
+    {
+      const vertex &Src = T.GetVertex(i);
+
+      V[i] = vertex(Transform.PointTransform(Src.P), NormalTransform.VectorTransform(Src.N).GetNormalized(), Src.T);
+    }
+    Tr->push_back(triangle(V[0], V[1], V[2], MtlId, EnviId));
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef __instance_h_
+#define __instance_h_
+
+#include <memory>
+
+#include "mesh.h"
+#include "math/matr.h"
+
+/**
+ * \brief Placed mesh with own transformation and material
+ */
+class instance
+{
+public:
+  /** Instanced mesh */
+  std::shared_ptr<mesh> Mesh;
+
+  /** Object to world transformation */
+  matr Transform;
+
+  /** World to object transformation */
+  matr InvTransform;
+
+  /** Object to world normals transformation */
+  matr NormalTransform;
+
+  /** Material identificator (overrides mesh triangles material) */
+  INT MtlId;
+
+  /** Environment identificator (overrides mesh triangles environment) */
+  INT EnviId;
+
+  /**
+   * \brief Instance constructor
+   * \param[in] Mesh Instanced mesh
+   * \param[in] MtlId Material identificator
+   * \param[in] EnviId Environment identificator
+   * \param[in] Transform Object to world transformation
+   */
+  instance( const std::shared_ptr<mesh> &Mesh, const INT MtlId, const INT EnviId,
+            const matr &Transform = matr::Identity() );
+
+  /**
+   * \brief Set object to world transformation function (scene IsTransformChanged flag must be set)
+   * \param[in] NewTransform Object to world transformation
+   */
+  VOID SetTransform( const matr &NewTransform );
+
+  /**
+   * \brief Get world space bounding box function (mesh must be built)
+   * \return Bounding box
+   */
+  aabb GetBB( VOID ) const;
+
+  /**
+   * \brief Transform interpolated intersection vertex to world space function
+   * \param[in, out] V Vertex
+   */
+  VOID TransformVertex( vertex *V ) const;
+
+  /**
+   * \brief Add world space triangles of instance function (mesh must be built)
+   * \param[in, out] Tr Triangles array
+   */
+  VOID AddTriangles( std::vector<triangle> *Tr ) const;
+};
+
+#endif /* __instance_h_ */
@@ -0,0 +1,171 @@
+#include "instance_tree.h"
+
+/**
+ * \brief Build top-level tree function
+ * \param[in] SceneInstances Instances (must live while tree is used, meshes must be built)
+ * \param[in] SceneWorldTree Structure for world space geometry (must live while tree is used)
+ * \param[in] Par Building parameters
+ */
+VOID instance_tree::Build( const std::vector<instance> &SceneInstances, const acceleration_structure &SceneWorldTree,
+                           const TREE_PARAMS &Par )
+{
+  std::vector<aabb> Boxes(SceneInstances.size());
+  std::vector<vec> Centers(SceneInstances.size());
+  std::vector<UINT32> Order;
+
+  Clear();
+  WorldTree = &SceneWorldTree;
+
+  for (size_t i = 0; i < SceneInstances.size(); i++)
+  {
+    Boxes[i] = SceneInstances[i].GetBB();
+    Centers[i] = (Boxes[i].Min + Boxes[i].Max) / 2;
+  }
+
+  // Instances are few and expensive to intersect, so every instance gets own leaf if possible
+  TREE_PARAMS TopLevelPar = Par;
+
+  TopLevelPar.MinNumOfTriangleLeaf = 1;
+  TopLevelPar.MaxNumOfTriangleLeaf = 1;
+
+  kd_tree::BuildNodes(Boxes, Centers, TopLevelPar, &Nodes, &Order);
+
+  Instances.reserve(Order.size());
+  for (UINT32 Index : Order)
+    Instances.push_back(&SceneInstances[Index]);
+}
+
+/**
+ * \brief Intersection with ray function
+ * \param[in] R Ray
+ * \param[in, out] Intr Intersection structure
+ * \param[in, out] Near Distance to nearest intersection
+ * \param[in] Par Render parameters
+ * \return TRUE-if intersect, FALSE-if otherwise
+ */
+BOOL instance_tree::Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const
+{
+  UINT32 Stack[TraversalStackSize];
+  INT StackSize = 0;
+  UINT32 U = 0;
+  BOOL Hit = WorldTree != nullptr && WorldTree->Intersect(R, Intr, Near, Par);
+  FLT Dist;
+
+  while (!Nodes.empty())
+  {
+    const kd_tree_node_data &Node = Nodes[U];
+
+    if (Node.Intersect(R, &Dist) && Dist <= *Near)
+    {
+      if (Node.NumOfTriangles >= 0) // Leaf
+      {
+        for (UINT32 i = Node.Offset; i < Node.Offset + Node.NumOfTriangles; i++)
+        {
+          const instance *Inst = Instances[i];
+
+          // Direction is not normalized, so distance along object space ray equals world space one
+          const ray ObjectRay(Inst->InvTransform.PointTransform(R.Org), Inst->InvTransform.VectorTransform(R.Dir));
+
+          if (Inst->Mesh->GetAccelerationStructure().Intersect(ObjectRay, Intr, Near, Par))
+          {
+            Hit = TRUE;
+            Intr->Instance = Inst;
+          }
+        }
+      }
+      else
+      {
+        const INT SplitAxis = -1 - Node.NumOfTriangles;
+        const FLT DirAlongAxis = SplitAxis == 0 ? R.Dir.X : SplitAxis == 1 ? R.Dir.Y : R.Dir.Z;
+
+        if (DirAlongAxis < 0)
+        {
+          Stack[StackSize++] = U + 1;
+          U = Node.Offset;
+        }
+        else
+        {
+          Stack[StackSize++] = Node.Offset;
+          U++;
+        }
+        continue;
+      }
+    }
+
+    if (StackSize == 0)
+      break;
+    U = Stack[--StackSize];
+  }
+
+  return Hit;
+}
+
+/**
+ * \brief Check if any intersection with ray is closer than distance function (traversal stops at first found one)
+ * \param[in] R Ray
+ * \param[in] MaxDist Distance along ray
+ * \param[in] Par Render parameters
+ * \return TRUE-if ray is occluded, FALSE-if otherwise
+ */
+BOOL instance_tree::Occluded( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const
+{
+  UINT32 Stack[TraversalStackSize];
+  INT StackSize = 0;
+  UINT32 U = 0;
+  BOOL Hit = WorldTree != nullptr && WorldTree->Occluded(R, MaxDist, Par);
+  FLT Dist;
+
+  while (!Nodes.empty() && !Hit)
+  {
+    const kd_tree_node_data &Node = Nodes[U];
+
+    if (Node.Intersect(R, &Dist) && Dist <= MaxDist)
+    {
+      if (Node.NumOfTriangles >= 0) // Leaf
+      {
+        for (UINT32 i = Node.Offset; i < Node.Offset + Node.NumOfTriangles && !Hit; i++)
+        {
+          const instance *Inst = Instances[i];
+
+          // Direction is not normalized, so distance along object space ray equals world space one
+          const ray ObjectRay(Inst->InvTransform.PointTransform(R.Org), Inst->InvTransform.VectorTransform(R.Dir));
+
+          Hit = Inst->Mesh->GetAccelerationStructure().Occluded(ObjectRay, MaxDist, Par);
+        }
+      }
+      else
+      {
+        const INT SplitAxis = -1 - Node.NumOfTriangles;
+        const FLT DirAlongAxis = SplitAxis == 0 ? R.Dir.X : SplitAxis == 1 ? R.Dir.Y : R.Dir.Z;
+
+        if (DirAlongAxis < 0)
+        {
+          Stack[StackSize++] = U + 1;
+          U = Node.Offset;
+        }
+        else
+        {
+          Stack[StackSize++] = Node.Offset;
+          U++;
+        }
+        continue;
+      }
+    }
+
+    if (StackSize == 0)
+      break;
+    U = Stack[--StackSize];
+  }
+
+  return Hit;
+}
+
+/**
+ * \brief Clear tree function
+ */
+VOID instance_tree::Clear( VOID )
+{
+  Nodes.clear();
+  Instances.clear();
+  WorldTree = nullptr;
+}
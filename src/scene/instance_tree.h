@@ -0,0 +1,61 @@
+#ifndef __instance_tree_h_
+#define __instance_tree_h_
+
+#include <vector>
+
+#include "instance.h"
+
+/**
+ * \brief Two-level acceleration structure (top-level tree over instances, meshes have own trees)
+ */
+class instance_tree : public acceleration_structure
+{
+private:
+  /** Packed top-level tree nodes in depth-first order (leaves reference instances) */
+  std::vector<kd_tree_node_data> Nodes;
+
+  /** Instances in leaves order */
+  std::vector<const instance *> Instances;
+
+  /** Structure for world space (not instanced) geometry */
+  const acceleration_structure *WorldTree = nullptr;
+
+  /** Traversal stack size (must be greater than maximal tree depth) */
+  static const INT TraversalStackSize = 64;
+
+public:
+  /**
+   * \brief Build top-level tree function
+   * \param[in] SceneInstances Instances (must live while tree is used, meshes must be built)
+   * \param[in] SceneWorldTree Structure for world space geometry (must live while tree is used)
+   * \param[in] Par Building parameters
+   */
+  VOID Build( const std::vector<instance> &SceneInstances, const acceleration_structure &SceneWorldTree,
+              const TREE_PARAMS &Par );
+
+  /**
+   * \brief Intersection with ray function
+   * \param[in] R Ray
+   * \param[in, out] Intr Intersection structure
+   * \param[in, out] Near Distance to nearest intersection
+   * \param[in] Par Render parameters
+   * \return TRUE-if intersect, FALSE-if otherwise
+   */
+  BOOL Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const override;
+
+  /**
+   * \brief Check if any intersection with ray is closer than distance function (traversal stops at first found one)
+   * \param[in] R Ray
+   * \param[in] MaxDist Distance along ray
+   * \param[in] Par Render parameters
+   * \return TRUE-if ray is occluded, FALSE-if otherwise
+   */
+  BOOL Occluded( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const override;
+
+  /**
+   * \brief Clear tree function
+   */
+  VOID Clear( VOID );
+};
+
+#endif /* __instance_tree_h_ */
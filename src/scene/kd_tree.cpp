@@ -1,8 +1,16 @@
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
 
 #include "kd_tree.h"
 #include "material.h"
+#include "utils/error.h"
+#include "utils/parallel_for.h"
 
 /**
  * \brief Get size with alignment
@@ -25,8 +33,8 @@ kd_tree::PACKED_SCENE_ELEMENTS_SIZES kd_tree::GetSizesOfPackedSceneElements( UIN
 
   Res.MaterialsSize = material::Table.size() * sizeof(material);
   Res.EnvironmentsSize = environment::Table.size() * sizeof(environment);
-  Res.NodesSize = (MaxUForGPUPack + 1) * sizeof(kd_tree_node_data);
-  Res.TrianglesSize = NumberOfTrianglesInTree * sizeof(triangle);
+  Res.NodesSize = Nodes.size() * sizeof(kd_tree_node_data);
+  Res.TrianglesSize = Triangles.size() * sizeof(triangle);
 
   Res.MaterialsSizeAlignment = GetWithAlignment(Res.MaterialsSize, Alignment);
   Res.EnvironmentsSizeAlignment = GetWithAlignment(Res.EnvironmentsSize, Alignment);
@@ -36,93 +44,808 @@ kd_tree::PACKED_SCENE_ELEMENTS_SIZES kd_tree::GetSizesOfPackedSceneElements( UIN
   return Res;
 }
 
+/**
+ * \brief Get bin index function
+ * \param[in] Center Triangle center
+ * \param[in] NumberOfBins Number of bins
+ * \return Bin index
+ */
+INT kd_tree::SAH_SPLIT::GetBin( const vec &Center, const INT NumberOfBins ) const
+{
+  const INT Bin = (INT)((Center.*Axis - Min) * Scale);
+
+  return std::min(std::max(Bin, 0), NumberOfBins - 1);
+}
+
+/**
+ * \brief Get number of threads for tree building function
+ * \return Number of threads
+ */
+INT kd_tree::GetNumberOfThreads( VOID )
+{
+  return parallel_for::GetNumberOfThreads();
+}
+
+/**
+ * \brief Get number of ranges for parallel processing of triangles function
+ * \param[in] N Number of triangles
+ * \return Number of ranges (1 - if triangles should be processed serially)
+ */
+INT kd_tree::GetNumberOfRanges( const size_t N )
+{
+  return N >= ParallelReduceThreshold ? GetNumberOfThreads() : 1;
+}
+
+/**
+ * \brief Get triangles and triangles centers bounds function
+ * \param[in] Indices Triangle indices
+ * \param[in] N Number of triangles
+ * \param[in] Data Per triangle build data
+ * \return Bounds
+ */
+kd_tree::BOUNDS kd_tree::GetBounds( const UINT32 *Indices, const size_t N, const BUILD_DATA &Data )
+{
+  const INT NumberOfRanges = GetNumberOfRanges(N);
+  std::vector<BOUNDS> RangesBounds(NumberOfRanges);
+
+  RunOnRanges(N, NumberOfRanges, [&]( INT Range, size_t Begin, size_t End )
+    {
+      BOUNDS &Res = RangesBounds[Range];
+
+      Res.BB = Data.Boxes[Indices[Begin]];
+      Res.CentersBB = {Data.Centers[Indices[Begin]], Data.Centers[Indices[Begin]]};
+
+      for (size_t i = Begin + 1; i < End; i++)
+      {
+        Res.BB.Expand(Data.Boxes[Indices[i]]);
+        Res.CentersBB.Expand(Data.Centers[Indices[i]]);
+      }
+    });
+
+  for (INT i = 1; i < NumberOfRanges; i++)
+  {
+    RangesBounds[0].BB.Expand(RangesBounds[i].BB);
+    RangesBounds[0].CentersBB.Expand(RangesBounds[i].CentersBB);
+  }
+
+  return RangesBounds[0];
+}
+
+/**
+ * \brief Find best split by binned surface area heuristic function
+ * \param[in] Indices Node triangle indices
+ * \param[in] N Number of node triangles
+ * \param[in] Data Per triangle build data
+ * \param[in] Bounds Node triangles bounds
+ * \param[in] Par Tree building parameters
+ * \return Best split (Axis is nullptr if node can't be splitted)
+ */
+kd_tree::SAH_SPLIT kd_tree::FindSplit( const UINT32 *Indices, const size_t N, const BUILD_DATA &Data,
+                                       const BOUNDS &Bounds, const TREE_PARAMS &Par )
+{
+  /* Bin for split evaluation */
+  struct BIN
+  {
+    /** Bounding box of bin triangles */
+    aabb BB;
+
+    /** Number of bin triangles */
+    INT N = 0;
+
+    /**
+     * \brief Add box to bin function
+     * \param[in] Box Added box
+     * \param[in] Count Number of triangles in box
+     */
+    VOID Add( const aabb &Box, const INT Count )
+    {
+      if (N == 0)
+        BB = Box;
+      else
+        BB.Expand(Box);
+      N += Count;
+    }
+  };
+
+  SAH_SPLIT Best;
+  const FLT Area = Bounds.BB.GetSurfaceArea();
+
+  if (N == 0 || Par.NumberOfBins < 2 || !(Area > 0))
+    return Best;
+
+  FLT vec::* const Axes[3] = {&vec::X, &vec::Y, &vec::Z};
+  SAH_SPLIT Splits[3];
+
+  for (INT Axis = 0; Axis < 3; Axis++)
+  {
+    const FLT Extent = Bounds.CentersBB.Max.*Axes[Axis] - Bounds.CentersBB.Min.*Axes[Axis];
+
+    if (!(Extent > 0))
+      continue;
+
+    Splits[Axis].Axis = Axes[Axis];
+    Splits[Axis].Min = Bounds.CentersBB.Min.*Axes[Axis];
+    Splits[Axis].Scale = Par.NumberOfBins / Extent;
+  }
+
+  // Fill bins of all axes (each range of triangles has own bins)
+  const INT NumberOfRanges = GetNumberOfRanges(N);
+  std::vector<std::vector<BIN>> RangesBins(NumberOfRanges);
+
+  RunOnRanges(N, NumberOfRanges, [&]( INT Range, size_t Begin, size_t End )
+    {
+      std::vector<BIN> &Bins = RangesBins[Range];
+
+      Bins.resize(3 * Par.NumberOfBins);
+      for (size_t i = Begin; i < End; i++)
+      {
+        const vec &Center = Data.Centers[Indices[i]];
+        const aabb &Box = Data.Boxes[Indices[i]];
+
+        for (INT Axis = 0; Axis < 3; Axis++)
+          if (Splits[Axis].Axis != nullptr)
+            Bins[Axis * Par.NumberOfBins + Splits[Axis].GetBin(Center, Par.NumberOfBins)].Add(Box, 1);
+      }
+    });
+
+  std::vector<BIN> &Bins = RangesBins[0];
+
+  for (INT i = 1; i < NumberOfRanges; i++)
+    for (size_t j = 0; j < Bins.size(); j++)
+      if (RangesBins[i][j].N != 0)
+        Bins[j].Add(RangesBins[i][j].BB, RangesBins[i][j].N);
+
+  std::vector<FLT> RightAreas(Par.NumberOfBins);
+  std::vector<INT> RightNumbers(Par.NumberOfBins);
+
+  Best.Cost = INFINITY;
+
+  for (INT Axis = 0; Axis < 3; Axis++)
+  {
+    if (Splits[Axis].Axis == nullptr)
+      continue;
+
+    const BIN *AxisBins = Bins.data() + Axis * Par.NumberOfBins;
+
+    // Sweep from right to left for right subtree costs
+    BIN Accumulated;
+
+    for (INT i = Par.NumberOfBins - 1; i > 0; i--)
+    {
+      if (AxisBins[i].N != 0)
+        Accumulated.Add(AxisBins[i].BB, AxisBins[i].N);
+
+      RightNumbers[i] = Accumulated.N;
+      RightAreas[i] = Accumulated.N == 0 ? 0 : Accumulated.BB.GetSurfaceArea();
+    }
+
+    // Sweep from left to right and evaluate split after each bin
+    Accumulated.N = 0;
+
+    for (INT i = 0; i < Par.NumberOfBins - 1; i++)
+    {
+      if (AxisBins[i].N != 0)
+        Accumulated.Add(AxisBins[i].BB, AxisBins[i].N);
+
+      if (Accumulated.N == 0 || RightNumbers[i + 1] == 0)
+        continue;
+
+      const FLT Cost = Par.TraversalCost + Par.IntersectionCost *
+        (Accumulated.BB.GetSurfaceArea() * Accumulated.N + RightAreas[i + 1] * RightNumbers[i + 1]) / Area;
+
+      if (Cost < Best.Cost)
+      {
+        Best = Splits[Axis];
+        Best.Bin = i;
+        Best.Cost = Cost;
+      }
+    }
+  }
+
+  return Best;
+}
+
 /**
  * \brief Recursive build tree function
- * \param[in] Tr Triangle for build
+ * \param[in, out] Node Built node
+ * \param[in, out] Indices All triangle indices (node range is reordered)
+ * \param[in] Offset Node triangles offset in indices array
+ * \param[in] N Number of node triangles
+ * \param[in] Data Per triangle build data
+ * \param[in] Depth Depth of current level
+ * \param[in] Par Tree building parameters
+ * \param[in, out] Tasks Subtree tasks (nullptr - whole subtree is built by calling thread)
+ * \return Number of nodes in subtree (without nodes of collected tasks)
+ */
+INT64 kd_tree::BuildRec( BUILD_NODE &Node, UINT32 *Indices, const UINT32 Offset, const size_t N,
+                         const BUILD_DATA &Data, const INT Depth, const TREE_PARAMS &Par, BUILD_TASKS *Tasks )
+{
+  UINT32 *NodeIndices = Indices + Offset;
+
+  Node.TrianglesOffset = Offset;
+  Node.NumOfTriangles = N;
+
+  if (N == 0)
+  {
+    Node.BB = {vec::Make(), vec::Make()};
+    return 1;
+  }
+
+  const BOUNDS Bounds = GetBounds(NodeIndices, N, Data);
+
+  Node.BB = Bounds.BB;
+
+  if (Depth > Par.MaxDepthTree || N < static_cast<size_t>(Par.MinNumOfTriangleLeaf))
+    return 1;
+
+  const SAH_SPLIT Split = FindSplit(NodeIndices, N, Data, Bounds, Par);
+
+  // Stop if split is impossible or leaf is cheaper than split
+  if (Split.Axis == nullptr ||
+      (Split.Cost >= Par.IntersectionCost * N && N <= static_cast<size_t>(Par.MaxNumOfTriangleLeaf)))
+    return 1;
+
+  const size_t LeftN =
+    std::partition(NodeIndices, NodeIndices + N, [&]( UINT32 Index )
+      {
+        return Split.GetBin(Data.Centers[Index], Par.NumberOfBins) <= Split.Bin;
+      }) - NodeIndices;
+
+  if (LeftN == 0 || LeftN == N)
+    return 1;
+
+  Node.NumOfTriangles = 0;
+  Node.SplitAxis = Split.Axis == &vec::X ? 0 : Split.Axis == &vec::Y ? 1 : 2;
+  Node.Left = std::make_unique<BUILD_NODE>();
+  Node.Right = std::make_unique<BUILD_NODE>();
+
+  if (Tasks == nullptr)
+  {
+    const INT64 LeftNodes = BuildRec(*Node.Left, Indices, Offset, LeftN, Data, Depth + 1, Par);
+
+    return 1 + LeftNodes + BuildRec(*Node.Right, Indices, Offset + LeftN, N - LeftN, Data, Depth + 1, Par);
+  }
+
+  // Small enough children are left to pool threads, big ones are splitted further by calling thread
+  const BUILD_TASK Children[2] =
+  {
+    {Node.Left.get(), Offset, LeftN, Depth + 1},
+    {Node.Right.get(), Offset + (UINT32)LeftN, N - LeftN, Depth + 1}
+  };
+  INT64 NumOfNodes = 1;
+
+  for (const BUILD_TASK &Child : Children)
+    if (Child.N <= Tasks->MaxTaskSize)
+      Tasks->List.push_back(Child);
+    else
+      NumOfNodes += BuildRec(*Child.Node, Indices, Child.Offset, Child.N, Data, Child.Depth, Par, Tasks);
+
+  return NumOfNodes;
+}
+
+/**
+ * \brief Build subtree function (top levels are built by calling thread, lower subtrees are tasks of threads pool)
+ * \param[in, out] Node Built node
+ * \param[in, out] Indices All triangle indices (node range is reordered)
+ * \param[in] Offset Node triangles offset in indices array
+ * \param[in] N Number of node triangles
+ * \param[in] Data Per triangle build data
  * \param[in] Depth Depth of current level
- * \param[in, out] BS Building structure
- * \param[in] U Node index in array
- * \param[in, out] MaxU Maximal node index
  * \param[in] Par Tree building parameters
+ * \return Number of nodes in subtree
+ */
+INT64 kd_tree::BuildSubtree( BUILD_NODE &Node, UINT32 *Indices, const UINT32 Offset, const size_t N,
+                             const BUILD_DATA &Data, const INT Depth, const TREE_PARAMS &Par )
+{
+  const INT NumberOfThreads = GetNumberOfThreads();
+
+  if (NumberOfThreads == 1 || N < ParallelBuildThreshold)
+    return BuildRec(Node, Indices, Offset, N, Data, Depth, Par);
+
+  BUILD_TASKS Tasks;
+
+  Tasks.MaxTaskSize = std::max(N / (NumberOfThreads * BuildTasksPerThread), ParallelBuildThreshold);
+
+  INT64 NumOfNodes = BuildRec(Node, Indices, Offset, N, Data, Depth, Par, &Tasks);
+
+  // Biggest tasks are started first, smaller ones fill the gaps (threads steal the rest)
+  std::sort(Tasks.List.begin(), Tasks.List.end(), []( const BUILD_TASK &A, const BUILD_TASK &B )
+    {
+      return A.N > B.N;
+    });
+
+  std::vector<INT64> TasksNodes(Tasks.List.size());
+
+  parallel_for::Run((INT)Tasks.List.size(), [&]( INT i )
+    {
+      const BUILD_TASK &Task = Tasks.List[i];
+
+      TasksNodes[i] = BuildRec(*Task.Node, Indices, Task.Offset, Task.N, Data, Task.Depth, Par);
+    });
+
+  for (const INT64 TaskNodes : TasksNodes)
+    NumOfNodes += TaskNodes;
+  return NumOfNodes;
+}
+
+/**
+ * \brief Build packed nodes over arbitrary primitives function
+ * \param[in] Boxes Primitives bounding boxes
+ * \param[in] Centers Primitives centers
+ * \param[in] Par Building parameters
+ * \param[out] Nodes Packed nodes in depth-first order
+ * \param[out] Order Primitives indices in leaves order (leaf offsets index this array)
  */
-VOID kd_tree::BuildRec( const std::vector<triangle> &Tr, const INT Depth,
-                        std::vector<std::vector<triangle>> &BS,
-                        const INT64 U, INT64 &MaxU, const TREE_PARAMS &Par )
+VOID kd_tree::BuildNodes( const std::vector<aabb> &Boxes, const std::vector<vec> &Centers, const TREE_PARAMS &Par,
+                          std::vector<kd_tree_node_data> *Nodes, std::vector<UINT32> *Order )
 {
-  IsLeaf = FALSE;
-  MaxU = std::max(U, MaxU);
+  if (Par.MaxDepthTree + 1 >= TraversalStackSize)
+    error("Maximal tree depth is too big");
 
-  if (Depth > Par.MaxDepthTree || Tr.size() < Par.NumOfTriangleLeaf)
+  const BUILD_DATA Data = {Boxes, Centers};
+  BUILD_NODE Root;
+
+  Nodes->clear();
+  Order->resize(Boxes.size());
+  for (UINT32 i = 0; i < Boxes.size(); i++)
+    (*Order)[i] = i;
+
+  Nodes->reserve(BuildSubtree(Root, Order->data(), 0, Boxes.size(), Data, 0, Par));
+  PackTree(Root, Nodes);
+}
+
+/**
+ * \brief Build tree function
+ * \param[in] Tr Triangles for building (stored in tree in leaves order)
+ * \param[in] Par Building parameters
+ */
+VOID kd_tree::Build( std::vector<triangle> Tr, const TREE_PARAMS &Par )
+{
+  Clear();
+
+  std::vector<aabb> Boxes(Tr.size());
+  std::vector<vec> Centers(Tr.size());
+  std::vector<UINT32> Indices;
+
+  RunOnRanges(Tr.size(), GetNumberOfRanges(Tr.size()), [&]( INT, size_t Begin, size_t End )
+    {
+      for (size_t i = Begin; i < End; i++)
+      {
+        Boxes[i] = Tr[i].GetBB();
+        Centers[i] = Tr[i].GetMiddle();
+      }
+    });
+
+  BuildNodes(Boxes, Centers, Par, &BuiltNodes, &Indices);
+  BuiltOrder = Indices;
+
+  // Place triangles in leaves order by following permutation cycles (processed indices are marked as fixed points)
+  for (UINT32 i = 0; i < Tr.size(); i++)
   {
-    if (Tr.size() > 0)
-      BB = Tr[0].GetBB();
-    Triangles = Tr;
-    IsLeaf = TRUE;
-    for (std::vector<triangle>::const_iterator It = Tr.cbegin() + 1;
-         It != Tr.cend(); It++)
+    if (Indices[i] == i)
+      continue;
+
+    const triangle First = Tr[i];
+    UINT32 j = i;
+
+    while (Indices[j] != i)
     {
-      BB.Expand(It->GetBB());
+      const UINT32 Next = Indices[j];
+
+      Tr[j] = Tr[Next];
+      Indices[j] = j;
+      j = Next;
     }
+    Tr[j] = First;
+    Indices[j] = j;
+  }
+
+  BuiltTriangles = std::move(Tr);
+  Nodes = BuiltNodes;
+  Triangles = BuiltTriangles;
+  Order = BuiltOrder;
+
+  EvaluateCosts(Par, &BuildCosts);
+  RootBuildCost = BuildCosts[0];
+}
+
+/**
+ * \brief Build tree or load it from cache function
+ * \param[in] Key Hash of build input (building parameters are added to it)
+ * \param[in] NumOfTriangles Number of triangles returned by GetTriangles (checked on cache load)
+ * \param[in] GetTriangles Function which returns triangles for building (called only if cache is not used)
+ * \param[in] Par Building parameters (cache is used if CachePath is not empty)
+ */
+VOID kd_tree::BuildCached( hasher Key, const UINT64 NumOfTriangles,
+                           const std::function<std::vector<triangle> (VOID)> &GetTriangles, const TREE_PARAMS &Par )
+{
+  if (Par.CachePath.empty())
+  {
+    Build(GetTriangles(), Par);
     return;
   }
 
-  vec Middle = vec::Make();
-  BB = Tr[0].GetBB();
-  for (std::vector<triangle>::const_iterator It = Tr.cbegin() + 1;
-       It != Tr.cend(); It++)
+  Key.Add(CacheVersion);
+  Key.Add(Par.MaxDepthTree);
+  Key.Add(Par.MinNumOfTriangleLeaf);
+  Key.Add(Par.MaxNumOfTriangleLeaf);
+  Key.Add(Par.NumberOfBins);
+  Key.Add(Par.TraversalCost);
+  Key.Add(Par.IntersectionCost);
+
+  CHAR KeyStr[17];
+
+  snprintf(KeyStr, sizeof(KeyStr), "%016llx", (unsigned long long)Key.Get());
+
+  const std::string FileName = (std::filesystem::path(Par.CachePath) / (std::string(KeyStr) + ".tree")).string();
+
+  if (Load(FileName, Key.Get(), NumOfTriangles))
   {
-    BB.Expand(It->GetBB());
-    Middle += It->GetMiddle();
+    EvaluateCosts(Par, &BuildCosts);
+    RootBuildCost = BuildCosts[0];
+    return;
   }
-  Middle /= Tr.size();
 
-  std::vector<triangle> &LeftTr(BS[Depth * 2]);
-  std::vector<triangle> &RightTr(BS[Depth * 2 + 1]);
-  LeftTr.clear();
-  RightTr.clear();
+  Build(GetTriangles(), Par);
+
+  // Tree of unexpected triangles number would never be loaded
+  if (Triangles.size() != NumOfTriangles)
+    std::cout << "Tree cache file '" + FileName + "' is not saved: unexpected number of triangles\n";
+  else if (!Save(FileName, Key.Get()))
+    std::cout << "Tree cache file '" + FileName + "' is not saved\n";
+}
+
+/**
+ * \brief Replace triangles without tree nodes change function (e.g. if only materials are changed)
+ * \param[in] Tr New triangles in build input order (same number as in tree)
+ * \return TRUE-if triangles replaced, FALSE-if number of triangles is changed (tree must be rebuilt)
+ */
+BOOL kd_tree::SetTriangles( const std::vector<triangle> &Tr )
+{
+  if (Tr.size() != Triangles.size())
+    return FALSE;
+
+  DetachFromCache();
+
+  RunOnRanges(Tr.size(), GetNumberOfRanges(Tr.size()), [&]( INT, size_t Begin, size_t End )
+    {
+      for (size_t i = Begin; i < End; i++)
+        BuiltTriangles[i] = Tr[BuiltOrder[i]];
+    });
+
+  return TRUE;
+}
+
+/**
+ * \brief Refit nodes bounds to current triangles function (degraded subtrees are rebuilt)
+ * \param[in] Par Building parameters
+ * \return TRUE-if tree refitted, FALSE-if tree quality is too low (tree must be rebuilt)
+ */
+BOOL kd_tree::Refit( const TREE_PARAMS &Par )
+{
+  if (Nodes.empty())
+    return FALSE;
+
+  DetachFromCache();
+
+  // Leaves bounds are independent, inner nodes are processed from the end (children are after parent)
+  RunOnRanges(BuiltNodes.size(), GetNumberOfRanges(BuiltNodes.size()), [&]( INT, size_t Begin, size_t End )
+    {
+      for (size_t i = Begin; i < End; i++)
+      {
+        kd_tree_node_data &Node = BuiltNodes[i];
+
+        if (Node.NumOfTriangles <= 0)
+          continue;
+
+        aabb BB = BuiltTriangles[Node.Offset].GetBB();
+
+        for (UINT32 j = Node.Offset + 1; j < Node.Offset + Node.NumOfTriangles; j++)
+          BB.Expand(BuiltTriangles[j].GetBB());
+        Node.SetBB(BB);
+      }
+    });
+
+  for (size_t i = BuiltNodes.size(); i-- > 0; )
+    if (BuiltNodes[i].NumOfTriangles < 0)
+    {
+      aabb BB = BuiltNodes[i + 1].GetBB();
+
+      BB.Expand(BuiltNodes[BuiltNodes[i].Offset].GetBB());
+      BuiltNodes[i].SetBB(BB);
+    }
+
+  std::vector<FLT> Costs;
+
+  EvaluateCosts(Par, &Costs);
+  if (Costs[0] <= RootBuildCost * Par.RebuildThreshold)
+    return TRUE;
+
+  // Rebuild only subtrees which lost quality, whole tree is rebuilt if they are too big
+  std::vector<BOOL> IsRebuilt(BuiltNodes.size(), FALSE);
+
+  if (FindDegradedSubtrees(0, Costs, Par, &IsRebuilt) > BuiltTriangles.size() / 2)
+    return FALSE;
+
+  const size_t N = BuiltTriangles.size();
+  std::vector<aabb> Boxes(N);
+  std::vector<vec> Centers(N);
+  std::vector<UINT32> Indices(N);
+
+  RunOnRanges(N, GetNumberOfRanges(N), [&]( INT, size_t Begin, size_t End )
+    {
+      for (size_t i = Begin; i < End; i++)
+      {
+        Boxes[i] = BuiltTriangles[i].GetBB();
+        Centers[i] = BuiltTriangles[i].GetMiddle();
+        Indices[i] = i;
+      }
+    });
+
+  const BUILD_DATA Data = {Boxes, Centers};
+  std::vector<kd_tree_node_data> NewNodes;
+  std::vector<triangle> NewTriangles(N);
+  std::vector<UINT32> NewOrder(N);
+
+  NewNodes.reserve(BuiltNodes.size());
+  RebuildRec(0, 0, IsRebuilt, Indices.data(), Data, Par, &NewNodes);
+
+  RunOnRanges(N, GetNumberOfRanges(N), [&]( INT, size_t Begin, size_t End )
+    {
+      for (size_t i = Begin; i < End; i++)
+      {
+        NewTriangles[i] = BuiltTriangles[Indices[i]];
+        NewOrder[i] = BuiltOrder[Indices[i]];
+      }
+    });
+
+  BuiltNodes = std::move(NewNodes);
+  BuiltTriangles = std::move(NewTriangles);
+  BuiltOrder = std::move(NewOrder);
+  Nodes = BuiltNodes;
+  Triangles = BuiltTriangles;
+  Order = BuiltOrder;
+
+  EvaluateCosts(Par, &BuildCosts);
 
-  FLT vec::* Axis = BB.MaxAxis();
+  return BuildCosts[0] <= RootBuildCost * Par.RebuildThreshold;
+}
+
+/**
+ * \brief Evaluate SAH costs of all nodes function
+ * \param[in] Par Tree building parameters
+ * \param[out] Costs Nodes costs (expected cost of ray query in node subtree, if node is hit)
+ */
+VOID kd_tree::EvaluateCosts( const TREE_PARAMS &Par, std::vector<FLT> *Costs ) const
+{
+  Costs->resize(Nodes.size());
 
-  for (std::vector<triangle>::const_iterator It = Tr.cbegin();
-       It != Tr.cend(); It++)
+  for (size_t i = Nodes.size(); i-- > 0; )
   {
-    if (Middle.*Axis > It->GetMiddle().*Axis)
-      RightTr.push_back(*It);
+    const kd_tree_node_data &Node = Nodes[i];
+
+    if (Node.NumOfTriangles >= 0)
+    {
+      (*Costs)[i] = Par.IntersectionCost * Node.NumOfTriangles;
+      continue;
+    }
+
+    const FLT Area = Node.GetBB().GetSurfaceArea();
+    const FLT LeftArea = Nodes[i + 1].GetBB().GetSurfaceArea();
+    const FLT RightArea = Nodes[Node.Offset].GetBB().GetSurfaceArea();
+
+    // Degenerate (flat) node - children are hit with equal probability
+    if (Area <= 0)
+      (*Costs)[i] = Par.TraversalCost + ((*Costs)[i + 1] + (*Costs)[Node.Offset]) / 2;
     else
-      LeftTr.push_back(*It);
+      (*Costs)[i] = Par.TraversalCost + (LeftArea * (*Costs)[i + 1] + RightArea * (*Costs)[Node.Offset]) / Area;
   }
+}
+
+/**
+ * \brief Get range of subtree triangles function
+ * \param[in] U Subtree root index
+ * \param[out] Begin First triangle index
+ * \param[out] End Index after last triangle
+ */
+VOID kd_tree::GetTrianglesRange( UINT32 U, UINT32 *Begin, UINT32 *End ) const
+{
+  UINT32 Last = U;
 
-  if (LeftTr.empty() || RightTr.empty())
+  while (Nodes[U].NumOfTriangles < 0)
+    U++;
+  while (Nodes[Last].NumOfTriangles < 0)
+    Last = Nodes[Last].Offset;
+
+  *Begin = Nodes[U].Offset;
+  *End = Nodes[Last].Offset + Nodes[Last].NumOfTriangles;
+}
+
+/**
+ * \brief Find degraded subtrees for rebuild function
+ * \param[in] U Degraded subtree root index
+ * \param[in] Costs Refitted nodes costs
+ * \param[in] Par Tree building parameters
+ * \param[in, out] IsRebuilt Nodes rebuild flags (roots of rebuilt subtrees are marked)
+ * \return Number of triangles in rebuilt subtrees
+ */
+UINT64 kd_tree::FindDegradedSubtrees( const UINT32 U, const std::vector<FLT> &Costs, const TREE_PARAMS &Par,
+                                      std::vector<BOOL> *IsRebuilt ) const
+{
+  UINT64 NumOfRebuilt = 0;
+  BOOL IsChildDegraded = FALSE;
+
+  // Descend while degradation is localized in children, otherwise node split itself became bad
+  for (const UINT32 Child : {U + 1, Nodes[U].Offset})
+    if (Nodes[Child].NumOfTriangles < 0 && Costs[Child] > BuildCosts[Child] * Par.RebuildThreshold)
+    {
+      IsChildDegraded = TRUE;
+      NumOfRebuilt += FindDegradedSubtrees(Child, Costs, Par, IsRebuilt);
+    }
+
+  if (IsChildDegraded)
+    return NumOfRebuilt;
+
+  UINT32 Begin, End;
+
+  GetTrianglesRange(U, &Begin, &End);
+  (*IsRebuilt)[U] = TRUE;
+
+  return End - Begin;
+}
+
+/**
+ * \brief Copy tree with rebuild of marked subtrees function
+ * \param[in] U Copied node index
+ * \param[in] Depth Depth of node
+ * \param[in] IsRebuilt Nodes rebuild flags
+ * \param[in, out] Indices Triangle indices (rebuilt subtrees ranges are reordered)
+ * \param[in] Data Per triangle build data
+ * \param[in] Par Tree building parameters
+ * \param[in, out] NewNodes Packed nodes of new tree
+ */
+VOID kd_tree::RebuildRec( const UINT32 U, const INT Depth, const std::vector<BOOL> &IsRebuilt, UINT32 *Indices,
+                          const BUILD_DATA &Data, const TREE_PARAMS &Par,
+                          std::vector<kd_tree_node_data> *NewNodes ) const
+{
+  if (IsRebuilt[U])
   {
-    IsLeaf = TRUE;
-    Triangles = Tr;
+    UINT32 Begin, End;
+    BUILD_NODE Root;
+
+    GetTrianglesRange(U, &Begin, &End);
+    BuildSubtree(Root, Indices, Begin, End - Begin, Data, Depth, Par);
+    PackTree(Root, NewNodes);
     return;
   }
 
-  Left = std::make_unique<kd_tree>();
+  const UINT64 V = NewNodes->size();
 
-  Left->BuildRec(LeftTr, Depth + 1, BS, 2 * U + 1, MaxU, Par);
-  LeftTr.clear();
+  NewNodes->push_back(Nodes[U]);
+  if (Nodes[U].NumOfTriangles >= 0)
+    return;
 
-  Right = std::make_unique<kd_tree>();;
+  RebuildRec(U + 1, Depth + 1, IsRebuilt, Indices, Data, Par, NewNodes);
+  (*NewNodes)[V].Offset = NewNodes->size();
+  RebuildRec(Nodes[U].Offset, Depth + 1, IsRebuilt, Indices, Data, Par, NewNodes);
+}
+
+/**
+ * \brief Copy tree from cache file to own storage function (before tree modification)
+ */
+VOID kd_tree::DetachFromCache( VOID )
+{
+  if (CacheFile == nullptr)
+    return;
 
-  Right->BuildRec(RightTr, Depth + 1, BS, 2 * U + 2, MaxU, Par);
-  RightTr.clear();
+  BuiltNodes.assign(Nodes.begin(), Nodes.end());
+  BuiltTriangles.assign(Triangles.begin(), Triangles.end());
+  BuiltOrder.assign(Order.begin(), Order.end());
+  Nodes = BuiltNodes;
+  Triangles = BuiltTriangles;
+  Order = BuiltOrder;
+  CacheFile.reset();
 }
 
 /**
- * \brief Build tree function
- * \param[in] Tr Triangles for building
- * \param[in] Par Building parameters
+ * \brief Load tree from cache file function
+ * \param[in] FileName Cache file name
+ * \param[in] Key Build input hash
+ * \param[in] NumOfTriangles Number of build input triangles (rejects files of colliding keys)
+ * \return TRUE-if tree loaded, FALSE-if file is missing or not valid
  */
-VOID kd_tree::Build( const std::vector<triangle> &Tr, const TREE_PARAMS &Par )
+BOOL kd_tree::Load( const std::string &FileName, const UINT64 Key, const UINT64 NumOfTriangles )
 {
-  NumberOfTrianglesInTree = Tr.size();
+  std::unique_ptr<mapped_file> File = std::make_unique<mapped_file>();
+
+  if (!File->Open(FileName) || File->GetSize() < sizeof(CACHE_HEADER))
+    return FALSE;
+
+  CACHE_HEADER Header;
+
+  memcpy(&Header, File->GetData(), sizeof(CACHE_HEADER));
+
+  if (memcmp(Header.Signature, CacheSignature, sizeof(CacheSignature)) != 0 ||
+      Header.Version != CacheVersion ||
+      Header.NodeSize != sizeof(kd_tree_node_data) ||
+      Header.TriangleSize != sizeof(triangle) ||
+      Header.Key != Key ||
+      Header.NumOfTriangles != NumOfTriangles ||
+      Header.NodesOffset % CacheAlignment != 0 ||
+      Header.TrianglesOffset % CacheAlignment != 0 ||
+      Header.OrderOffset % CacheAlignment != 0 ||
+      Header.NumOfNodes == 0 ||
+      Header.NodesOffset + Header.NumOfNodes * sizeof(kd_tree_node_data) > File->GetSize() ||
+      Header.TrianglesOffset + Header.NumOfTriangles * sizeof(triangle) > File->GetSize() ||
+      Header.OrderOffset + Header.NumOfTriangles * sizeof(UINT32) > File->GetSize())
+  {
+    return FALSE;
+  }
+
   Clear();
-  BuildStructure.clear();
-  BuildStructure.resize(2 * (Par.MaxDepthTree + 1));
-  BuildRec(Tr, 0, BuildStructure, 0, MaxUForGPUPack, Par);
-  BuildStructure.clear();
+  Nodes = array_view<kd_tree_node_data>(
+    reinterpret_cast<const kd_tree_node_data *>(File->GetData() + Header.NodesOffset), Header.NumOfNodes);
+  Triangles = array_view<triangle>(
+    reinterpret_cast<const triangle *>(File->GetData() + Header.TrianglesOffset), Header.NumOfTriangles);
+  Order = array_view<UINT32>(
+    reinterpret_cast<const UINT32 *>(File->GetData() + Header.OrderOffset), Header.NumOfTriangles);
+  CacheFile = std::move(File);
+
+  return TRUE;
+}
+
+/**
+ * \brief Save tree to cache file function
+ * \param[in] FileName Cache file name
+ * \param[in] Key Build input hash
+ * \return TRUE-if tree saved, FALSE-otherwise
+ */
+BOOL kd_tree::Save( const std::string &FileName, const UINT64 Key ) const
+{
+  CACHE_HEADER Header = {};
+
+  memcpy(Header.Signature, CacheSignature, sizeof(CacheSignature));
+  Header.Version = CacheVersion;
+  Header.NodeSize = sizeof(kd_tree_node_data);
+  Header.TriangleSize = sizeof(triangle);
+  Header.Key = Key;
+  Header.NumOfNodes = Nodes.size();
+  Header.NumOfTriangles = Triangles.size();
+  Header.NodesOffset = GetWithAlignment(sizeof(CACHE_HEADER), CacheAlignment);
+  Header.TrianglesOffset =
+    GetWithAlignment(Header.NodesOffset + Nodes.size() * sizeof(kd_tree_node_data), CacheAlignment);
+  Header.OrderOffset =
+    GetWithAlignment(Header.TrianglesOffset + Triangles.size() * sizeof(triangle), CacheAlignment);
+
+  std::error_code Error;
+
+  std::filesystem::create_directories(std::filesystem::path(FileName).parent_path(), Error);
+  Error.clear();
+
+  // Write to temporary file and rename it, so concurrent runs never see partially written cache
+  const std::string TmpFileName = FileName + "." + std::to_string(std::random_device()()) + ".tmp";
+  std::ofstream File(TmpFileName, std::ios::binary);
+  const CHAR Zeros[CacheAlignment] = {};
+
+  File.write(reinterpret_cast<const CHAR *>(&Header), sizeof(CACHE_HEADER));
+  File.write(Zeros, Header.NodesOffset - sizeof(CACHE_HEADER));
+  File.write(reinterpret_cast<const CHAR *>(Nodes.data()), Nodes.size() * sizeof(kd_tree_node_data));
+  File.write(Zeros, Header.TrianglesOffset - Header.NodesOffset - Nodes.size() * sizeof(kd_tree_node_data));
+  File.write(reinterpret_cast<const CHAR *>(Triangles.data()), Triangles.size() * sizeof(triangle));
+  File.write(Zeros, Header.OrderOffset - Header.TrianglesOffset - Triangles.size() * sizeof(triangle));
+  File.write(reinterpret_cast<const CHAR *>(Order.data()), Order.size() * sizeof(UINT32));
+  File.close();
+
+  if (File)
+    std::filesystem::rename(TmpFileName, FileName, Error);
+
+  if (!File || Error)
+  {
+    std::filesystem::remove(TmpFileName, Error);
+    return FALSE;
+  }
+
+  return TRUE;
 }
 
 /**
@@ -135,40 +858,153 @@ VOID kd_tree::Build( const std::vector<triangle> &Tr, const TREE_PARAMS &Par )
  */
 BOOL kd_tree::Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const
 {
+  UINT32 Stack[TraversalStackSize];
+  INT StackSize = 0;
+  UINT32 U = 0;
+  BOOL Hit = FALSE;
   FLT Dist;
+  INTR CurIntr;
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+  UINT64 VisitedNodes = 0;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
 
-  if (BB.Intersect(R, &Dist))
+  while (!Nodes.empty())
   {
-    if (Dist > *Near)
-      return FALSE;
+    const kd_tree_node_data &Node = Nodes[U];
 
-    if (!IsLeaf)
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+    VisitedNodes++;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+    if (Node.Intersect(R, &Dist) && Dist <= *Near)
     {
-      const BOOL LeftHit = Left->Intersect(R, Intr, Near, Par);
-      const BOOL RightHit = Right->Intersect(R, Intr, Near, Par);
-      
-      return LeftHit || RightHit;
+      if (Node.NumOfTriangles >= 0) // Leaf
+      {
+        for (UINT32 i = Node.Offset; i < Node.Offset + Node.NumOfTriangles; i++)
+          if (Triangles[i].Intersect(R, &CurIntr, Par) && CurIntr.T < *Near)
+          {
+            Hit = TRUE;
+            *Near = CurIntr.T;
+            *Intr = CurIntr;
+          }
+      }
+      else
+      {
+        // Visit near child first (left subtree is next node), far child is culled by its box if hit is closer
+        const INT SplitAxis = -1 - Node.NumOfTriangles;
+        const FLT DirAlongAxis = SplitAxis == 0 ? R.Dir.X : SplitAxis == 1 ? R.Dir.Y : R.Dir.Z;
+
+        if (DirAlongAxis < 0)
+        {
+          Stack[StackSize++] = U + 1;
+          U = Node.Offset;
+        }
+        else
+        {
+          Stack[StackSize++] = Node.Offset;
+          U++;
+        }
+        continue;
+      }
     }
-    else
-    {
-      BOOL Hit = FALSE;
-      INTR CurIntr;
 
-      for (std::vector<triangle>::const_iterator It = Triangles.cbegin();
-           It != Triangles.cend(); It++)
+    if (StackSize == 0)
+      break;
+    U = Stack[--StackSize];
+  }
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+  NumOfVisitedNodes.fetch_add(VisitedNodes, std::memory_order_relaxed);
+  NumOfIntersectionRequests.fetch_add(1, std::memory_order_relaxed);
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+  return Hit;
+}
+
+/**
+ * \brief Check if any intersection with ray is closer than distance function (traversal stops at first found one)
+ * \param[in] R Ray
+ * \param[in] MaxDist Distance along ray
+ * \param[in] Par Render parameters
+ * \return TRUE-if ray is occluded, FALSE-if otherwise
+ */
+BOOL kd_tree::Occluded( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const
+{
+  UINT32 Stack[TraversalStackSize];
+  INT StackSize = 0;
+  UINT32 U = 0;
+  BOOL Hit = FALSE;
+  FLT Dist;
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+  UINT64 VisitedNodes = 0;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+  while (!Nodes.empty() && !Hit)
+  {
+    const kd_tree_node_data &Node = Nodes[U];
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+    VisitedNodes++;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+    if (Node.Intersect(R, &Dist) && Dist <= MaxDist)
+    {
+      if (Node.NumOfTriangles >= 0) // Leaf
+      {
+        for (UINT32 i = Node.Offset; i < Node.Offset + Node.NumOfTriangles && !Hit; i++)
+          Hit = Triangles[i].IsIntersected(R, MaxDist, Par);
+      }
+      else
       {
-        if (It->Intersect(R, &CurIntr, Par) && CurIntr.T < *Near)
+        // Near child is still visited first, it is more likely to contain occluder
+        const INT SplitAxis = -1 - Node.NumOfTriangles;
+        const FLT DirAlongAxis = SplitAxis == 0 ? R.Dir.X : SplitAxis == 1 ? R.Dir.Y : R.Dir.Z;
+
+        if (DirAlongAxis < 0)
         {
-          Hit = TRUE;
-          *Near = CurIntr.T;
-          *Intr = CurIntr;
+          Stack[StackSize++] = U + 1;
+          U = Node.Offset;
         }
+        else
+        {
+          Stack[StackSize++] = Node.Offset;
+          U++;
+        }
+        continue;
       }
-
-      return Hit;
     }
+
+    if (StackSize == 0)
+      break;
+    U = Stack[--StackSize];
   }
-  return FALSE;
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+  NumOfVisitedNodes.fetch_add(VisitedNodes, std::memory_order_relaxed);
+  NumOfIntersectionRequests.fetch_add(1, std::memory_order_relaxed);
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+  return Hit;
+}
+
+/**
+ * \brief Get packed tree nodes function
+ * \return Nodes in depth-first order
+ */
+array_view<kd_tree_node_data> kd_tree::GetNodes( VOID ) const
+{
+  return Nodes;
+}
+
+/**
+ * \brief Get tree triangles function
+ * \return Triangles in leaves order
+ */
+array_view<triangle> kd_tree::GetTriangles( VOID ) const
+{
+  return Triangles;
 }
 
 /**
@@ -176,12 +1012,15 @@ BOOL kd_tree::Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAM
  */
 VOID kd_tree::Clear( VOID )
 {
-  BB.Min = vec::Make();
-  BB.Max = vec::Make();
-  Left = nullptr;
-  Right = nullptr;
-  Triangles.clear();
-  IsLeaf = FALSE;
+  Nodes = array_view<kd_tree_node_data>();
+  Triangles = array_view<triangle>();
+  Order = array_view<UINT32>();
+  BuiltNodes.clear();
+  BuiltTriangles.clear();
+  BuiltOrder.clear();
+  BuildCosts.clear();
+  RootBuildCost = 0;
+  CacheFile.reset();
 }
 
 /**
@@ -208,40 +1047,33 @@ VOID kd_tree::FillSceneData( BYTE *Buffer, UINT64 Alignment ) const
   memcpy(Buffer + Offset, environment::Table.data(), environment::Table.size() * sizeof(environment));
   Offset += Sizes.EnvironmentsSizeAlignment;
 
-  UINT64 TrianglesOffset = 0;
+  memcpy(Buffer + Offset, Triangles.data(), Sizes.TrianglesSize);
+  Offset += Sizes.TrianglesSizeAlignment;
 
-  PackTree(reinterpret_cast<triangle *>(Buffer + Offset),
-           reinterpret_cast<kd_tree_node_data *>(Buffer + Sizes.TrianglesSizeAlignment + Offset),
-           0, &TrianglesOffset);
+  memcpy(Buffer + Offset, Nodes.data(), Sizes.NodesSize);
 }
 
 /**
- * \brief Pack tree for gpu_render
- * \param[in, out] TrianglesBuffer Buffer for write triangles
- * \param[in, out] NodesBuffer Buffer for write packed tree nodes
- * \param[in] U Current node index
- * \param[in] TrianglesOffset Triangles offset in buffer
+ * \brief Pack tree in depth-first order function
+ * \param[in] Node Packed node
+ * \param[in, out] Nodes Packed nodes array
  */
-VOID kd_tree::PackTree( triangle *TrianglesBuffer,
-                        kd_tree_node_data *NodesBuffer,
-                        UINT64 U, UINT64 *TrianglesOffset ) const
+VOID kd_tree::PackTree( const BUILD_NODE &Node, std::vector<kd_tree_node_data> *Nodes )
 {
-  NodesBuffer[U].BB = BB;
-  NodesBuffer[U].NumOfTriangles = IsLeaf ? (INT64)Triangles.size() : -1;
-  NodesBuffer[U].TrianglesOffset = *TrianglesOffset;
+  const UINT64 U = Nodes->size();
 
-  if (IsLeaf && !Triangles.empty())
-  {
-    memcpy(TrianglesBuffer + *TrianglesOffset,
-           Triangles.data(),
-           Triangles.size() * sizeof(triangle));
-  }
-
-  *TrianglesOffset += Triangles.size();
+  Nodes->emplace_back();
+  (*Nodes)[U].SetBB(Node.BB);
 
-  if (!IsLeaf)
+  if (Node.Left == nullptr)
   {
-    Left->PackTree(TrianglesBuffer, NodesBuffer, 2 * U + 1, TrianglesOffset);
-    Right->PackTree(TrianglesBuffer, NodesBuffer, 2 * U + 2, TrianglesOffset);
+    (*Nodes)[U].Offset = Node.TrianglesOffset;
+    (*Nodes)[U].NumOfTriangles = Node.NumOfTriangles;
+    return;
   }
+
+  (*Nodes)[U].NumOfTriangles = -1 - Node.SplitAxis;
+  PackTree(*Node.Left, Nodes);
+  (*Nodes)[U].Offset = Nodes->size();
+  PackTree(*Node.Right, Nodes);
 }
@@ -1,73 +1,373 @@
 #ifndef __kd_tree_h_
 #define __kd_tree_h_
 
+#include <functional>
 #include <vector>
 #include <memory>
+#include <string>
 
+#include "acceleration_structure.h"
 #include "triangle.h"
 #include "aabb.h"
 #include "scene_data.h"
 #include "kd_tree_node_data.h"
+#include "utils/array_view.h"
+#include "utils/hasher.h"
+#include "utils/mapped_file.h"
+#include "utils/parallel_for.h"
 
 /**
  * \brief Tree for fast intersection
  */
-class kd_tree
+class kd_tree : public acceleration_structure
 {
 private:
-  /** Node bounding box */
-  aabb BB =
-    {
-      vec::Make(),
-      vec::Make()
-    };
+  /** Packed tree nodes in depth-first order (points to built nodes or to cache file) */
+  array_view<kd_tree_node_data> Nodes;
+
+  /** Tree triangles ordered by leaves (points to built triangles or to cache file) */
+  array_view<triangle> Triangles;
+
+  /** Build input index of every tree triangle (points to built order or to cache file) */
+  array_view<UINT32> Order;
+
+  /** Built tree nodes storage */
+  std::vector<kd_tree_node_data> BuiltNodes;
+
+  /** Built tree triangles storage */
+  std::vector<triangle> BuiltTriangles;
+
+  /** Built triangles order storage */
+  std::vector<UINT32> BuiltOrder;
+
+  /** Nodes SAH costs after last build (refitted nodes costs are compared with them) */
+  std::vector<FLT> BuildCosts;
+
+  /** Root SAH cost after last full build (limits quality loss by sequence of partial rebuilds) */
+  FLT RootBuildCost = 0;
+
+  /** Mapped cache file (if tree is loaded from cache) */
+  std::unique_ptr<mapped_file> CacheFile;
+
+  /**
+   * \brief Tree cache file header
+   */
+  struct CACHE_HEADER
+  {
+    /** File signature */
+    CHAR Signature[8];
+
+    /** Cache format version */
+    UINT32 Version;
+
+    /** Size of packed node */
+    UINT32 NodeSize;
+
+    /** Size of triangle */
+    UINT32 TriangleSize;
+
+    /** Not used padding */
+    UINT32 _Padding;
+
+    /** Build input hash */
+    UINT64 Key;
+
+    /** Number of nodes */
+    UINT64 NumOfNodes;
+
+    /** Number of triangles (equals number of build input triangles, every triangle is stored once) */
+    UINT64 NumOfTriangles;
+
+    /** Nodes offset from file begin */
+    UINT64 NodesOffset;
+
+    /** Triangles offset from file begin */
+    UINT64 TrianglesOffset;
+
+    /** Triangles order offset from file begin */
+    UINT64 OrderOffset;
+  };
+
+  /** Cache file signature */
+  static constexpr CHAR CacheSignature[8] = "IGTREE";
+
+  /** Cache file format version (must be increased if nodes/triangles layout or build algorithm is changed) */
+  static constexpr UINT32 CacheVersion = 2;
+
+  /** Alignment of arrays in cache file */
+  static constexpr UINT64 CacheAlignment = 64;
+
+  /** Traversal stack size (must be greater than maximal tree depth) */
+  static const INT TraversalStackSize = 64;
+
+  /** Minimal number of triangles for parallel bounds and bins evaluation */
+  static const size_t ParallelReduceThreshold = 1 << 16;
+
+  /** Minimal number of triangles for building subtrees in separate tasks */
+  static const size_t ParallelBuildThreshold = 1 << 12;
+
+  /** Number of subtree tasks per thread (extra tasks balance load of unbalanced splits) */
+  static const INT BuildTasksPerThread = 4;
+
+  /**
+   * \brief Tree node for build
+   */
+  struct BUILD_NODE
+  {
+    /** Node bounding box */
+    aabb BB;
+
+    /** Left subtree (nullptr - for leaf) */
+    std::unique_ptr<BUILD_NODE> Left;
+
+    /** Right subtree (nullptr - for leaf) */
+    std::unique_ptr<BUILD_NODE> Right;
+
+    /** Split axis for not leaf (0 - X, 1 - Y, 2 - Z) */
+    INT SplitAxis = 0;
+
+    /** Leaf triangles offset in triangle indices array */
+    UINT32 TrianglesOffset = 0;
+
+    /** Number of leaf triangles */
+    UINT32 NumOfTriangles = 0;
+  };
+
+  /**
+   * \brief Subtree building task
+   */
+  struct BUILD_TASK
+  {
+    /** Subtree root */
+    BUILD_NODE *Node;
+
+    /** Subtree triangles offset in triangle indices array */
+    UINT32 Offset;
+
+    /** Number of subtree triangles */
+    size_t N;
+
+    /** Depth of subtree root */
+    INT Depth;
+  };
+
+  /**
+   * \brief Subtree building tasks collected by top levels building
+   */
+  struct BUILD_TASKS
+  {
+    /** Tasks */
+    std::vector<BUILD_TASK> List;
+
+    /** Maximal number of triangles of task (bigger subtrees are splitted by top levels building) */
+    size_t MaxTaskSize;
+  };
+
+  /**
+   * \brief Triangles bounds
+   */
+  struct BOUNDS
+  {
+    /** Bounding box of triangles */
+    aabb BB;
+
+    /** Bounding box of triangles centers */
+    aabb CentersBB;
+  };
+
+  /**
+   * \brief Per triangle data for build
+   */
+  struct BUILD_DATA
+  {
+    /** Triangles bounding boxes */
+    const std::vector<aabb> &Boxes;
+
+    /** Triangles centers */
+    const std::vector<vec> &Centers;
+  };
+
+  /**
+   * \brief Surface area heuristic split description
+   */
+  struct SAH_SPLIT
+  {
+    /** Split axis (nullptr - if split not found) */
+    FLT vec::* Axis = nullptr;
 
-  /** Left subtree */
-  std::unique_ptr<kd_tree> Left = nullptr;
+    /** Last bin of left subtree */
+    INT Bin = 0;
 
-  /** Right subtree */
-  std::unique_ptr<kd_tree> Right = nullptr;
+    /** Split cost */
+    FLT Cost = 0;
 
-  /** Node triangles */
-  std::vector<triangle> Triangles;
-  
-  /** Leaf flag */
-  BOOL IsLeaf = TRUE;
+    /** Minimal triangle center coordinate along axis */
+    FLT Min = 0;
 
-  /** Maximal position in array for packing tree */
-  INT64 MaxUForGPUPack = 0;
+    /** Number of bins per unit of length along axis */
+    FLT Scale = 0;
 
-  /** Number of triangles in all tree */
-  INT64 NumberOfTrianglesInTree = 0;
+    /**
+     * \brief Get bin index function
+     * \param[in] Center Triangle center
+     * \param[in] NumberOfBins Number of bins
+     * \return Bin index
+     */
+    INT GetBin( const vec &Center, const INT NumberOfBins ) const;
+  };
+
+  /**
+   * \brief Get number of threads for tree building function
+   * \return Number of threads
+   */
+  static INT GetNumberOfThreads( VOID );
+
+  /**
+   * \brief Get number of ranges for parallel processing of triangles function
+   * \param[in] N Number of triangles
+   * \return Number of ranges (1 - if triangles should be processed serially)
+   */
+  static INT GetNumberOfRanges( const size_t N );
+
+  /**
+   * \brief Run function for ranges of triangles function
+   * \param[in] N Number of triangles
+   * \param[in] NumberOfRanges Number of ranges
+   * \param[in] Func Function for run (gets range index, begin and end of range)
+   */
+  template <class func>
+    static VOID RunOnRanges( const size_t N, const INT NumberOfRanges, const func &Func )
+    {
+      if (NumberOfRanges == 1)
+      {
+        Func(0, 0, N);
+        return;
+      }
 
-  /** Structure for build */
-  std::vector<std::vector<triangle>> BuildStructure;
+      parallel_for::Run(NumberOfRanges, [&]( INT i )
+        {
+          Func(i, N * i / NumberOfRanges, N * (i + 1) / NumberOfRanges);
+        });
+    }
 
-  // TODO: Create kd-tree node structure without common tree information
+  /**
+   * \brief Get triangles and triangles centers bounds function
+   * \param[in] Indices Triangle indices
+   * \param[in] N Number of triangles
+   * \param[in] Data Per triangle build data
+   * \return Bounds
+   */
+  static BOUNDS GetBounds( const UINT32 *Indices, const size_t N, const BUILD_DATA &Data );
+
+  /**
+   * \brief Find best split by binned surface area heuristic function
+   * \param[in] Indices Node triangle indices
+   * \param[in] N Number of node triangles
+   * \param[in] Data Per triangle build data
+   * \param[in] Bounds Node triangles bounds
+   * \param[in] Par Tree building parameters
+   * \return Best split (Axis is nullptr if node can't be splitted)
+   */
+  static SAH_SPLIT FindSplit( const UINT32 *Indices, const size_t N, const BUILD_DATA &Data,
+                              const BOUNDS &Bounds, const TREE_PARAMS &Par );
 
   /**
    * \brief Recursive build tree function
-   * \param[in] Tr Triangle for build
+   * \param[in, out] Node Built node
+   * \param[in, out] Indices All triangle indices (node range is reordered)
+   * \param[in] Offset Node triangles offset in indices array
+   * \param[in] N Number of node triangles
+   * \param[in] Data Per triangle build data
+   * \param[in] Depth Depth of current level
+   * \param[in] Par Tree building parameters
+   * \param[in, out] Tasks Subtree tasks (nullptr - whole subtree is built by calling thread)
+   * \return Number of nodes in subtree (without nodes of collected tasks)
+   */
+  static INT64 BuildRec( BUILD_NODE &Node, UINT32 *Indices, const UINT32 Offset, const size_t N,
+                         const BUILD_DATA &Data, const INT Depth, const TREE_PARAMS &Par,
+                         BUILD_TASKS *Tasks = nullptr );
+
+  /**
+   * \brief Build subtree function (top levels are built by calling thread, lower subtrees are tasks of threads pool)
+   * \param[in, out] Node Built node
+   * \param[in, out] Indices All triangle indices (node range is reordered)
+   * \param[in] Offset Node triangles offset in indices array
+   * \param[in] N Number of node triangles
+   * \param[in] Data Per triangle build data
    * \param[in] Depth Depth of current level
-   * \param[in, out] BS Building structure
-   * \param[in] U Node index in array
-   * \param[in, out] MaxU Maximal node index
    * \param[in] Par Tree building parameters
+   * \return Number of nodes in subtree
+   */
+  static INT64 BuildSubtree( BUILD_NODE &Node, UINT32 *Indices, const UINT32 Offset, const size_t N,
+                             const BUILD_DATA &Data, const INT Depth, const TREE_PARAMS &Par );
+
+  /**
+   * \brief Pack tree in depth-first order function
+   * \param[in] Node Packed node
+   * \param[in, out] Nodes Packed nodes array
+   */
+  static VOID PackTree( const BUILD_NODE &Node, std::vector<kd_tree_node_data> *Nodes );
+
+  /**
+   * \brief Evaluate SAH costs of all nodes function
+   * \param[in] Par Tree building parameters
+   * \param[out] Costs Nodes costs (expected cost of ray query in node subtree, if node is hit)
    */
-  VOID BuildRec( const std::vector<triangle> &Tr, const INT Depth,
-                 std::vector<std::vector<triangle>> &BS,
-                 const INT64 U, INT64 &MaxU, const TREE_PARAMS &Par );
+  VOID EvaluateCosts( const TREE_PARAMS &Par, std::vector<FLT> *Costs ) const;
 
   /**
-   * \brief Pack tree for gpu_render
-   * \param[in, out] TrianglesBuffer Buffer for write triangles
-   * \param[in, out] NodesBuffer Buffer for write packed tree nodes
-   * \param[in] U Current node index
-   * \param[in] TrianglesOffset Triangles offset in buffer
+   * \brief Get range of subtree triangles function
+   * \param[in] U Subtree root index
+   * \param[out] Begin First triangle index
+   * \param[out] End Index after last triangle
    */
-  VOID PackTree( triangle *TrianglesBuffer,
-                 kd_tree_node_data *NodesBuffer,
-                 UINT64 U, UINT64 *TrianglesOffset ) const;
+  VOID GetTrianglesRange( UINT32 U, UINT32 *Begin, UINT32 *End ) const;
+
+  /**
+   * \brief Find degraded subtrees for rebuild function
+   * \param[in] U Degraded subtree root index
+   * \param[in] Costs Refitted nodes costs
+   * \param[in] Par Tree building parameters
+   * \param[in, out] IsRebuilt Nodes rebuild flags (roots of rebuilt subtrees are marked)
+   * \return Number of triangles in rebuilt subtrees
+   */
+  UINT64 FindDegradedSubtrees( const UINT32 U, const std::vector<FLT> &Costs, const TREE_PARAMS &Par,
+                               std::vector<BOOL> *IsRebuilt ) const;
+
+  /**
+   * \brief Copy tree with rebuild of marked subtrees function
+   * \param[in] U Copied node index
+   * \param[in] Depth Depth of node
+   * \param[in] IsRebuilt Nodes rebuild flags
+   * \param[in, out] Indices Triangle indices (rebuilt subtrees ranges are reordered)
+   * \param[in] Data Per triangle build data
+   * \param[in] Par Tree building parameters
+   * \param[in, out] NewNodes Packed nodes of new tree
+   */
+  VOID RebuildRec( const UINT32 U, const INT Depth, const std::vector<BOOL> &IsRebuilt, UINT32 *Indices,
+                   const BUILD_DATA &Data, const TREE_PARAMS &Par, std::vector<kd_tree_node_data> *NewNodes ) const;
+
+  /**
+   * \brief Copy tree from cache file to own storage function (before tree modification)
+   */
+  VOID DetachFromCache( VOID );
+
+  /**
+   * \brief Load tree from cache file function
+   * \param[in] FileName Cache file name
+   * \param[in] Key Build input hash
+   * \param[in] NumOfTriangles Number of build input triangles (rejects files of colliding keys)
+   * \return TRUE-if tree loaded, FALSE-if file is missing or not valid
+   */
+  BOOL Load( const std::string &FileName, const UINT64 Key, const UINT64 NumOfTriangles );
+
+  /**
+   * \brief Save tree to cache file function
+   * \param[in] FileName Cache file name
+   * \param[in] Key Build input hash
+   * \return TRUE-if tree saved, FALSE-otherwise
+   */
+  BOOL Save( const std::string &FileName, const UINT64 Key ) const;
 
   /**
    * \brief Get size with alignment
@@ -78,12 +378,47 @@ private:
   static UINT64 GetWithAlignment( UINT64 Size, UINT64 Alignment );
 
 public:
+  /**
+   * \brief Build packed nodes over arbitrary primitives function
+   * \param[in] Boxes Primitives bounding boxes
+   * \param[in] Centers Primitives centers
+   * \param[in] Par Building parameters
+   * \param[out] Nodes Packed nodes in depth-first order
+   * \param[out] Order Primitives indices in leaves order (leaf offsets index this array)
+   */
+  static VOID BuildNodes( const std::vector<aabb> &Boxes, const std::vector<vec> &Centers, const TREE_PARAMS &Par,
+                          std::vector<kd_tree_node_data> *Nodes, std::vector<UINT32> *Order );
+
   /**
    * \brief Build tree function
-   * \param[in] Tr Triangles for building
+   * \param[in] Tr Triangles for building (stored in tree in leaves order)
    * \param[in] Par Building parameters
    */
-  VOID Build( const std::vector<triangle> &Tr, const TREE_PARAMS &Par );
+  VOID Build( std::vector<triangle> Tr, const TREE_PARAMS &Par );
+
+  /**
+   * \brief Build tree or load it from cache function
+   * \param[in] Key Hash of build input (building parameters are added to it)
+   * \param[in] NumOfTriangles Number of triangles returned by GetTriangles (checked on cache load)
+   * \param[in] GetTriangles Function which returns triangles for building (called only if cache is not used)
+   * \param[in] Par Building parameters (cache is used if CachePath is not empty)
+   */
+  VOID BuildCached( hasher Key, const UINT64 NumOfTriangles,
+                    const std::function<std::vector<triangle> (VOID)> &GetTriangles, const TREE_PARAMS &Par );
+
+  /**
+   * \brief Replace triangles without tree nodes change function (e.g. if only materials are changed)
+   * \param[in] Tr New triangles in build input order (same number as in tree)
+   * \return TRUE-if triangles replaced, FALSE-if number of triangles is changed (tree must be rebuilt)
+   */
+  BOOL SetTriangles( const std::vector<triangle> &Tr );
+
+  /**
+   * \brief Refit nodes bounds to current triangles function (degraded subtrees are rebuilt)
+   * \param[in] Par Building parameters
+   * \return TRUE-if tree refitted, FALSE-if tree quality is too low (tree must be rebuilt)
+   */
+  BOOL Refit( const TREE_PARAMS &Par );
 
   /**
    * \brief Intersection with ray function
@@ -93,7 +428,28 @@ public:
    * \param[in] Par Render parameters
    * \return TRUE-if intersect, FALSE-if otherwise
    */
-  BOOL Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const;
+  BOOL Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const override;
+
+  /**
+   * \brief Check if any intersection with ray is closer than distance function (traversal stops at first found one)
+   * \param[in] R Ray
+   * \param[in] MaxDist Distance along ray
+   * \param[in] Par Render parameters
+   * \return TRUE-if ray is occluded, FALSE-if otherwise
+   */
+  BOOL Occluded( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const override;
+
+  /**
+   * \brief Get packed tree nodes function
+   * \return Nodes in depth-first order
+   */
+  array_view<kd_tree_node_data> GetNodes( VOID ) const;
+
+  /**
+   * \brief Get tree triangles function
+   * \return Triangles in leaves order
+   */
+  array_view<triangle> GetTriangles( VOID ) const;
 
   /**
    * \brief Tree constructor
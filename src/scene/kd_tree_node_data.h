@@ -1,16 +1,16 @@
 #ifndef __gpu_kd_tree_h_
 #define __gpu_kd_tree_h_
 
-#include "aabb.h"
-#include "triangle.h"
-#include "kd_tree.h"
+#include <cmath>
+#include <type_traits>
 
-#pragma pack(push, 4)
+#include "aabb.h"
+#include "math/ray.h"
 
 /**
- * \brief Packed tree node data
+ * \brief Packed tree node data (used by cpu_render and gpu_render)
  */
-class kd_tree_node_data
+class alignas(32) kd_tree_node_data
 {
 private:
   /**
@@ -18,24 +18,79 @@ private:
    */
   static VOID AlignmentTestMethod( VOID )
   {
-    static_assert(sizeof(kd_tree_node_data) == 3 * 16);
-    static_assert(offsetof(kd_tree_node_data, TrianglesOffset) == 2 * 16);
+    static_assert(sizeof(kd_tree_node_data) == 2 * 16);
+    static_assert(alignof(kd_tree_node_data) == 2 * 16);
+    static_assert(offsetof(kd_tree_node_data, Offset) == 12);
+    static_assert(offsetof(kd_tree_node_data, Max) == 16);
+    static_assert(offsetof(kd_tree_node_data, NumOfTriangles) == 16 + 12);
     static_assert(std::is_trivial<kd_tree_node_data>::value && std::is_standard_layout<kd_tree_node_data>::value);
   }
 public:
-  /** Node bounding box */
-  aabb BB;
+  /** Node bounding box minimal coordinate */
+  FLT Min[3];
+
+  /** Triangles offset for leaf, second (right) child index for not leaf (left child is next node) */
+  UINT32 Offset;
 
-  /** Node triangles offset */
-  UINT32 TrianglesOffset;
+  /** Node bounding box maximal coordinate */
+  FLT Max[3];
 
-  /** Number of triangles (-1 - if not leaf) */
+  /** Number of triangles for leaf, -1 - split axis for not leaf (-1 - X, -2 - Y, -3 - Z) */
   INT32 NumOfTriangles;
 
-  /** Not used padding */
-  FLT _Padding[2];
-};
+  /**
+   * \brief Set node bounding box function
+   * \param[in] BB Bounding box
+   */
+  VOID SetBB( const aabb &BB )
+  {
+    Min[0] = BB.Min.X;
+    Min[1] = BB.Min.Y;
+    Min[2] = BB.Min.Z;
+    Max[0] = BB.Max.X;
+    Max[1] = BB.Max.Y;
+    Max[2] = BB.Max.Z;
+  }
+
+  /**
+   * \brief Get node bounding box function
+   * \return Bounding box
+   */
+  aabb GetBB( VOID ) const
+  {
+    return {vec(Min[0], Min[1], Min[2]), vec(Max[0], Max[1], Max[2])};
+  }
+
+  /**
+   * \brief Intersection node bounding box with ray function
+   * \param[in] R Ray
+   * \param[out] T Distance to nearest intersection
+   * \return TRUE-if intersect, FALSE-if otherwise
+   */
+  BOOL Intersect( const ray &R, FLT *T ) const
+  {
+    FLT Tn = (Min[0] - R.Org.X) * R.InvDir.X;
+    FLT Tf = (Max[0] - R.Org.X) * R.InvDir.X;
+
+    FLT Near = fminf(Tn, Tf);
+    FLT Far = fmaxf(Tn, Tf);
 
-#pragma pack(pop)
+    Tn = (Min[1] - R.Org.Y) * R.InvDir.Y;
+    Tf = (Max[1] - R.Org.Y) * R.InvDir.Y;
+
+    Near = fmaxf(Near, fminf(Tn, Tf));
+    Far = fminf(Far, fmaxf(Tn, Tf));
+
+    Tn = (Min[2] - R.Org.Z) * R.InvDir.Z;
+    Tf = (Max[2] - R.Org.Z) * R.InvDir.Z;
+
+    Near = fmaxf(Near, fminf(Tn, Tf));
+    Far = fminf(Far, fmaxf(Tn, Tf));
+    *T = Near;
+    Far *= 1.00000024f;
+
+    return Far >= Near;
+  }
+};
 
 #endif /* __gpu_kd_tree_h_ */
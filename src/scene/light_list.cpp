@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cmath>
+
+#include "light_list.h"
+#include "material.h"
+
+/**
+ * \brief Remove all lights function
+ */
+VOID light_list::Clear( VOID )
+{
+  Lights.clear();
+}
+
+/**
+ * \brief Add emissive triangles to list function (triangles without emission are skipped)
+ * \param[in] Triangles World space triangles
+ */
+VOID light_list::Add( array_view<triangle> Triangles )
+{
+  for (const triangle &Tr : Triangles)
+  {
+    const vec &Emit = material::Table[Tr.GetMaterialId()].Emit;
+
+    if (Emit.X <= 0 && Emit.Y <= 0 && Emit.Z <= 0)
+      continue;
+
+    LIGHT Light;
+
+    Light.P0 = Tr.GetVertex(0).P;
+    Light.Edge1 = Tr.GetVertex(1).P - Light.P0;
+    Light.Edge2 = Tr.GetVertex(2).P - Light.P0;
+
+    const vec Cross = Light.Edge1 % Light.Edge2;
+
+    // Degenerated triangles can't be sampled
+    Light.Area = !Cross / 2;
+    if (Light.Area <= 0)
+      continue;
+
+    Light.N = Cross / (2 * Light.Area);
+    Light.CumulativeArea = GetArea() + Light.Area;
+    Light.MatId = Tr.GetMaterialId();
+    Light._Padding[0] = 0;
+    Lights.push_back(Light);
+  }
+}
+
+/**
+ * \brief Check if list is empty function
+ * \return TRUE-if there are no lights, FALSE-otherwise
+ */
+BOOL light_list::IsEmpty( VOID ) const
+{
+  return Lights.empty();
+}
+
+/**
+ * \brief Get total area of lights function
+ * \return Area
+ */
+FLT light_list::GetArea( VOID ) const
+{
+  return Lights.empty() ? 0 : Lights.back().CumulativeArea;
+}
+
+/**
+ * \brief Get lights function
+ * \return Lights array
+ */
+const std::vector<LIGHT> & light_list::GetLights( VOID ) const
+{
+  return Lights;
+}
+
+/**
+ * \brief Sample uniformly distributed point on lights surface function (list must be not empty)
+ * \param[in] Select Uniform random number in [0, 1) for light selection
+ * \param[in] U First uniform random number in [0, 1) for point on triangle
+ * \param[in] V Second uniform random number in [0, 1) for point on triangle
+ * \param[out] P Sampled point
+ * \return Sampled light (probability density of point by area is 1 / GetArea())
+ */
+const LIGHT & light_list::Sample( const FLT Select, const FLT U, const FLT V, vec *P ) const
+{
+  const FLT Area = Select * GetArea();
+  const std::vector<LIGHT>::const_iterator It =
+    std::upper_bound(Lights.cbegin(), Lights.cend() - 1, Area,
+                     []( const FLT Value, const LIGHT &Light )
+                     {
+                       return Value < Light.CumulativeArea;
+                     });
+  const FLT SqrtU = sqrtf(U);
+
+  *P = It->P0 + It->Edge1 * (SqrtU * (1 - V)) + It->Edge2 * (SqrtU * V);
+  return *It;
+}
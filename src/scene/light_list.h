@@ -0,0 +1,102 @@
+#ifndef __light_list_h_
+#define __light_list_h_
+
+#include <vector>
+
+#include "triangle.h"
+#include "utils/array_view.h"
+
+#pragma pack(push, 4)
+
+/**
+ * \brief Emissive triangle structure (same layout is used by gpu_render)
+ */
+struct LIGHT
+{
+  /**
+   * \brief Compile-time alignment test.
+   */
+  static VOID AlignmentTestMethod( VOID )
+  {
+    static_assert(sizeof(LIGHT) == 5 * 16);
+    static_assert(std::is_trivial<LIGHT>::value && std::is_standard_layout<LIGHT>::value);
+  }
+
+  /** First triangle vertex position */
+  vec P0;
+
+  /** First triangle edge (from first vertex to second) */
+  vec Edge1;
+
+  /** Second triangle edge (from first vertex to third) */
+  vec Edge2;
+
+  /** Triangle geometric normal */
+  vec N;
+
+  /** Sum of areas of lights up to this one (including it) */
+  FLT CumulativeArea;
+
+  /** Triangle area */
+  FLT Area;
+
+  /** Material index */
+  INT MatId;
+
+  /** Not used padding */
+  FLT _Padding[1];
+};
+
+#pragma pack(pop)
+
+/**
+ * \brief List of emissive triangles for explicit light sampling (lights are selected proportionally to area)
+ */
+class light_list
+{
+private:
+  /** Emissive triangles */
+  std::vector<LIGHT> Lights;
+
+public:
+  /**
+   * \brief Remove all lights function
+   */
+  VOID Clear( VOID );
+
+  /**
+   * \brief Add emissive triangles to list function (triangles without emission are skipped)
+   * \param[in] Triangles World space triangles
+   */
+  VOID Add( array_view<triangle> Triangles );
+
+  /**
+   * \brief Check if list is empty function
+   * \return TRUE-if there are no lights, FALSE-otherwise
+   */
+  BOOL IsEmpty( VOID ) const;
+
+  /**
+   * \brief Get total area of lights function
+   * \return Area
+   */
+  FLT GetArea( VOID ) const;
+
+  /**
+   * \brief Get lights function
+   * \return Lights array
+   */
+  const std::vector<LIGHT> & GetLights( VOID ) const;
+
+  /**
+   * \brief Sample uniformly distributed point on lights surface function (list must be not empty)
+   * \param[in] Select Uniform random number in [0, 1) for light selection
+   * \param[in] U First uniform random number in [0, 1) for point on triangle
+   * \param[in] V Second uniform random number in [0, 1) for point on triangle
+   * \param[out] P Sampled point
+   * \return Sampled light (probability density of point by area is 1 / GetArea())
+   */
+  const LIGHT & Sample( const FLT Select, const FLT U, const FLT V, vec *P ) const;
+};
+
+#endif /* __light_list_h_ */
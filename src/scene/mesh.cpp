@@ -0,0 +1,164 @@
+#include "mesh.h"
+#include "shape.h"
+#include "utils/error.h"
+
+/** Loaded *.obj meshes (file name -> mesh) */
+std::unordered_map<std::string, std::weak_ptr<mesh>> mesh::Cache;
+
+/**
+ * \brief Mesh constructor
+ * \param[in] Tr Object space triangles
+ */
+mesh::mesh( std::vector<triangle> Tr ) : Triangles(std::move(Tr)), NumOfTriangles(Triangles.size())
+{
+  for (const triangle &Tr : Triangles)
+    Tr.AddToHash(&Key);
+}
+
+/**
+ * \brief Mesh from *.obj file constructor (file is parsed on build if tree is not cached)
+ * \param[in] ObjFileName Name of file
+ */
+mesh::mesh( const std::string &ObjFileName ) : FileName(ObjFileName)
+{
+  mapped_file File;
+
+  if (!File.Open(FileName))
+    error("File not load");
+
+  Key.Add(File.GetData(), File.GetSize());
+
+  // Every face line of *.obj file is one triangle
+  const CHAR *Data = reinterpret_cast<const CHAR *>(File.GetData());
+
+  for (UINT64 i = 0; i + 1 < File.GetSize(); i++)
+    if (Data[i] == 'f' && Data[i + 1] == ' ' && (i == 0 || Data[i - 1] == '\n'))
+      NumOfTriangles++;
+}
+
+/**
+ * \brief Load *.obj file mesh function (every file is read once while its mesh is used)
+ * \param[in] FileName Name of file
+ * \return Mesh
+ */
+std::shared_ptr<mesh> mesh::LoadOBJ( const std::string &FileName )
+{
+  std::shared_ptr<mesh> Res = Cache[FileName].lock();
+
+  if (Res == nullptr)
+  {
+    Res = std::make_shared<mesh>(FileName);
+    Cache[FileName] = Res;
+  }
+
+  return Res;
+}
+
+/**
+ * \brief Check that kd-trees built with parameters are equal function (acceleration structure type is ignored)
+ * \param[in] A First building parameters
+ * \param[in] B Second building parameters
+ * \return TRUE-if trees are equal, FALSE-otherwise
+ */
+BOOL mesh::IsSameTree( const TREE_PARAMS &A, const TREE_PARAMS &B )
+{
+  return A.MaxDepthTree == B.MaxDepthTree &&
+         A.MinNumOfTriangleLeaf == B.MinNumOfTriangleLeaf &&
+         A.MaxNumOfTriangleLeaf == B.MaxNumOfTriangleLeaf &&
+         A.NumberOfBins == B.NumberOfBins &&
+         A.TraversalCost == B.TraversalCost &&
+         A.IntersectionCost == B.IntersectionCost;
+}
+
+/**
+ * \brief Build mesh tree function (kd-tree is rebuilt only if its building parameters are changed)
+ * \param[in] Par Building parameters
+ */
+VOID mesh::Build( const TREE_PARAMS &Par )
+{
+  BOOL IsTreeChanged = FALSE;
+
+  if (!IsBuilt || !IsSameTree(Par, BuiltPar))
+  {
+    Tree.BuildCached(Key, NumOfTriangles, [&]( VOID )
+      {
+        // Rebuilt tree takes triangles of previous tree
+        if (IsBuilt)
+          return std::vector<triangle>(Tree.GetTriangles().begin(), Tree.GetTriangles().end());
+        return FileName.empty() ? std::move(Triangles) : shape::ReadOBJ(FileName, 0, 0);
+      }, Par);
+    Triangles.clear();
+    IsBuilt = TRUE;
+    BuiltPar = Par;
+    IsTreeChanged = TRUE;
+  }
+
+  if (!IsTreeChanged && Par.Type == Type)
+    return;
+
+  Type = Par.Type;
+  Bvh4.Clear();
+  Bvh8.Clear();
+  if (Type == ACCELERATION_STRUCTURE_TYPE::BVH4)
+    Bvh4.Build(Tree);
+  else if (Type == ACCELERATION_STRUCTURE_TYPE::BVH8)
+    Bvh8.Build(Tree);
+}
+
+/**
+ * \brief Get hash of mesh source data function
+ * \return Hash
+ */
+const hasher & mesh::GetKey( VOID ) const
+{
+  return Key;
+}
+
+/**
+ * \brief Get number of mesh triangles function (mesh may be not built)
+ * \return Number of triangles
+ */
+UINT64 mesh::GetNumOfTriangles( VOID ) const
+{
+  return NumOfTriangles;
+}
+
+/**
+ * \brief Get mesh triangles function (mesh must be built)
+ * \return Triangles in tree leaves order
+ */
+array_view<triangle> mesh::GetTriangles( VOID ) const
+{
+  return Tree.GetTriangles();
+}
+
+/**
+ * \brief Get mesh bounding box function (mesh must be built)
+ * \return Object space bounding box
+ */
+aabb mesh::GetBB( VOID ) const
+{
+  const array_view<kd_tree_node_data> Nodes = Tree.GetNodes();
+
+  if (Nodes.empty())
+    return {vec(0, 0, 0), vec(0, 0, 0)};
+
+  return Nodes[0].GetBB();
+}
+
+/**
+ * \brief Get acceleration structure function (mesh must be built)
+ * \return Acceleration structure for intersection
+ */
+const acceleration_structure & mesh::GetAccelerationStructure( VOID ) const
+{
+  switch (Type)
+  {
+  case ACCELERATION_STRUCTURE_TYPE::BVH4:
+    return Bvh4;
+  case ACCELERATION_STRUCTURE_TYPE::BVH8:
+    return Bvh8;
+  default:
+    return Tree;
+  }
+}
@@ -0,0 +1,126 @@
+#ifndef __mesh_h_
+#define __mesh_h_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "kd_tree.h"
+#include "wide_bvh.h"
+
+/**
+ * \brief Triangle mesh in object space with own (bottom-level) tree, shared by instances
+ */
+class mesh
+{
+private:
+  /** Triangles waiting for tree build (moved to tree by build) */
+  std::vector<triangle> Triangles;
+
+  /** Source *.obj file name (empty - triangles are set by constructor), file is read only if tree is not cached */
+  std::string FileName;
+
+  /** Hash of mesh source data (triangles or *.obj file contents) */
+  hasher Key;
+
+  /** Number of source triangles (known before tree build) */
+  UINT64 NumOfTriangles = 0;
+
+  /** Tree over object space triangles */
+  kd_tree Tree;
+
+  /** Wide trees collapsed from kd-tree (built only if selected by tree parameters) */
+  wide_bvh<4> Bvh4;
+  wide_bvh<8> Bvh8;
+
+  /** Built acceleration structure type */
+  ACCELERATION_STRUCTURE_TYPE Type = ACCELERATION_STRUCTURE_TYPE::KD_TREE;
+
+  /** Is tree built flag */
+  BOOL IsBuilt = FALSE;
+
+  /** Parameters of built tree */
+  TREE_PARAMS BuiltPar;
+
+  /** Loaded *.obj meshes (file name -> mesh) */
+  static std::unordered_map<std::string, std::weak_ptr<mesh>> Cache;
+
+  /**
+   * \brief Check that kd-trees built with parameters are equal function (acceleration structure type is ignored)
+   * \param[in] A First building parameters
+   * \param[in] B Second building parameters
+   * \return TRUE-if trees are equal, FALSE-otherwise
+   */
+  static BOOL IsSameTree( const TREE_PARAMS &A, const TREE_PARAMS &B );
+
+public:
+  /**
+   * \brief Mesh constructor
+   * \param[in] Tr Object space triangles
+   */
+  mesh( std::vector<triangle> Tr );
+
+  /**
+   * \brief Mesh from *.obj file constructor (file is parsed on build if tree is not cached)
+   * \param[in] ObjFileName Name of file
+   */
+  mesh( const std::string &ObjFileName );
+
+  /**
+   * \brief Load *.obj file mesh function (every file is read once while its mesh is used)
+   * \param[in] FileName Name of file
+   * \return Mesh
+   */
+  static std::shared_ptr<mesh> LoadOBJ( const std::string &FileName );
+
+  /**
+   * \brief Build mesh tree function (kd-tree is rebuilt only if its building parameters are changed)
+   * \param[in] Par Building parameters
+   */
+  VOID Build( const TREE_PARAMS &Par );
+
+  /**
+   * \brief Get hash of mesh source data function
+   * \return Hash
+   */
+  const hasher & GetKey( VOID ) const;
+
+  /**
+   * \brief Get number of mesh triangles function (mesh may be not built)
+   * \return Number of triangles
+   */
+  UINT64 GetNumOfTriangles( VOID ) const;
+
+  /**
+   * \brief Get mesh triangles function (mesh must be built)
+   * \return Triangles in tree leaves order
+   */
+  array_view<triangle> GetTriangles( VOID ) const;
+
+  /**
+   * \brief Get mesh bounding box function (mesh must be built)
+   * \return Object space bounding box
+   */
+  aabb GetBB( VOID ) const;
+
+  /**
+   * \brief Get acceleration structure function (mesh must be built)
+   * \return Acceleration structure for intersection
+   */
+  const acceleration_structure & GetAccelerationStructure( VOID ) const;
+
+  /**
+   * \brief Deleted copy function
+   * \param[in] Mesh Other mesh
+   */
+  mesh( const mesh &Mesh ) = delete;
+
+  /**
+   * \brief Deleted copy function
+   * \param[in] Mesh Other mesh
+   */
+  VOID operator=( const mesh &Mesh ) = delete;
+};
+
+#endif /* __mesh_h_ */
@@ -2,6 +2,7 @@
 #define __params_h_
 
 #include <cstddef>
+#include <string>
 
 #include "def.h"
 
@@ -18,8 +19,9 @@ private:
    */
   static VOID AlignmentTestMethod( VOID )
   {
-    static_assert(sizeof(RENDER_PARAMS) == 16);
+    static_assert(sizeof(RENDER_PARAMS) == 32);
     static_assert(offsetof(RENDER_PARAMS, MaxDepthRender) == 8);
+    static_assert(offsetof(RENDER_PARAMS, RouletteDepth) == 16);
     static_assert(std::is_trivial<RENDER_PARAMS>::value && std::is_standard_layout<RENDER_PARAMS>::value);
   }
 public:
@@ -32,22 +34,67 @@ public:
   /** Maximal depth render */
   INT MaxDepthRender;
 
+  /** Seed of random numbers for frame (same seed gives same image) */
+  UINT32 Seed;
+
+  /** Number of bounces after which paths are terminated by Russian roulette (roulette is off if not less than MaxDepthRender) */
+  INT RouletteDepth;
+
+  /** Minimal probability of path continuation by Russian roulette (limits weight of continued paths) */
+  FLT RouletteMinProbability;
+
   /** Not used padding */
-  FLT _Padding[1];
+  FLT _Padding[2];
 };
 
 #pragma pack(pop)
 
+/**
+ * \brief Acceleration structure type enumeration
+ */
+enum class ACCELERATION_STRUCTURE_TYPE
+{
+  /** Binary kd-tree */
+  KD_TREE,
+
+  /** Bounding volume hierarchy with 4 children per node (cpu_render only) */
+  BVH4,
+
+  /** Bounding volume hierarchy with 8 children per node (cpu_render only) */
+  BVH8,
+};
+
 /**
  * \brief Tree parameters structure
  */
 struct TREE_PARAMS
 {
-  /** Maximal kd-tree depth */
+  /** Acceleration structure type for cpu_render (gpu_render always uses kd-tree) */
+  ACCELERATION_STRUCTURE_TYPE Type = ACCELERATION_STRUCTURE_TYPE::KD_TREE;
+
+  /** Maximal kd-tree depth (must be less than traversal stack size (64) minus 1) */
   INT MaxDepthTree = 50;
   
-  /** Maximal number of leaf triangles */
-  INT NumOfTriangleLeaf = 7;
+  /** Number of triangles below which node is always leaf (maximal leaf size is MaxNumOfTriangleLeaf) */
+  INT MinNumOfTriangleLeaf = 2;
+
+  /** Number of triangles above which node is split even if SAH prefers leaf */
+  INT MaxNumOfTriangleLeaf = 16;
+
+  /** Number of bins for SAH split evaluation */
+  INT NumberOfBins = 16;
+
+  /** Cost of one traversal step for SAH (relative to IntersectionCost) */
+  FLT TraversalCost = 1;
+
+  /** Cost of one triangle intersection for SAH */
+  FLT IntersectionCost = 1;
+
+  /** Maximal ratio of refitted tree SAH cost to built tree cost (degraded subtrees are rebuilt if exceeded) */
+  FLT RebuildThreshold = 1.5f;
+
+  /** Directory for built trees cache (empty - trees are always built) */
+  std::string CachePath;
 };
 
 #endif /* __params_h_ */
@@ -13,51 +13,266 @@ scene::scene( VOID )
   RenderPar.Threshold = 1e-5f;
   RenderPar.ColorThreshold = 1e-6f;
   RenderPar.MaxDepthRender = 5;
+  RenderPar.Seed = 0;
+  RenderPar.RouletteDepth = 3;
+  RenderPar.RouletteMinProbability = 0.05f;
   AirEnvi = environment::Make();
 }
 
 /**
- * \brief Get tree ffor intersection function
- * \return Tree for intersection
+ * \brief Get structure for shapes triangles selected by tree parameters function
+ * \return Acceleration structure
  */
-const kd_tree & scene::GetTree( VOID )
+const acceleration_structure & scene::GetWorldTree( VOID ) const
 {
-  if (IsChanged)
+  switch (TreePar.Type)
   {
-    std::vector<triangle> Tr;
-    UINT64 Size = 0;
-
-    for (std::vector<shape *>::const_iterator It = Objects.cbegin();
-         It != Objects.cend(); It++)
-    {
-      Size += (*It)->Triangles.size();
-    }
-    Tr.reserve(Size);
+  case ACCELERATION_STRUCTURE_TYPE::BVH4:
+    return Bvh4;
+  case ACCELERATION_STRUCTURE_TYPE::BVH8:
+    return Bvh8;
+  default:
+    return Tree;
+  }
+}
 
-    for (std::vector<shape *>::const_iterator It = Objects.cbegin();
-         It != Objects.cend(); It++)
+/**
+ * \brief Check triangles and instances material and environment identificators function
+ */
+VOID scene::CheckIdentificators( VOID ) const
+{
+  for (std::vector<instance>::const_iterator It = Instances.cbegin();
+       It != Instances.cend(); It++)
+  {
+    if (It->MtlId < 0 || static_cast<size_t>(It->MtlId) >= material::Table.size() ||
+        It->EnviId < 0 || static_cast<size_t>(It->EnviId) >= environment::Table.size())
     {
-      std::copy((*It)->Triangles.cbegin(),
-                (*It)->Triangles.cend(),
-                std::back_inserter(Tr));
+      error("Wrong instance");
     }
+  }
 
-    for (std::vector<triangle>::const_iterator It = Tr.cbegin();
-         It != Tr.cend(); It++)
+  for (std::vector<shape *>::const_iterator It = Objects.cbegin();
+       It != Objects.cend(); It++)
+  {
+    for (std::vector<triangle>::const_iterator TrIt = (*It)->Triangles.cbegin();
+         TrIt != (*It)->Triangles.cend(); TrIt++)
     {
-      if (It->GetMaterialId() < 0 || It->GetMaterialId() >= material::Table.size() ||
-          It->GetEnvironmentId() < 0 || It->GetEnvironmentId() >= environment::Table.size())
+      if (TrIt->GetMaterialId() < 0 || static_cast<size_t>(TrIt->GetMaterialId()) >= material::Table.size() ||
+          TrIt->GetEnvironmentId() < 0 || static_cast<size_t>(TrIt->GetEnvironmentId()) >= environment::Table.size())
       {
         error("Wrong triangle");
       }
     }
+  }
+}
+
+/**
+ * \brief Collect triangles for tree function
+ * \param[in] WithInstances Flatten instances flag (instanced meshes are built)
+ * \return Shapes (and instances) triangles
+ */
+std::vector<triangle> scene::CollectTriangles( const BOOL WithInstances ) const
+{
+  std::vector<triangle> Tr;
+  UINT64 Size = 0;
+
+  for (std::vector<shape *>::const_iterator It = Objects.cbegin();
+       It != Objects.cend(); It++)
+  {
+    Size += (*It)->Triangles.size();
+  }
+  if (WithInstances)
+    for (std::vector<instance>::const_iterator It = Instances.cbegin();
+         It != Instances.cend(); It++)
+    {
+      It->Mesh->Build(TreePar);
+      Size += It->Mesh->GetTriangles().size();
+    }
+  Tr.reserve(Size);
 
-    std::cout << "Triangles: " + std::to_string(Tr.size()) + "\n";
+  for (std::vector<shape *>::const_iterator It = Objects.cbegin();
+       It != Objects.cend(); It++)
+  {
+    std::copy((*It)->Triangles.cbegin(),
+              (*It)->Triangles.cend(),
+              std::back_inserter(Tr));
+  }
+  if (WithInstances)
+    for (std::vector<instance>::const_iterator It = Instances.cbegin();
+         It != Instances.cend(); It++)
+    {
+      It->AddTriangles(&Tr);
+    }
+
+  return Tr;
+}
 
-    Tree.Build(Tr, TreePar);
+/**
+ * \brief Build trees function
+ * \param[in] WithInstances Flatten instances into tree flag (otherwise top-level tree is built)
+ */
+VOID scene::BuildTrees( const BOOL WithInstances )
+{
+  hasher Key;
+  UINT64 NumOfTriangles = 0;
 
-    IsChanged = FALSE;
+  CheckIdentificators();
+
+  for (std::vector<shape *>::const_iterator It = Objects.cbegin();
+       It != Objects.cend(); It++)
+  {
+    NumOfTriangles += (*It)->Triangles.size();
+    for (std::vector<triangle>::const_iterator TrIt = (*It)->Triangles.cbegin();
+         TrIt != (*It)->Triangles.cend(); TrIt++)
+    {
+      TrIt->AddToHash(&Key);
+    }
   }
 
+  if (WithInstances)
+    for (std::vector<instance>::const_iterator It = Instances.cbegin();
+         It != Instances.cend(); It++)
+    {
+      NumOfTriangles += It->Mesh->GetNumOfTriangles();
+      Key.Add(It->Mesh->GetKey().Get());
+      Key.Add(It->Transform);
+      Key.Add(It->MtlId);
+      Key.Add(It->EnviId);
+    }
+
+  // Triangles are collected (and instances are flattened) only if tree is not loaded from cache
+  Tree.BuildCached(Key, NumOfTriangles, [&]( VOID )
+    {
+      return CollectTriangles(WithInstances);
+    }, TreePar);
+
+  std::cout << "Triangles: " + std::to_string(Tree.GetTriangles().size()) +
+               ", instances: " + std::to_string(Instances.size()) + "\n";
+
+  Bvh4.Clear();
+  Bvh8.Clear();
+  if (TreePar.Type == ACCELERATION_STRUCTURE_TYPE::BVH4)
+    Bvh4.Build(Tree);
+  else if (TreePar.Type == ACCELERATION_STRUCTURE_TYPE::BVH8)
+    Bvh8.Build(Tree);
+
+  InstanceTree.Clear();
+  if (!WithInstances && !Instances.empty())
+  {
+    // Mesh tree is built (or loaded from cache) once for all instances
+    for (std::vector<instance>::const_iterator It = Instances.cbegin();
+         It != Instances.cend(); It++)
+    {
+      It->Mesh->Build(TreePar);
+    }
+    InstanceTree.Build(Instances, GetWorldTree(), TreePar);
+  }
+
+  BuildLights(WithInstances);
+
+  IsTreeWithInstances = WithInstances && !Instances.empty();
+  IsChanged = FALSE;
+  IsTransformChanged = FALSE;
+  IsMaterialChanged = FALSE;
+}
+
+/**
+ * \brief Update trees after transformations or materials change function (trees are rebuilt if topology is changed)
+ * \param[in] WithInstances Flatten instances into tree flag (otherwise top-level tree is built)
+ */
+VOID scene::UpdateTrees( const BOOL WithInstances )
+{
+  CheckIdentificators();
+
+  // Materials are stored in triangles, so nodes are kept and only triangles are replaced
+  if (!Tree.SetTriangles(CollectTriangles(WithInstances)) ||
+      (IsTransformChanged && !Tree.Refit(TreePar)))
+  {
+    BuildTrees(WithInstances);
+    return;
+  }
+
+  if (IsTransformChanged)
+  {
+    Bvh4.Clear();
+    Bvh8.Clear();
+    if (TreePar.Type == ACCELERATION_STRUCTURE_TYPE::BVH4)
+      Bvh4.Build(Tree);
+    else if (TreePar.Type == ACCELERATION_STRUCTURE_TYPE::BVH8)
+      Bvh8.Build(Tree);
+
+    // Meshes trees are in object space and are not changed, top-level tree is cheap to rebuild
+    if (!WithInstances && !Instances.empty())
+      InstanceTree.Build(Instances, GetWorldTree(), TreePar);
+  }
+
+  BuildLights(WithInstances);
+
+  IsTransformChanged = FALSE;
+  IsMaterialChanged = FALSE;
+}
+
+/**
+ * \brief Collect emissive triangles of tree (and of not flattened instances) function
+ * \param[in] WithInstances Instances are flattened into tree flag
+ */
+VOID scene::BuildLights( const BOOL WithInstances )
+{
+  Lights.Clear();
+  Lights.Add(Tree.GetTriangles());
+
+  if (!WithInstances)
+    for (std::vector<instance>::const_iterator It = Instances.cbegin();
+         It != Instances.cend(); It++)
+    {
+      const vec &Emit = material::Table[It->MtlId].Emit;
+
+      // Only emissive instances are transformed to world space
+      if (Emit.X > 0 || Emit.Y > 0 || Emit.Z > 0)
+      {
+        std::vector<triangle> Tr;
+
+        It->AddTriangles(&Tr);
+        Lights.Add(Tr);
+      }
+    }
+}
+
+/**
+ * \brief Get tree for intersection function (instances triangles are flattened into tree)
+ * \return Tree for intersection
+ */
+const kd_tree & scene::GetTree( VOID )
+{
+  if (IsChanged || (!IsTreeWithInstances && !Instances.empty()))
+    BuildTrees(TRUE);
+  else if (IsTransformChanged || IsMaterialChanged)
+    UpdateTrees(TRUE);
+
   return Tree;
 }
+
+/**
+ * \brief Get acceleration structure selected by tree parameters function
+ * \return Acceleration structure for intersection
+ */
+const acceleration_structure & scene::GetAccelerationStructure( VOID )
+{
+  if (IsChanged || IsTreeWithInstances)
+    BuildTrees(FALSE);
+  else if (IsTransformChanged || IsMaterialChanged)
+    UpdateTrees(FALSE);
+
+  if (!Instances.empty())
+    return InstanceTree;
+  return GetWorldTree();
+}
+
+/**
+ * \brief Get emissive triangles of last built tree function
+ * \return Lights
+ */
+const light_list & scene::GetLights( VOID ) const
+{
+  return Lights;
+}
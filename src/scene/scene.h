@@ -3,6 +3,9 @@
 
 #include "shape.h"
 #include "kd_tree.h"
+#include "wide_bvh.h"
+#include "instance_tree.h"
+#include "light_list.h"
 #include "scene_data.h"
 
 /**
@@ -11,21 +14,79 @@
 class scene
 {
 private:
-  /** Tree for fast intersection */
+  /** Tree for fast intersection (over shapes triangles, instances are flattened into it only for gpu_render) */
   kd_tree Tree;
 
+  /** Wide trees collapsed from kd-tree (built only if selected by tree parameters) */
+  wide_bvh<4> Bvh4;
+  wide_bvh<8> Bvh8;
+
+  /** Top-level tree over instances (used by cpu_render if scene has instances) */
+  instance_tree InstanceTree;
+
+  /** Emissive triangles for explicit light sampling */
+  light_list Lights;
+
+  /** Is instances triangles flattened into tree flag */
+  BOOL IsTreeWithInstances = FALSE;
+
+  /**
+   * \brief Get structure for shapes triangles selected by tree parameters function
+   * \return Acceleration structure
+   */
+  const acceleration_structure & GetWorldTree( VOID ) const;
+
+  /**
+   * \brief Check triangles and instances material and environment identificators function
+   */
+  VOID CheckIdentificators( VOID ) const;
+
+  /**
+   * \brief Collect triangles for tree function
+   * \param[in] WithInstances Flatten instances flag (instanced meshes are built)
+   * \return Shapes (and instances) triangles
+   */
+  std::vector<triangle> CollectTriangles( const BOOL WithInstances ) const;
+
+  /**
+   * \brief Build trees function
+   * \param[in] WithInstances Flatten instances into tree flag (otherwise top-level tree is built)
+   */
+  VOID BuildTrees( const BOOL WithInstances );
+
+  /**
+   * \brief Update trees after transformations or materials change function (trees are rebuilt if topology is changed)
+   * \param[in] WithInstances Flatten instances into tree flag (otherwise top-level tree is built)
+   */
+  VOID UpdateTrees( const BOOL WithInstances );
+
+  /**
+   * \brief Collect emissive triangles of tree (and of not flattened instances) function
+   * \param[in] WithInstances Instances are flattened into tree flag
+   */
+  VOID BuildLights( const BOOL WithInstances );
+
 public:
   /**
    * \brief Scene default constructor.
    */
   scene( VOID );
 
-  /** Changes flag */
+  /** Changes flag (shapes or instances are added or removed, trees are rebuilt) */
   BOOL IsChanged = FALSE;
 
+  /** Transformations changes flag (shapes triangles are moved or instances transformations are set, trees are refitted) */
+  BOOL IsTransformChanged = FALSE;
+
+  /** Materials changes flag (only triangles or instances material and environment identificators are changed) */
+  BOOL IsMaterialChanged = FALSE;
+
   /** Shapes array */
   std::vector<shape *> Objects;
 
+  /** Mesh instances */
+  std::vector<instance> Instances;
+
   /** Render parameters */
   RENDER_PARAMS RenderPar;
 
@@ -36,10 +97,22 @@ public:
   environment AirEnvi;
 
   /**
-   * \brief Get tree for intersection function
+   * \brief Get tree for intersection function (instances triangles are flattened into tree)
    * \return Tree for intersection
    */
   const kd_tree & GetTree( VOID );
+
+  /**
+   * \brief Get acceleration structure selected by tree parameters function
+   * \return Acceleration structure for intersection
+   */
+  const acceleration_structure & GetAccelerationStructure( VOID );
+
+  /**
+   * \brief Get emissive triangles of last built tree function
+   * \return Lights
+   */
+  const light_list & GetLights( VOID ) const;
 };
 
 #endif /* __scene_h_ */
@@ -40,8 +40,11 @@ public:
   /** Image height */
   UINT32 Height;
 
-  /** Not used padding */
-  UINT32 _Padding[2];
+  /** Number of emissive triangles */
+  UINT32 NumOfLights;
+
+  /** Total area of emissive triangles */
+  FLT LightsArea;
 };
 
 #pragma pack(pop)
@@ -19,6 +19,20 @@ VOID shape::AddTriangles( const std::vector<triangle> &NewTriangles )
  */
 VOID shape::LoadOBJ( const std::string &FileName, const INT MtlId,
                      const INT EnviId, const matr &BaseTransform )
+{
+  AddTriangles(ReadOBJ(FileName, MtlId, EnviId, BaseTransform));
+}
+
+/**
+ * \brief Read triangles from *.obj file function
+ * \param[in] FileName Name of file
+ * \param[in] MtlId Material identificator
+ * \param[in] EnviId Environment identificator
+ * \param[in] BaseTransform Transformation for model
+ * \return Triangles
+ */
+std::vector<triangle> shape::ReadOBJ( const std::string &FileName, const INT MtlId,
+                                      const INT EnviId, const matr &BaseTransform )
 {
   struct OBJ_VERTEX_INDEX
   {
@@ -32,6 +46,7 @@ VOID shape::LoadOBJ( const std::string &FileName, const INT MtlId,
   std::vector<vec> Normals;
   std::vector<vec2> TexCoords;
   std::vector<OBJ_VERTEX_INDEX> I;
+  std::vector<triangle> Triangles;
   FILE *F;
   CHAR Buf[1 << 8];
   matr NormalTransform(BaseTransform.GetInverse().GetTranspose());
@@ -122,6 +137,8 @@ VOID shape::LoadOBJ( const std::string &FileName, const INT MtlId,
 
     Triangles.push_back(triangle(P0, P1, P2, MtlId, EnviId));
   }
+
+  return Triangles;
 }
 
 /**
@@ -34,6 +34,17 @@ public:
    */
   VOID AddTriangles( const std::vector<triangle> &NewTriangles );
 
+  /**
+   * \brief Read triangles from *.obj file function
+   * \param[in] FileName Name of file
+   * \param[in] MtlId Material identificator
+   * \param[in] EnviId Environment identificator
+   * \param[in] BaseTransform Transformation for model
+   * \return Triangles
+   */
+  static std::vector<triangle> ReadOBJ( const std::string &FileName, const INT MtlId, const INT EnviId,
+                                        const matr &BaseTransform = matr::Identity() );
+
   /**
    * \brief Load *.obj file and add triangles function
    * \param[in] FileName Name of file
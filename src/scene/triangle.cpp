@@ -64,6 +64,32 @@ triangle::triangle( const vertex& A, const vertex& B, const vertex& C, const INT
   V0 = P0.P & V1;
 }
 
+/**
+ * \brief Get triangle vertex function
+ * \param[in] Index Vertex index (0, 1 or 2)
+ * \return Vertex
+ */
+const vertex & triangle::GetVertex( const INT Index ) const
+{
+  return Index == 0 ? P0 : Index == 1 ? P1 : P2;
+}
+
+/**
+ * \brief Add triangle source data (vertices and identifiers, without padding) to hash function
+ * \param[in, out] Hash Hash
+ */
+VOID triangle::AddToHash( hasher *Hash ) const
+{
+  for (const vertex *V : {&P0, &P1, &P2})
+  {
+    const FLT Data[8] = {V->P.X, V->P.Y, V->P.Z, V->N.X, V->N.Y, V->N.Z, V->T.X, V->T.Y};
+
+    Hash->Add(Data);
+  }
+  Hash->Add(MatId);
+  Hash->Add(EnviId);
+}
+
 /**
  * \brief Get triangle center (medians intersection)
  * \return Center
@@ -126,6 +152,33 @@ BOOL triangle::Intersect( const ray &R, INTR *Intr, const RENDER_PARAMS &Par ) c
   return FALSE;
 }
 
+/**
+ * \brief Check ray intersection closer than distance function (intersection structure is not filled)
+ * \param[in] R Ray
+ * \param[in] MaxDist Distance along ray
+ * \param[in] Par Render parameters
+ * \return TRUE-if intersect, FALSE-if otherwise
+ */
+BOOL triangle::IsIntersected( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const
+{
+  const FLT NormDir = N & R.Dir;
+
+  if (fabs(NormDir) < Par.Threshold)
+    return FALSE;
+
+  const FLT T = -((N & R.Org) - D) / NormDir;
+
+  if (T < 0 || T >= MaxDist)
+    return FALSE;
+
+  const vec P = R(T);
+  const FLT
+    U = (P & U1) - U0,
+    V = (P & V1) - V0;
+
+  return U >= 0 && V >= 0 && U + V <= 1;
+}
+
 /**
  * \brief Get interpolated intersection point
  * \param[in] Intersection structure
@@ -3,8 +3,10 @@
 
 #include "aabb.h"
 #include "params.h"
+#include "utils/hasher.h"
 
 struct INTR;
+class instance;
 
 #pragma pack(push, 4)
 
@@ -154,6 +156,15 @@ public:
    */
   BOOL Intersect( const ray &R, INTR *Intr, const RENDER_PARAMS &Par ) const;
 
+  /**
+   * \brief Check ray intersection closer than distance function (intersection structure is not filled)
+   * \param[in] R Ray
+   * \param[in] MaxDist Distance along ray
+   * \param[in] Par Render parameters
+   * \return TRUE-if intersect, FALSE-if otherwise
+   */
+  BOOL IsIntersected( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const;
+
   /**
    * \brief Get interpolated intersection point
    * \param[in] Intersection structure
@@ -161,6 +172,19 @@ public:
    */
   vertex GetInterp( const INTR &Intr ) const;
 
+  /**
+   * \brief Get triangle vertex function
+   * \param[in] Index Vertex index (0, 1 or 2)
+   * \return Vertex
+   */
+  const vertex & GetVertex( const INT Index ) const;
+
+  /**
+   * \brief Add triangle source data (vertices and identifiers, without padding) to hash function
+   * \param[in, out] Hash Hash
+   */
+  VOID AddToHash( hasher *Hash ) const;
+
   /**
    * \brief Get triangle center (medians intersection)
    * \return Center
@@ -222,6 +246,9 @@ struct INTR
 
   /** Intersection vertex */
   vertex Vert;
+
+  /** Intersected instance (nullptr - triangle is in world space) */
+  const instance *Instance = nullptr;
 };
 
 #endif /* __triangle_h_ */
@@ -0,0 +1,369 @@
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define WIDE_BVH_USE_SSE
+#include <immintrin.h>
+#endif
+
+#include "wide_bvh.h"
+
+/**
+ * \brief Build tree function
+ * \param[in] Tree Built kd-tree (must live while wide tree is used)
+ */
+template <INT Width>
+  VOID wide_bvh<Width>::Build( const kd_tree &Tree )
+  {
+    Clear();
+    Triangles = Tree.GetTriangles();
+
+    if (!Tree.GetNodes().empty())
+      CollapseRec(Tree.GetNodes(), 0);
+  }
+
+/**
+ * \brief Collapse kd-tree subtree to wide node function
+ * \param[in] TreeNodes Packed kd-tree nodes
+ * \param[in] Root Index of subtree root in kd-tree nodes
+ * \return Index of built node
+ */
+template <INT Width>
+  UINT32 wide_bvh<Width>::CollapseRec( const array_view<kd_tree_node_data> &TreeNodes, const UINT32 Root )
+  {
+    const UINT32 Res = Nodes.size();
+    UINT32 Children[Width];
+    INT NumOfChildren = 0;
+
+    Nodes.emplace_back();
+
+    if (TreeNodes[Root].NumOfTriangles >= 0)
+      Children[NumOfChildren++] = Root;
+    else
+    {
+      Children[NumOfChildren++] = Root + 1;
+      Children[NumOfChildren++] = TreeNodes[Root].Offset;
+    }
+
+    // Open inner child with largest surface area while there are free slots
+    while (NumOfChildren < Width)
+    {
+      INT Best = -1;
+      FLT BestArea = -1;
+
+      for (INT i = 0; i < NumOfChildren; i++)
+      {
+        const kd_tree_node_data &Node = TreeNodes[Children[i]];
+
+        if (Node.NumOfTriangles >= 0)
+          continue;
+
+        const FLT
+          DX = Node.Max[0] - Node.Min[0],
+          DY = Node.Max[1] - Node.Min[1],
+          DZ = Node.Max[2] - Node.Min[2],
+          Area = DX * DY + DY * DZ + DZ * DX;
+
+        if (Area > BestArea)
+        {
+          Best = i;
+          BestArea = Area;
+        }
+      }
+
+      if (Best == -1)
+        break;
+
+      const UINT32 Opened = Children[Best];
+
+      Children[Best] = Opened + 1;
+      Children[NumOfChildren++] = TreeNodes[Opened].Offset;
+    }
+
+    for (INT i = 0; i < Width; i++)
+    {
+      NODE &Node = Nodes[Res];
+
+      if (i >= NumOfChildren)
+      {
+        // Empty box is never intersected
+        Node.MinX[i] = Node.MinY[i] = Node.MinZ[i] = INFINITY;
+        Node.MaxX[i] = Node.MaxY[i] = Node.MaxZ[i] = -INFINITY;
+        Node.Child[i] = 0;
+        Node.NumOfTriangles[i] = 0;
+        continue;
+      }
+
+      const kd_tree_node_data &Child = TreeNodes[Children[i]];
+
+      Node.MinX[i] = Child.Min[0];
+      Node.MinY[i] = Child.Min[1];
+      Node.MinZ[i] = Child.Min[2];
+      Node.MaxX[i] = Child.Max[0];
+      Node.MaxY[i] = Child.Max[1];
+      Node.MaxZ[i] = Child.Max[2];
+
+      if (Child.NumOfTriangles >= 0)
+      {
+        Node.Child[i] = Child.Offset;
+        Node.NumOfTriangles[i] = Child.NumOfTriangles;
+      }
+      else
+      {
+        const UINT32 ChildIndex = CollapseRec(TreeNodes, Children[i]);
+
+        // Nodes array may be reallocated
+        Nodes[Res].Child[i] = ChildIndex;
+        Nodes[Res].NumOfTriangles[i] = -1;
+      }
+    }
+
+    return Res;
+  }
+
+/**
+ * \brief Intersection ray with node children boxes function
+ * \param[in] Node Tree node
+ * \param[in] Ray Ray data
+ * \param[in] MaxT Maximal distance along ray
+ * \param[out] T Distances to children boxes
+ * \return Bit mask of intersected children
+ */
+template <INT Width>
+  UINT32 wide_bvh<Width>::IntersectChildren( const NODE &Node, const RAY_DATA &Ray, const FLT MaxT, FLT *T )
+  {
+    // Near and far planes are selected by direction sign, so empty boxes (Min > Max) are never intersected
+    const FLT
+      *NearX = Ray.IsNegative[0] ? Node.MaxX : Node.MinX,
+      *NearY = Ray.IsNegative[1] ? Node.MaxY : Node.MinY,
+      *NearZ = Ray.IsNegative[2] ? Node.MaxZ : Node.MinZ,
+      *FarX = Ray.IsNegative[0] ? Node.MinX : Node.MaxX,
+      *FarY = Ray.IsNegative[1] ? Node.MinY : Node.MaxY,
+      *FarZ = Ray.IsNegative[2] ? Node.MinZ : Node.MaxZ;
+    UINT32 Mask = 0;
+    INT Begin = 0;
+
+#ifdef WIDE_BVH_USE_SSE
+    // Children of 8-wide nodes are tested by two packs of 4
+    if constexpr (Width % 4 == 0)
+    {
+      const __m128
+        OrgX = _mm_set1_ps(Ray.Org[0]), OrgY = _mm_set1_ps(Ray.Org[1]), OrgZ = _mm_set1_ps(Ray.Org[2]),
+        InvX = _mm_set1_ps(Ray.InvDir[0]), InvY = _mm_set1_ps(Ray.InvDir[1]), InvZ = _mm_set1_ps(Ray.InvDir[2]);
+
+      for (; Begin < Width; Begin += 4)
+      {
+        // NaN (0 * INFINITY) in first operand is replaced by second operand
+        const __m128 TNear =
+          _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(NearX + Begin), OrgX), InvX),
+            _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(NearY + Begin), OrgY), InvY),
+              _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(NearZ + Begin), OrgZ), InvZ),
+                _mm_setzero_ps())));
+        const __m128 TFar =
+          _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(FarX + Begin), OrgX), InvX),
+            _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(FarY + Begin), OrgY), InvY),
+              _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(FarZ + Begin), OrgZ), InvZ),
+                _mm_set1_ps(MaxT))));
+
+        _mm_storeu_ps(T + Begin, TNear);
+        Mask |= (UINT32)_mm_movemask_ps(_mm_cmple_ps(TNear, _mm_mul_ps(TFar, _mm_set1_ps(1.00000024f)))) << Begin;
+      }
+    }
+#endif /* WIDE_BVH_USE_SSE */
+
+    // Scalar fallback
+    for (; Begin < Width; Begin++)
+    {
+      const FLT
+        TNear = fmaxf(fmaxf(fmaxf(0, (NearZ[Begin] - Ray.Org[2]) * Ray.InvDir[2]),
+                            (NearY[Begin] - Ray.Org[1]) * Ray.InvDir[1]),
+                      (NearX[Begin] - Ray.Org[0]) * Ray.InvDir[0]),
+        TFar = fminf(fminf(fminf(MaxT, (FarZ[Begin] - Ray.Org[2]) * Ray.InvDir[2]),
+                           (FarY[Begin] - Ray.Org[1]) * Ray.InvDir[1]),
+                     (FarX[Begin] - Ray.Org[0]) * Ray.InvDir[0]);
+
+      T[Begin] = TNear;
+      if (TNear <= TFar * 1.00000024f)
+        Mask |= 1U << Begin;
+    }
+
+    return Mask;
+  }
+
+/**
+ * \brief Intersection with ray function
+ * \param[in] R Ray
+ * \param[in, out] Intr Intersection structure
+ * \param[in, out] Near Distance to nearest intersection
+ * \param[in] Par Render parameters
+ * \return TRUE-if intersect, FALSE-if otherwise
+ */
+template <INT Width>
+  BOOL wide_bvh<Width>::Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const
+  {
+    /* Traversal stack entry */
+    struct STACK_ENTRY
+    {
+      /** Node index or triangles offset */
+      UINT32 Index;
+
+      /** Number of triangles (-1 for node) */
+      INT32 NumOfTriangles;
+
+      /** Distance to entry */
+      FLT T;
+    };
+
+    if (Nodes.empty())
+      return FALSE;
+
+    const RAY_DATA Ray =
+      {
+        {R.Org.X, R.Org.Y, R.Org.Z},
+        {R.InvDir.X, R.InvDir.Y, R.InvDir.Z},
+        {R.InvDir.X < 0, R.InvDir.Y < 0, R.InvDir.Z < 0}
+      };
+    STACK_ENTRY Stack[Width * 64];
+    INT StackSize = 0;
+    alignas(32) FLT T[Width];
+    BOOL Hit = FALSE;
+    INTR CurIntr;
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+    UINT64 VisitedNodes = 0;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+    Stack[StackSize++] = {0, -1, 0};
+
+    while (StackSize > 0)
+    {
+      const STACK_ENTRY Entry = Stack[--StackSize];
+
+      if (Entry.T > *Near)
+        continue;
+
+      if (Entry.NumOfTriangles >= 0) // Leaf
+      {
+        for (UINT32 i = Entry.Index; i < Entry.Index + Entry.NumOfTriangles; i++)
+          if (Triangles[i].Intersect(R, &CurIntr, Par) && CurIntr.T < *Near)
+          {
+            Hit = TRUE;
+            *Near = CurIntr.T;
+            *Intr = CurIntr;
+          }
+        continue;
+      }
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+      VisitedNodes++;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+      const NODE &Node = Nodes[Entry.Index];
+      UINT32 Mask = IntersectChildren(Node, Ray, *Near, T);
+      const INT First = StackSize;
+
+      // Push intersected children sorted from far to near (nearest is popped first)
+      for (INT i = 0; Mask != 0; i++, Mask >>= 1)
+      {
+        if ((Mask & 1) == 0 || Node.NumOfTriangles[i] == 0)
+          continue;
+
+        INT j = StackSize++;
+
+        for (; j > First && Stack[j - 1].T < T[i]; j--)
+          Stack[j] = Stack[j - 1];
+        Stack[j] = {Node.Child[i], Node.NumOfTriangles[i], T[i]};
+      }
+    }
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+    NumOfVisitedNodes.fetch_add(VisitedNodes, std::memory_order_relaxed);
+    NumOfIntersectionRequests.fetch_add(1, std::memory_order_relaxed);
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+    return Hit;
+  }
+
+/**
+ * \brief Check if any intersection with ray is closer than distance function (traversal stops at first found one)
+ * \param[in] R Ray
+ * \param[in] MaxDist Distance along ray
+ * \param[in] Par Render parameters
+ * \return TRUE-if ray is occluded, FALSE-if otherwise
+ */
+template <INT Width>
+  BOOL wide_bvh<Width>::Occluded( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const
+  {
+    /* Traversal stack entry */
+    struct STACK_ENTRY
+    {
+      /** Node index or triangles offset */
+      UINT32 Index;
+
+      /** Number of triangles (-1 for node) */
+      INT32 NumOfTriangles;
+    };
+
+    if (Nodes.empty())
+      return FALSE;
+
+    const RAY_DATA Ray =
+      {
+        {R.Org.X, R.Org.Y, R.Org.Z},
+        {R.InvDir.X, R.InvDir.Y, R.InvDir.Z},
+        {R.InvDir.X < 0, R.InvDir.Y < 0, R.InvDir.Z < 0}
+      };
+    STACK_ENTRY Stack[Width * 64];
+    INT StackSize = 0;
+    alignas(32) FLT T[Width];
+    BOOL Hit = FALSE;
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+    UINT64 VisitedNodes = 0;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+    Stack[StackSize++] = {0, -1};
+
+    while (StackSize > 0 && !Hit)
+    {
+      const STACK_ENTRY Entry = Stack[--StackSize];
+
+      if (Entry.NumOfTriangles >= 0) // Leaf
+      {
+        for (UINT32 i = Entry.Index; i < Entry.Index + Entry.NumOfTriangles && !Hit; i++)
+          Hit = Triangles[i].IsIntersected(R, MaxDist, Par);
+        continue;
+      }
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+      VisitedNodes++;
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+      const NODE &Node = Nodes[Entry.Index];
+      UINT32 Mask = IntersectChildren(Node, Ray, MaxDist, T);
+
+      // Any occluder is enough, so children are not sorted by distance
+      for (INT i = 0; Mask != 0; i++, Mask >>= 1)
+        if ((Mask & 1) != 0 && Node.NumOfTriangles[i] != 0)
+          Stack[StackSize++] = {Node.Child[i], Node.NumOfTriangles[i]};
+    }
+
+#if ENABLE_TREE_TRAVERSAL_STATISTICS
+    NumOfVisitedNodes.fetch_add(VisitedNodes, std::memory_order_relaxed);
+    NumOfIntersectionRequests.fetch_add(1, std::memory_order_relaxed);
+#endif /* ENABLE_TREE_TRAVERSAL_STATISTICS */
+
+    return Hit;
+  }
+
+/**
+ * \brief Clear tree function
+ */
+template <INT Width>
+  VOID wide_bvh<Width>::Clear( VOID )
+  {
+    Nodes.clear();
+    Triangles = array_view<triangle>();
+  }
+
+template class wide_bvh<4>;
+template class wide_bvh<8>;
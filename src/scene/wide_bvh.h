@@ -0,0 +1,116 @@
+#ifndef __wide_bvh_h_
+#define __wide_bvh_h_
+
+#include <vector>
+
+#include "kd_tree.h"
+
+/**
+ * \brief Bounding volume hierarchy with Width children per node (collapsed from kd_tree)
+ */
+template <INT Width>
+  class wide_bvh : public acceleration_structure
+  {
+  private:
+    /**
+     * \brief Tree node with children bounds in structure of arrays layout
+     */
+    struct alignas(32) NODE
+    {
+      /** Children bounding boxes minimal X coordinates */
+      FLT MinX[Width];
+
+      /** Children bounding boxes minimal Y coordinates */
+      FLT MinY[Width];
+
+      /** Children bounding boxes minimal Z coordinates */
+      FLT MinZ[Width];
+
+      /** Children bounding boxes maximal X coordinates */
+      FLT MaxX[Width];
+
+      /** Children bounding boxes maximal Y coordinates */
+      FLT MaxY[Width];
+
+      /** Children bounding boxes maximal Z coordinates */
+      FLT MaxZ[Width];
+
+      /** Node index for inner child, triangles offset for leaf child */
+      UINT32 Child[Width];
+
+      /** Number of triangles for leaf child, -1 for inner child */
+      INT32 NumOfTriangles[Width];
+    };
+
+    /**
+     * \brief Ray data for children boxes intersection
+     */
+    struct RAY_DATA
+    {
+      /** Ray origin */
+      FLT Org[3];
+
+      /** Inversed ray direction */
+      FLT InvDir[3];
+
+      /** Negative direction flags */
+      BOOL IsNegative[3];
+    };
+
+    /** Tree nodes in depth-first order (root is first) */
+    std::vector<NODE> Nodes;
+
+    /** Source tree triangles */
+    array_view<triangle> Triangles;
+
+    /**
+     * \brief Collapse kd-tree subtree to wide node function
+     * \param[in] TreeNodes Packed kd-tree nodes
+     * \param[in] Root Index of subtree root in kd-tree nodes
+     * \return Index of built node
+     */
+    UINT32 CollapseRec( const array_view<kd_tree_node_data> &TreeNodes, const UINT32 Root );
+
+    /**
+     * \brief Intersection ray with node children boxes function
+     * \param[in] Node Tree node
+     * \param[in] Ray Ray data
+     * \param[in] MaxT Maximal distance along ray
+     * \param[out] T Distances to children boxes
+     * \return Bit mask of intersected children
+     */
+    static UINT32 IntersectChildren( const NODE &Node, const RAY_DATA &Ray, const FLT MaxT, FLT *T );
+
+  public:
+    /**
+     * \brief Build tree function
+     * \param[in] Tree Built kd-tree (must live while wide tree is used)
+     */
+    VOID Build( const kd_tree &Tree );
+
+    /**
+     * \brief Intersection with ray function
+     * \param[in] R Ray
+     * \param[in, out] Intr Intersection structure
+     * \param[in, out] Near Distance to nearest intersection
+     * \param[in] Par Render parameters
+     * \return TRUE-if intersect, FALSE-if otherwise
+     */
+    BOOL Intersect( const ray &R, INTR *Intr, FLT *Near, const RENDER_PARAMS &Par ) const override;
+
+    /**
+     * \brief Check if any intersection with ray is closer than distance function (traversal stops at first found one)
+     * \param[in] R Ray
+     * \param[in] MaxDist Distance along ray
+     * \param[in] Par Render parameters
+     * \return TRUE-if ray is occluded, FALSE-if otherwise
+     */
+    BOOL Occluded( const ray &R, const FLT MaxDist, const RENDER_PARAMS &Par ) const override;
+
+    /**
+     * \brief Clear tree function
+     */
+    VOID Clear( VOID );
+  };
+
+#endif /* __wide_bvh_h_ */
@@ -30,6 +30,24 @@ std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene_loader>> scene_
         &scene_loader::LoadValue<UINT, scene_loader>,
         reinterpret_cast<BYTE scene_loader::*>(&scene_loader::NumberOfSamples))
     },
+    {
+      "time_budget",
+      scene_loader::LOAD_SUBTREE<scene_loader>(
+        &scene_loader::LoadValue<FLT, scene_loader>,
+        reinterpret_cast<BYTE scene_loader::*>(&scene_loader::TimeBudget))
+    },
+    {
+      "seed",
+      scene_loader::LOAD_SUBTREE<scene_loader>(
+        &scene_loader::LoadValue<UINT, scene_loader>,
+        reinterpret_cast<BYTE scene_loader::*>(&scene_loader::Seed))
+    },
+    {
+      "number_of_threads",
+      scene_loader::LOAD_SUBTREE<scene_loader>(
+        &scene_loader::LoadValue<INT, scene_loader>,
+        reinterpret_cast<BYTE scene_loader::*>(&scene_loader::NumberOfThreads))
+    },
     {
       "output_path",
       scene_loader::LOAD_SUBTREE<scene_loader>(
@@ -41,28 +59,7 @@ std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene_loader>> scene_
       scene_loader::LOAD_SUBTREE<scene_loader>(
         &scene_loader::LoadValueWithTranslator<image::FORMAT, scene_loader>,
         reinterpret_cast<BYTE scene_loader::*>(&scene_loader::OutputFormat),
-        []( const std::string &Str, BYTE *Data )
-        {
-          static std::unordered_map<std::string, image::FORMAT> FormatsMap =
-            {
-              {
-                "jpg", image::FORMAT::JPG
-              },
-              {
-                "png", image::FORMAT::PNG
-              },
-              {
-                "tga", image::FORMAT::TGA
-              },
-            };
-
-          std::unordered_map<std::string, image::FORMAT>::const_iterator Res = FormatsMap.find(Str);
-
-          if (Res == FormatsMap.cend())
-            error("unknown image type");
-
-          *reinterpret_cast<image::FORMAT *>(Data) = Res->second;
-        })
+        &scene_loader::TranslateImageFormat)
     },
     {
       "render_mode",
@@ -92,6 +89,18 @@ std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene_loader>> scene_
           *reinterpret_cast<render::MODE *>(Data) = Res->second;
         })
     },
+    {
+      "progressive",
+      scene_loader::LOAD_SUBTREE<scene_loader>(
+        &scene_loader::LoadProgressiveParams,
+        reinterpret_cast<BYTE scene_loader::*>(&scene_loader::Progressive))
+    },
+    {
+      "adaptive",
+      scene_loader::LOAD_SUBTREE<scene_loader>(
+        &scene_loader::LoadAdaptiveParams,
+        reinterpret_cast<BYTE scene_loader::*>(&scene_loader::Adaptive))
+    },
     {
       "camera",
       scene_loader::LOAD_SUBTREE<scene_loader>(
@@ -106,6 +115,71 @@ std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene_loader>> scene_
     },
   };
 
+/** Tags maps for progressive rendering parameters loading */
+std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<PROGRESSIVE_PARAMS>> scene_loader::ProgressiveParamsTagsMap =
+  {
+    {
+      "samples",
+      scene_loader::LOAD_SUBTREE<PROGRESSIVE_PARAMS>(
+        &scene_loader::LoadValue<INT, PROGRESSIVE_PARAMS>,
+        reinterpret_cast<BYTE PROGRESSIVE_PARAMS::*>(&PROGRESSIVE_PARAMS::Samples))
+    },
+    {
+      "seconds",
+      scene_loader::LOAD_SUBTREE<PROGRESSIVE_PARAMS>(
+        &scene_loader::LoadValue<FLT, PROGRESSIVE_PARAMS>,
+        reinterpret_cast<BYTE PROGRESSIVE_PARAMS::*>(&PROGRESSIVE_PARAMS::Seconds))
+    },
+    {
+      "image_path",
+      scene_loader::LOAD_SUBTREE<PROGRESSIVE_PARAMS>(
+        &scene_loader::LoadValue<std::string, PROGRESSIVE_PARAMS>,
+        reinterpret_cast<BYTE PROGRESSIVE_PARAMS::*>(&PROGRESSIVE_PARAMS::ImagePath))
+    },
+    {
+      "image_format",
+      scene_loader::LOAD_SUBTREE<PROGRESSIVE_PARAMS>(
+        &scene_loader::LoadValueWithTranslator<image::FORMAT, PROGRESSIVE_PARAMS>,
+        reinterpret_cast<BYTE PROGRESSIVE_PARAMS::*>(&PROGRESSIVE_PARAMS::ImageFormat),
+        &scene_loader::TranslateImageFormat)
+    },
+    {
+      "accumulation_path",
+      scene_loader::LOAD_SUBTREE<PROGRESSIVE_PARAMS>(
+        &scene_loader::LoadValue<std::string, PROGRESSIVE_PARAMS>,
+        reinterpret_cast<BYTE PROGRESSIVE_PARAMS::*>(&PROGRESSIVE_PARAMS::AccumulationPath))
+    },
+    {
+      "resume",
+      scene_loader::LOAD_SUBTREE<PROGRESSIVE_PARAMS>(
+        &scene_loader::LoadValue<BOOL, PROGRESSIVE_PARAMS>,
+        reinterpret_cast<BYTE PROGRESSIVE_PARAMS::*>(&PROGRESSIVE_PARAMS::Resume))
+    },
+  };
+
+/** Tags maps for adaptive sampling parameters loading */
+std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<ADAPTIVE_PARAMS>> scene_loader::AdaptiveParamsTagsMap =
+  {
+    {
+      "threshold",
+      scene_loader::LOAD_SUBTREE<ADAPTIVE_PARAMS>(
+        &scene_loader::LoadValue<FLT, ADAPTIVE_PARAMS>,
+        reinterpret_cast<BYTE ADAPTIVE_PARAMS::*>(&ADAPTIVE_PARAMS::Threshold))
+    },
+    {
+      "min_samples",
+      scene_loader::LOAD_SUBTREE<ADAPTIVE_PARAMS>(
+        &scene_loader::LoadValue<INT, ADAPTIVE_PARAMS>,
+        reinterpret_cast<BYTE ADAPTIVE_PARAMS::*>(&ADAPTIVE_PARAMS::MinSamples))
+    },
+    {
+      "max_samples",
+      scene_loader::LOAD_SUBTREE<ADAPTIVE_PARAMS>(
+        &scene_loader::LoadValue<INT, ADAPTIVE_PARAMS>,
+        reinterpret_cast<BYTE ADAPTIVE_PARAMS::*>(&ADAPTIVE_PARAMS::MaxSamples))
+    },
+  };
+
 /** Tags map for parse camera subtree */
 std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene_loader::CAMERA_LOAD_DATA>> scene_loader::CameraTagsMap =
   {
@@ -428,6 +502,122 @@ std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene_loader::OBJ_LOA
     },
   };
 
+/** Tags maps for tree parameters loading */
+std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<TREE_PARAMS>> scene_loader::TreeParamsTagsMap =
+  {
+    {
+      "type",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValueWithTranslator<ACCELERATION_STRUCTURE_TYPE, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::Type),
+        []( const std::string &Str, BYTE *Data )
+        {
+          static std::unordered_map<std::string, ACCELERATION_STRUCTURE_TYPE> TypesMap =
+            {
+              {
+                "kd_tree", ACCELERATION_STRUCTURE_TYPE::KD_TREE
+              },
+              {
+                "bvh4", ACCELERATION_STRUCTURE_TYPE::BVH4
+              },
+              {
+                "bvh8", ACCELERATION_STRUCTURE_TYPE::BVH8
+              }
+            };
+
+          std::unordered_map<std::string, ACCELERATION_STRUCTURE_TYPE>::const_iterator Res = TypesMap.find(Str);
+
+          if (Res == TypesMap.cend())
+            error("unknown acceleration structure type");
+
+          *reinterpret_cast<ACCELERATION_STRUCTURE_TYPE *>(Data) = Res->second;
+        })
+    },
+    {
+      "max_depth",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<INT, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::MaxDepthTree))
+    },
+    {
+      "min_leaf_size",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<INT, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::MinNumOfTriangleLeaf))
+    },
+    {
+      "max_leaf_size",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<INT, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::MaxNumOfTriangleLeaf))
+    },
+    {
+      "number_of_bins",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<INT, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::NumberOfBins))
+    },
+    {
+      "traversal_cost",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<FLT, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::TraversalCost))
+    },
+    {
+      "intersection_cost",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<FLT, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::IntersectionCost))
+    },
+    {
+      "rebuild_threshold",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<FLT, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::RebuildThreshold))
+    },
+    {
+      "cache_path",
+      scene_loader::LOAD_SUBTREE<TREE_PARAMS>(
+        &scene_loader::LoadValue<std::string, TREE_PARAMS>,
+        reinterpret_cast<BYTE TREE_PARAMS::*>(&TREE_PARAMS::CachePath))
+    },
+  };
+
+/** Tags maps for render parameters loading */
+std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<RENDER_PARAMS>> scene_loader::RenderParamsTagsMap =
+  {
+    {
+      "threshold",
+      scene_loader::LOAD_SUBTREE<RENDER_PARAMS>(
+        &scene_loader::LoadValue<FLT, RENDER_PARAMS>,
+        reinterpret_cast<BYTE RENDER_PARAMS::*>(&RENDER_PARAMS::Threshold))
+    },
+    {
+      "color_threshold",
+      scene_loader::LOAD_SUBTREE<RENDER_PARAMS>(
+        &scene_loader::LoadValue<FLT, RENDER_PARAMS>,
+        reinterpret_cast<BYTE RENDER_PARAMS::*>(&RENDER_PARAMS::ColorThreshold))
+    },
+    {
+      "max_depth",
+      scene_loader::LOAD_SUBTREE<RENDER_PARAMS>(
+        &scene_loader::LoadValue<INT, RENDER_PARAMS>,
+        reinterpret_cast<BYTE RENDER_PARAMS::*>(&RENDER_PARAMS::MaxDepthRender))
+    },
+    {
+      "roulette_depth",
+      scene_loader::LOAD_SUBTREE<RENDER_PARAMS>(
+        &scene_loader::LoadValue<INT, RENDER_PARAMS>,
+        reinterpret_cast<BYTE RENDER_PARAMS::*>(&RENDER_PARAMS::RouletteDepth))
+    },
+    {
+      "roulette_min_probability",
+      scene_loader::LOAD_SUBTREE<RENDER_PARAMS>(
+        &scene_loader::LoadValue<FLT, RENDER_PARAMS>,
+        reinterpret_cast<BYTE RENDER_PARAMS::*>(&RENDER_PARAMS::RouletteMinProbability))
+    },
+  };
+
 /** Tags maps for scene loading */
 std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene>> scene_loader::SceneTagsMap =
   {
@@ -461,6 +651,18 @@ std::unordered_map<std::string, scene_loader::LOAD_SUBTREE<scene>> scene_loader:
         &scene_loader::LoadAirEnvironmentName,
         reinterpret_cast<BYTE scene::*>(&scene::AirEnvi))
     },
+    {
+      "tree_params",
+      scene_loader::LOAD_SUBTREE<scene>(
+        &scene_loader::LoadTreeParams,
+        reinterpret_cast<BYTE scene::*>(&scene::TreePar))
+    },
+    {
+      "render_params",
+      scene_loader::LOAD_SUBTREE<scene>(
+        &scene_loader::LoadRenderParams,
+        reinterpret_cast<BYTE scene::*>(&scene::RenderPar))
+    },
   };
   
 /**
@@ -649,7 +851,138 @@ VOID scene_loader::LoadObj( scene *StructurePointer, const LOAD_SUBTREE<scene> &
   if (EnviIt == EnvironmentsMap.cend())
     error("environment '" + ObjData.EnviName + "' not found");
 
-  SceneShape.LoadOBJ(ObjData.FileName, MtlIt->second, EnviIt->second, ObjData.Transform);
+  // Same file is read and its tree is built once, every model is an instance of shared mesh
+  StructurePointer->Instances.emplace_back(mesh::LoadOBJ(ObjData.FileName), MtlIt->second, EnviIt->second,
+                                           ObjData.Transform);
+}
+
+/**
+ * \brief Load progressive rendering parameters function.
+ * \param[in, out] StructurePointer Pointer to structure for fill
+ * \param[in] LoadStructure Load structure
+ * \param[in] PropertyTree Property tree for loading
+ */
+VOID scene_loader::LoadProgressiveParams( scene_loader *StructurePointer, const LOAD_SUBTREE<scene_loader> &LoadStructure,
+                                          const bpt::ptree &PropertyTree )
+{
+  PROGRESSIVE_PARAMS *ProgressivePtr =
+    &(StructurePointer->*reinterpret_cast<PROGRESSIVE_PARAMS scene_loader::*>(LoadStructure.Data));
+
+  for (const auto &[NodeName, NodeSubtree] : PropertyTree)
+  {
+    std::unordered_map<std::string, LOAD_SUBTREE<PROGRESSIVE_PARAMS>>::const_iterator Res =
+      ProgressiveParamsTagsMap.find(NodeName);
+
+    if (Res == ProgressiveParamsTagsMap.cend())
+      error("unknown tag '" + NodeName + "'");
+
+    (this->*(Res->second.LoadFunction))(ProgressivePtr, Res->second, NodeSubtree);
+  }
+}
+
+/**
+ * \brief Load adaptive sampling parameters function.
+ * \param[in, out] StructurePointer Pointer to structure for fill
+ * \param[in] LoadStructure Load structure
+ * \param[in] PropertyTree Property tree for loading
+ */
+VOID scene_loader::LoadAdaptiveParams( scene_loader *StructurePointer, const LOAD_SUBTREE<scene_loader> &LoadStructure,
+                                       const bpt::ptree &PropertyTree )
+{
+  ADAPTIVE_PARAMS *AdaptivePtr =
+    &(StructurePointer->*reinterpret_cast<ADAPTIVE_PARAMS scene_loader::*>(LoadStructure.Data));
+
+  for (const auto &[NodeName, NodeSubtree] : PropertyTree)
+  {
+    std::unordered_map<std::string, LOAD_SUBTREE<ADAPTIVE_PARAMS>>::const_iterator Res =
+      AdaptiveParamsTagsMap.find(NodeName);
+
+    if (Res == AdaptiveParamsTagsMap.cend())
+      error("unknown tag '" + NodeName + "'");
+
+    (this->*(Res->second.LoadFunction))(AdaptivePtr, Res->second, NodeSubtree);
+  }
+}
+
+/**
+ * \brief Translate image format name function
+ * \param[in] Str Format name
+ * \param[out] Data Pointer to image::FORMAT
+ */
+VOID scene_loader::TranslateImageFormat( const std::string &Str, BYTE *Data )
+{
+  static std::unordered_map<std::string, image::FORMAT> FormatsMap =
+    {
+      {
+        "jpg", image::FORMAT::JPG
+      },
+      {
+        "png", image::FORMAT::PNG
+      },
+      {
+        "tga", image::FORMAT::TGA
+      },
+      {
+        "pfm", image::FORMAT::PFM
+      },
+      {
+        "hdr", image::FORMAT::HDR
+      },
+      {
+        "exr", image::FORMAT::EXR
+      },
+    };
+
+  std::unordered_map<std::string, image::FORMAT>::const_iterator Res = FormatsMap.find(Str);
+
+  if (Res == FormatsMap.cend())
+    error("unknown image type");
+
+  *reinterpret_cast<image::FORMAT *>(Data) = Res->second;
+}
+
+/**
+ * \brief Load tree parameters function.
+ * \param[in, out] StructurePointer Pointer to structure for fill
+ * \param[in] LoadStructure Load structure
+ * \param[in] PropertyTree Property tree for loading
+ */
+VOID scene_loader::LoadTreeParams( scene *StructurePointer, const LOAD_SUBTREE<scene> &LoadStructure,
+                                   const bpt::ptree &PropertyTree )
+{
+  TREE_PARAMS *TreeParPtr = &(StructurePointer->*reinterpret_cast<TREE_PARAMS scene::*>(LoadStructure.Data));
+
+  for (const auto &[NodeName, NodeSubtree] : PropertyTree)
+  {
+    std::unordered_map<std::string, LOAD_SUBTREE<TREE_PARAMS>>::const_iterator Res = TreeParamsTagsMap.find(NodeName);
+
+    if (Res == TreeParamsTagsMap.cend())
+      error("unknown tag '" + NodeName + "'");
+
+    (this->*(Res->second.LoadFunction))(TreeParPtr, Res->second, NodeSubtree);
+  }
+}
+
+/**
+ * \brief Load render parameters function.
+ * \param[in, out] StructurePointer Pointer to structure for fill
+ * \param[in] LoadStructure Load structure
+ * \param[in] PropertyTree Property tree for loading
+ */
+VOID scene_loader::LoadRenderParams( scene *StructurePointer, const LOAD_SUBTREE<scene> &LoadStructure,
+                                     const bpt::ptree &PropertyTree )
+{
+  RENDER_PARAMS *RenderParPtr = &(StructurePointer->*reinterpret_cast<RENDER_PARAMS scene::*>(LoadStructure.Data));
+
+  for (const auto &[NodeName, NodeSubtree] : PropertyTree)
+  {
+    std::unordered_map<std::string, LOAD_SUBTREE<RENDER_PARAMS>>::const_iterator Res = RenderParamsTagsMap.find(NodeName);
+
+    if (Res == RenderParamsTagsMap.cend())
+      error("unknown tag '" + NodeName + "'");
+
+    (this->*(Res->second.LoadFunction))(RenderParPtr, Res->second, NodeSubtree);
+  }
 }
 
 /**
@@ -672,6 +1005,7 @@ VOID scene_loader::LoadFromPropertyTree( const bpt::ptree &PropertyTree )
   Camera.SetProj(CameraLoadData.PrDist, CameraLoadData.PrSize);
   Camera.SetView(CameraLoadData.Loc, CameraLoadData.At, CameraLoadData.Up1);
 
+  Scene.RenderPar.Seed = Seed;
   Scene.Objects.push_back(&SceneShape);
   Scene.IsChanged = TRUE;
 }
@@ -171,6 +171,31 @@ private:
   VOID LoadCamera( scene_loader *StructurePointer, const LOAD_SUBTREE<scene_loader> &LoadStructure,
                    const bpt::ptree &PropertyTree );
 
+  /**
+   * \brief Load progressive rendering parameters function.
+   * \param[in, out] StructurePointer Pointer to structure for fill
+   * \param[in] LoadStructure Load structure
+   * \param[in] PropertyTree Property tree for loading
+   */
+  VOID LoadProgressiveParams( scene_loader *StructurePointer, const LOAD_SUBTREE<scene_loader> &LoadStructure,
+                              const bpt::ptree &PropertyTree );
+
+  /**
+   * \brief Load adaptive sampling parameters function.
+   * \param[in, out] StructurePointer Pointer to structure for fill
+   * \param[in] LoadStructure Load structure
+   * \param[in] PropertyTree Property tree for loading
+   */
+  VOID LoadAdaptiveParams( scene_loader *StructurePointer, const LOAD_SUBTREE<scene_loader> &LoadStructure,
+                           const bpt::ptree &PropertyTree );
+
+  /**
+   * \brief Translate image format name function
+   * \param[in] Str Format name
+   * \param[out] Data Pointer to image::FORMAT
+   */
+  static VOID TranslateImageFormat( const std::string &Str, BYTE *Data );
+
   /**
    * \brief Load scene structure function.
    * \param[in, out] StructurePointer Pointer to structure for fill
@@ -453,6 +478,24 @@ private:
   VOID LoadAirEnvironmentName( scene *StructurePointer, const LOAD_SUBTREE<scene> &LoadStructure,
                                const bpt::ptree &PropertyTree );
 
+  /**
+   * \brief Load tree parameters function.
+   * \param[in, out] StructurePointer Pointer to structure for fill
+   * \param[in] LoadStructure Load structure
+   * \param[in] PropertyTree Property tree for loading
+   */
+  VOID LoadTreeParams( scene *StructurePointer, const LOAD_SUBTREE<scene> &LoadStructure,
+                       const bpt::ptree &PropertyTree );
+
+  /**
+   * \brief Load render parameters function.
+   * \param[in, out] StructurePointer Pointer to structure for fill
+   * \param[in] LoadStructure Load structure
+   * \param[in] PropertyTree Property tree for loading
+   */
+  VOID LoadRenderParams( scene *StructurePointer, const LOAD_SUBTREE<scene> &LoadStructure,
+                         const bpt::ptree &PropertyTree );
+
   /** Tags map for parse frame subtree */
   static std::unordered_map<std::string, LOAD_SUBTREE<scene_loader>> FrameTagsMap;
 
@@ -480,6 +523,18 @@ private:
   /** Tags maps for obj loading */
   static std::unordered_map<std::string, LOAD_SUBTREE<OBJ_LOAD_STRUCTURE>> ObjTagsMap;
 
+  /** Tags maps for tree parameters loading */
+  static std::unordered_map<std::string, LOAD_SUBTREE<TREE_PARAMS>> TreeParamsTagsMap;
+
+  /** Tags maps for render parameters loading */
+  static std::unordered_map<std::string, LOAD_SUBTREE<RENDER_PARAMS>> RenderParamsTagsMap;
+
+  /** Tags maps for progressive rendering parameters loading */
+  static std::unordered_map<std::string, LOAD_SUBTREE<PROGRESSIVE_PARAMS>> ProgressiveParamsTagsMap;
+
+  /** Tags maps for adaptive sampling parameters loading */
+  static std::unordered_map<std::string, LOAD_SUBTREE<ADAPTIVE_PARAMS>> AdaptiveParamsTagsMap;
+
   /** Tags maps for scene loading */
   static std::unordered_map<std::string, LOAD_SUBTREE<scene>> SceneTagsMap;
 
@@ -511,6 +566,15 @@ public:
   /** Number of samples per pixel */
   INT NumberOfSamples = 1;
 
+  /** Frame time budget in seconds (0 - number of samples is fixed) */
+  FLT TimeBudget = 0;
+
+  /** Seed of random numbers (same seed gives same image) */
+  UINT Seed = 0;
+
+  /** Number of CPU threads (0 - number of hardware threads) */
+  INT NumberOfThreads = 0;
+
   /** Output image format */
   image::FORMAT OutputFormat = image::FORMAT::PNG;
 
@@ -520,6 +584,12 @@ public:
   /** Render mode */
   render::MODE RenderMode = render::MODE::CPU;
 
+  /** Progressive rendering parameters */
+  PROGRESSIVE_PARAMS Progressive;
+
+  /** Adaptive sampling parameters */
+  ADAPTIVE_PARAMS Adaptive;
+
   /** Camera for render */
   cam Camera;
 
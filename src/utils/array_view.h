@@ -0,0 +1,101 @@
+#ifndef __array_view_h_
+#define __array_view_h_
+
+#include <cstddef>
+#include <vector>
+
+#include "def.h"
+
+/**
+ * \brief Non-owning view of contiguous array (vector or mapped file part)
+ */
+template <class type>
+  class array_view
+  {
+  private:
+    /** Array data */
+    const type *Data = nullptr;
+
+    /** Number of elements */
+    size_t Size = 0;
+
+  public:
+    /**
+     * \brief Empty view constructor
+     */
+    array_view( VOID ) = default;
+
+    /**
+     * \brief Constructor with initial value
+     * \param[in] Data Array data
+     * \param[in] Size Number of elements
+     */
+    array_view( const type *Data, const size_t Size ) : Data(Data), Size(Size)
+    {
+    }
+
+    /**
+     * \brief Vector view constructor
+     * \param[in] Vector Vector
+     */
+    array_view( const std::vector<type> &Vector ) : Data(Vector.data()), Size(Vector.size())
+    {
+    }
+
+    /**
+     * \brief Get element function
+     * \param[in] Index Element index
+     * \return Element
+     */
+    const type & operator[]( const size_t Index ) const
+    {
+      return Data[Index];
+    }
+
+    /**
+     * \brief Get array data function
+     * \return Pointer to first element
+     */
+    const type * data( VOID ) const
+    {
+      return Data;
+    }
+
+    /**
+     * \brief Get number of elements function
+     * \return Number of elements
+     */
+    size_t size( VOID ) const
+    {
+      return Size;
+    }
+
+    /**
+     * \brief Check if view is empty function
+     * \return TRUE-if empty, FALSE-otherwise
+     */
+    BOOL empty( VOID ) const
+    {
+      return Size == 0;
+    }
+
+    /**
+     * \brief Get begin iterator function
+     * \return Pointer to first element
+     */
+    const type * begin( VOID ) const
+    {
+      return Data;
+    }
+
+    /**
+     * \brief Get end iterator function
+     * \return Pointer after last element
+     */
+    const type * end( VOID ) const
+    {
+      return Data + Size;
+    }
+  };
+
+#endif /* __array_view_h_ */
@@ -0,0 +1,111 @@
+#ifndef __hasher_h_
+#define __hasher_h_
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "def.h"
+
+/**
+ * \brief Incremental 64-bit hash (xxHash64 rounds over 8-byte words with final avalanche) for cache keys
+ */
+class hasher
+{
+private:
+  /** Current hash state */
+  UINT64 Value = Prime5;
+
+  /** Hash primes (xxHash64) */
+  static const UINT64
+    Prime1 = 0x9E3779B185EBCA87ULL,
+    Prime2 = 0xC2B2AE3D27D4EB4FULL,
+    Prime3 = 0x165667B19E3779F9ULL,
+    Prime4 = 0x85EBCA77C2B2AE63ULL,
+    Prime5 = 0x27D4EB2F165667C5ULL;
+
+  /**
+   * \brief Rotate bits left function
+   * \param[in] X Value
+   * \param[in] N Number of bits
+   * \return Rotated value
+   */
+  static UINT64 RotateLeft( const UINT64 X, const INT N )
+  {
+    return (X << N) | (X >> (64 - N));
+  }
+
+  /**
+   * \brief Mix word to hash state function (every word bit affects all state bits)
+   * \param[in] Word Word
+   */
+  VOID AddWord( const UINT64 Word )
+  {
+    Value ^= RotateLeft(Word * Prime2, 31) * Prime1;
+    Value = RotateLeft(Value, 27) * Prime1 + Prime4;
+  }
+
+public:
+  /**
+   * \brief Add bytes to hash function
+   * \param[in] Data Pointer to bytes
+   * \param[in] Size Number of bytes
+   */
+  VOID Add( const VOID *Data, const UINT64 Size )
+  {
+    const BYTE *Bytes = reinterpret_cast<const BYTE *>(Data);
+    UINT64 i = 0;
+
+    for (; i + 8 <= Size; i += 8)
+    {
+      UINT64 Word;
+
+      memcpy(&Word, Bytes + i, 8);
+      AddWord(Word);
+    }
+    for (; i < Size; i++)
+    {
+      Value ^= Bytes[i] * Prime5;
+      Value = RotateLeft(Value, 11) * Prime1;
+    }
+    AddWord(Size);
+  }
+
+  /**
+   * \brief Add trivially copyable value to hash function
+   * \param[in] Data Value
+   */
+  template <class type>
+    VOID Add( const type &Data )
+    {
+      static_assert(std::is_trivially_copyable<type>::value);
+      Add(&Data, sizeof(type));
+    }
+
+  /**
+   * \brief Add string to hash function
+   * \param[in] Str String
+   */
+  VOID Add( const std::string &Str )
+  {
+    Add(Str.data(), Str.size());
+  }
+
+  /**
+   * \brief Get hash value function
+   * \return Hash value (state after avalanche)
+   */
+  UINT64 Get( VOID ) const
+  {
+    UINT64 H = Value;
+
+    H ^= H >> 33;
+    H *= Prime2;
+    H ^= H >> 29;
+    H *= Prime3;
+    H ^= H >> 32;
+    return H;
+  }
+};
+
+#endif /* __hasher_h_ */
@@ -1,4 +1,7 @@
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "ext/stb/stb_image.h"
@@ -13,8 +16,12 @@
 #include "def.h"
 #include "image.h"
 #include "error.h"
+#include "utils/image_kernels.h"
 #include "utils/parallel_for.h"
 
+/* Rows are processed by kernels as arrays of components */
+static_assert(sizeof(image_vec) == 3 * sizeof(DBL), "image_vec must consist of 3 components");
+
 /**
  * \brief Clear image function
  */
@@ -69,6 +76,26 @@ VOID image::SetPixel( const INT X, const INT Y, const image_vec &Color )
   Buffer[X + (UINT64)Y * W] = Color;
 }
 
+/**
+ * \brief Get row components function
+ * \param[in] Y Row index
+ * \return R, G, B components of row pixels one after another
+ */
+DBL * image::GetRow( const INT Y )
+{
+  return &Buffer[(UINT64)Y * W].R;
+}
+
+/**
+ * \brief Get row components function
+ * \param[in] Y Row index
+ * \return R, G, B components of row pixels one after another
+ */
+const DBL * image::GetRow( const INT Y ) const
+{
+  return &Buffer[(UINT64)Y * W].R;
+}
+
 /**
  * \brief Resize image function
  * \param[in] NewW New image width
@@ -110,17 +137,7 @@ VOID image::operator+=( const image & Img )
   //for (INT y = 0; y < H; y++)
   parallel_for::Run(Img.FrameH, [&]( INT y )
   {
-    for (INT x = 0; x < W; x++)
-    {
-      const image_vec OldPixel = GetPixel(x, y);
-      const image_vec NewPixel = Img.GetPixel(x, y);
-  
-      const DBL R = OldPixel.R + NewPixel.R;
-      const DBL G = OldPixel.G + NewPixel.G;
-      const DBL B = OldPixel.B + NewPixel.B;
-  
-      SetPixel(x, y, image_vec(R, G, B));
-    }
+    image_kernels::Add(GetRow(y), Img.GetRow(y), W * 3);
   });
 }
 
@@ -134,19 +151,71 @@ VOID image::operator/=(const DBL N)
   //for (INT y = 0; y < H; y++)
   parallel_for::Run(H, [&]( INT y )
   {
-    for (INT x = 0; x < W; x++)
-    {
-      const image_vec OldPixel = GetPixel(x, y);
-  
-      const DBL R = OldPixel.R / N;
-      const DBL G = OldPixel.G / N;
-      const DBL B = OldPixel.B / N;
-  
-      SetPixel(x, y, image_vec(R, G, B));
-    }
+    image_kernels::Divide(GetRow(y), GetRow(y), W * 3, N, 1);
   });
 }
 
+/**
+ * \brief Set image to other image divided by number function (image is resized in one pass with division)
+ * \param[in] Img Source image
+ * \param[in] N Number
+ */
+VOID image::SetDivided( const image &Img, const DBL N )
+{
+  Resize(Img.FrameW, Img.FrameH);
+
+  parallel_for::Run(H, [&]( INT y )
+  {
+    image_kernels::Divide(Img.GetRow(y), GetRow(y), W * 3, N, 1);
+  });
+}
+
+/**
+ * \brief Quantize image to 8 bits per component function
+ * \param[out] Data Colors of pixels (0xAABBGGRR)
+ */
+VOID image::Quantize( std::vector<DWORD> *Data ) const
+{
+  Data->resize((UINT64)W * H);
+
+  parallel_for::Run(H, [&]( INT y )
+  {
+    image_kernels::Quantize(GetRow(y), Data->data() + (UINT64)y * W, W);
+  });
+}
+
+/**
+ * \brief Save 8 bits per component colors function (png, jpg or tga format)
+ * \param[in] FileName Name of file
+ * \param[in] Format File format
+ * \param[in] Data Colors of pixels (0xAABBGGRR)
+ * \param[in] Width Image width
+ * \param[in] Height Image height
+ */
+VOID image::SaveQuantized( const std::string &FileName, FORMAT Format, const DWORD *Data, const INT Width,
+                           const INT Height )
+{
+  INT IsWritten = 0;
+
+  switch (Format)
+  {
+  case FORMAT::JPG:
+    IsWritten = stbi_write_jpg(FileName.c_str(), Width, Height, 4, (const VOID *)Data, 100);
+    break;
+  case FORMAT::PNG:
+    IsWritten = stbi_write_png(FileName.c_str(), Width, Height, 4, (const VOID *)Data, 0);
+    break;
+  case FORMAT::TGA:
+    IsWritten = stbi_write_tga(FileName.c_str(), Width, Height, 4, (const VOID *)Data);
+    break;
+  default:
+    error("8-bit colors can't be saved in linear format");
+  }
+
+  if (!IsWritten)
+    error("File " + FileName + " can't be written");
+}
+
 /**
  * \brief Save image function (tga format)
  * \param[in] FileName Name of file
@@ -154,12 +223,9 @@ VOID image::operator/=(const DBL N)
 VOID image::SaveTGA( const std::string &FileName ) const
 {
   std::vector<DWORD> Data;
-  
-  Data.reserve(W * H);
-  for (std::vector<image_vec>::const_iterator It = Buffer.cbegin(); It != Buffer.cend(); It++)
-    Data.push_back(It->ToDWORD());
-  
-  stbi_write_tga(FileName.c_str(), W, H, 4, (VOID *)Data.data());
+
+  Quantize(&Data);
+  SaveQuantized(FileName, FORMAT::TGA, Data.data(), W, H);
 }
 
 /**
@@ -169,12 +235,9 @@ VOID image::SaveTGA( const std::string &FileName ) const
 VOID image::SavePNG( const std::string &FileName ) const
 {
   std::vector<DWORD> Data;
-  
-  Data.reserve(W * H);
-  for (std::vector<image_vec>::const_iterator It = Buffer.cbegin(); It != Buffer.cend(); It++)
-    Data.push_back(It->ToDWORD());
-  
-  stbi_write_png(FileName.c_str(), W, H, 4, (VOID *)Data.data(), 0);
+
+  Quantize(&Data);
+  SaveQuantized(FileName, FORMAT::PNG, Data.data(), W, H);
 }
 
 /**
@@ -184,12 +247,235 @@ VOID image::SavePNG( const std::string &FileName ) const
 VOID image::SaveJPEG( const std::string &FileName ) const
 {
   std::vector<DWORD> Data;
-  
-  Data.reserve(W * H);
-  for (std::vector<image_vec>::const_iterator It = Buffer.cbegin(); It != Buffer.cend(); It++)
-    Data.push_back(It->ToDWORD());
-  
-  stbi_write_jpg(FileName.c_str(), W, H, 4, (VOID *)Data.data(), 100);
+
+  Quantize(&Data);
+  SaveQuantized(FileName, FORMAT::JPG, Data.data(), W, H);
+}
+
+/**
+ * \brief Save image function (pfm format, rows are written one by one)
+ * \param[in] FileName Name of file
+ */
+VOID image::SavePFM( const std::string &FileName ) const
+{
+  std::ofstream File(FileName, std::ios::binary);
+
+  if (!File.is_open())
+    error("File " + FileName + " can't be opened");
+
+  std::vector<FLT> Row((UINT64)W * 3);
+
+  // Negative scale marks little endian floats, rows are stored from bottom to top
+  File << "PF\n" << W << " " << H << "\n-1.0\n";
+  for (INT y = H - 1; y >= 0; y--)
+  {
+    const DBL *Src = GetRow(y);
+
+    std::copy(Src, Src + Row.size(), Row.begin());
+    File.write(reinterpret_cast<const CHAR *>(Row.data()), Row.size() * sizeof(FLT));
+  }
+}
+
+/**
+ * \brief Convert pixels to shared exponent format function (Radiance RGBE)
+ * \param[in] Src Source pixels
+ * \param[out] Dst Destination pixels (4 bytes per pixel)
+ * \param[in] NumberOfPixels Number of pixels
+ */
+VOID image::ToRGBE( const DBL *Src, BYTE *Dst, const INT NumberOfPixels )
+{
+  for (INT i = 0; i < NumberOfPixels; i++, Src += 3, Dst += 4)
+  {
+    // Negative and NaN components are written as zeros
+    const DBL
+      R = std::max(0.0, Src[0]),
+      G = std::max(0.0, Src[1]),
+      B = std::max(0.0, Src[2]),
+      Max = std::min(std::max(std::max(R, G), B), 1e38);
+
+    if (Max < 1e-32)
+    {
+      Dst[0] = Dst[1] = Dst[2] = Dst[3] = 0;
+      continue;
+    }
+
+    INT Exponent;
+    const DBL Scale = std::frexp(Max, &Exponent) * 256 / Max;
+
+    Dst[0] = static_cast<BYTE>(std::min(R, Max) * Scale);
+    Dst[1] = static_cast<BYTE>(std::min(G, Max) * Scale);
+    Dst[2] = static_cast<BYTE>(std::min(B, Max) * Scale);
+    Dst[3] = static_cast<BYTE>(Exponent + 128);
+  }
+}
+
+/**
+ * \brief Run length encode component of RGBE pixels function (Radiance adaptive run length encoding)
+ * \param[in] Src First component of pixels (components of one pixel are 4 bytes apart)
+ * \param[in] NumberOfPixels Number of pixels
+ * \param[in, out] Dst Encoded data (it is appended)
+ */
+VOID image::EncodeRunLength( const BYTE *Src, const INT NumberOfPixels, std::vector<BYTE> *Dst )
+{
+  // Shorter runs are cheaper as parts of literal sequences
+  const INT MinRunLength = 4, MaxRunLength = 127, MaxLiteralLength = 128;
+  INT x = 0;
+
+  while (x < NumberOfPixels)
+  {
+    INT RunStart = x, RunLength = 0;
+
+    for (; RunStart < NumberOfPixels; RunStart += RunLength)
+    {
+      RunLength = 1;
+      while (RunStart + RunLength < NumberOfPixels && RunLength < MaxRunLength &&
+             Src[(RunStart + RunLength) * 4] == Src[RunStart * 4])
+        RunLength++;
+      if (RunLength >= MinRunLength)
+        break;
+    }
+
+    while (x < RunStart)
+    {
+      const INT Count = std::min(MaxLiteralLength, RunStart - x);
+
+      Dst->push_back(static_cast<BYTE>(Count));
+      for (INT i = 0; i < Count; i++)
+        Dst->push_back(Src[(x + i) * 4]);
+      x += Count;
+    }
+
+    if (RunStart < NumberOfPixels)
+    {
+      Dst->push_back(static_cast<BYTE>(128 + RunLength));
+      Dst->push_back(Src[RunStart * 4]);
+      x = RunStart + RunLength;
+    }
+  }
+}
+
+/**
+ * \brief Save image function (Radiance hdr format, rows are written one by one)
+ * \param[in] FileName Name of file
+ */
+VOID image::SaveHDR( const std::string &FileName ) const
+{
+  std::ofstream File(FileName, std::ios::binary);
+
+  if (!File.is_open())
+    error("File " + FileName + " can't be opened");
+
+  std::vector<BYTE> Pixels((UINT64)W * 4), Encoded;
+
+  File << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << H << " +X " << W << "\n";
+  for (INT y = 0; y < H; y++)
+  {
+    ToRGBE(GetRow(y), Pixels.data(), W);
+
+    // Run length encoding of separate components is defined only for widths from 8 to 32767
+    if (W < 8 || W > 32767)
+    {
+      File.write(reinterpret_cast<const CHAR *>(Pixels.data()), Pixels.size());
+      continue;
+    }
+
+    Encoded.assign({2, 2, static_cast<BYTE>(W >> 8), static_cast<BYTE>(W & 0xFF)});
+    for (INT i = 0; i < 4; i++)
+      EncodeRunLength(Pixels.data() + i, W, &Encoded);
+    File.write(reinterpret_cast<const CHAR *>(Encoded.data()), Encoded.size());
+  }
+}
+
+/**
+ * \brief Save image function (exr format, rows are written one by one)
+ * \param[in] FileName Name of file
+ */
+VOID image::SaveEXR( const std::string &FileName ) const
+{
+  std::ofstream File(FileName, std::ios::binary);
+
+  if (!File.is_open())
+    error("File " + FileName + " can't be opened");
+
+  std::string Header;
+
+  // Values are little endian as on host, attribute is name, type, size and value
+  auto AddAttribute = [&Header]( const std::string &Name, const std::string &Type, const VOID *Value, const INT Size )
+    {
+      Header.append(Name.c_str(), Name.size() + 1);
+      Header.append(Type.c_str(), Type.size() + 1);
+      Header.append(reinterpret_cast<const CHAR *>(&Size), sizeof(Size));
+      Header.append(static_cast<const CHAR *>(Value), Size);
+    };
+
+  // Channels are sorted by name, every one is 32-bit float without subsampling
+  std::string Channels;
+
+  for (const CHAR *Name : {"B", "G", "R"})
+  {
+    const INT Channel[4] = {2, 0, 1, 1};
+
+    Channels.append(Name, 2);
+    Channels.append(reinterpret_cast<const CHAR *>(Channel), sizeof(Channel));
+  }
+  Channels.push_back(0);
+
+  const INT Window[4] = {0, 0, W - 1, H - 1};
+  const BYTE NoCompression = 0, IncreasingY = 0;
+  const FLT PixelAspectRatio = 1, ScreenWindowCenter[2] = {0, 0}, ScreenWindowWidth = 1;
+
+  AddAttribute("channels", "chlist", Channels.data(), static_cast<INT>(Channels.size()));
+  AddAttribute("compression", "compression", &NoCompression, sizeof(NoCompression));
+  AddAttribute("dataWindow", "box2i", Window, sizeof(Window));
+  AddAttribute("displayWindow", "box2i", Window, sizeof(Window));
+  AddAttribute("lineOrder", "lineOrder", &IncreasingY, sizeof(IncreasingY));
+  AddAttribute("pixelAspectRatio", "float", &PixelAspectRatio, sizeof(PixelAspectRatio));
+  AddAttribute("screenWindowCenter", "v2f", ScreenWindowCenter, sizeof(ScreenWindowCenter));
+  AddAttribute("screenWindowWidth", "float", &ScreenWindowWidth, sizeof(ScreenWindowWidth));
+  Header.push_back(0);
+
+  // Magic number and version 2 of single part scan line file
+  const INT Start[2] = {20000630, 2};
+
+  File.write(reinterpret_cast<const CHAR *>(Start), sizeof(Start));
+  File.write(Header.data(), Header.size());
+
+  // Uncompressed chunks have same size, so offsets table is known before rows
+  const INT RowSize = W * 3 * sizeof(FLT);
+  const UINT64 FirstChunkOffset = sizeof(Start) + Header.size() + (UINT64)H * sizeof(UINT64);
+
+  for (INT y = 0; y < H; y++)
+  {
+    const UINT64 Offset = FirstChunkOffset + (UINT64)y * (2 * sizeof(INT) + RowSize);
+
+    File.write(reinterpret_cast<const CHAR *>(&Offset), sizeof(Offset));
+  }
+
+  std::vector<FLT> Row((UINT64)W * 3);
+
+  for (INT y = 0; y < H; y++)
+  {
+    const DBL *Src = GetRow(y);
+    const INT ChunkHeader[2] = {y, RowSize};
+
+    // Channels of row are stored one after another
+    for (INT x = 0; x < W; x++)
+      for (INT i = 0; i < 3; i++)
+        Row[(UINT64)(2 - i) * W + x] = static_cast<FLT>(Src[x * 3 + i]);
+
+    File.write(reinterpret_cast<const CHAR *>(ChunkHeader), sizeof(ChunkHeader));
+    File.write(reinterpret_cast<const CHAR *>(Row.data()), Row.size() * sizeof(FLT));
+  }
+}
+
+/**
+ * \brief Check if image format keeps linear values function (HDR correction is not applied for such formats)
+ * \param[in] Format File format
+ * \return TRUE-if format keeps linear values, FALSE-otherwise
+ */
+BOOL image::IsLinearFormat( FORMAT Format )
+{
+  return Format == FORMAT::PFM || Format == FORMAT::HDR || Format == FORMAT::EXR;
 }
 
 /**
@@ -210,5 +496,14 @@ VOID image::Save( const std::string &FileName, FORMAT Format ) const
   case FORMAT::TGA:
     SaveTGA(FileName);
     break;
+  case FORMAT::PFM:
+    SavePFM(FileName);
+    break;
+  case FORMAT::HDR:
+    SaveHDR(FileName);
+    break;
+  case FORMAT::EXR:
+    SaveEXR(FileName);
+    break;
   }
 }
@@ -21,6 +21,22 @@ private:
   /** Image height */
   INT H = 0;
 
+  /**
+   * \brief Convert pixels to shared exponent format function (Radiance RGBE)
+   * \param[in] Src Source pixels
+   * \param[out] Dst Destination pixels (4 bytes per pixel)
+   * \param[in] NumberOfPixels Number of pixels
+   */
+  static VOID ToRGBE( const DBL *Src, BYTE *Dst, const INT NumberOfPixels );
+
+  /**
+   * \brief Run length encode component of RGBE pixels function (Radiance adaptive run length encoding)
+   * \param[in] Src First component of pixels (components of one pixel are 4 bytes apart)
+   * \param[in] NumberOfPixels Number of pixels
+   * \param[in, out] Dst Encoded data (it is appended)
+   */
+  static VOID EncodeRunLength( const BYTE *Src, const INT NumberOfPixels, std::vector<BYTE> *Dst );
+
 public:
   /** Reference to image width */
   const INT &FrameW = W;
@@ -40,9 +56,25 @@ public:
     JPG,
 
     /** TGA image format */
-    TGA
+    TGA,
+
+    /** Portable float map format (linear 32-bit float components) */
+    PFM,
+
+    /** Radiance HDR format (linear components with shared exponent) */
+    HDR,
+
+    /** OpenEXR format (linear 32-bit float components without compression) */
+    EXR
   };
 
+  /**
+   * \brief Check if image format keeps linear values function (HDR correction is not applied for such formats)
+   * \param[in] Format File format
+   * \return TRUE-if format keeps linear values, FALSE-otherwise
+   */
+  static BOOL IsLinearFormat( FORMAT Format );
+
   /**
    * \brief Image constructor
    */
@@ -77,6 +109,20 @@ public:
    */
   VOID SetPixel( const INT X, const INT Y, const image_vec &Color );
   
+  /**
+   * \brief Get row components function
+   * \param[in] Y Row index
+   * \return R, G, B components of row pixels one after another
+   */
+  DBL * GetRow( const INT Y );
+
+  /**
+   * \brief Get row components function
+   * \param[in] Y Row index
+   * \return R, G, B components of row pixels one after another
+   */
+  const DBL * GetRow( const INT Y ) const;
+
   /**
    * \brief Resize image function
    * \param[in] NewW New image width
@@ -98,6 +144,30 @@ public:
    */
   VOID operator/=( const DBL N );
 
+  /**
+   * \brief Set image to other image divided by number function (image is resized in one pass with division)
+   * \param[in] Img Source image
+   * \param[in] N Number
+   */
+  VOID SetDivided( const image &Img, const DBL N );
+
+  /**
+   * \brief Quantize image to 8 bits per component function
+   * \param[out] Data Colors of pixels (0xAABBGGRR)
+   */
+  VOID Quantize( std::vector<DWORD> *Data ) const;
+
+  /**
+   * \brief Save 8 bits per component colors function (png, jpg or tga format)
+   * \param[in] FileName Name of file
+   * \param[in] Format File format
+   * \param[in] Data Colors of pixels (0xAABBGGRR)
+   * \param[in] Width Image width
+   * \param[in] Height Image height
+   */
+  static VOID SaveQuantized( const std::string &FileName, FORMAT Format, const DWORD *Data, const INT Width,
+                             const INT Height );
+
   /**
    * \brief Save image function (tga format)
    * \param[in] FileName Name of file
@@ -116,6 +186,24 @@ public:
    */
   VOID SaveJPEG( const std::string &FileName ) const;
 
+  /**
+   * \brief Save image function (pfm format, rows are written one by one)
+   * \param[in] FileName Name of file
+   */
+  VOID SavePFM( const std::string &FileName ) const;
+
+  /**
+   * \brief Save image function (Radiance hdr format, rows are written one by one)
+   * \param[in] FileName Name of file
+   */
+  VOID SaveHDR( const std::string &FileName ) const;
+
+  /**
+   * \brief Save image function (exr format, rows are written one by one)
+   * \param[in] FileName Name of file
+   */
+  VOID SaveEXR( const std::string &FileName ) const;
+
   /**
    * \brief Save image function
    * \param[in] FileName Name of file
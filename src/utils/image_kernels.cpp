@@ -0,0 +1,390 @@
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_KERNELS_USE_SSE2
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#include "image_kernels.h"
+#include "image_kernels_impl.h"
+
+/**
+ * \brief Scalar pack of components
+ */
+class scalar_pack
+{
+public:
+  /** Register type */
+  using reg = DBL;
+
+  /** Number of components in pack */
+  static constexpr INT Width = 1;
+
+  /* Component-wise operations */
+  static reg Load( const DBL *Src ) { return *Src; }
+  static VOID Store( DBL *Dst, const reg V ) { *Dst = V; }
+  static reg Set1( const DBL V ) { return V; }
+  static reg Add( const reg A, const reg B ) { return A + B; }
+  static reg Sub( const reg A, const reg B ) { return A - B; }
+  static reg Mul( const reg A, const reg B ) { return A * B; }
+  static reg Div( const reg A, const reg B ) { return A / B; }
+  static reg Min( const reg A, const reg B ) { return A < B ? A : B; }
+  static reg Max( const reg A, const reg B ) { return A > B ? A : B; }
+
+  /**
+   * \brief Get power of 2 function
+   * \param[in] T Integer exponent plus 2^52 + 2^51
+   * \return 2^exponent
+   */
+  static reg Pow2( const reg T )
+  {
+    UINT64 Bits;
+
+    std::memcpy(&Bits, &T, sizeof(Bits));
+    Bits = (Bits + 1023) << 52;
+    reg Res;
+    std::memcpy(&Res, &Bits, sizeof(Res));
+    return Res;
+  }
+
+  /**
+   * \brief Zero pixel if its luminance is not greater than limit function
+   * \param[in] Src Source pixel
+   * \param[out] Dst Destination pixel
+   * \param[in] Limit Luminance limit
+   */
+  static VOID Threshold( const DBL *Src, DBL *Dst, const DBL Limit )
+  {
+    const BOOL IsBright = Src[0] * 0.3 + Src[1] * 0.59 + Src[2] * 0.11 > Limit;
+
+    for (INT i = 0; i < 3; i++)
+      Dst[i] = IsBright ? Src[i] : 0;
+  }
+
+  /**
+   * \brief Quantize 4 pixels function
+   * \param[in] Src Source pixels
+   * \param[out] Dst Destination colors
+   */
+  static VOID Quantize( const DBL *Src, DWORD *Dst )
+  {
+    for (INT i = 0; i < 4; i++, Src += 3)
+    {
+      const DWORD
+        CorrectedR = fminf(fmaxf(Src[0] * 255.0, 0.0), 255.0),
+        CorrectedG = fminf(fmaxf(Src[1] * 255.0, 0.0), 255.0),
+        CorrectedB = fminf(fmaxf(Src[2] * 255.0, 0.0), 255.0);
+
+      Dst[i] = 0xFF000000 | (CorrectedB << 16) | (CorrectedG << 8) | CorrectedR;
+    }
+  }
+};
+
+#ifdef IMAGE_KERNELS_USE_SSE2
+/**
+ * \brief SSE2 pack of components
+ */
+class sse2_pack
+{
+public:
+  /** Register type */
+  using reg = __m128d;
+
+  /** Number of components in pack */
+  static constexpr INT Width = 2;
+
+  /* Component-wise operations */
+  static reg Load( const DBL *Src ) { return _mm_loadu_pd(Src); }
+  static VOID Store( DBL *Dst, const reg V ) { _mm_storeu_pd(Dst, V); }
+  static reg Set1( const DBL V ) { return _mm_set1_pd(V); }
+  static reg Add( const reg A, const reg B ) { return _mm_add_pd(A, B); }
+  static reg Sub( const reg A, const reg B ) { return _mm_sub_pd(A, B); }
+  static reg Mul( const reg A, const reg B ) { return _mm_mul_pd(A, B); }
+  static reg Div( const reg A, const reg B ) { return _mm_div_pd(A, B); }
+  static reg Min( const reg A, const reg B ) { return _mm_min_pd(A, B); }
+  static reg Max( const reg A, const reg B ) { return _mm_max_pd(A, B); }
+
+  /**
+   * \brief Get power of 2 function
+   * \param[in] T Integer exponent plus 2^52 + 2^51
+   * \return 2^exponent
+   */
+  static reg Pow2( const reg T )
+  {
+    return _mm_castsi128_pd(_mm_slli_epi64(_mm_add_epi64(_mm_castpd_si128(T), _mm_set1_epi64x(1023)), 52));
+  }
+
+  /**
+   * \brief Zero pixels with luminance not greater than limit function
+   * \param[in] Src 2 source pixels
+   * \param[out] Dst 2 destination pixels
+   * \param[in] Limit Luminance limit
+   */
+  static VOID Threshold( const DBL *Src, DBL *Dst, const DBL Limit )
+  {
+    // Components are R0 G0 | B0 R1 | G1 B1
+    const __m128d A = _mm_loadu_pd(Src), B = _mm_loadu_pd(Src + 2), C = _mm_loadu_pd(Src + 4);
+    const __m128d
+      R = _mm_shuffle_pd(A, B, 2),
+      G = _mm_shuffle_pd(A, C, 1),
+      Bl = _mm_shuffle_pd(B, C, 2);
+    const __m128d Luminance =
+      _mm_add_pd(_mm_add_pd(_mm_mul_pd(R, _mm_set1_pd(0.3)), _mm_mul_pd(G, _mm_set1_pd(0.59))),
+                 _mm_mul_pd(Bl, _mm_set1_pd(0.11)));
+    const __m128d Mask = _mm_cmpgt_pd(Luminance, _mm_set1_pd(Limit));
+
+    _mm_storeu_pd(Dst, _mm_and_pd(A, _mm_shuffle_pd(Mask, Mask, 0)));
+    _mm_storeu_pd(Dst + 2, _mm_and_pd(B, Mask));
+    _mm_storeu_pd(Dst + 4, _mm_and_pd(C, _mm_shuffle_pd(Mask, Mask, 3)));
+  }
+
+  /**
+   * \brief Quantize 4 pixels function
+   * \param[in] Src Source pixels
+   * \param[out] Dst Destination colors
+   */
+  static VOID Quantize( const DBL *Src, DWORD *Dst )
+  {
+    const __m128d Scale = _mm_set1_pd(255.0);
+    const __m128 Zero = _mm_setzero_ps(), Max = _mm_set1_ps(255.0f);
+    __m128i Components[3];
+
+    // Doubles are rounded to floats before clamping, same as fminf/fmaxf do
+    for (INT i = 0; i < 3; i++)
+    {
+      const __m128 F = _mm_movelh_ps(_mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(Src + i * 4), Scale)),
+                                     _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(Src + i * 4 + 2), Scale)));
+
+      Components[i] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(F, Zero), Max));
+    }
+
+    alignas(16) BYTE Bytes[16];
+
+    _mm_store_si128(reinterpret_cast<__m128i *>(Bytes),
+      _mm_packus_epi16(_mm_packs_epi32(Components[0], Components[1]), _mm_packs_epi32(Components[2], Components[2])));
+    for (INT i = 0; i < 4; i++)
+      Dst[i] = 0xFF000000 | (Bytes[i * 3 + 2] << 16) | (Bytes[i * 3 + 1] << 8) | Bytes[i * 3];
+  }
+};
+#endif /* IMAGE_KERNELS_USE_SSE2 */
+
+/**
+ * \brief Get selected kernels function
+ * \return Reference to kernels pointer
+ */
+const image_kernels::KERNELS *& image_kernels::GetSelectedKernels( VOID )
+{
+  static const KERNELS *Kernels = GetKernels(GetWidestISA());
+
+  return Kernels;
+}
+
+/**
+ * \brief Get kernels of instruction set function
+ * \param[in] Set Instruction set
+ * \return Kernels (nullptr if instruction set is not compiled in)
+ */
+const image_kernels::KERNELS * image_kernels::GetKernels( const ISA Set )
+{
+  switch (Set)
+  {
+  case ISA::AVX2:
+    return GetAVX2Kernels();
+  case ISA::SSE2:
+    return GetSSE2Kernels();
+  case ISA::SCALAR:
+  default:
+    return GetScalarKernels();
+  }
+}
+
+/**
+ * \brief Get scalar kernels function
+ * \return Kernels
+ */
+const image_kernels::KERNELS * image_kernels::GetScalarKernels( VOID )
+{
+  using impl = image_kernels_impl<scalar_pack>;
+  static const KERNELS Kernels =
+    {impl::Threshold, impl::BlurRow, impl::BlurColumn, impl::ToneMap, impl::Add, impl::Divide, impl::Quantize};
+
+  return &Kernels;
+}
+
+/**
+ * \brief Get SSE2 kernels function
+ * \return Kernels (nullptr if SSE2 is not compiled in)
+ */
+const image_kernels::KERNELS * image_kernels::GetSSE2Kernels( VOID )
+{
+#ifdef IMAGE_KERNELS_USE_SSE2
+  using impl = image_kernels_impl<sse2_pack>;
+  static const KERNELS Kernels =
+    {impl::Threshold, impl::BlurRow, impl::BlurColumn, impl::ToneMap, impl::Add, impl::Divide, impl::Quantize};
+
+  return &Kernels;
+#else /* IMAGE_KERNELS_USE_SSE2 */
+  return nullptr;
+#endif /* IMAGE_KERNELS_USE_SSE2 */
+}
+
+/**
+ * \brief Check if CPU supports instruction set function
+ * \param[in] Set Instruction set
+ * \return TRUE-if instructions may be executed, FALSE-otherwise
+ */
+BOOL image_kernels::IsSupportedByCPU( const ISA Set )
+{
+  switch (Set)
+  {
+  case ISA::AVX2:
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    {
+      INT Info[4];
+
+      // OS must save YMM registers (OSXSAVE and XCR0 bits)
+      __cpuid(Info, 1);
+      if ((Info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+        return FALSE;
+      __cpuidex(Info, 7, 0);
+      return (Info[1] & (1 << 5)) != 0;
+    }
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2");
+#else
+    return FALSE;
+#endif
+  case ISA::SSE2:
+#ifdef IMAGE_KERNELS_USE_SSE2
+    return TRUE;
+#else /* IMAGE_KERNELS_USE_SSE2 */
+    return FALSE;
+#endif /* IMAGE_KERNELS_USE_SSE2 */
+  case ISA::SCALAR:
+  default:
+    return TRUE;
+  }
+}
+
+/**
+ * \brief Check if instruction set may be used function
+ * \param[in] Set Instruction set
+ * \return TRUE-if instruction set is supported both by CPU and build, FALSE-otherwise
+ */
+BOOL image_kernels::IsAvailable( const ISA Set )
+{
+  // Kernels getter is compiled for its instruction set, so it is called only on CPU supporting it
+  return IsSupportedByCPU(Set) && GetKernels(Set) != nullptr;
+}
+
+/**
+ * \brief Get widest available instruction set function
+ * \return Instruction set supported both by CPU and build
+ */
+image_kernels::ISA image_kernels::GetWidestISA( VOID )
+{
+  for (ISA Set : {ISA::AVX2, ISA::SSE2})
+    if (IsAvailable(Set))
+      return Set;
+
+  return ISA::SCALAR;
+}
+
+/**
+ * \brief Select instruction set function (for tests and benchmarks, widest one is used by default)
+ * \param[in] Set Instruction set (unavailable one is replaced by widest available)
+ */
+VOID image_kernels::SetISA( const ISA Set )
+{
+  GetSelectedKernels() = GetKernels(IsAvailable(Set) ? Set : GetWidestISA());
+}
+
+/**
+ * \brief Zero pixels with luminance not greater than limit function
+ * \param[in] Src Source pixels
+ * \param[out] Dst Destination pixels (may be source)
+ * \param[in] NumberOfPixels Number of pixels
+ * \param[in] Limit Luminance limit
+ */
+VOID image_kernels::Threshold( const DBL *Src, DBL *Dst, const INT NumberOfPixels, const DBL Limit )
+{
+  GetSelectedKernels()->Threshold(Src, Dst, NumberOfPixels, Limit);
+}
+
+/**
+ * \brief Blur row with 9 taps function (pixels out of row are clamped to its ends)
+ * \param[in] Src Source row
+ * \param[out] Dst Destination row (not source)
+ * \param[in] NumberOfPixels Number of pixels in row
+ * \param[in] Coefs 5 blur coefficients of distances from 0 to 4
+ */
+VOID image_kernels::BlurRow( const DBL *Src, DBL *Dst, const INT NumberOfPixels, const DBL *Coefs )
+{
+  GetSelectedKernels()->BlurRow(Src, Dst, NumberOfPixels, Coefs);
+}
+
+/**
+ * \brief Blur column with 9 taps function (rows are blurred at once)
+ * \param[in] Rows 9 source rows from 4 above destination to 4 below it
+ * \param[out] Dst Destination row (not one of sources)
+ * \param[in] NumberOfComponents Number of components in row
+ * \param[in] Coefs 5 blur coefficients of distances from 0 to 4
+ */
+VOID image_kernels::BlurColumn( const DBL * const *Rows, DBL *Dst, const INT NumberOfComponents, const DBL *Coefs )
+{
+  GetSelectedKernels()->BlurColumn(Rows, Dst, NumberOfComponents, Coefs);
+}
+
+/**
+ * \brief Tone mapping function (1 - exp(-X * Exposure) with fast exponent approximation)
+ * \param[in] Src Source components
+ * \param[out] Dst Destination components (may be source)
+ * \param[in] NumberOfComponents Number of components
+ * \param[in] Exposure Exposure
+ */
+VOID image_kernels::ToneMap( const DBL *Src, DBL *Dst, const INT NumberOfComponents, const DBL Exposure )
+{
+  GetSelectedKernels()->ToneMap(Src, Dst, NumberOfComponents, Exposure);
+}
+
+/**
+ * \brief Add components function
+ * \param[in, out] Dst Destination components
+ * \param[in] Src Added components
+ * \param[in] NumberOfComponents Number of components
+ */
+VOID image_kernels::Add( DBL *Dst, const DBL *Src, const INT NumberOfComponents )
+{
+  GetSelectedKernels()->Add(Dst, Src, NumberOfComponents);
+}
+
+/**
+ * \brief Divide components function (Src / Divisor * Multiplier)
+ * \param[in] Src Source components
+ * \param[out] Dst Destination components (may be source)
+ * \param[in] NumberOfComponents Number of components
+ * \param[in] Divisor Divisor
+ * \param[in] Multiplier Multiplier of quotient
+ */
+VOID image_kernels::Divide( const DBL *Src, DBL *Dst, const INT NumberOfComponents, const DBL Divisor,
+                            const DBL Multiplier )
+{
+  GetSelectedKernels()->Divide(Src, Dst, NumberOfComponents, Divisor, Multiplier);
+}
+
+/**
+ * \brief Quantize pixels to 8 bits per component function (same as image_vec::ToDWORD)
+ * \param[in] Src Source pixels
+ * \param[out] Dst Destination colors (0xAABBGGRR)
+ * \param[in] NumberOfPixels Number of pixels
+ */
+VOID image_kernels::Quantize( const DBL *Src, DWORD *Dst, const INT NumberOfPixels )
+{
+  GetSelectedKernels()->Quantize(Src, Dst, NumberOfPixels);
+}
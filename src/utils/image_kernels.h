@@ -0,0 +1,178 @@
+#ifndef __image_kernels_h_
+#define __image_kernels_h_
+
+#include "def.h"
+
+/**
+ * \brief Vectorized image processing kernels (pixels are R, G, B components one after another,
+ *        widest instruction set supported by CPU is selected at first use)
+ */
+class image_kernels
+{
+public:
+  /**
+   * \brief Instruction set enumeration
+   */
+  enum class ISA
+  {
+    /** Scalar code */
+    SCALAR,
+
+    /** SSE2 (2 components at once) */
+    SSE2,
+
+    /** AVX2 (4 components at once) */
+    AVX2
+  };
+
+private:
+  /**
+   * \brief Kernels of instruction set
+   */
+  struct KERNELS
+  {
+    /** Bright pass kernel */
+    VOID (*Threshold)( const DBL *Src, DBL *Dst, INT NumberOfPixels, DBL Limit );
+
+    /** Horizontal blur kernel */
+    VOID (*BlurRow)( const DBL *Src, DBL *Dst, INT NumberOfPixels, const DBL *Coefs );
+
+    /** Vertical blur kernel */
+    VOID (*BlurColumn)( const DBL * const *Rows, DBL *Dst, INT NumberOfComponents, const DBL *Coefs );
+
+    /** Tone mapping kernel */
+    VOID (*ToneMap)( const DBL *Src, DBL *Dst, INT NumberOfComponents, DBL Exposure );
+
+    /** Addition kernel */
+    VOID (*Add)( DBL *Dst, const DBL *Src, INT NumberOfComponents );
+
+    /** Division kernel */
+    VOID (*Divide)( const DBL *Src, DBL *Dst, INT NumberOfComponents, DBL Divisor, DBL Multiplier );
+
+    /** Quantization kernel */
+    VOID (*Quantize)( const DBL *Src, DWORD *Dst, INT NumberOfPixels );
+  };
+
+  /**
+   * \brief Get selected kernels function
+   * \return Reference to kernels pointer
+   */
+  static const KERNELS *& GetSelectedKernels( VOID );
+
+  /**
+   * \brief Get kernels of instruction set function
+   * \param[in] Set Instruction set
+   * \return Kernels (nullptr if instruction set is not compiled in)
+   */
+  static const KERNELS * GetKernels( ISA Set );
+
+  /**
+   * \brief Get scalar kernels function
+   * \return Kernels
+   */
+  static const KERNELS * GetScalarKernels( VOID );
+
+  /**
+   * \brief Get SSE2 kernels function
+   * \return Kernels (nullptr if SSE2 is not compiled in)
+   */
+  static const KERNELS * GetSSE2Kernels( VOID );
+
+  /**
+   * \brief Get AVX2 kernels function (defined in separate translation unit compiled for AVX2)
+   * \return Kernels (nullptr if AVX2 is not compiled in)
+   */
+  static const KERNELS * GetAVX2Kernels( VOID );
+
+  /**
+   * \brief Check if CPU supports instruction set function
+   * \param[in] Set Instruction set
+   * \return TRUE-if instructions may be executed, FALSE-otherwise
+   */
+  static BOOL IsSupportedByCPU( ISA Set );
+
+public:
+  /**
+   * \brief Check if instruction set may be used function
+   * \param[in] Set Instruction set
+   * \return TRUE-if instruction set is supported both by CPU and build, FALSE-otherwise
+   */
+  static BOOL IsAvailable( ISA Set );
+
+  /**
+   * \brief Get widest available instruction set function
+   * \return Instruction set supported both by CPU and build
+   */
+  static ISA GetWidestISA( VOID );
+
+  /**
+   * \brief Select instruction set function (for tests and benchmarks, widest one is used by default)
+   * \param[in] Set Instruction set (unavailable one is replaced by widest available)
+   */
+  static VOID SetISA( ISA Set );
+
+  /**
+   * \brief Zero pixels with luminance not greater than limit function
+   * \param[in] Src Source pixels
+   * \param[out] Dst Destination pixels (may be source)
+   * \param[in] NumberOfPixels Number of pixels
+   * \param[in] Limit Luminance limit
+   */
+  static VOID Threshold( const DBL *Src, DBL *Dst, const INT NumberOfPixels, const DBL Limit );
+
+  /**
+   * \brief Blur row with 9 taps function (pixels out of row are clamped to its ends)
+   * \param[in] Src Source row
+   * \param[out] Dst Destination row (not source)
+   * \param[in] NumberOfPixels Number of pixels in row
+   * \param[in] Coefs 5 blur coefficients of distances from 0 to 4
+   */
+  static VOID BlurRow( const DBL *Src, DBL *Dst, const INT NumberOfPixels, const DBL *Coefs );
+
+  /**
+   * \brief Blur column with 9 taps function (rows are blurred at once)
+   * \param[in] Rows 9 source rows from 4 above destination to 4 below it
+   * \param[out] Dst Destination row (not one of sources)
+   * \param[in] NumberOfComponents Number of components in row
+   * \param[in] Coefs 5 blur coefficients of distances from 0 to 4
+   */
+  static VOID BlurColumn( const DBL * const *Rows, DBL *Dst, const INT NumberOfComponents, const DBL *Coefs );
+
+  /**
+   * \brief Tone mapping function (1 - exp(-X * Exposure) with fast exponent approximation)
+   * \param[in] Src Source components
+   * \param[out] Dst Destination components (may be source)
+   * \param[in] NumberOfComponents Number of components
+   * \param[in] Exposure Exposure
+   */
+  static VOID ToneMap( const DBL *Src, DBL *Dst, const INT NumberOfComponents, const DBL Exposure );
+
+  /**
+   * \brief Add components function
+   * \param[in, out] Dst Destination components
+   * \param[in] Src Added components
+   * \param[in] NumberOfComponents Number of components
+   */
+  static VOID Add( DBL *Dst, const DBL *Src, const INT NumberOfComponents );
+
+  /**
+   * \brief Divide components function (Src / Divisor * Multiplier)
+   * \param[in] Src Source components
+   * \param[out] Dst Destination components (may be source)
+   * \param[in] NumberOfComponents Number of components
+   * \param[in] Divisor Divisor
+   * \param[in] Multiplier Multiplier of quotient
+   */
+  static VOID Divide( const DBL *Src, DBL *Dst, const INT NumberOfComponents, const DBL Divisor,
+                      const DBL Multiplier );
+
+  /**
+   * \brief Quantize pixels to 8 bits per component function (same as image_vec::ToDWORD)
+   * \param[in] Src Source pixels
+   * \param[out] Dst Destination colors (0xAABBGGRR)
+   * \param[in] NumberOfPixels Number of pixels
+   */
+  static VOID Quantize( const DBL *Src, DWORD *Dst, const INT NumberOfPixels );
+};
+
+#endif /* __image_kernels_h_ */
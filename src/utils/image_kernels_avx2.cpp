@@ -0,0 +1,116 @@
+/* Translation unit is compiled with AVX2 enabled, kernels are called only if CPU supports it */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "image_kernels.h"
+#include "image_kernels_impl.h"
+
+#if defined(__AVX2__)
+/**
+ * \brief AVX2 pack of components
+ */
+class avx2_pack
+{
+public:
+  /** Register type */
+  using reg = __m256d;
+
+  /** Number of components in pack */
+  static constexpr INT Width = 4;
+
+  /* Component-wise operations */
+  static reg Load( const DBL *Src ) { return _mm256_loadu_pd(Src); }
+  static VOID Store( DBL *Dst, const reg V ) { _mm256_storeu_pd(Dst, V); }
+  static reg Set1( const DBL V ) { return _mm256_set1_pd(V); }
+  static reg Add( const reg A, const reg B ) { return _mm256_add_pd(A, B); }
+  static reg Sub( const reg A, const reg B ) { return _mm256_sub_pd(A, B); }
+  static reg Mul( const reg A, const reg B ) { return _mm256_mul_pd(A, B); }
+  static reg Div( const reg A, const reg B ) { return _mm256_div_pd(A, B); }
+  static reg Min( const reg A, const reg B ) { return _mm256_min_pd(A, B); }
+  static reg Max( const reg A, const reg B ) { return _mm256_max_pd(A, B); }
+
+  /**
+   * \brief Get power of 2 function
+   * \param[in] T Integer exponent plus 2^52 + 2^51
+   * \return 2^exponent
+   */
+  static reg Pow2( const reg T )
+  {
+    return _mm256_castsi256_pd(
+      _mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(T), _mm256_set1_epi64x(1023)), 52));
+  }
+
+  /**
+   * \brief Zero pixels with luminance not greater than limit function
+   * \param[in] Src 4 source pixels
+   * \param[out] Dst 4 destination pixels
+   * \param[in] Limit Luminance limit
+   */
+  static VOID Threshold( const DBL *Src, DBL *Dst, const DBL Limit )
+  {
+    const __m256i Index = _mm256_set_epi64x(9, 6, 3, 0);
+    const __m256d
+      R = _mm256_i64gather_pd(Src, Index, 8),
+      G = _mm256_i64gather_pd(Src + 1, Index, 8),
+      B = _mm256_i64gather_pd(Src + 2, Index, 8);
+    const __m256d Luminance =
+      _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(R, _mm256_set1_pd(0.3)), _mm256_mul_pd(G, _mm256_set1_pd(0.59))),
+                    _mm256_mul_pd(B, _mm256_set1_pd(0.11)));
+    const __m256d Mask = _mm256_cmp_pd(Luminance, _mm256_set1_pd(Limit), _CMP_GT_OQ);
+
+    // Pixel masks are spread to components R0 G0 B0 R1 | G1 B1 R2 G2 | B2 R3 G3 B3
+    _mm256_storeu_pd(Dst, _mm256_and_pd(_mm256_loadu_pd(Src), _mm256_permute4x64_pd(Mask, _MM_SHUFFLE(1, 0, 0, 0))));
+    _mm256_storeu_pd(Dst + 4,
+      _mm256_and_pd(_mm256_loadu_pd(Src + 4), _mm256_permute4x64_pd(Mask, _MM_SHUFFLE(2, 2, 1, 1))));
+    _mm256_storeu_pd(Dst + 8,
+      _mm256_and_pd(_mm256_loadu_pd(Src + 8), _mm256_permute4x64_pd(Mask, _MM_SHUFFLE(3, 3, 3, 2))));
+  }
+
+  /**
+   * \brief Quantize 4 pixels function
+   * \param[in] Src Source pixels
+   * \param[out] Dst Destination colors
+   */
+  static VOID Quantize( const DBL *Src, DWORD *Dst )
+  {
+    const __m256d Scale = _mm256_set1_pd(255.0);
+    const __m128 Zero = _mm_setzero_ps(), Max = _mm_set1_ps(255.0f);
+    __m128i Components[3];
+
+    // Doubles are rounded to floats before clamping, same as fminf/fmaxf do
+    for (INT i = 0; i < 3; i++)
+    {
+      const __m128 F = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(Src + i * 4), Scale));
+
+      Components[i] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(F, Zero), Max));
+    }
+
+    // Bytes R0 G0 B0 R1 ... B3 are spread to colors with alpha
+    const __m128i Bytes =
+      _mm_packus_epi16(_mm_packs_epi32(Components[0], Components[1]), _mm_packs_epi32(Components[2], Components[2]));
+    const __m128i Colors =
+      _mm_shuffle_epi8(Bytes, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Dst),
+      _mm_or_si128(Colors, _mm_set1_epi32(static_cast<INT>(0xFF000000))));
+  }
+};
+#endif /* __AVX2__ */
+
+/**
+ * \brief Get AVX2 kernels function (defined in separate translation unit compiled for AVX2)
+ * \return Kernels (nullptr if AVX2 is not compiled in)
+ */
+const image_kernels::KERNELS * image_kernels::GetAVX2Kernels( VOID )
+{
+#if defined(__AVX2__)
+  using impl = image_kernels_impl<avx2_pack>;
+  static const KERNELS Kernels =
+    {impl::Threshold, impl::BlurRow, impl::BlurColumn, impl::ToneMap, impl::Add, impl::Divide, impl::Quantize};
+
+  return &Kernels;
+#else /* __AVX2__ */
+  return nullptr;
+#endif /* __AVX2__ */
+}
@@ -0,0 +1,271 @@
+#ifndef __image_kernels_impl_h_
+#define __image_kernels_impl_h_
+
+#include <cstring>
+
+#include "def.h"
+
+/**
+ * \brief Image processing kernels on packs of components
+ * \tparam pack Pack of components class (instruction set wrapper)
+ * \note Included only by translation units of kernels (every pack is compiled for its instruction set)
+ */
+template <class pack>
+  class image_kernels_impl
+  {
+  private:
+    /** Pack register type */
+    using reg = typename pack::reg;
+
+    /** Number of components in pack */
+    static constexpr INT Width = pack::Width;
+
+    /** Number of pixels quantized by pack at once */
+    static constexpr INT QuantizeWidth = 4;
+
+    /** Number of components out of row needed by blur at each side */
+    static constexpr INT BlurBorder = 12;
+
+    /** Number added to value to round it to integer in low mantissa bits (2^52 + 2^51) */
+    static constexpr DBL RoundMagic = 6755399441055744.0;
+
+    /** 1 / ln(2) */
+    static constexpr DBL Log2E = 1.4426950408889634;
+
+    /** High part of ln(2) (n * Ln2Hi is exact) */
+    static constexpr DBL Ln2Hi = 6.93147180369123816490e-01;
+
+    /** Low part of ln(2) */
+    static constexpr DBL Ln2Lo = 1.90821492927058770002e-10;
+
+    /** Exponent argument limit (result stays normalized) */
+    static constexpr DBL ExpLimit = 700;
+
+    /**
+     * \brief Fast exponent function (relative error is below 1e-9)
+     * \param[in] X Argument
+     * \return e^X
+     */
+    static reg Exp( const reg X )
+    {
+      const reg ClampedX = pack::Min(pack::Max(X, pack::Set1(-ExpLimit)), pack::Set1(ExpLimit));
+
+      // e^x = 2^n * e^r, n = round(x / ln(2)), |r| <= ln(2) / 2
+      const reg T = pack::Add(pack::Mul(ClampedX, pack::Set1(Log2E)), pack::Set1(RoundMagic));
+      const reg N = pack::Sub(T, pack::Set1(RoundMagic));
+      const reg R = pack::Sub(pack::Sub(ClampedX, pack::Mul(N, pack::Set1(Ln2Hi))), pack::Mul(N, pack::Set1(Ln2Lo)));
+
+      // Taylor polynomial of 8th degree
+      reg P = pack::Set1(1.0 / 40320);
+
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0 / 5040));
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0 / 720));
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0 / 120));
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0 / 24));
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0 / 6));
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0 / 2));
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0));
+      P = pack::Add(pack::Mul(P, R), pack::Set1(1.0));
+
+      return pack::Mul(P, pack::Pow2(T));
+    }
+
+    /**
+     * \brief Blur component of row with clamping function
+     * \param[in] Src Source row
+     * \param[in] NumberOfPixels Number of pixels in row
+     * \param[in] Index Component index
+     * \param[in] Coefs 5 blur coefficients of distances from 0 to 4
+     * \return Blurred component
+     */
+    static DBL BlurComponent( const DBL *Src, const INT NumberOfPixels, const INT Index, const DBL *Coefs )
+    {
+      const INT X = Index / 3, Component = Index % 3;
+      DBL Sum = 0;
+
+      for (INT i = -4; i < 5; i++)
+      {
+        const INT SrcX = X + i < 0 ? 0 : X + i >= NumberOfPixels ? NumberOfPixels - 1 : X + i;
+
+        Sum += Coefs[i < 0 ? -i : i] * Src[SrcX * 3 + Component];
+      }
+
+      return Sum;
+    }
+
+  public:
+    /**
+     * \brief Zero pixels with luminance not greater than limit function
+     * \param[in] Src Source pixels
+     * \param[out] Dst Destination pixels (may be source)
+     * \param[in] NumberOfPixels Number of pixels
+     * \param[in] Limit Luminance limit
+     */
+    static VOID Threshold( const DBL *Src, DBL *Dst, const INT NumberOfPixels, const DBL Limit )
+    {
+      INT i = 0;
+
+      for (; i + Width <= NumberOfPixels; i += Width)
+        pack::Threshold(Src + i * 3, Dst + i * 3, Limit);
+
+      // Rest pixels are processed by pack in zero padded buffer
+      if (i < NumberOfPixels)
+      {
+        DBL Buffer[Width * 3] = {};
+
+        std::memcpy(Buffer, Src + i * 3, (NumberOfPixels - i) * 3 * sizeof(DBL));
+        pack::Threshold(Buffer, Buffer, Limit);
+        std::memcpy(Dst + i * 3, Buffer, (NumberOfPixels - i) * 3 * sizeof(DBL));
+      }
+    }
+
+    /**
+     * \brief Blur row with 9 taps function (pixels out of row are clamped to its ends)
+     * \param[in] Src Source row
+     * \param[out] Dst Destination row (not source)
+     * \param[in] NumberOfPixels Number of pixels in row
+     * \param[in] Coefs 5 blur coefficients of distances from 0 to 4
+     */
+    static VOID BlurRow( const DBL *Src, DBL *Dst, const INT NumberOfPixels, const DBL *Coefs )
+    {
+      const INT NumberOfComponents = NumberOfPixels * 3;
+      INT i = 0;
+
+      for (; i < BlurBorder && i < NumberOfComponents; i++)
+        Dst[i] = BlurComponent(Src, NumberOfPixels, i, Coefs);
+
+      // Inner components are summed in same order as border ones, so results don't depend on pack
+      for (; i + Width <= NumberOfComponents - BlurBorder; i += Width)
+      {
+        reg Sum = pack::Set1(0);
+
+        for (INT j = -4; j < 5; j++)
+          Sum = pack::Add(Sum, pack::Mul(pack::Set1(Coefs[j < 0 ? -j : j]), pack::Load(Src + i + j * 3)));
+        pack::Store(Dst + i, Sum);
+      }
+
+      for (; i < NumberOfComponents; i++)
+        Dst[i] = BlurComponent(Src, NumberOfPixels, i, Coefs);
+    }
+
+    /**
+     * \brief Blur column with 9 taps function (rows are blurred at once)
+     * \param[in] Rows 9 source rows from 4 above destination to 4 below it
+     * \param[out] Dst Destination row (not one of sources)
+     * \param[in] NumberOfComponents Number of components in row
+     * \param[in] Coefs 5 blur coefficients of distances from 0 to 4
+     */
+    static VOID BlurColumn( const DBL * const *Rows, DBL *Dst, const INT NumberOfComponents, const DBL *Coefs )
+    {
+      INT i = 0;
+
+      for (; i + Width <= NumberOfComponents; i += Width)
+      {
+        reg Sum = pack::Set1(0);
+
+        for (INT j = 0; j < 9; j++)
+          Sum = pack::Add(Sum, pack::Mul(pack::Set1(Coefs[j < 4 ? 4 - j : j - 4]), pack::Load(Rows[j] + i)));
+        pack::Store(Dst + i, Sum);
+      }
+
+      for (; i < NumberOfComponents; i++)
+      {
+        DBL Sum = 0;
+
+        for (INT j = 0; j < 9; j++)
+          Sum += Coefs[j < 4 ? 4 - j : j - 4] * Rows[j][i];
+        Dst[i] = Sum;
+      }
+    }
+
+    /**
+     * \brief Tone mapping function (1 - exp(-X * Exposure) with fast exponent approximation)
+     * \param[in] Src Source components
+     * \param[out] Dst Destination components (may be source)
+     * \param[in] NumberOfComponents Number of components
+     * \param[in] Exposure Exposure
+     */
+    static VOID ToneMap( const DBL *Src, DBL *Dst, const INT NumberOfComponents, const DBL Exposure )
+    {
+      const reg One = pack::Set1(1), NegativeExposure = pack::Set1(-Exposure);
+      INT i = 0;
+
+      for (; i + Width <= NumberOfComponents; i += Width)
+        pack::Store(Dst + i, pack::Sub(One, Exp(pack::Mul(pack::Load(Src + i), NegativeExposure))));
+
+      // Rest components are processed by pack in zero padded buffer
+      if (i < NumberOfComponents)
+      {
+        DBL Buffer[Width] = {};
+
+        std::memcpy(Buffer, Src + i, (NumberOfComponents - i) * sizeof(DBL));
+        pack::Store(Buffer, pack::Sub(One, Exp(pack::Mul(pack::Load(Buffer), NegativeExposure))));
+        std::memcpy(Dst + i, Buffer, (NumberOfComponents - i) * sizeof(DBL));
+      }
+    }
+
+    /**
+     * \brief Add components function
+     * \param[in, out] Dst Destination components
+     * \param[in] Src Added components
+     * \param[in] NumberOfComponents Number of components
+     */
+    static VOID Add( DBL *Dst, const DBL *Src, const INT NumberOfComponents )
+    {
+      INT i = 0;
+
+      for (; i + Width <= NumberOfComponents; i += Width)
+        pack::Store(Dst + i, pack::Add(pack::Load(Dst + i), pack::Load(Src + i)));
+
+      for (; i < NumberOfComponents; i++)
+        Dst[i] += Src[i];
+    }
+
+    /**
+     * \brief Divide components function (Src / Divisor * Multiplier)
+     * \param[in] Src Source components
+     * \param[out] Dst Destination components (may be source)
+     * \param[in] NumberOfComponents Number of components
+     * \param[in] Divisor Divisor
+     * \param[in] Multiplier Multiplier of quotient
+     */
+    static VOID Divide( const DBL *Src, DBL *Dst, const INT NumberOfComponents, const DBL Divisor,
+                        const DBL Multiplier )
+    {
+      const reg D = pack::Set1(Divisor), M = pack::Set1(Multiplier);
+      INT i = 0;
+
+      for (; i + Width <= NumberOfComponents; i += Width)
+        pack::Store(Dst + i, pack::Mul(pack::Div(pack::Load(Src + i), D), M));
+
+      for (; i < NumberOfComponents; i++)
+        Dst[i] = Src[i] / Divisor * Multiplier;
+    }
+
+    /**
+     * \brief Quantize pixels to 8 bits per component function (same as image_vec::ToDWORD)
+     * \param[in] Src Source pixels
+     * \param[out] Dst Destination colors (0xAABBGGRR)
+     * \param[in] NumberOfPixels Number of pixels
+     */
+    static VOID Quantize( const DBL *Src, DWORD *Dst, const INT NumberOfPixels )
+    {
+      INT i = 0;
+
+      for (; i + QuantizeWidth <= NumberOfPixels; i += QuantizeWidth)
+        pack::Quantize(Src + i * 3, Dst + i);
+
+      // Rest pixels are processed by pack in zero padded buffer
+      if (i < NumberOfPixels)
+      {
+        DBL Buffer[QuantizeWidth * 3] = {};
+        DWORD Colors[QuantizeWidth];
+
+        std::memcpy(Buffer, Src + i * 3, (NumberOfPixels - i) * 3 * sizeof(DBL));
+        pack::Quantize(Buffer, Colors);
+        std::memcpy(Dst + i, Colors, (NumberOfPixels - i) * sizeof(DWORD));
+      }
+    }
+  };
+
+#endif /* __image_kernels_impl_h_ */
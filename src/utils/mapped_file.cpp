@@ -0,0 +1,106 @@
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#include "mapped_file.h"
+
+/**
+ * \brief Open file function
+ * \param[in] FileName Name of file
+ * \return TRUE-if file opened, FALSE-otherwise
+ */
+BOOL mapped_file::Open( const std::string &FileName )
+{
+  Close();
+
+#ifndef _WIN32
+  const INT File = open(FileName.c_str(), O_RDONLY);
+
+  if (File != -1)
+  {
+    struct stat Stat;
+
+    if (fstat(File, &Stat) == 0 && Stat.st_size > 0)
+    {
+      VOID *Mapping = mmap(nullptr, Stat.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+
+      if (Mapping != MAP_FAILED)
+      {
+        Data = reinterpret_cast<const BYTE *>(Mapping);
+        Size = Stat.st_size;
+        IsMapped = TRUE;
+      }
+    }
+    close(File);
+  }
+#endif /* _WIN32 */
+
+  if (IsMapped)
+    return TRUE;
+
+  // Mapping is not available - read whole file
+  std::ifstream Stream(FileName, std::ios::binary | std::ios::ate);
+
+  if (!Stream)
+    return FALSE;
+
+  Buffer.resize(Stream.tellg());
+  Stream.seekg(0);
+  if (!Stream.read(reinterpret_cast<CHAR *>(Buffer.data()), Buffer.size()))
+  {
+    Buffer.clear();
+    return FALSE;
+  }
+
+  Data = Buffer.data();
+  Size = Buffer.size();
+
+  return TRUE;
+}
+
+/**
+ * \brief Close file function
+ */
+VOID mapped_file::Close( VOID )
+{
+#ifndef _WIN32
+  if (IsMapped)
+    munmap(const_cast<BYTE *>(Data), Size);
+#endif /* _WIN32 */
+
+  Data = nullptr;
+  Size = 0;
+  IsMapped = FALSE;
+  Buffer.clear();
+}
+
+/**
+ * \brief Get file data function
+ * \return Pointer to file data
+ */
+const BYTE * mapped_file::GetData( VOID ) const
+{
+  return Data;
+}
+
+/**
+ * \brief Get file size function
+ * \return File size
+ */
+UINT64 mapped_file::GetSize( VOID ) const
+{
+  return Size;
+}
+
+/**
+ * \brief Mapped file destructor
+ */
+mapped_file::~mapped_file( VOID )
+{
+  Close();
+}
@@ -0,0 +1,75 @@
+#ifndef __mapped_file_h_
+#define __mapped_file_h_
+
+#include <string>
+#include <vector>
+
+#include "def.h"
+
+/**
+ * \brief Read-only file mapped to memory (file is read to buffer if mapping is not available, e.g. on Windows)
+ */
+class mapped_file
+{
+private:
+  /** File data */
+  const BYTE *Data = nullptr;
+
+  /** File size */
+  UINT64 Size = 0;
+
+  /** Is data mapped flag (otherwise data points to buffer) */
+  BOOL IsMapped = FALSE;
+
+  /** Buffer with file data (used if mapping failed) */
+  std::vector<BYTE> Buffer;
+
+public:
+  /**
+   * \brief Mapped file default constructor
+   */
+  mapped_file( VOID ) = default;
+
+  /**
+   * \brief Open file function
+   * \param[in] FileName Name of file
+   * \return TRUE-if file opened, FALSE-otherwise
+   */
+  BOOL Open( const std::string &FileName );
+
+  /**
+   * \brief Close file function
+   */
+  VOID Close( VOID );
+
+  /**
+   * \brief Get file data function
+   * \return Pointer to file data
+   */
+  const BYTE * GetData( VOID ) const;
+
+  /**
+   * \brief Get file size function
+   * \return File size
+   */
+  UINT64 GetSize( VOID ) const;
+
+  /**
+   * \brief Mapped file destructor
+   */
+  ~mapped_file( VOID );
+
+  /**
+   * \brief Deleted copy function
+   * \param[in] File Other file
+   */
+  mapped_file( const mapped_file &File ) = delete;
+
+  /**
+   * \brief Deleted copy function
+   * \param[in] File Other file
+   */
+  VOID operator=( const mapped_file &File ) = delete;
+};
+
+#endif /* __mapped_file_h_ */
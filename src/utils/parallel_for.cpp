@@ -1,28 +1,335 @@
-#include <future>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include "parallel_for.h"
 
-/** Number of threads */
-INT parallel_for::NumberOfThreads = std::thread::hardware_concurrency();
+/**
+ * \brief Persistent threads pool class (calling thread works as thread 0, workers sleep between runs)
+ */
+class parallel_for::pool
+{
+private:
+  /**
+   * \brief Iterations range of thread (owner takes chunks from begin, other threads steal halves from end)
+   */
+  struct alignas(64) RANGE
+  {
+    /** Begin (high 32 bits) and end (low 32 bits) of not started iterations */
+    std::atomic<UINT64> BeginEnd;
+  };
+
+  /** Worker threads */
+  std::vector<std::thread> Workers;
+
+  /** Ranges of all threads (calling thread range is first) */
+  std::unique_ptr<RANGE[]> Ranges;
+
+  /** Mutex for workers wake up and completion */
+  std::mutex Mutex;
+
+  /** Condition for workers wake up */
+  std::condition_variable WakeUp;
+
+  /** Condition for completion of all workers */
+  std::condition_variable Done;
+
+  /** Index of current run (workers wake up when it is changed) */
+  UINT64 Generation = 0;
+
+  /** Number of workers which didn't finish current run */
+  INT NumberOfActive = 0;
+
+  /** Workers stop flag */
+  BOOL IsStopping = FALSE;
+
+  /** Run in progress flag */
+  std::atomic<BOOL> IsBusy = FALSE;
+
+  /** First exception thrown by iteration function during current run */
+  std::exception_ptr Exception;
+
+  /** Function for run of iterations range */
+  RANGE_FUNC RangeFunc = nullptr;
+
+  /** Iteration function */
+  const VOID *Func = nullptr;
+
+  /** Number of iterations taken by thread at once */
+  INT ChunkSize = 1;
+
+  /**
+   * \brief Pack range function
+   * \param[in] Begin Range begin
+   * \param[in] End Range end
+   * \return Packed range
+   */
+  static UINT64 Pack( const INT Begin, const INT End )
+  {
+    return (UINT64)(UINT32)Begin << 32 | (UINT32)End;
+  }
+
+  /**
+   * \brief Steal half of not started iterations of other thread function
+   * \param[in] Index Thread index
+   * \return TRUE-if iterations were stolen (and placed to thread range), FALSE-if all ranges are empty
+   */
+  BOOL Steal( const INT Index )
+  {
+    const INT NumberOfThreads = (INT)Workers.size() + 1;
+
+    for (INT i = 1; i < NumberOfThreads; i++)
+    {
+      RANGE &Victim = Ranges[(Index + i) % NumberOfThreads];
+      UINT64 Value = Victim.BeginEnd.load();
+
+      while (TRUE)
+      {
+        const INT Begin = (INT)(Value >> 32), End = (INT)(UINT32)Value;
+
+        if (Begin >= End)
+          break;
+
+        const INT Middle = End - std::max((End - Begin) / 2, std::min(ChunkSize, End - Begin));
+
+        if (Victim.BeginEnd.compare_exchange_weak(Value, Pack(Begin, Middle)))
+        {
+          // Own range is empty, so nobody else modifies it
+          Ranges[Index].BeginEnd.store(Pack(Middle, End));
+          return TRUE;
+        }
+      }
+    }
+    return FALSE;
+  }
+
+  /**
+   * \brief Run iterations of current run function (returns when there are no not started iterations)
+   * \param[in] Index Thread index
+   */
+  VOID Work( const INT Index )
+  {
+    RANGE &Own = Ranges[Index];
+
+    try
+    {
+      while (TRUE)
+      {
+        UINT64 Value = Own.BeginEnd.load();
+        const INT Begin = (INT)(Value >> 32), End = (INT)(UINT32)Value;
+
+        if (Begin >= End)
+        {
+          if (!Steal(Index))
+            return;
+          continue;
+        }
+
+        const INT ChunkEnd = End - Begin > ChunkSize ? Begin + ChunkSize : End;
+
+        if (Own.BeginEnd.compare_exchange_weak(Value, Pack(ChunkEnd, End)))
+          RangeFunc(Func, Begin, ChunkEnd);
+      }
+    }
+    catch ( ... )
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+
+      if (!Exception)
+        Exception = std::current_exception();
+    }
+  }
+
+  /**
+   * \brief Worker thread function
+   * \param[in] Index Thread index
+   * \param[in] SeenGeneration Index of last run before thread start
+   */
+  VOID WorkerMain( const INT Index, UINT64 SeenGeneration )
+  {
+    std::unique_lock<std::mutex> Lock(Mutex);
+
+    while (TRUE)
+    {
+      WakeUp.wait(Lock, [&]( VOID )
+        {
+          return IsStopping || Generation != SeenGeneration;
+        });
+      if (IsStopping)
+        return;
+      SeenGeneration = Generation;
+
+      Lock.unlock();
+      Work(Index);
+      Lock.lock();
+
+      if (--NumberOfActive == 0)
+        Done.notify_one();
+    }
+  }
+
+public:
+  /**
+   * \brief Pool constructor (all hardware threads are used)
+   */
+  pool( VOID )
+  {
+    Start(0);
+  }
+
+  /**
+   * \brief Pool destructor
+   */
+  ~pool( VOID )
+  {
+    Stop();
+  }
+
+  /**
+   * \brief Start worker threads function
+   * \param[in] N Number of threads (including calling thread), 0 - number of hardware threads
+   */
+  VOID Start( const INT N )
+  {
+    const INT NumberOfThreads = N > 0 ? N : std::max(1, (INT)std::thread::hardware_concurrency());
+
+    Ranges = std::make_unique<RANGE[]>(NumberOfThreads);
+    for (INT i = 0; i < NumberOfThreads; i++)
+      Ranges[i].BeginEnd.store(0);
+
+    IsStopping = FALSE;
+    Workers.reserve(NumberOfThreads - 1);
+    for (INT i = 1; i < NumberOfThreads; i++)
+      Workers.emplace_back(&pool::WorkerMain, this, i, Generation);
+  }
+
+  /**
+   * \brief Stop worker threads function
+   */
+  VOID Stop( VOID )
+  {
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+
+      IsStopping = TRUE;
+    }
+    WakeUp.notify_all();
+
+    for (std::thread &Worker : Workers)
+      Worker.join();
+    Workers.clear();
+  }
+
+  /**
+   * \brief Get number of threads function
+   * \return Number of threads (including calling thread)
+   */
+  INT GetNumberOfThreads( VOID ) const
+  {
+    return (INT)Workers.size() + 1;
+  }
+
+  /**
+   * \brief Run iterations on all threads function
+   * \param[in] N Number of iterations
+   * \param[in] NewChunkSize Number of iterations taken by thread at once
+   * \param[in] NewRangeFunc Function for run of iterations range
+   * \param[in] NewFunc Iteration function
+   */
+  VOID Run( const INT N, const INT NewChunkSize, const RANGE_FUNC NewRangeFunc, const VOID *NewFunc )
+  {
+    const INT NumberOfThreads = GetNumberOfThreads();
+
+    // Pool threads are busy with other run (or this call is nested), so iterations are run by calling thread
+    if (N <= NewChunkSize || NumberOfThreads == 1 || IsBusy.exchange(TRUE))
+    {
+      NewRangeFunc(NewFunc, 0, N);
+      return;
+    }
+
+    RangeFunc = NewRangeFunc;
+    Func = NewFunc;
+    ChunkSize = NewChunkSize;
+    for (INT i = 0; i < NumberOfThreads; i++)
+      Ranges[i].BeginEnd.store(Pack((INT)((INT64)N * i / NumberOfThreads),
+                                    (INT)((INT64)N * (i + 1) / NumberOfThreads)));
+
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+
+      NumberOfActive = NumberOfThreads - 1;
+      Generation++;
+    }
+    WakeUp.notify_all();
+
+    Work(0);
+
+    std::exception_ptr RunException;
+
+    {
+      std::unique_lock<std::mutex> Lock(Mutex);
+
+      Done.wait(Lock, [&]( VOID )
+        {
+          return NumberOfActive == 0;
+        });
+      std::swap(RunException, Exception);
+    }
+    IsBusy.store(FALSE);
+
+    if (RunException)
+      std::rethrow_exception(RunException);
+  }
+};
 
 /**
- * \brief Run parallel for
+ * \brief Get threads pool function (pool is started on first call)
+ * \return Pool
+ */
+parallel_for::pool & parallel_for::GetPool( VOID )
+{
+  static pool Pool;
+
+  return Pool;
+}
+
+/**
+ * \brief Run iterations range function on pool threads
  * \param[in] N Number of iterations
- * \param[in] Func Function for run
+ * \param[in] ChunkSize Number of iterations taken by thread at once
+ * \param[in] RangeFunc Function for run of iterations range
+ * \param[in] Func Iteration function passed to range function
  */
-VOID parallel_for::Run( INT N, const std::function<VOID (INT)> &Func )
+VOID parallel_for::Dispatch( const INT N, const INT ChunkSize, const RANGE_FUNC RangeFunc, const VOID *Func )
 {
-  std::vector<std::future<VOID>> Tasks(NumberOfThreads);
+  if (N <= 0)
+    return;
 
-  for (INT i = 0; i < NumberOfThreads; i++)
-    Tasks[i] = std::async([=]( VOID )
-      {
-        for (INT j = i; j < N; j += NumberOfThreads)
-          Func(j);
-      });
+  GetPool().Run(N, std::max(ChunkSize, 1), RangeFunc, Func);
+}
 
-  for (INT i = 0; i < NumberOfThreads; i++)
-    Tasks[i].wait();
-}
\ No newline at end of file
+/**
+ * \brief Set number of threads function (must not be called during run)
+ * \param[in] N Number of threads (including calling thread), 0 - number of hardware threads
+ */
+VOID parallel_for::SetNumberOfThreads( const INT N )
+{
+  pool &Pool = GetPool();
+
+  Pool.Stop();
+  Pool.Start(N);
+}
+
+/**
+ * \brief Get number of threads function
+ * \return Number of threads (including calling thread)
+ */
+INT parallel_for::GetNumberOfThreads( VOID )
+{
+  return GetPool().GetNumberOfThreads();
+}
@@ -1,28 +1,67 @@
 #ifndef __parallel_for_h_
 #define __parallel_for_h_
 
-#include <functional>
-
 #include "def.h"
 
 /**
- * \brief Parallel for class
+ * \brief Parallel for class (iterations are run by persistent threads pool)
  */
 class parallel_for
 {
 private:
-  /** Number of threads */
-  static INT NumberOfThreads;
+  /** Function for run of iterations range [Begin, End) of type-erased iteration function */
+  using RANGE_FUNC = VOID (*)( const VOID *Func, INT Begin, INT End );
+
+  /** Persistent threads pool */
+  class pool;
+
+  /**
+   * \brief Get threads pool function (pool is started on first call)
+   * \return Pool
+   */
+  static pool & GetPool( VOID );
+
+  /**
+   * \brief Run iterations range function on pool threads
+   * \param[in] N Number of iterations
+   * \param[in] ChunkSize Number of iterations taken by thread at once
+   * \param[in] RangeFunc Function for run of iterations range
+   * \param[in] Func Iteration function passed to range function
+   */
+  static VOID Dispatch( INT N, INT ChunkSize, RANGE_FUNC RangeFunc, const VOID *Func );
 
 public:
   parallel_for( VOID ) = delete;
 
   /**
-   * \brief Run parallel for
+   * \brief Set number of threads function (must not be called during run)
+   * \param[in] N Number of threads (including calling thread), 0 - number of hardware threads
+   */
+  static VOID SetNumberOfThreads( INT N );
+
+  /**
+   * \brief Get number of threads function
+   * \return Number of threads (including calling thread)
+   */
+  static INT GetNumberOfThreads( VOID );
+
+  /**
+   * \brief Run parallel for (nested and concurrent runs are executed serially by calling thread)
    * \param[in] N Number of iterations
-   * \param[in] Func Function for run
+   * \param[in] Func Function for run (gets iteration index)
+   * \param[in] ChunkSize Number of iterations taken by thread at once
    */
-  static VOID Run( INT N, const std::function<VOID (INT)> &Func );
+  template <class func>
+    static VOID Run( INT N, const func &Func, INT ChunkSize = 1 )
+    {
+      Dispatch(N, ChunkSize, []( const VOID *F, INT Begin, INT End )
+        {
+          const func &Iteration = *static_cast<const func *>(F);
+
+          for (INT i = Begin; i < End; i++)
+            Iteration(i);
+        }, &Func);
+    }
 };
 
 #endif /* __parallel_for_h_ */
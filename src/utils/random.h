@@ -0,0 +1,70 @@
+#ifndef __random_h_
+#define __random_h_
+
+#include "def.h"
+
+// https://www.pcg-random.org
+
+/**
+ * \brief Small fast random numbers generator (PCG32) with independent streams
+ */
+class random_generator
+{
+private:
+  /** Generator state */
+  UINT64 State = 0;
+
+  /** Stream selector (must be odd) */
+  UINT64 Increment = 1;
+
+public:
+  /**
+   * \brief Generator constructor
+   * \param[in] Seed Initial state
+   * \param[in] Stream Stream number (generators with different streams give uncorrelated sequences)
+   */
+  random_generator( const UINT64 Seed, const UINT64 Stream ) : Increment((Stream << 1) | 1)
+  {
+    GetNext();
+    State += Seed;
+    GetNext();
+  }
+
+  /**
+   * \brief Get next random number function
+   * \return Random number
+   */
+  UINT32 GetNext( VOID )
+  {
+    const UINT64 OldState = State;
+
+    State = OldState * 6364136223846793005ULL + Increment;
+
+    const UINT32 XorShifted = static_cast<UINT32>(((OldState >> 18) ^ OldState) >> 27);
+    const UINT32 Rot = static_cast<UINT32>(OldState >> 59);
+
+    return (XorShifted >> Rot) | (XorShifted << ((32 - Rot) & 31));
+  }
+
+  /**
+   * \brief Get next uniformly distributed number in [0, 1) function
+   * \return Random number
+   */
+  FLT GetNextUniform( VOID )
+  {
+    return (GetNext() >> 8) * (1.0f / (1 << 24));
+  }
+
+  /**
+   * \brief Get next uniformly distributed number in [Min, Max) function
+   * \param[in] Min Range begin
+   * \param[in] Max Range end
+   * \return Random number
+   */
+  FLT GetNextUniform( const FLT Min, const FLT Max )
+  {
+    return Min + (Max - Min) * GetNextUniform();
+  }
+};
+
+#endif /* __random_h_ */
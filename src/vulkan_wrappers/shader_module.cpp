@@ -1,5 +1,6 @@
 #include <cassert>
 #include <fstream>
+#include <unordered_map>
 #include <vector>
 
 #include "shader_module.h"
@@ -22,16 +23,25 @@ shader_module::shader_module( const VkDevice Device, const std::string_view &Fil
     error("File "s + FileName.data() + " not found");
   
   size_t Size = File.tellg();
-  std::vector<CHAR> Bytes(Size);
+
+  if (Size % sizeof(UINT32) != 0)
+    error("File "s + FileName.data() + " is not SPIR-V binary");
+
+  std::vector<UINT32> Code(Size / sizeof(UINT32));
   
   File.seekg(std::ios::beg);
-  File.read(Bytes.data(), Size);
+  File.read(reinterpret_cast<CHAR *>(Code.data()), Size);
   
+  if (!File || Code.size() < 5 || Code[0] != 0x07230203)
+    error("File "s + FileName.data() + " is not SPIR-V binary");
+
+  Blocks = ReadBlocks(Code);
+
   VkShaderModuleCreateInfo CreateInfo = {};
   
   CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  CreateInfo.codeSize = Size * sizeof(CHAR);
-  CreateInfo.pCode = reinterpret_cast<UINT32 *>(Bytes.data());
+  CreateInfo.codeSize = Size;
+  CreateInfo.pCode = Code.data();
   
   vulkan_validation::Check(
     vkCreateShaderModule(DeviceId, &CreateInfo, nullptr, &ShaderModuleId),
@@ -47,6 +57,102 @@ VkShaderModule shader_module::GetShaderModuleId( VOID ) const
   return ShaderModuleId;
 }
 
+/**
+ * \brief Get layouts of resource blocks declared by shader
+ * \return Blocks layouts
+ */
+const std::vector<shader_module::BLOCK_LAYOUT> & shader_module::GetBlocks( VOID ) const
+{
+  return Blocks;
+}
+
+/**
+ * \brief Read resource blocks layouts from SPIR-V binary function
+ * \param[in] Code SPIR-V words
+ * \return Blocks layouts
+ */
+std::vector<shader_module::BLOCK_LAYOUT> shader_module::ReadBlocks( const std::vector<UINT32> &Code )
+{
+  // Instructions, decorations and storage classes numbers from SPIR-V specification
+  enum : UINT32
+  {
+    OpTypeStruct = 30, OpTypePointer = 32, OpVariable = 59, OpDecorate = 71, OpMemberDecorate = 72,
+    DecorationArrayStride = 6, DecorationBinding = 33, DecorationDescriptorSet = 34, DecorationOffset = 35,
+    StorageClassUniform = 2, StorageClassPushConstant = 9, StorageClassStorageBuffer = 12
+  };
+
+  struct VARIABLE
+  {
+    UINT32 Type, Id, StorageClass;
+  };
+
+  std::unordered_map<UINT32, UINT32> Sets, Bindings, ArrayStrides, Pointees;
+  std::unordered_map<UINT32, std::vector<UINT32>> MembersTypes, MembersOffsets;
+  std::vector<VARIABLE> Variables;
+
+  // Header is 5 words, every instruction starts with word count in high half of its first word
+  for (size_t i = 5; i < Code.size();)
+  {
+    const UINT32 WordCount = Code[i] >> 16, OpCode = Code[i] & 0xFFFF;
+    const UINT32 *Operands = Code.data() + i + 1;
+
+    if (WordCount == 0 || i + WordCount > Code.size())
+      error("Broken SPIR-V binary");
+
+    if (OpCode == OpDecorate && WordCount >= 4)
+    {
+      if (Operands[1] == DecorationDescriptorSet)
+        Sets[Operands[0]] = Operands[2];
+      else if (Operands[1] == DecorationBinding)
+        Bindings[Operands[0]] = Operands[2];
+      else if (Operands[1] == DecorationArrayStride)
+        ArrayStrides[Operands[0]] = Operands[2];
+    }
+    else if (OpCode == OpMemberDecorate && WordCount >= 5 && Operands[2] == DecorationOffset)
+    {
+      std::vector<UINT32> &Offsets = MembersOffsets[Operands[0]];
+
+      if (Offsets.size() <= Operands[1])
+        Offsets.resize(Operands[1] + 1);
+      Offsets[Operands[1]] = Operands[3];
+    }
+    else if (OpCode == OpTypeStruct && WordCount >= 2)
+      MembersTypes[Operands[0]].assign(Operands + 1, Operands + WordCount - 1);
+    else if (OpCode == OpTypePointer && WordCount >= 4)
+      Pointees[Operands[0]] = Operands[2];
+    else if (OpCode == OpVariable && WordCount >= 4)
+      Variables.push_back({Operands[0], Operands[1], Operands[2]});
+
+    i += WordCount;
+  }
+
+  std::vector<BLOCK_LAYOUT> Res;
+
+  for (const VARIABLE &Var : Variables)
+  {
+    if (Var.StorageClass != StorageClassUniform && Var.StorageClass != StorageClassStorageBuffer &&
+        Var.StorageClass != StorageClassPushConstant)
+      continue;
+
+    const UINT32 Block = Pointees[Var.Type];
+    const std::vector<UINT32> &Members = MembersTypes[Block];
+    BLOCK_LAYOUT Layout;
+
+    if (Var.StorageClass == StorageClassPushConstant)
+      Layout.Set = Layout.Binding = PushConstantsBinding;
+    else
+    {
+      Layout.Set = Sets[Var.Id];
+      Layout.Binding = Bindings[Var.Id];
+    }
+    Layout.MemberOffsets = MembersOffsets[Block];
+    Layout.ArrayStride = Members.empty() ? 0 : ArrayStrides[Members[0]];
+    Res.push_back(std::move(Layout));
+  }
+
+  return Res;
+}
+
 /**
  * \brief Shader module destructor
  */
@@ -67,6 +173,7 @@ shader_module & shader_module::operator=( shader_module &&Shader )
 
   std::swap(ShaderModuleId, Shader.ShaderModuleId);
   std::swap(DeviceId, Shader.DeviceId);
+  std::swap(Blocks, Shader.Blocks);
 
   return *this;
 }
@@ -82,4 +189,5 @@ shader_module::shader_module( shader_module &&Shader )
 
   std::swap(ShaderModuleId, Shader.ShaderModuleId);
   std::swap(DeviceId, Shader.DeviceId);
+  std::swap(Blocks, Shader.Blocks);
 }
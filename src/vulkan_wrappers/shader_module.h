@@ -3,6 +3,7 @@
 
 #include "ext/volk/volk.h"
 #include <string_view>
+#include <vector>
 
 #include "def.h"
 
@@ -12,6 +13,27 @@
 class shader_module
 {
 public:
+  /** Descriptor set and binding of push constants block */
+  static constexpr UINT32 PushConstantsBinding = 0xFFFFFFFF;
+
+  /**
+   * \brief Layout of resource block declared by shader (read from SPIR-V decorations)
+   */
+  struct BLOCK_LAYOUT
+  {
+    /** Descriptor set (PushConstantsBinding - for push constants) */
+    UINT32 Set;
+
+    /** Binding in descriptor set (PushConstantsBinding - for push constants) */
+    UINT32 Binding;
+
+    /** Offsets of block members */
+    std::vector<UINT32> MemberOffsets;
+
+    /** Array stride of first member (0 - first member is not array) */
+    UINT32 ArrayStride;
+  };
+
   /**
    * \brief Default constructor.
    */
@@ -30,6 +52,12 @@ public:
    */
   VkShaderModule GetShaderModuleId( VOID ) const;
 
+  /**
+   * \brief Get layouts of resource blocks declared by shader
+   * \return Blocks layouts
+   */
+  const std::vector<BLOCK_LAYOUT> & GetBlocks( VOID ) const;
+
   /**
    * \brief Shader module destructor
    */
@@ -50,6 +78,13 @@ public:
   shader_module( shader_module &&Shader );
 
 private:
+  /**
+   * \brief Read resource blocks layouts from SPIR-V binary function
+   * \param[in] Code SPIR-V words
+   * \return Blocks layouts
+   */
+  static std::vector<BLOCK_LAYOUT> ReadBlocks( const std::vector<UINT32> &Code );
+
   /**
    * \brief Removed copy function
    * \param[in] Shader Vulkan shader module
@@ -69,6 +104,9 @@ private:
 
   /** Device identifier */
   VkDevice DeviceId = VK_NULL_HANDLE;
+
+  /** Layouts of resource blocks declared by shader */
+  std::vector<BLOCK_LAYOUT> Blocks;
 };
 
 #endif /* __shader_module_h_ */
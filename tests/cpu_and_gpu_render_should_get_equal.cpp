@@ -9,7 +9,6 @@
 shape Cow;
 shape Box;
 shape Emit;
-shape Dragons;
 
 /**
  * \brief Generate scene function (Hardcode)
@@ -37,23 +36,24 @@ VOID GenScene( scene &Scn )
   Box.MakeBox(vec(0.5f, 0, -13.5), vec(5, 2, -11.5), RedMtl, DefEnvi);
   Emit.MakeBox(vec(-3, 6.4, -3), vec(3, 6.51, 3), EmitMtl, DefEnvi);
 
-  Dragons.LoadOBJ("bin/models/dragon.obj", GreenMtl, DefEnvi,
+  std::shared_ptr<mesh> Dragon = mesh::LoadOBJ("bin/models/dragon.obj");
+
+  Scn.Instances.emplace_back(Dragon, GreenMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(35) * matr::Translate(vec(-4, 0, 1.5)));
-  Dragons.LoadOBJ("bin/models/dragon.obj", PinkMetalMtl, DefEnvi,
+  Scn.Instances.emplace_back(Dragon, PinkMetalMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(125) * matr::Translate(vec(4, 0, 1.5)));
-  Dragons.LoadOBJ("bin/models/dragon.obj", BlueMtl, DefEnvi,
+  Scn.Instances.emplace_back(Dragon, BlueMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(-145) * matr::Translate(vec(3, 0, -3)));
-  Dragons.LoadOBJ("bin/models/dragon.obj", RedMtl, DefEnvi,
+  Scn.Instances.emplace_back(Dragon, RedMtl, DefEnvi,
     matr::Scale(vec(0.75, 0.75, 0.75)) * matr::RotateX(-90) *
     matr::RotateY(-55) * matr::Translate(vec(-3, 0, -3)));
 
   Scn.Objects.push_back(&Cow);
   Scn.Objects.push_back(&Box);
   Scn.Objects.push_back(&Emit);
-  Scn.Objects.push_back(&Dragons);
 
   Scn.IsChanged = TRUE;
 }
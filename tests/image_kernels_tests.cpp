@@ -0,0 +1,117 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+#include "utils/image_kernels.h"
+
+/** Tolerance of results of different instruction sets (operations order of sums may differ) */
+static const DBL KernelsTolerance = 1e-12;
+
+/**
+ * \brief Generate random components function
+ * \param[in, out] Generator Random generator
+ * \param[in] NumberOfComponents Number of components
+ * \param[in] Min Minimal component
+ * \param[in] Max Maximal component
+ * \return Components
+ */
+static std::vector<DBL> GenComponents( std::mt19937 &Generator, const INT NumberOfComponents, const DBL Min,
+                                       const DBL Max )
+{
+  std::uniform_real_distribution<DBL> Distribution(Min, Max);
+  std::vector<DBL> Components(NumberOfComponents);
+
+  for (DBL &C : Components)
+    C = Distribution(Generator);
+
+  return Components;
+}
+
+/**
+ * \brief Check that components are equal within tolerance function
+ * \param[in] A First components
+ * \param[in] B Second components
+ * \return TRUE-if components are equal, FALSE-otherwise
+ */
+static BOOL IsComponentsEqual( const std::vector<DBL> &A, const std::vector<DBL> &B )
+{
+  for (size_t i = 0; i < A.size(); i++)
+    if (std::abs(A[i] - B[i]) > KernelsTolerance * std::max(1.0, std::abs(B[i])))
+      return FALSE;
+
+  return A.size() == B.size();
+}
+
+BOOST_AUTO_TEST_SUITE(ImageKernelsTestsSuite)
+
+/**
+ * \brief Test kernels of every available instruction set give results of scalar kernels
+ */
+BOOST_AUTO_TEST_CASE(ImageKernelsEqualScalarKernelsTest)
+{
+  const DBL Coefs[5] = {0.2, 0.18, 0.14, 0.1, 0.08};
+  std::mt19937 Generator(30);
+
+  for (const image_kernels::ISA Set : {image_kernels::ISA::SSE2, image_kernels::ISA::AVX2})
+  {
+    if (!image_kernels::IsAvailable(Set))
+    {
+      BOOST_TEST_MESSAGE("Instruction set " << static_cast<INT>(Set) << " is not available, skipped");
+      continue;
+    }
+
+    // Sizes cover tails of packs and of 4 pixels quantization blocks
+    for (INT NumberOfPixels = 1; NumberOfPixels <= 37; NumberOfPixels++)
+    {
+      const INT N = NumberOfPixels * 3;
+      const std::vector<DBL> Src = GenComponents(Generator, N, -0.25, 2);
+      std::vector<std::vector<DBL>> Rows;
+      std::vector<const DBL *> RowsPointers;
+      std::vector<DBL> Res[2];
+      std::vector<DWORD> Colors[2];
+
+      for (INT i = 0; i < 9; i++)
+      {
+        Rows.push_back(GenComponents(Generator, N, 0, 2));
+        RowsPointers.push_back(Rows.back().data());
+      }
+
+      for (const image_kernels::ISA Kernels : {image_kernels::ISA::SCALAR, Set})
+      {
+        const INT Index = Kernels == image_kernels::ISA::SCALAR ? 0 : 1;
+
+        image_kernels::SetISA(Kernels);
+        Res[Index].clear();
+
+        std::vector<DBL> Dst(N);
+
+        image_kernels::Threshold(Src.data(), Dst.data(), NumberOfPixels, 1);
+        Res[Index].insert(Res[Index].end(), Dst.begin(), Dst.end());
+        image_kernels::BlurRow(Src.data(), Dst.data(), NumberOfPixels, Coefs);
+        Res[Index].insert(Res[Index].end(), Dst.begin(), Dst.end());
+        image_kernels::BlurColumn(RowsPointers.data(), Dst.data(), N, Coefs);
+        Res[Index].insert(Res[Index].end(), Dst.begin(), Dst.end());
+        image_kernels::ToneMap(Rows[0].data(), Dst.data(), N, 1.5);
+        Res[Index].insert(Res[Index].end(), Dst.begin(), Dst.end());
+        Dst = Rows[1];
+        image_kernels::Add(Dst.data(), Src.data(), N);
+        Res[Index].insert(Res[Index].end(), Dst.begin(), Dst.end());
+        image_kernels::Divide(Src.data(), Dst.data(), N, 3, 7);
+        Res[Index].insert(Res[Index].end(), Dst.begin(), Dst.end());
+
+        Colors[Index].resize(NumberOfPixels);
+        image_kernels::Quantize(Src.data(), Colors[Index].data(), NumberOfPixels);
+      }
+
+      BOOST_CHECK_MESSAGE(IsComponentsEqual(Res[1], Res[0]),
+                          "instruction set " << static_cast<INT>(Set) << ", pixels " << NumberOfPixels);
+      BOOST_CHECK_MESSAGE(Colors[1] == Colors[0],
+                          "quantization, instruction set " << static_cast<INT>(Set) << ", pixels " << NumberOfPixels);
+    }
+  }
+
+  image_kernels::SetISA(image_kernels::GetWidestISA());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
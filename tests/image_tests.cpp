@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+#include "utils/error.h"
+#include "utils/image.h"
+
+/**
+ * \brief Read whole file function
+ * \param[in] FileName Name of file
+ * \return File bytes
+ */
+static std::vector<BYTE> ReadFile( const std::filesystem::path &FileName )
+{
+  std::ifstream File(FileName, std::ios::binary);
+
+  return std::vector<BYTE>(std::istreambuf_iterator<CHAR>(File), std::istreambuf_iterator<CHAR>());
+}
+
+/**
+ * \brief Read value of little endian file data function
+ * \param[in] Data File data
+ * \param[in, out] Pos Position of value (it is moved after value)
+ * \return Value
+ */
+template<typename type>
+  static type ReadValue( const std::vector<BYTE> &Data, size_t *Pos )
+  {
+    type Value;
+
+    BOOST_REQUIRE(*Pos + sizeof(type) <= Data.size());
+    std::memcpy(&Value, Data.data() + *Pos, sizeof(type));
+    *Pos += sizeof(type);
+    return Value;
+  }
+
+/**
+ * \brief Get test component function (neighbour components differ, some are negative)
+ * \param[in] X Pixel column
+ * \param[in] Y Pixel row
+ * \param[in] C Component index
+ * \return Component
+ */
+static DBL GetTestComponent( const INT X, const INT Y, const INT C )
+{
+  return ((X * 37 + Y * 53 + C * 11) % 97 - 5) / 7.0;
+}
+
+/**
+ * \brief Generate image with test components function
+ * \param[out] Img Image
+ * \param[in] W Image width
+ * \param[in] H Image height
+ */
+static VOID GenTestImage( image *Img, const INT W, const INT H )
+{
+  Img->Resize(W, H);
+  for (INT y = 0; y < H; y++)
+    for (INT x = 0; x < W; x++)
+      Img->SetPixel(x, y, image_vec(GetTestComponent(x, y, 0), GetTestComponent(x, y, 1), GetTestComponent(x, y, 2)));
+}
+
+/**
+ * \brief Lengths of run length encoded packets
+ */
+struct RUN_LENGTH_STATS
+{
+  /** Maximal length of run */
+  INT MaxRun = 0;
+
+  /** Maximal length of literal sequence */
+  INT MaxLiteral = 0;
+};
+
+/**
+ * \brief Decode run length encoded component of Radiance scan line function
+ * \param[in] Data File data
+ * \param[in, out] Pos Position of encoded component (it is moved after component)
+ * \param[in] W Scan line width
+ * \param[out] Dst First component of pixels (components of one pixel are 4 bytes apart)
+ * \param[in, out] Stats Lengths of packets
+ */
+static VOID DecodeRunLength( const std::vector<BYTE> &Data, size_t *Pos, const INT W, BYTE *Dst,
+                             RUN_LENGTH_STATS *Stats )
+{
+  for (INT x = 0; x < W;)
+  {
+    const INT Count = ReadValue<BYTE>(Data, Pos);
+
+    BOOST_REQUIRE(Count != 0);
+    if (Count > 128)
+    {
+      const BYTE Value = ReadValue<BYTE>(Data, Pos);
+
+      BOOST_REQUIRE(x + Count - 128 <= W);
+      for (INT i = 0; i < Count - 128; i++)
+        Dst[(x + i) * 4] = Value;
+      x += Count - 128;
+      Stats->MaxRun = std::max(Stats->MaxRun, Count - 128);
+    }
+    else
+    {
+      BOOST_REQUIRE(x + Count <= W);
+      for (INT i = 0; i < Count; i++)
+        Dst[(x + i) * 4] = ReadValue<BYTE>(Data, Pos);
+      x += Count;
+      Stats->MaxLiteral = std::max(Stats->MaxLiteral, Count);
+    }
+  }
+}
+
+/**
+ * \brief Check that RGBE pixel is quantized source pixel function
+ * \param[in] RGBE Pixel in shared exponent format
+ * \param[in] Src Source pixel components
+ * \return TRUE-if components are equal within precision of format, FALSE-otherwise
+ */
+static BOOL IsRGBEEqual( const BYTE *RGBE, const DBL *Src )
+{
+  const DBL Max = std::max(std::max(std::max(Src[0], Src[1]), Src[2]), 0.0);
+
+  if (RGBE[3] == 0)
+    return Max < 1e-32;
+
+  const DBL Scale = std::ldexp(1.0, RGBE[3] - (128 + 8));
+
+  for (INT i = 0; i < 3; i++)
+    if (std::abs((RGBE[i] + 0.5) * Scale - std::max(Src[i], 0.0)) > Max / 256)
+      return FALSE;
+
+  return TRUE;
+}
+
+BOOST_AUTO_TEST_SUITE(ImageTestsSuite)
+
+/**
+ * \brief Test pfm file keeps header and pixels (rows from bottom to top)
+ */
+BOOST_AUTO_TEST_CASE(SavePFMTest)
+{
+  const std::filesystem::path FileName = std::filesystem::temp_directory_path() / "image_generator_test.pfm";
+  const INT W = 13, H = 5;
+  image Img;
+
+  GenTestImage(&Img, W, H);
+  Img.SavePFM(FileName.string());
+
+  const std::vector<BYTE> Data = ReadFile(FileName);
+  const std::string Header = "PF\n" + std::to_string(W) + " " + std::to_string(H) + "\n-1.0\n";
+
+  std::filesystem::remove(FileName);
+  BOOST_REQUIRE_EQUAL(Data.size(), Header.size() + (size_t)W * H * 3 * sizeof(FLT));
+  BOOST_CHECK(std::memcmp(Data.data(), Header.data(), Header.size()) == 0);
+
+  size_t Pos = Header.size();
+
+  for (INT y = H - 1; y >= 0; y--)
+    for (INT x = 0; x < W * 3; x++)
+      BOOST_CHECK_EQUAL(ReadValue<FLT>(Data, &Pos), static_cast<FLT>(Img.GetRow(y)[x]));
+}
+
+/**
+ * \brief Test Radiance hdr file keeps header and pixels for flat and run length encoded scan lines
+ */
+BOOST_AUTO_TEST_CASE(SaveHDRTest)
+{
+  const std::filesystem::path FileName = std::filesystem::temp_directory_path() / "image_generator_test.hdr";
+
+  // Widths below 8 and above 32767 are not run length encoded
+  for (const INT W : {1, 7, 8, 400, 32767, 32768})
+  {
+    const INT H = W > 1000 ? 1 : 3;
+    image Img;
+
+    GenTestImage(&Img, W, H);
+
+    // Literal sequence of 129 pixels is followed by runs of 127 and 128 equal pixels
+    if (W == 400)
+      for (INT y = 0; y < H; y++)
+        for (INT x = 129; x < 384; x++)
+          Img.SetPixel(x, y, x < 256 ? image_vec(1, 2, 3) : image_vec(0.5, 0.25, 0));
+    Img.SaveHDR(FileName.string());
+
+    const std::vector<BYTE> Data = ReadFile(FileName);
+    const std::string Header =
+      "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(H) + " +X " + std::to_string(W) + "\n";
+    const BOOL IsEncoded = W >= 8 && W <= 32767;
+    RUN_LENGTH_STATS Stats;
+    std::vector<BYTE> Pixels((size_t)W * 4);
+    size_t Pos = Header.size();
+
+    std::filesystem::remove(FileName);
+    BOOST_REQUIRE(Data.size() >= Header.size());
+    BOOST_CHECK(std::memcmp(Data.data(), Header.data(), Header.size()) == 0);
+
+    for (INT y = 0; y < H; y++)
+    {
+      if (IsEncoded)
+      {
+        const BYTE ScanLineHeader[4] = {2, 2, static_cast<BYTE>(W >> 8), static_cast<BYTE>(W & 0xFF)};
+
+        for (INT i = 0; i < 4; i++)
+          BOOST_REQUIRE_EQUAL(ReadValue<BYTE>(Data, &Pos), ScanLineHeader[i]);
+        for (INT i = 0; i < 4; i++)
+          DecodeRunLength(Data, &Pos, W, Pixels.data() + i, &Stats);
+      }
+      else
+        for (BYTE &Component : Pixels)
+          Component = ReadValue<BYTE>(Data, &Pos);
+
+      for (INT x = 0; x < W; x++)
+        BOOST_REQUIRE_MESSAGE(IsRGBEEqual(Pixels.data() + x * 4, Img.GetRow(y) + x * 3),
+                              "width " << W << ", pixel " << x << ", row " << y);
+    }
+    BOOST_CHECK_EQUAL(Pos, Data.size());
+
+    if (W == 400)
+    {
+      BOOST_CHECK_EQUAL(Stats.MaxRun, 127);
+      BOOST_CHECK_EQUAL(Stats.MaxLiteral, 128);
+    }
+  }
+}
+
+/**
+ * \brief Test exr file keeps header and pixels
+ */
+BOOST_AUTO_TEST_CASE(SaveEXRTest)
+{
+  const std::filesystem::path FileName = std::filesystem::temp_directory_path() / "image_generator_test.exr";
+  const INT W = 11, H = 6;
+  image Img;
+
+  GenTestImage(&Img, W, H);
+  Img.SaveEXR(FileName.string());
+
+  const std::vector<BYTE> Data = ReadFile(FileName);
+  size_t Pos = 0;
+
+  std::filesystem::remove(FileName);
+  BOOST_REQUIRE_EQUAL(ReadValue<INT>(Data, &Pos), 20000630);
+  BOOST_REQUIRE_EQUAL(ReadValue<INT>(Data, &Pos), 2);
+
+  // Attributes are read up to empty name
+  std::vector<std::string> Names;
+  std::string Channels;
+  BOOL IsCompressed = TRUE;
+  INT Window[4] = {};
+
+  for (;;)
+  {
+    const std::string Name(reinterpret_cast<const CHAR *>(Data.data() + Pos));
+
+    Pos += Name.size() + 1;
+    if (Name.empty())
+      break;
+
+    const std::string Type(reinterpret_cast<const CHAR *>(Data.data() + Pos));
+
+    Pos += Type.size() + 1;
+
+    const INT Size = ReadValue<INT>(Data, &Pos);
+
+    BOOST_REQUIRE(Pos + Size <= Data.size());
+    Names.push_back(Name);
+    if (Name == "channels")
+      Channels.assign(reinterpret_cast<const CHAR *>(Data.data() + Pos), Size);
+    else if (Name == "compression")
+      IsCompressed = Data[Pos] != 0;
+    else if (Name == "dataWindow")
+      std::memcpy(Window, Data.data() + Pos, sizeof(Window));
+    Pos += Size;
+  }
+
+  for (const CHAR *Name : {"channels", "compression", "dataWindow", "displayWindow", "lineOrder",
+                           "pixelAspectRatio", "screenWindowCenter", "screenWindowWidth"})
+    BOOST_CHECK_MESSAGE(std::find(Names.begin(), Names.end(), Name) != Names.end(), "attribute " << Name);
+  BOOST_CHECK(!IsCompressed);
+  BOOST_CHECK(Window[0] == 0 && Window[1] == 0 && Window[2] == W - 1 && Window[3] == H - 1);
+
+  // Channels B, G, R of 32-bit floats
+  std::string ExpectedChannels;
+
+  for (const CHAR *Name : {"B", "G", "R"})
+  {
+    const INT Channel[4] = {2, 0, 1, 1};
+
+    ExpectedChannels.append(Name, 2);
+    ExpectedChannels.append(reinterpret_cast<const CHAR *>(Channel), sizeof(Channel));
+  }
+  ExpectedChannels.push_back(0);
+  BOOST_CHECK(Channels == ExpectedChannels);
+
+  // Every scan line chunk is found by offsets table
+  std::vector<UINT64> Offsets;
+
+  for (INT y = 0; y < H; y++)
+    Offsets.push_back(ReadValue<UINT64>(Data, &Pos));
+
+  for (INT y = 0; y < H; y++)
+  {
+    Pos = Offsets[y];
+    BOOST_REQUIRE_EQUAL(ReadValue<INT>(Data, &Pos), y);
+    BOOST_REQUIRE_EQUAL(ReadValue<INT>(Data, &Pos), W * 3 * (INT)sizeof(FLT));
+    for (INT c = 2; c >= 0; c--)
+      for (INT x = 0; x < W; x++)
+        BOOST_CHECK_EQUAL(ReadValue<FLT>(Data, &Pos), static_cast<FLT>(Img.GetRow(y)[x * 3 + c]));
+  }
+  BOOST_CHECK_EQUAL(Pos, Data.size());
+}
+
+/**
+ * \brief Test saving to file which can't be opened is reported
+ */
+BOOST_AUTO_TEST_CASE(SaveToMissingDirectoryTest)
+{
+  const std::filesystem::path Dir = std::filesystem::temp_directory_path() / "image_generator_missing_dir";
+  image Img;
+
+  std::filesystem::remove_all(Dir);
+  GenTestImage(&Img, 4, 4);
+  for (const image::FORMAT Format : {image::FORMAT::PNG, image::FORMAT::TGA, image::FORMAT::PFM, image::FORMAT::HDR,
+                                     image::FORMAT::EXR})
+    BOOST_CHECK_THROW(Img.Save((Dir / "frame").string(), Format), error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,450 @@
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <boost/test/unit_test.hpp>
+
+#include "scene/kd_tree.h"
+#include "scene/wide_bvh.h"
+#include "scene/instance_tree.h"
+#include "utils/parallel_for.h"
+
+/**
+ * \brief Generate random triangles function
+ * \param[in] Count Number of triangles
+ * \param[in] Seed Random generator seed
+ * \return Generated triangles
+ */
+static std::vector<triangle> GenTriangles( const INT Count, const UINT Seed )
+{
+  std::mt19937 Gen(Seed);
+  std::uniform_real_distribution<FLT> Pos(-10, 10);
+  std::uniform_real_distribution<FLT> Offset(-0.5, 0.5);
+  std::vector<triangle> Res;
+
+  for (INT i = 0; i < Count; i++)
+  {
+    vec C(Pos(Gen), Pos(Gen), Pos(Gen));
+    vec N(0, 1, 0);
+
+    Res.push_back(triangle(
+      vertex(C + vec(Offset(Gen), Offset(Gen), Offset(Gen)), N, vec2(0, 0)),
+      vertex(C + vec(Offset(Gen), Offset(Gen), Offset(Gen)), N, vec2(0, 0)),
+      vertex(C + vec(Offset(Gen), Offset(Gen), Offset(Gen)), N, vec2(0, 0)), 0, 0));
+  }
+
+  return Res;
+}
+
+/**
+ * \brief Generate random spheres triangles function
+ * \param[in] Count Number of spheres
+ * \param[in] N Number of sphere parallels (sphere has 4 * N * (N - 1) triangles)
+ * \param[in] Seed Random generator seed
+ * \return Generated triangles
+ */
+static std::vector<triangle> GenSpheres( const INT Count, const INT N, const UINT Seed )
+{
+  const FLT PI(3.14159265359f);
+  std::mt19937 Gen(Seed);
+  std::uniform_real_distribution<FLT> Pos(-1, 1);
+  std::vector<triangle> Res;
+
+  for (INT k = 0; k < Count; k++)
+  {
+    const vec C(Pos(Gen) * 5, 3 + Pos(Gen) * 2.5f, Pos(Gen) * 10);
+    auto GetVertex = [&]( const INT i, const INT j )
+      {
+        const FLT Theta = i * PI / N, Phi = j * PI / N;
+        const vec Normal(sinf(Theta) * cosf(Phi), cosf(Theta), sinf(Theta) * sinf(Phi));
+
+        return vertex(C + Normal * 0.3f, Normal, vec2(0, 0));
+      };
+
+    for (INT i = 0; i < N; i++)
+      for (INT j = 0; j < 2 * N; j++)
+      {
+        if (i != N - 1)
+          Res.push_back(triangle(GetVertex(i, j), GetVertex(i + 1, j), GetVertex(i + 1, j + 1), 0, 0));
+        if (i != 0)
+          Res.push_back(triangle(GetVertex(i, j), GetVertex(i + 1, j + 1), GetVertex(i, j + 1), 0, 0));
+      }
+  }
+
+  return Res;
+}
+
+BOOST_AUTO_TEST_SUITE(KdTreeTestsSuite)
+
+/**
+ * \brief Test bounding box surface area
+ */
+BOOST_AUTO_TEST_CASE(AabbSurfaceAreaTest)
+{
+  aabb Box = {vec(0, 0, 0), vec(1, 2, 3)};
+
+  BOOST_CHECK_CLOSE(Box.GetSurfaceArea(), 22.0, 1e-4);
+}
+
+/**
+ * \brief Test tree intersection equals brute force intersection
+ */
+BOOST_AUTO_TEST_CASE(TreeIntersectionEqualsBruteForceTest)
+{
+  std::vector<triangle> Triangles = GenTriangles(2000, 30);
+  RENDER_PARAMS RenderPar = {};
+  TREE_PARAMS TreePar;
+  kd_tree Tree;
+
+  Tree.Build(Triangles, TreePar);
+
+  std::mt19937 Gen(47);
+  std::uniform_real_distribution<FLT> Dir(-1, 1);
+
+  for (INT i = 0; i < 1000; i++)
+  {
+    vec D(Dir(Gen), Dir(Gen), Dir(Gen));
+    D.Normalize();
+    ray R(vec(Dir(Gen), Dir(Gen), Dir(Gen)) * 12, D);
+
+    INTR TreeIntr, Intr;
+    FLT TreeNear = INFINITY, Near = INFINITY;
+    BOOL IsTreeHit = Tree.Intersect(R, &TreeIntr, &TreeNear, RenderPar);
+    BOOL IsHit = FALSE;
+
+    for (const triangle &Tr : Triangles)
+      if (Tr.Intersect(R, &Intr, RenderPar) && Intr.T < Near)
+      {
+        Near = Intr.T;
+        IsHit = TRUE;
+      }
+
+    BOOST_REQUIRE_EQUAL(IsTreeHit, IsHit);
+    if (IsHit)
+      BOOST_CHECK_CLOSE(TreeNear, Near, 1e-3);
+  }
+}
+
+/**
+ * \brief Test wide trees intersection equals kd-tree intersection (including axis-aligned rays)
+ */
+BOOST_AUTO_TEST_CASE(WideBvhIntersectionEqualsKdTreeTest)
+{
+  RENDER_PARAMS RenderPar = {};
+  TREE_PARAMS TreePar;
+  kd_tree Tree;
+  wide_bvh<4> Bvh4;
+  wide_bvh<8> Bvh8;
+
+  Tree.Build(GenTriangles(2000, 31), TreePar);
+  Bvh4.Build(Tree);
+  Bvh8.Build(Tree);
+
+  std::mt19937 Gen(48);
+  std::uniform_real_distribution<FLT> Dir(-1, 1);
+
+  for (INT i = 0; i < 1000; i++)
+  {
+    vec D(Dir(Gen), Dir(Gen), Dir(Gen));
+    if (i % 4 == 0)
+      D = vec(i % 3 == 0, i % 3 == 1, i % 3 == 2);
+    D.Normalize();
+    ray R(vec(Dir(Gen), Dir(Gen), Dir(Gen)) * 12, D);
+
+    INTR Intr;
+    FLT Near = INFINITY, Near4 = INFINITY, Near8 = INFINITY;
+    BOOL IsHit = Tree.Intersect(R, &Intr, &Near, RenderPar);
+
+    BOOST_REQUIRE_EQUAL(Bvh4.Intersect(R, &Intr, &Near4, RenderPar), IsHit);
+    BOOST_REQUIRE_EQUAL(Bvh8.Intersect(R, &Intr, &Near8, RenderPar), IsHit);
+    if (IsHit)
+    {
+      BOOST_CHECK_EQUAL(Near4, Near);
+      BOOST_CHECK_EQUAL(Near8, Near);
+    }
+  }
+}
+
+/**
+ * \brief Test hash of words which differ by sign bits differ
+ */
+BOOST_AUTO_TEST_CASE(HasherSignBitsTest)
+{
+  const DBL Words[2][2] = {{1, 2}, {-1, -2}};
+  hasher Keys[2];
+
+  for (INT i = 0; i < 2; i++)
+    Keys[i].Add(Words[i]);
+
+  BOOST_CHECK_NE(Keys[0].Get(), Keys[1].Get());
+}
+
+/**
+ * \brief Test tree loaded from cache equals built tree
+ */
+BOOST_AUTO_TEST_CASE(TreeCacheTest)
+{
+  const std::vector<triangle> Triangles = GenTriangles(1000, 34);
+  const std::filesystem::path CachePath = std::filesystem::temp_directory_path() / "image_generator_tree_cache_test";
+  TREE_PARAMS TreePar;
+  hasher Key;
+  kd_tree Tree, CachedTree;
+  BOOL IsBuilt = FALSE;
+
+  std::filesystem::remove_all(CachePath);
+  TreePar.CachePath = CachePath.string();
+  for (const triangle &Tr : Triangles)
+    Tr.AddToHash(&Key);
+
+  Tree.BuildCached(Key, Triangles.size(), [&]( VOID ) { return Triangles; }, TreePar);
+
+  // File of the same key but other number of triangles is rejected
+  CachedTree.BuildCached(Key, Triangles.size() + 1, [&]( VOID ) { IsBuilt = TRUE; return Triangles; }, TreePar);
+  BOOST_CHECK(IsBuilt);
+
+  IsBuilt = FALSE;
+  CachedTree.BuildCached(Key, Triangles.size(), [&]( VOID ) { IsBuilt = TRUE; return Triangles; }, TreePar);
+  std::filesystem::remove_all(CachePath);
+
+  BOOST_CHECK(!IsBuilt);
+  BOOST_REQUIRE_EQUAL(CachedTree.GetNodes().size(), Tree.GetNodes().size());
+  BOOST_REQUIRE_EQUAL(CachedTree.GetTriangles().size(), Tree.GetTriangles().size());
+  BOOST_CHECK(memcmp(CachedTree.GetNodes().data(), Tree.GetNodes().data(),
+                     Tree.GetNodes().size() * sizeof(kd_tree_node_data)) == 0);
+  BOOST_CHECK(memcmp(CachedTree.GetTriangles().data(), Tree.GetTriangles().data(),
+                     Tree.GetTriangles().size() * sizeof(triangle)) == 0);
+}
+
+/**
+ * \brief Test tree built by subtree tasks of threads pool equals tree built by one thread
+ */
+BOOST_AUTO_TEST_CASE(ParallelBuildEqualsSerialBuildTest)
+{
+  const std::vector<triangle> Triangles = GenTriangles(30000, 36);
+  TREE_PARAMS TreePar;
+  kd_tree Tree, SerialTree;
+
+  parallel_for::SetNumberOfThreads(4);
+  Tree.Build(Triangles, TreePar);
+  parallel_for::SetNumberOfThreads(1);
+  SerialTree.Build(Triangles, TreePar);
+  parallel_for::SetNumberOfThreads(0);
+
+  BOOST_REQUIRE_EQUAL(Tree.GetNodes().size(), SerialTree.GetNodes().size());
+  BOOST_REQUIRE_EQUAL(Tree.GetTriangles().size(), SerialTree.GetTriangles().size());
+  BOOST_CHECK(memcmp(Tree.GetNodes().data(), SerialTree.GetNodes().data(),
+                     Tree.GetNodes().size() * sizeof(kd_tree_node_data)) == 0);
+  BOOST_CHECK(memcmp(Tree.GetTriangles().data(), SerialTree.GetTriangles().data(),
+                     Tree.GetTriangles().size() * sizeof(triangle)) == 0);
+}
+
+/**
+ * \brief Test refitted tree intersection equals built tree intersection after triangles motion
+ */
+BOOST_AUTO_TEST_CASE(TreeRefitEqualsBuiltTreeTest)
+{
+  std::vector<triangle> Triangles = GenTriangles(2000, 35);
+  RENDER_PARAMS RenderPar = {};
+  TREE_PARAMS TreePar;
+  kd_tree Tree, BuiltTree;
+
+  Tree.Build(Triangles, TreePar);
+
+  // Small motion of all triangles is only refitted, big motion of triangles group degrades subtrees
+  for (INT Step = 0; Step < 2; Step++)
+  {
+    for (triangle &Tr : Triangles)
+      if (Step == 0 || Tr.GetMiddle().X > 5)
+      {
+        const vec Shift = Step == 0 ? vec(0.2, 0, 0) : vec(0, 15, 0);
+
+        Tr = triangle(
+          vertex(Tr.GetVertex(0).P + Shift, Tr.GetVertex(0).N, Tr.GetVertex(0).T),
+          vertex(Tr.GetVertex(1).P + Shift, Tr.GetVertex(1).N, Tr.GetVertex(1).T),
+          vertex(Tr.GetVertex(2).P + Shift, Tr.GetVertex(2).N, Tr.GetVertex(2).T), 0, 0);
+      }
+
+    BOOST_REQUIRE(Tree.SetTriangles(Triangles));
+    if (!Tree.Refit(TreePar))
+    {
+      BOOST_CHECK_NE(Step, 0);
+      Tree.Build(Triangles, TreePar);
+    }
+    BuiltTree.Build(Triangles, TreePar);
+
+    std::mt19937 Gen(50);
+    std::uniform_real_distribution<FLT> Dir(-1, 1);
+
+    for (INT i = 0; i < 1000; i++)
+    {
+      vec D(Dir(Gen), Dir(Gen), Dir(Gen));
+      D.Normalize();
+      ray R(vec(Dir(Gen), Dir(Gen), Dir(Gen)) * 12, D);
+
+      INTR Intr;
+      FLT Near = INFINITY, BuiltNear = INFINITY;
+      BOOL IsHit = BuiltTree.Intersect(R, &Intr, &BuiltNear, RenderPar);
+
+      BOOST_REQUIRE_EQUAL(Tree.Intersect(R, &Intr, &Near, RenderPar), IsHit);
+      if (IsHit)
+        BOOST_CHECK_EQUAL(Near, BuiltNear);
+    }
+  }
+}
+
+/**
+ * \brief Test two-level tree intersection equals intersection of flattened instances
+ */
+BOOST_AUTO_TEST_CASE(InstanceTreeIntersectionEqualsFlattenedTest)
+{
+  RENDER_PARAMS RenderPar = {};
+  TREE_PARAMS TreePar;
+  std::shared_ptr<mesh> Mesh = std::make_shared<mesh>(GenTriangles(500, 32));
+  std::vector<instance> Instances;
+  std::vector<triangle> Flattened;
+  kd_tree WorldTree, FlatTree;
+  instance_tree InstanceTree;
+
+  Mesh->Build(TreePar);
+  Instances.emplace_back(Mesh, 1, 0, matr::Scale(vec(0.5, 0.5, 0.5)) * matr::Translate(vec(5, 0, 0)));
+  Instances.emplace_back(Mesh, 2, 0, matr::RotateY(45) * matr::Translate(vec(-5, 3, 0)));
+  Instances.emplace_back(Mesh, 3, 0, matr::RotateX(-90));
+
+  WorldTree.Build(GenTriangles(100, 33), TreePar);
+  Flattened.assign(WorldTree.GetTriangles().begin(), WorldTree.GetTriangles().end());
+  for (const instance &Inst : Instances)
+    Inst.AddTriangles(&Flattened);
+  FlatTree.Build(Flattened, TreePar);
+  InstanceTree.Build(Instances, WorldTree, TreePar);
+
+  std::mt19937 Gen(49);
+  std::uniform_real_distribution<FLT> Dir(-1, 1);
+
+  for (INT i = 0; i < 1000; i++)
+  {
+    vec D(Dir(Gen), Dir(Gen), Dir(Gen));
+    D.Normalize();
+    ray R(vec(Dir(Gen), Dir(Gen), Dir(Gen)) * 12, D);
+
+    INTR FlatIntr, Intr;
+    FLT FlatNear = INFINITY, Near = INFINITY;
+    BOOL IsHit = FlatTree.Intersect(R, &FlatIntr, &FlatNear, RenderPar);
+
+    BOOST_REQUIRE_EQUAL(InstanceTree.Intersect(R, &Intr, &Near, RenderPar), IsHit);
+    if (IsHit)
+    {
+      BOOST_CHECK_CLOSE(Near, FlatNear, 1e-2);
+      BOOST_CHECK_EQUAL(Intr.Instance == nullptr ? Intr.Tr->GetMaterialId() : Intr.Instance->MtlId,
+                        FlatIntr.Tr->GetMaterialId());
+    }
+  }
+}
+
+/**
+ * \brief Test occlusion queries of all structures equal closest intersection distance comparison
+ */
+BOOST_AUTO_TEST_CASE(OccludedEqualsIntersectionTest)
+{
+  RENDER_PARAMS RenderPar = {};
+  TREE_PARAMS TreePar;
+  std::shared_ptr<mesh> Mesh = std::make_shared<mesh>(GenTriangles(500, 36));
+  std::vector<instance> Instances;
+  kd_tree Tree;
+  wide_bvh<4> Bvh4;
+  wide_bvh<8> Bvh8;
+  instance_tree InstanceTree;
+
+  Mesh->Build(TreePar);
+  Instances.emplace_back(Mesh, 0, 0, matr::Scale(vec(0.5, 0.5, 0.5)) * matr::Translate(vec(5, 0, 0)));
+  Tree.Build(GenTriangles(2000, 37), TreePar);
+  Bvh4.Build(Tree);
+  Bvh8.Build(Tree);
+  InstanceTree.Build(Instances, Tree, TreePar);
+
+  std::mt19937 Gen(51);
+  std::uniform_real_distribution<FLT> Dir(-1, 1);
+  std::uniform_real_distribution<FLT> Dist(0, 25);
+
+  for (INT i = 0; i < 1000; i++)
+  {
+    vec D(Dir(Gen), Dir(Gen), Dir(Gen));
+    D.Normalize();
+    ray R(vec(Dir(Gen), Dir(Gen), Dir(Gen)) * 12, D);
+    const FLT MaxDist = Dist(Gen);
+
+    for (const acceleration_structure *Structure :
+         std::initializer_list<const acceleration_structure *>{&Tree, &Bvh4, &Bvh8, &InstanceTree})
+    {
+      INTR Intr;
+      FLT Near = INFINITY;
+      BOOL IsHit = Structure->Intersect(R, &Intr, &Near, RenderPar) && Near < MaxDist;
+
+      BOOST_CHECK_EQUAL(Structure->Occluded(R, MaxDist, RenderPar), IsHit);
+    }
+  }
+}
+
+/**
+ * \brief Measure closest intersection and occlusion queries of the same shadow rays (disabled by default, run by
+ *        '--run_test=KdTreeTestsSuite/OccludedBenchmarkTest --log_level=message')
+ */
+BOOST_AUTO_TEST_CASE(OccludedBenchmarkTest, *boost::unit_test::disabled())
+{
+  RENDER_PARAMS RenderPar = {};
+  TREE_PARAMS TreePar;
+  kd_tree Tree;
+  wide_bvh<4> Bvh4;
+  wide_bvh<8> Bvh8;
+  std::vector<ray> Rays;
+  std::vector<FLT> Dists;
+  std::mt19937 Gen(52);
+  std::uniform_real_distribution<FLT> Pos(-1, 1);
+
+  // About 700k triangles, shadow rays from scene points towards area light above spheres
+  Tree.Build(GenSpheres(200, 30, 53), TreePar);
+  Bvh4.Build(Tree);
+  Bvh8.Build(Tree);
+  for (INT i = 0; i < 1000000; i++)
+  {
+    const vec
+      Org(Pos(Gen) * 5, 3 + Pos(Gen) * 3, Pos(Gen) * 12),
+      Light(Pos(Gen) * 3, 6.4f, Pos(Gen) * 3);
+    const FLT Dist = !(Light - Org);
+
+    Rays.push_back(ray(Org, (Light - Org) / Dist));
+    Dists.push_back(Dist);
+  }
+
+  for (const acceleration_structure *Structure :
+       std::initializer_list<const acceleration_structure *>{&Tree, &Bvh4, &Bvh8})
+  {
+    size_t NumOfHits = 0, NumOfOccluded = 0;
+    const std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < Rays.size(); i++)
+    {
+      INTR Intr;
+      FLT Near = Dists[i];
+
+      NumOfHits += Structure->Intersect(Rays[i], &Intr, &Near, RenderPar);
+    }
+
+    const std::chrono::steady_clock::time_point Middle = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < Rays.size(); i++)
+      NumOfOccluded += Structure->Occluded(Rays[i], Dists[i], RenderPar);
+
+    const std::chrono::steady_clock::time_point End = std::chrono::steady_clock::now();
+    const DBL
+      IntersectTime = std::chrono::duration<DBL>(Middle - Start).count(),
+      OccludedTime = std::chrono::duration<DBL>(End - Middle).count();
+
+    BOOST_CHECK_EQUAL(NumOfOccluded, NumOfHits);
+    BOOST_TEST_MESSAGE("Structure " << static_cast<INT>(Structure == &Tree ? 0 : Structure == &Bvh4 ? 1 : 2) <<
+                       ": occluded rays " << 100.0 * NumOfOccluded / Rays.size() << "%, intersect " <<
+                       Rays.size() / IntersectTime * 1e-6 << " Mrays/s, occluded " <<
+                       Rays.size() / OccludedTime * 1e-6 << " Mrays/s");
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
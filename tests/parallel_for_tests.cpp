@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "utils/parallel_for.h"
+
+/**
+ * \brief Check that every iteration was run exactly once function
+ * \param[in] Counters Number of runs of every iteration
+ * \param[in] N Number of iterations
+ * \return TRUE-if every iteration was run once, FALSE-otherwise
+ */
+static BOOL IsEveryIterationRunOnce( const std::atomic<INT> *Counters, const INT N )
+{
+  for (INT i = 0; i < N; i++)
+    if (Counters[i].load() != 1)
+      return FALSE;
+
+  return TRUE;
+}
+
+BOOST_AUTO_TEST_SUITE(ParallelForTestsSuite)
+
+/**
+ * \brief Test all iterations are run once when iterations costs differ (threads steal ranges of each other)
+ */
+BOOST_AUTO_TEST_CASE(ParallelForCoverageTest)
+{
+  const INT N = 100000;
+
+  parallel_for::SetNumberOfThreads(4);
+
+  for (const INT ChunkSize : {1, 3, 64, N})
+  {
+    std::unique_ptr<std::atomic<INT>[]> Counters(new std::atomic<INT>[N]);
+
+    for (INT i = 0; i < N; i++)
+      Counters[i].store(0);
+
+    // Iterations of first quarter are much heavier, so other threads finish own ranges early and steal
+    parallel_for::Run(N, [&]( INT i )
+      {
+        volatile INT Work = 0;
+
+        for (INT j = 0; j < (i < N / 4 ? 200 : 1); j++)
+          Work += j;
+        Counters[i]++;
+      }, ChunkSize);
+
+    BOOST_CHECK_MESSAGE(IsEveryIterationRunOnce(Counters.get(), N), "chunk size " << ChunkSize);
+  }
+
+  parallel_for::SetNumberOfThreads(0);
+}
+
+/**
+ * \brief Test nested and concurrent runs are run serially by calling threads
+ */
+BOOST_AUTO_TEST_CASE(ParallelForNestedAndConcurrentRunTest)
+{
+  const INT N = 64, M = 100;
+  std::unique_ptr<std::atomic<INT>[]> Counters(new std::atomic<INT>[N * M]);
+
+  parallel_for::SetNumberOfThreads(4);
+  for (INT i = 0; i < N * M; i++)
+    Counters[i].store(0);
+
+  parallel_for::Run(N, [&]( INT i )
+    {
+      parallel_for::Run(M, [&]( INT j )
+        {
+          Counters[i * M + j]++;
+        });
+    });
+
+  BOOST_CHECK(IsEveryIterationRunOnce(Counters.get(), N * M));
+
+  // Runs from other threads don't wait for pool
+  std::unique_ptr<std::atomic<INT>[]> ThreadsCounters[2];
+  std::thread Threads[2];
+
+  for (INT t = 0; t < 2; t++)
+  {
+    ThreadsCounters[t].reset(new std::atomic<INT>[N * M]);
+    for (INT i = 0; i < N * M; i++)
+      ThreadsCounters[t][i].store(0);
+    Threads[t] = std::thread([&, t]( VOID )
+      {
+        for (INT k = 0; k < 10; k++)
+          parallel_for::Run(N * M / 10, [&]( INT i )
+            {
+              ThreadsCounters[t][k * N * M / 10 + i]++;
+            });
+      });
+  }
+  for (std::thread &Thread : Threads)
+    Thread.join();
+
+  for (INT t = 0; t < 2; t++)
+    BOOST_CHECK(IsEveryIterationRunOnce(ThreadsCounters[t].get(), N * M));
+
+  parallel_for::SetNumberOfThreads(0);
+}
+
+/**
+ * \brief Test exception of iteration is rethrown by calling thread and pool stays usable
+ */
+BOOST_AUTO_TEST_CASE(ParallelForExceptionTest)
+{
+  const INT N = 10000;
+  std::atomic<INT> NumberOfRuns = 0;
+
+  parallel_for::SetNumberOfThreads(4);
+
+  BOOST_CHECK_THROW(parallel_for::Run(N, [&]( INT i )
+    {
+      if (i == N / 2 || i == N - 1)
+        throw std::runtime_error("iteration failed");
+    }), std::runtime_error);
+
+  parallel_for::Run(N, [&]( INT )
+    {
+      NumberOfRuns++;
+    });
+  BOOST_CHECK_EQUAL(NumberOfRuns.load(), N);
+
+  parallel_for::SetNumberOfThreads(0);
+}
+
+/**
+ * \brief Test restart of pool with other number of threads
+ */
+BOOST_AUTO_TEST_CASE(ParallelForSetNumberOfThreadsTest)
+{
+  for (const INT NumberOfThreads : {3, 1, 8, 2})
+  {
+    std::atomic<INT> Sum = 0;
+
+    parallel_for::SetNumberOfThreads(NumberOfThreads);
+    BOOST_CHECK_EQUAL(parallel_for::GetNumberOfThreads(), NumberOfThreads);
+
+    parallel_for::Run(1000, [&]( INT i )
+      {
+        Sum += i;
+      });
+    BOOST_CHECK_EQUAL(Sum.load(), 999 * 1000 / 2);
+  }
+
+  parallel_for::SetNumberOfThreads(0);
+  BOOST_CHECK_EQUAL(parallel_for::GetNumberOfThreads(), (INT)std::max(1U, std::thread::hardware_concurrency()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,232 @@
+#include <cstring>
+#include <filesystem>
+#include <boost/test/unit_test.hpp>
+
+#include "render/cpu_render/cpu_render.h"
+#include "scene/material.h"
+#include "utils/error.h"
+
+/**
+ * \brief Generate small test scene function
+ * \param[in, out] Scn Scene for generation
+ * \param[in, out] Sh Shape of scene objects (must live while scene is used)
+ */
+static VOID GenTestScene( scene &Scn, shape &Sh )
+{
+  const INT DefMtl = material::AddToTable(material(vec(1, 1, 1), vec(0, 0, 0), 0.6, 0.3));
+  const INT DefEnvi = environment::AddToTable(environment::Make());
+  const INT EmitMtl = material::AddToTable(material(vec(0, 0, 0), vec(5, 5, 5)));
+  const INT GreenMtl = material::AddToTable(material(vec(0, 1.5, 0), vec(0, 0, 0), 0.8, 0.3));
+
+  Sh.MakeBox(vec(-6, 0, -15), vec(6, 6.5, 9), DefMtl, DefEnvi);
+  Sh.MakeBox(vec(-5, 0, -14), vec(-3, 5, -12), GreenMtl, DefEnvi);
+  Sh.MakeBox(vec(-1, 0, -1), vec(1, 2, 1), DefMtl, DefEnvi);
+  Sh.MakeBox(vec(-3, 6.4, -3), vec(3, 6.51, 3), EmitMtl, DefEnvi);
+  Scn.AirEnvi = environment::Make();
+  Scn.Objects.push_back(&Sh);
+  Scn.IsChanged = TRUE;
+}
+
+/**
+ * \brief Render frame of test scene function (image keeps averaged samples without HDR correction)
+ * \param[in, out] Rnd Render
+ * \param[in, out] Scn Scene
+ * \param[in] W Frame width
+ * \param[in] H Frame height
+ * \param[in] NumberOfSamples Number of samples
+ * \param[out] Img Rendered image
+ */
+static VOID RenderTestFrame( cpu_render &Rnd, scene &Scn, const INT W, const INT H, const INT NumberOfSamples,
+                             image *Img )
+{
+  cam Camera;
+
+  Camera.SetWH(W, H);
+  Camera.SetProj();
+  Camera.SetView(vec(0, 5, -10), vec(0, 2.5, 0), vec(0, 1, 0));
+  Img->Resize(W, H);
+  Rnd.SetLinearOutput(TRUE);
+  Rnd.RenderFrame(Img, Camera, Scn, NumberOfSamples);
+}
+
+/**
+ * \brief Check that images are equal bit by bit function
+ * \param[in] Im1 First image
+ * \param[in] Im2 Second image
+ * \return TRUE-if images are equal, FALSE-otherwise
+ */
+static BOOL IsImagesEqual( const image &Im1, const image &Im2 )
+{
+  if (Im1.FrameW != Im2.FrameW || Im1.FrameH != Im2.FrameH)
+    return FALSE;
+
+  for (INT y = 0; y < Im1.FrameH; y++)
+    if (memcmp(Im1.GetRow(y), Im2.GetRow(y), Im1.FrameW * 3 * sizeof(DBL)) != 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * \brief Get mean of image components function
+ * \param[in] Img Image
+ * \return Mean of all pixels components
+ */
+static DBL GetImageMean( const image &Img )
+{
+  DBL Sum = 0;
+
+  for (INT y = 0; y < Img.FrameH; y++)
+    for (INT x = 0; x < Img.FrameW * 3; x++)
+      Sum += Img.GetRow(y)[x];
+
+  return Sum / (Img.FrameW * Img.FrameH * 3);
+}
+
+BOOST_AUTO_TEST_SUITE(ProgressiveRenderTestsSuite)
+
+/**
+ * \brief Test render resumed from checkpoint equals uninterrupted render
+ */
+BOOST_AUTO_TEST_CASE(CheckpointResumeEqualsUninterruptedRenderTest)
+{
+  const std::filesystem::path AccumulationPath =
+    std::filesystem::temp_directory_path() / "image_generator_checkpoint_test.acc";
+  const INT W = 40, H = 24, NumberOfSamples = 8;
+  scene Scn;
+  shape Sh;
+  cpu_render Rnd, ResumedRnd;
+  PROGRESSIVE_PARAMS Par;
+  image Uninterrupted, Resumed;
+
+  GenTestScene(Scn, Sh);
+  std::filesystem::remove(AccumulationPath);
+
+  RenderTestFrame(Rnd, Scn, W, H, NumberOfSamples, &Uninterrupted);
+
+  // Render is stopped after checkpoint of half of samples and continued by other render
+  Par.AccumulationPath = AccumulationPath.string();
+  ResumedRnd.SetProgressiveParams(Par);
+  RenderTestFrame(ResumedRnd, Scn, W, H, NumberOfSamples / 2, &Resumed);
+  Par.Resume = TRUE;
+  ResumedRnd.SetProgressiveParams(Par);
+  RenderTestFrame(ResumedRnd, Scn, W, H, NumberOfSamples, &Resumed);
+
+  std::filesystem::remove(AccumulationPath);
+
+  BOOST_CHECK(IsImagesEqual(Resumed, Uninterrupted));
+}
+
+/**
+ * \brief Test accumulation buffer of other frame size or seed is rejected
+ */
+BOOST_AUTO_TEST_CASE(CheckpointOfOtherFrameIsRejectedTest)
+{
+  const std::filesystem::path AccumulationPath =
+    std::filesystem::temp_directory_path() / "image_generator_checkpoint_other_frame_test.acc";
+  const INT W = 16, H = 8;
+  scene Scn;
+  shape Sh;
+  cpu_render Rnd;
+  PROGRESSIVE_PARAMS Par;
+  image Img;
+
+  GenTestScene(Scn, Sh);
+  std::filesystem::remove(AccumulationPath);
+  Par.AccumulationPath = AccumulationPath.string();
+  Rnd.SetProgressiveParams(Par);
+  RenderTestFrame(Rnd, Scn, W, H, 2, &Img);
+
+  Par.Resume = TRUE;
+  Rnd.SetProgressiveParams(Par);
+  BOOST_CHECK_THROW(RenderTestFrame(Rnd, Scn, W + 1, H, 4, &Img), error);
+  BOOST_CHECK_THROW(RenderTestFrame(Rnd, Scn, W, H + 1, 4, &Img), error);
+  Scn.RenderPar.Seed++;
+  BOOST_CHECK_THROW(RenderTestFrame(Rnd, Scn, W, H, 4, &Img), error);
+  Scn.RenderPar.Seed--;
+  BOOST_CHECK_NO_THROW(RenderTestFrame(Rnd, Scn, W, H, 4, &Img));
+
+  std::filesystem::remove(AccumulationPath);
+}
+
+/**
+ * \brief Test converged tiles stop getting samples and sums of tiles are scaled by their numbers of samples
+ */
+BOOST_AUTO_TEST_CASE(AdaptiveSamplingConvergedTilesStopTest)
+{
+  const INT W = 24, H = 8, TileSize = 16, PassSamples = 4;
+  const ADAPTIVE_PARAMS Par {0.05f, PassSamples, 0};
+  adaptive_sampling Adaptive(Par, W, H, TileSize, 0);
+  image Sum;
+
+  Sum.Resize(W, H);
+
+  // Left tile gets constant samples, right one gets noisy samples with same mean
+  for (INT Pass = 0; Pass < 2; Pass++)
+  {
+    const INT N = Adaptive.GetNumberOfPassSamples(PassSamples);
+
+    BOOST_CHECK_EQUAL(N, PassSamples);
+    for (INT y = 0; y < H; y++)
+      for (INT x = 0; x < W; x++)
+      {
+        const INT Tile = Adaptive.GetTileIndex(x, y);
+
+        if (!Adaptive.IsTileActive(Tile))
+          continue;
+        for (INT i = 0; i < N; i++)
+        {
+          const FLT Value = Tile == 0 ? 0.5f : i % 2;
+
+          adaptive_sampling::AddSample(&Adaptive.GetPixelStats(x, y), Adaptive.GetNumberOfStatsSamples(Tile) + i + 1,
+                                       vec(Value, Value, Value));
+          for (INT c = 0; c < 3; c++)
+            Sum.GetRow(y)[x * 3 + c] += Value;
+        }
+      }
+    Adaptive.EndPass(N);
+  }
+
+  BOOST_CHECK(!Adaptive.IsTileActive(0));
+  BOOST_CHECK(Adaptive.IsTileActive(1));
+  BOOST_CHECK_EQUAL(Adaptive.GetNumberOfTileSamples(0), PassSamples);
+  BOOST_CHECK_EQUAL(Adaptive.GetNumberOfTileSamples(1), 2 * PassSamples);
+  BOOST_CHECK(!Adaptive.IsConverged());
+
+  // Both tiles have mean 0.5 after normalization and frame number of samples in uniform sums
+  image Normalized;
+  const image &UniformSum = Adaptive.GetUniformSum(Sum);
+  const INT NumberOfSamples = Adaptive.GetNumberOfSamples();
+
+  Normalized.Resize(W, H);
+  Adaptive.Normalize(Sum, &Normalized, 1);
+  BOOST_CHECK_EQUAL(NumberOfSamples, (PassSamples * TileSize + 2 * PassSamples * (W - TileSize)) / W);
+  for (INT y = 0; y < H; y++)
+    for (INT x = 0; x < W * 3; x++)
+    {
+      BOOST_CHECK_CLOSE(Normalized.GetRow(y)[x], 0.5, 1e-9);
+      BOOST_CHECK_CLOSE(UniformSum.GetRow(y)[x], 0.5 * NumberOfSamples, 1e-9);
+    }
+}
+
+/**
+ * \brief Test adaptive render has same mean as uniform render
+ */
+BOOST_AUTO_TEST_CASE(AdaptiveRenderMeanEqualsUniformRenderTest)
+{
+  const INT W = 64, H = 48, NumberOfSamples = 64;
+  scene Scn;
+  shape Sh;
+  cpu_render UniformRnd, AdaptiveRnd;
+  image Uniform, Adaptive;
+
+  GenTestScene(Scn, Sh);
+  RenderTestFrame(UniformRnd, Scn, W, H, NumberOfSamples, &Uniform);
+  // Tiles of this scene converge after 32-64 samples
+  AdaptiveRnd.SetAdaptiveParams({0.2f, 8, 0});
+  RenderTestFrame(AdaptiveRnd, Scn, W, H, NumberOfSamples, &Adaptive);
+
+  BOOST_CHECK_CLOSE(GetImageMean(Adaptive), GetImageMean(Uniform), 2.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()